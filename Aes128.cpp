@@ -0,0 +1,293 @@
+#include "pch.h"
+
+#include "Aes128.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BLURT_AES_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC lets us use any intrinsic anywhere; GCC and Clang want to be told
+// which functions may use instructions beyond the baseline
+#if defined(__GNUC__) || defined(__clang__)
+#define BLURT_TARGET_AES __attribute__((target("aes,sse2")))
+#else
+#define BLURT_TARGET_AES
+#endif
+
+namespace winrt::blurt {
+
+namespace {
+// FIPS-197 describes everything below; the table layout follows the
+// well-known "rijndael-alg-fst" reference code, with one table per direction
+// plus rotations standing in for the other three.
+
+constexpr std::uint8_t Xtime(std::uint8_t x) {
+    return static_cast<std::uint8_t>((x << 1) ^ ((x & 0x80) ? 0x1b : 0x00));
+}
+
+constexpr std::uint8_t Mul(std::uint8_t x, std::uint8_t y) {
+    std::uint8_t result{0};
+    while (y != 0) {
+        if (y & 1) result ^= x;
+        x = Xtime(x);
+        y >>= 1;
+    }
+    return result;
+}
+
+constexpr std::uint8_t Rotl8(std::uint8_t x, int n) {
+    return static_cast<std::uint8_t>((x << n) | (x >> (8 - n)));
+}
+
+struct Tables {
+    std::uint8_t sbox[256];
+    std::uint8_t inv_sbox[256];
+    std::uint32_t te[256];
+    std::uint32_t td[256];
+};
+
+constexpr Tables MakeTables() {
+    Tables t{};
+    // Walk the multiplicative group with generator 3 and its inverse 0xf6
+    // in lockstep, so q is always p's inverse, then apply the affine map
+    std::uint8_t p{1}, q{1};
+    do {
+        p = static_cast<std::uint8_t>(p ^ Xtime(p));
+        q = static_cast<std::uint8_t>(q ^ (q << 1));
+        q = static_cast<std::uint8_t>(q ^ (q << 2));
+        q = static_cast<std::uint8_t>(q ^ (q << 4));
+        if (q & 0x80) q ^= 0x09;
+        auto s = static_cast<std::uint8_t>(q ^ Rotl8(q, 1) ^ Rotl8(q, 2) ^ Rotl8(q, 3) ^
+                                           Rotl8(q, 4) ^ 0x63);
+        t.sbox[p] = s;
+    } while (p != 1);
+    t.sbox[0] = 0x63;
+
+    for (int i = 0; i < 256; i++) t.inv_sbox[t.sbox[i]] = static_cast<std::uint8_t>(i);
+    for (int i = 0; i < 256; i++) {
+        std::uint8_t s = t.sbox[i];
+        t.te[i] = static_cast<std::uint32_t>(Mul(s, 2)) << 24 |
+                  static_cast<std::uint32_t>(s) << 16 | static_cast<std::uint32_t>(s) << 8 |
+                  Mul(s, 3);
+        std::uint8_t v = t.inv_sbox[i];
+        t.td[i] = static_cast<std::uint32_t>(Mul(v, 0x0e)) << 24 |
+                  static_cast<std::uint32_t>(Mul(v, 0x09)) << 16 |
+                  static_cast<std::uint32_t>(Mul(v, 0x0d)) << 8 | Mul(v, 0x0b);
+    }
+    return t;
+}
+
+constexpr Tables kTables = MakeTables();
+
+inline std::uint32_t Rotr(std::uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+inline std::uint32_t Te(std::uint32_t a, std::uint32_t b, std::uint32_t c, std::uint32_t d) {
+    return kTables.te[a >> 24] ^ Rotr(kTables.te[(b >> 16) & 0xff], 8) ^
+           Rotr(kTables.te[(c >> 8) & 0xff], 16) ^ Rotr(kTables.te[d & 0xff], 24);
+}
+
+inline std::uint32_t Td(std::uint32_t a, std::uint32_t b, std::uint32_t c, std::uint32_t d) {
+    return kTables.td[a >> 24] ^ Rotr(kTables.td[(b >> 16) & 0xff], 8) ^
+           Rotr(kTables.td[(c >> 8) & 0xff], 16) ^ Rotr(kTables.td[d & 0xff], 24);
+}
+
+inline std::uint32_t Sub(const std::uint8_t* box, std::uint32_t a, std::uint32_t b,
+                         std::uint32_t c, std::uint32_t d) {
+    return static_cast<std::uint32_t>(box[a >> 24]) << 24 |
+           static_cast<std::uint32_t>(box[(b >> 16) & 0xff]) << 16 |
+           static_cast<std::uint32_t>(box[(c >> 8) & 0xff]) << 8 | box[d & 0xff];
+}
+
+inline std::uint32_t Load(const std::uint8_t* p) {
+    return static_cast<std::uint32_t>(p[0]) << 24 | static_cast<std::uint32_t>(p[1]) << 16 |
+           static_cast<std::uint32_t>(p[2]) << 8 | p[3];
+}
+
+inline void Store(std::uint32_t x, std::uint8_t* p) {
+    p[0] = static_cast<std::uint8_t>(x >> 24);
+    p[1] = static_cast<std::uint8_t>(x >> 16);
+    p[2] = static_cast<std::uint8_t>(x >> 8);
+    p[3] = static_cast<std::uint8_t>(x);
+}
+
+constexpr int kRounds = Aes128::kRounds;
+
+void EncryptBlocksPortable(const std::uint32_t* keys, const std::uint8_t*,
+                           const std::uint8_t* in, std::uint8_t* out, std::size_t num_blocks) {
+    for (std::size_t b = 0; b < num_blocks; b++, in += 16, out += 16) {
+        const auto* rk = keys;
+        std::uint32_t s0 = Load(in) ^ rk[0], s1 = Load(in + 4) ^ rk[1],
+                      s2 = Load(in + 8) ^ rk[2], s3 = Load(in + 12) ^ rk[3];
+        for (int round = 1; round < kRounds; round++) {
+            rk += 4;
+            std::uint32_t t0 = Te(s0, s1, s2, s3) ^ rk[0];
+            std::uint32_t t1 = Te(s1, s2, s3, s0) ^ rk[1];
+            std::uint32_t t2 = Te(s2, s3, s0, s1) ^ rk[2];
+            std::uint32_t t3 = Te(s3, s0, s1, s2) ^ rk[3];
+            s0 = t0, s1 = t1, s2 = t2, s3 = t3;
+        }
+        rk += 4;
+        Store(Sub(kTables.sbox, s0, s1, s2, s3) ^ rk[0], out);
+        Store(Sub(kTables.sbox, s1, s2, s3, s0) ^ rk[1], out + 4);
+        Store(Sub(kTables.sbox, s2, s3, s0, s1) ^ rk[2], out + 8);
+        Store(Sub(kTables.sbox, s3, s0, s1, s2) ^ rk[3], out + 12);
+    }
+}
+
+void DecryptBlocksPortable(const std::uint32_t* keys, const std::uint8_t*,
+                           const std::uint8_t* in, std::uint8_t* out, std::size_t num_blocks) {
+    for (std::size_t b = 0; b < num_blocks; b++, in += 16, out += 16) {
+        const auto* rk = keys;
+        std::uint32_t s0 = Load(in) ^ rk[0], s1 = Load(in + 4) ^ rk[1],
+                      s2 = Load(in + 8) ^ rk[2], s3 = Load(in + 12) ^ rk[3];
+        for (int round = 1; round < kRounds; round++) {
+            rk += 4;
+            std::uint32_t t0 = Td(s0, s3, s2, s1) ^ rk[0];
+            std::uint32_t t1 = Td(s1, s0, s3, s2) ^ rk[1];
+            std::uint32_t t2 = Td(s2, s1, s0, s3) ^ rk[2];
+            std::uint32_t t3 = Td(s3, s2, s1, s0) ^ rk[3];
+            s0 = t0, s1 = t1, s2 = t2, s3 = t3;
+        }
+        rk += 4;
+        Store(Sub(kTables.inv_sbox, s0, s3, s2, s1) ^ rk[0], out);
+        Store(Sub(kTables.inv_sbox, s1, s0, s3, s2) ^ rk[1], out + 4);
+        Store(Sub(kTables.inv_sbox, s2, s1, s0, s3) ^ rk[2], out + 8);
+        Store(Sub(kTables.inv_sbox, s3, s2, s1, s0) ^ rk[3], out + 12);
+    }
+}
+
+#ifdef BLURT_AES_X86
+// AES-NI instructions have a latency of several cycles but can start one
+// per cycle, so four blocks are run through each round together to keep
+// the unit busy
+#define BLURT_AES_NI_BLOCKS(round_op, last_op)                                       \
+    __m128i k[kRounds + 1];                                                          \
+    for (int r = 0; r <= kRounds; r++)                                               \
+        k[r] = _mm_load_si128(reinterpret_cast<const __m128i*>(keys_bytes + 16 * r)); \
+    std::size_t b = 0;                                                               \
+    for (; b + 4 <= num_blocks; b += 4) {                                            \
+        auto* src = reinterpret_cast<const __m128i*>(in + 16 * b);                   \
+        __m128i x0 = _mm_xor_si128(_mm_loadu_si128(src), k[0]);                      \
+        __m128i x1 = _mm_xor_si128(_mm_loadu_si128(src + 1), k[0]);                  \
+        __m128i x2 = _mm_xor_si128(_mm_loadu_si128(src + 2), k[0]);                  \
+        __m128i x3 = _mm_xor_si128(_mm_loadu_si128(src + 3), k[0]);                  \
+        for (int r = 1; r < kRounds; r++) {                                          \
+            x0 = round_op(x0, k[r]);                                                 \
+            x1 = round_op(x1, k[r]);                                                 \
+            x2 = round_op(x2, k[r]);                                                 \
+            x3 = round_op(x3, k[r]);                                                 \
+        }                                                                            \
+        auto* dst = reinterpret_cast<__m128i*>(out + 16 * b);                        \
+        _mm_storeu_si128(dst, last_op(x0, k[kRounds]));                              \
+        _mm_storeu_si128(dst + 1, last_op(x1, k[kRounds]));                          \
+        _mm_storeu_si128(dst + 2, last_op(x2, k[kRounds]));                          \
+        _mm_storeu_si128(dst + 3, last_op(x3, k[kRounds]));                          \
+    }                                                                                \
+    for (; b < num_blocks; b++) {                                                    \
+        auto* src = reinterpret_cast<const __m128i*>(in + 16 * b);                   \
+        __m128i x = _mm_xor_si128(_mm_loadu_si128(src), k[0]);                       \
+        for (int r = 1; r < kRounds; r++) x = round_op(x, k[r]);                     \
+        auto* dst = reinterpret_cast<__m128i*>(out + 16 * b);                        \
+        _mm_storeu_si128(dst, last_op(x, k[kRounds]));                               \
+    }
+
+BLURT_TARGET_AES void EncryptBlocksAesNi(const std::uint32_t*, const std::uint8_t* keys_bytes,
+                                         const std::uint8_t* in, std::uint8_t* out,
+                                         std::size_t num_blocks) {
+    BLURT_AES_NI_BLOCKS(_mm_aesenc_si128, _mm_aesenclast_si128)
+}
+
+BLURT_TARGET_AES void DecryptBlocksAesNi(const std::uint32_t*, const std::uint8_t* keys_bytes,
+                                         const std::uint8_t* in, std::uint8_t* out,
+                                         std::size_t num_blocks) {
+    BLURT_AES_NI_BLOCKS(_mm_aesdec_si128, _mm_aesdeclast_si128)
+}
+#undef BLURT_AES_NI_BLOCKS
+
+bool CpuHasAesNi() {
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, 1);
+    return (regs[2] & (1 << 25)) != 0;
+#else
+    return __builtin_cpu_supports("aes");
+#endif
+}
+#endif  // BLURT_AES_X86
+
+using BlocksFn = void (*)(const std::uint32_t*, const std::uint8_t*, const std::uint8_t*,
+                          std::uint8_t*, std::size_t);
+
+struct Kernels {
+    BlocksFn encrypt_blocks;
+    BlocksFn decrypt_blocks;
+    bool is_hardware;
+};
+
+Kernels PickKernels() {
+#ifdef BLURT_AES_X86
+    if (CpuHasAesNi()) return {EncryptBlocksAesNi, DecryptBlocksAesNi, true};
+#endif
+    return {EncryptBlocksPortable, DecryptBlocksPortable, false};
+}
+
+const Kernels& TheKernels() {
+    static const Kernels kernels = PickKernels();
+    return kernels;
+}
+}  // namespace
+
+bool Aes128::IsHardwareAccelerated() { return TheKernels().is_hardware; }
+
+void Aes128::SetKey(const std::uint8_t* key) {
+    constexpr std::uint8_t kRcon[kRounds] = {0x01, 0x02, 0x04, 0x08, 0x10,
+                                             0x20, 0x40, 0x80, 0x1b, 0x36};
+    auto* rk = enc_keys_.words.data();
+    for (int i = 0; i < 4; i++) rk[i] = Load(key + 4 * i);
+    for (int i = 0; i < kRounds; i++, rk += 4) {
+        std::uint32_t w = rk[3];
+        rk[4] = rk[0] ^ Sub(kTables.sbox, w << 8, w << 8, w << 8, w >> 24) ^
+                static_cast<std::uint32_t>(kRcon[i]) << 24;
+        rk[5] = rk[1] ^ rk[4];
+        rk[6] = rk[2] ^ rk[5];
+        rk[7] = rk[3] ^ rk[6];
+    }
+
+    // The inverse cipher uses the round keys backward, with InvMixColumns
+    // applied to all but the first and last
+    for (int round = 0; round <= kRounds; round++) {
+        for (int i = 0; i < 4; i++) {
+            std::uint32_t w = enc_keys_.words[4 * (kRounds - round) + i];
+            if (round != 0 && round != kRounds) {
+                w = kTables.td[kTables.sbox[w >> 24]] ^
+                    Rotr(kTables.td[kTables.sbox[(w >> 16) & 0xff]], 8) ^
+                    Rotr(kTables.td[kTables.sbox[(w >> 8) & 0xff]], 16) ^
+                    Rotr(kTables.td[kTables.sbox[w & 0xff]], 24);
+            }
+            dec_keys_.words[4 * round + i] = w;
+        }
+    }
+
+    for (std::size_t i = 0; i < enc_keys_.words.size(); i++) {
+        Store(enc_keys_.words[i], &enc_keys_.bytes[4 * i]);
+        Store(dec_keys_.words[i], &dec_keys_.bytes[4 * i]);
+    }
+}
+
+void Aes128::EncryptBlocks(const std::uint8_t* in, std::uint8_t* out,
+                           std::size_t num_blocks) const {
+    TheKernels().encrypt_blocks(enc_keys_.words.data(), enc_keys_.bytes.data(), in, out,
+                                num_blocks);
+}
+
+void Aes128::DecryptBlocks(const std::uint8_t* in, std::uint8_t* out,
+                           std::size_t num_blocks) const {
+    TheKernels().decrypt_blocks(dec_keys_.words.data(), dec_keys_.bytes.data(), in, out,
+                                num_blocks);
+}
+
+}  // namespace winrt::blurt
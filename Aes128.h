@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace winrt::blurt {
+
+// The AES block cipher with a 128-bit key. This is only the raw cipher;
+// modes of operation are built on top of it (see CryptState).
+//
+// On x86 CPUs with the AES-NI instructions, those do the work, several
+// blocks at a time where the caller allows it. Anywhere else, the usual
+// table-driven implementation takes over.
+class Aes128 {
+   public:
+    static constexpr std::size_t kBlockSize = 16;
+    static constexpr std::size_t kKeySize = 16;
+
+    // An all-zero key; call SetKey() before using the cipher
+    Aes128() = default;
+    explicit Aes128(const std::uint8_t* key) { SetKey(key); }
+
+    // Expand a kKeySize-byte key into round keys for both directions
+    void SetKey(const std::uint8_t* key);
+
+    // Encrypt or decrypt one kBlockSize-byte block; in and out may be the
+    // same buffer
+    void EncryptBlock(const std::uint8_t* in, std::uint8_t* out) const {
+        EncryptBlocks(in, out, 1);
+    }
+    void DecryptBlock(const std::uint8_t* in, std::uint8_t* out) const {
+        DecryptBlocks(in, out, 1);
+    }
+
+    // Encrypt or decrypt num_blocks consecutive, independent blocks; in and
+    // out may be the same buffer. Hardware AES pipelines these, so this is
+    // quicker than one block at a time.
+    void EncryptBlocks(const std::uint8_t* in, std::uint8_t* out, std::size_t num_blocks) const;
+    void DecryptBlocks(const std::uint8_t* in, std::uint8_t* out, std::size_t num_blocks) const;
+
+    // Whether this CPU has hardware AES that we use
+    static bool IsHardwareAccelerated();
+
+    static constexpr int kRounds = 10;
+
+   private:
+
+    // Round keys as big-endian words for the table-driven code, and as the
+    // same bytes in memory order for the hardware
+    struct RoundKeys {
+        std::array<std::uint32_t, 4 * (kRounds + 1)> words;
+        alignas(16) std::array<std::uint8_t, kBlockSize*(kRounds + 1)> bytes;
+    };
+
+    RoundKeys enc_keys_{};
+    // Round keys for the equivalent inverse cipher, in the order they're used
+    RoundKeys dec_keys_{};
+};
+
+}  // namespace winrt::blurt
@@ -18,7 +18,7 @@ namespace winrt::blurt::audio::implementation {
 template <typename SampleT = float, typename SizeT = std::int32_t>
 class AudioBuffer {
    public:
-    using size_type = typename SizeT;
+    using size_type = SizeT;
 
     // Creates a buffer with a capacity to hold a given number of samples
     AudioBuffer(size_type samples_capacity)
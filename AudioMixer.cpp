@@ -0,0 +1,203 @@
+#include "pch.h"
+
+#include "AudioMixer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include "MixKernels.h"
+
+namespace winrt::blurt::audio::implementation {
+
+namespace {
+// A speaker who hasn't sent anything in this long can have their decoder
+// handed over to somebody new
+constexpr auto kIdleReuseAfter = std::chrono::seconds{10};
+// Until the network side says otherwise
+constexpr auto kDefaultPlayoutTarget = std::chrono::milliseconds{30};
+// Room for the stretch scratch buffer to start with; it grows if the output
+// ever asks for more at once
+constexpr auto kStretchScratchDuration = std::chrono::milliseconds{60};
+
+// Mix in audio played out at a different speed, interpolating linearly
+// between frames
+void StretchAccumulate(float* dest, const float* src, std::int32_t channels,
+                       const PlayoutController::Plan& plan, float gain) {
+    for (std::int32_t i = 0; i < plan.output_frames; i++) {
+        double pos = plan.start + i * plan.step;
+        auto index = static_cast<std::int32_t>(pos);
+        auto frac = static_cast<float>(pos - index);
+        const float* a = src + index * channels;
+        const float* b = a + channels;
+        float* out = dest + i * channels;
+        for (std::int32_t c = 0; c < channels; c++) out[c] += gain * (a[c] + frac * (b[c] - a[c]));
+    }
+}
+}  // namespace
+
+AudioMixer::Speaker::Speaker(AudioSetup setup)
+    : decoder_{setup},
+      frames_per_second_{setup.SamplesPerChannelPerSecond()},
+      frames_per_mumble_frame_{setup.SamplesPerChannelPer(kMumbleFrameDuration)},
+      target_frames_{setup.SamplesPerChannelPer(kDefaultPlayoutTarget)},
+      playout_{setup.SamplesPerChannelPerSecond()},
+      stretch_scratch_(setup.TotalSamplesPer(kStretchScratchDuration)) {}
+
+void AudioMixer::Speaker::PlayoutTarget(std::chrono::milliseconds target) {
+    auto frames = static_cast<std::int64_t>(frames_per_second_) * target.count() / 1000;
+    target_frames_.store(static_cast<std::int32_t>(frames), std::memory_order_relaxed);
+}
+
+AudioMixer::DecodeCounts AudioMixer::Speaker::DecodeDue(JitterBuffer::Clock::time_point now) {
+    DecodeCounts counts;
+    while (auto frame = jitter_->Pop(now)) {
+        if (frame->IsGap()) {
+            FillGap(frame->Duration());
+            counts.lost += frame->Duration();
+            continue;
+        }
+        if (frame->Payload()->size() == 0) {
+            counts.received += frame->Duration();
+            continue;
+        }
+        try {
+            decoder_.DecodeToBuffer(*frame->Payload());
+            counts.received += frame->Duration();
+        } catch (const std::exception&) {
+            // TODO: log bogus audio packet
+            counts.lost += frame->Duration();
+        }
+    }
+    return counts;
+}
+
+void AudioMixer::Speaker::FillGap(std::uint32_t gap_duration) {
+    auto gap_frames = static_cast<std::int32_t>(gap_duration) * frames_per_mumble_frame_;
+
+    // The frame after the gap is still in the jitter buffer; if it has FEC
+    // data, that covers the tail end of the gap, one frame of its own length
+    std::int32_t fec_frames{0};
+    const ByteSlice* next = jitter_->PeekNextPayload();
+    if (next != nullptr && next->size() > 0) {
+        int n = opus_packet_get_nb_samples(*next, next->size(), frames_per_second_);
+        if (n > 0) fec_frames = std::min(n, gap_frames);
+    }
+
+    if (gap_frames > fec_frames) decoder_.ConcealToBuffer(gap_frames - fec_frames);
+    if (fec_frames > 0) decoder_.RecoverToBuffer(*next, fec_frames);
+}
+
+AudioMixer::Speaker* AudioMixer::SpeakerFor(std::uint32_t session,
+                                            JitterBuffer::Clock::time_point now) {
+    if (auto it = by_session_.find(session); it != by_session_.end()) {
+        it->second->last_active_ = now;
+        return it->second;
+    }
+
+    Speaker* speaker{nullptr};
+    if (speakers_.size() < kMaxSpeakers) {
+        speakers_.emplace_back(new Speaker{setup_});
+        speaker = speakers_.back().get();
+        slots_[speakers_.size() - 1].store(speaker, std::memory_order_release);
+    } else {
+        auto oldest = std::min_element(
+            speakers_.begin(), speakers_.end(),
+            [](const auto& a, const auto& b) { return a->last_active_ < b->last_active_; });
+        if (now - (*oldest)->last_active_ < kIdleReuseAfter) return nullptr;
+        speaker = oldest->get();
+        by_session_.erase(speaker->session_);
+        // Whatever the previous owner left in the buffer plays out
+        // normally; only the codec and sequencing state start over
+        speaker->decoder_.Reset();
+    }
+
+    speaker->session_ = session;
+    speaker->last_active_ = now;
+    speaker->jitter_.emplace();
+    speaker->Gain(1.0f);
+    by_session_[session] = speaker;
+    return speaker;
+}
+
+AudioMixer::DecodeCounts AudioMixer::DecodeDue(JitterBuffer::Clock::time_point now) {
+    DecodeCounts counts;
+    for (const auto& speaker : speakers_) {
+        auto speaker_counts = speaker->DecodeDue(now);
+        counts.received += speaker_counts.received;
+        counts.lost += speaker_counts.lost;
+    }
+    return counts;
+}
+
+std::int32_t AudioMixer::SamplesReady(std::int32_t samples_per_chan) const {
+    const std::int32_t wanted = samples_per_chan * setup_.NumChannels();
+    std::int32_t ready{0};
+    for (std::size_t i = 0; i < kMaxSpeakers; i++) {
+        auto* speaker = Published(i);
+        if (speaker == nullptr) break;
+        ready = std::max(ready, speaker->decoder_.BufferedSamples());
+        if (ready >= wanted) return wanted;
+    }
+    return ready;
+}
+
+std::int32_t AudioMixer::MixTo(float* dest, std::int32_t num_samples) {
+    std::memset(dest, 0, num_samples * sizeof(float));
+    const std::int32_t channels = setup_.NumChannels();
+    std::int32_t mixed{0};
+    for (std::size_t i = 0; i < kMaxSpeakers; i++) {
+        auto* speaker = Published(i);
+        if (speaker == nullptr) break;
+        auto& decoder = speaker->decoder_;
+        auto plan = speaker->playout_.Next(decoder.BufferedSamples() / channels,
+                                           num_samples / channels,
+                                           speaker->target_frames_.load(std::memory_order_relaxed));
+        speaker->delay_us_.store(speaker->playout_.Delay().count(), std::memory_order_relaxed);
+        if (plan.drop_frames > 0) decoder.ReleaseAudio(plan.drop_frames * channels);
+        if (plan.output_frames == 0) continue;
+        auto n = plan.output_frames * channels;
+
+        // Muted speakers still have their audio consumed, so they don't
+        // build up a backlog that plays out all at once on unmuting
+        auto gain = speaker->Gain();
+        if (gain != 0.0f && plan.IsExact()) {
+            auto src = decoder.PeekAudio(n);
+            MixAccumulate(dest, src.first.data, src.first.size, gain);
+            MixAccumulate(dest + src.first.size, src.second.data, src.second.size, gain);
+        } else if (gain != 0.0f) {
+            auto src = decoder.PeekAudio(plan.read_frames * channels);
+            const float* in = src.first.data;
+            if (src.second.size > 0) {
+                auto& scratch = speaker->stretch_scratch_;
+                if (scratch.size() < static_cast<std::size_t>(src.size()))
+                    scratch.resize(src.size());
+                std::copy(src.first.data, src.first.data + src.first.size, scratch.data());
+                std::copy(src.second.data, src.second.data + src.second.size,
+                          scratch.data() + src.first.size);
+                in = scratch.data();
+            }
+            StretchAccumulate(dest, in, channels, plan, gain);
+        }
+        decoder.ReleaseAudio(plan.consumed_frames * channels);
+        mixed = std::max(mixed, n);
+    }
+    SoftClip(dest, mixed);
+    return mixed;
+}
+
+bool AudioMixer::HoldsFrames() const {
+    return std::any_of(speakers_.begin(), speakers_.end(),
+                       [](const auto& speaker) { return speaker->jitter_->HeldFrames() > 0; });
+}
+
+std::chrono::microseconds AudioMixer::PlayoutDelay() const {
+    std::chrono::microseconds longest{0};
+    for (std::size_t i = 0; i < kMaxSpeakers; i++) {
+        auto* speaker = Published(i);
+        if (speaker == nullptr) break;
+        longest = std::max(longest, speaker->PlayoutDelay());
+    }
+    return longest;
+}
+
+}  // namespace winrt::blurt::audio::implementation
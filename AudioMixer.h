@@ -0,0 +1,134 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#include "AudioParams.h"
+#include "JitterBuffer.h"
+#include "OpusDecoder.h"
+#include "PlayoutController.h"
+
+namespace winrt::blurt::audio::implementation {
+
+// Mixes received audio from any number of simultaneous speakers. Each
+// speaker (i.e. each sender session) gets its own jitter buffer and Opus
+// decoder, so decoder state never bleeds between streams, and decoded audio
+// is summed sample-by-sample rather than played back to back.
+//
+// Threading: SpeakerFor(), DecodeDue() and everything done with the Speaker
+// SpeakerFor() returns belong to a single "network" thread at a time;
+// SamplesReady() and MixTo() belong to a single "output" thread, typically
+// the audio graph callback. The two sides never lock or wait on each other.
+class AudioMixer {
+   public:
+    static constexpr std::size_t kMaxSpeakers = 128;
+
+    // How much audio, in Mumble frames, decoding took as received and how
+    // much it had to fill in for because it went missing
+    struct DecodeCounts {
+        std::uint32_t received{0};
+        std::uint32_t lost{0};
+    };
+
+    class Speaker {
+       public:
+        JitterBuffer& Jitter() { return *jitter_; }
+        OpusDecoder& Decoder() { return decoder_; }
+
+        // Decode whatever the jitter buffer says is due by now, filling in
+        // for any frames that never arrived
+        DecodeCounts DecodeDue(JitterBuffer::Clock::time_point now);
+
+        // Linear gain applied when mixing; 0 mutes. Safe from any thread.
+        float Gain() const { return gain_.load(std::memory_order_relaxed); }
+        void Gain(float gain) { gain_.store(gain, std::memory_order_relaxed); }
+
+        // How much decoded audio should be kept waiting to play; playout
+        // speeds up or slows down to hold it there. Safe from any thread.
+        void PlayoutTarget(std::chrono::milliseconds target);
+
+        // How long decoded audio has lately been waiting to play. Safe from
+        // any thread.
+        std::chrono::microseconds PlayoutDelay() const {
+            return std::chrono::microseconds{delay_us_.load(std::memory_order_relaxed)};
+        }
+
+       private:
+        friend class AudioMixer;
+        Speaker(AudioSetup setup);
+
+        void FillGap(std::uint32_t gap_duration);
+
+        std::uint32_t session_{0};
+        JitterBuffer::Clock::time_point last_active_;
+        std::optional<JitterBuffer> jitter_;
+        OpusDecoder decoder_;
+        std::atomic<float> gain_{1.0f};
+        const std::int32_t frames_per_second_;
+        const std::int32_t frames_per_mumble_frame_;
+        std::atomic<std::int32_t> target_frames_;
+        std::atomic<std::int64_t> delay_us_{0};
+
+        // Output thread only
+        PlayoutController playout_;
+        // Where audio that wraps around the end of the decoder's buffer is
+        // made contiguous, when it has to be stretched
+        std::vector<float> stretch_scratch_;
+    };
+
+    AudioMixer(AudioSetup setup) : setup_{setup} {}
+
+    // Get the speaker for the given sender session, setting one up if this
+    // is a new session. Returns nullptr if kMaxSpeakers are all busy.
+    Speaker* SpeakerFor(std::uint32_t session, JitterBuffer::Clock::time_point now);
+
+    // Decode what's due by now for every speaker. Each packet that arrives
+    // decodes what it can for its own speaker, but the jitter buffer also
+    // holds audio back for a while: to build up a cushion at the start of a
+    // talk spurt, waiting on a frame that may yet turn up, or at the end of
+    // a spurt whose terminator was lost. Calling this every few milliseconds
+    // while HoldsFrames() plays that out even if the speaker sends nothing
+    // more.
+    DecodeCounts DecodeDue(JitterBuffer::Clock::time_point now);
+
+    // Whether any speaker's jitter buffer is holding frames back, so that a
+    // later DecodeDue() might have something to do
+    bool HoldsFrames() const;
+
+    // Get the number of samples (total, not per channel) a call to MixTo()
+    // would produce right now, given the number of samples per channel the
+    // output wants; zero means nobody is talking.
+    std::int32_t SamplesReady(std::int32_t samples_per_chan) const;
+
+    // Mix and consume up to the given number of samples (total, not per
+    // channel) from every active speaker into dest, overwriting what's
+    // there. Returns the number of samples written.
+    std::int32_t MixTo(float* dest, std::int32_t num_samples);
+
+    // The longest any speaker's decoded audio has lately been waiting to
+    // play. Safe from any thread.
+    std::chrono::microseconds PlayoutDelay() const;
+
+   private:
+    Speaker* Published(std::size_t i) const {
+        return slots_[i].load(std::memory_order_acquire);
+    }
+
+    const AudioSetup setup_;
+
+    // Published speakers, filled in order and never removed; the output
+    // thread stops at the first empty slot
+    std::array<std::atomic<Speaker*>, kMaxSpeakers> slots_{};
+
+    // Network thread only
+    std::vector<std::unique_ptr<Speaker>> speakers_;
+    std::unordered_map<std::uint32_t, Speaker*> by_session_;
+};
+
+}  // namespace winrt::blurt::audio::implementation
@@ -1,8 +1,10 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <stdexcept>
 #include <utility>
+#include <vector>
 #include "ByteChunk.h"
 #include "winrt/base.h"
 
@@ -20,6 +22,27 @@ enum class AudioPacketType {
     Opus = 4,
 };
 
+// The fixed fields of a voice datagram in Mumble's legacy format, without the
+// payload itself
+struct AudioPacketHeader {
+    AudioPacketType type;
+    std::uint32_t target;
+    std::uint32_t sender_session;
+    std::uint64_t frame_seq;
+    std::uint32_t payload_offset;
+    std::uint16_t payload_size;
+    bool is_terminator;
+    bool has_position_info;
+    // Null if the header parsed; otherwise a description of what's wrong
+    const char* error;
+};
+
+// Parse the headers of a burst of incoming voice datagrams in one pass,
+// filling in headers[i] for frames[i]. This never throws; a malformed frame
+// gets a header with its error set. Returns the number of frames that parsed.
+std::size_t ParseIncomingHeaders(const ByteSlice* frames, std::size_t count,
+                                 AudioPacketHeader* headers);
+
 // Represents an audio packet sent in Mumble's legacy datagram format.
 // Future versions of the protocol will use protobuf encoding for this;
 // that'll be nice, but it's going to while before we can rely on that being
@@ -29,16 +52,31 @@ enum class AudioPacketType {
 // Realistically, this only supports Opus for audio right now.
 class AudioPacket {
    public:
-    // Parse an incoming audio packet; can throw AudioParseFailure
-    static AudioPacket FromIncomingBytes(const ByteChunk& bytes) { return FromBytes(bytes, true); }
+    // Parse an incoming audio packet, copying its payload; can throw
+    // AudioParseFailure
+    static AudioPacket FromIncomingBytes(const ByteChunk& bytes) {
+        return FromBytes(CopyToSlice(bytes), true);
+    }
 
-    // Parse an outgoing audio packet; can throw AudioParseFailure
-    static AudioPacket FromOutgoingBytes(const ByteChunk& bytes) { return FromBytes(bytes, false); }
+    // Parse an outgoing audio packet, copying its payload; can throw
+    // AudioParseFailure
+    static AudioPacket FromOutgoingBytes(const ByteChunk& bytes) {
+        return FromBytes(CopyToSlice(bytes), false);
+    }
 
-    // Move a chunk of encoded bytes into a new audio packet
+    // Parse an incoming audio packet without copying anything: the
+    // resulting packet's payload is a view into the given frame, which it
+    // shares ownership of. Can throw AudioParseFailure.
+    static AudioPacket FromIncomingFrame(const ByteSlice& frame) { return FromBytes(frame, true); }
+
+    // Make a packet from a header parsed by ParseIncomingHeaders() and the
+    // frame it came from, sharing the frame's storage for the payload
+    static AudioPacket FromHeader(const AudioPacketHeader& header, const ByteSlice& frame);
+
+    // Make a new audio packet whose payload shares the given encoded bytes
     AudioPacket(AudioPacketType type, std::uint32_t target, std::uint64_t frame_seq,
                 std::uint32_t sender_session, bool is_terminator, bool has_position_info,
-                ByteChunk&& encoded_bytes)
+                ByteSlice encoded_bytes)
         : type_{type},
           target_{target},
           frame_seq_{frame_seq},
@@ -47,8 +85,10 @@ class AudioPacket {
           has_position_info_{has_position_info},
           payload_{std::move(encoded_bytes)} {}
 
+    // Move a chunk of encoded bytes into a new audio packet
     AudioPacket(AudioPacketType type, std::uint64_t frame_seq, ByteChunk&& encoded_bytes)
-        : AudioPacket{type, 0, frame_seq, 0, false, false, std::move(encoded_bytes)} {}
+        : AudioPacket{type, 0, frame_seq, 0, false, false, ByteSlice::Of(std::move(encoded_bytes))} {
+    }
 
     AudioPacketType Type() const { return type_; }
     std::uint32_t Target() const { return target_; }
@@ -60,12 +100,15 @@ class AudioPacket {
         // See comment in the constructor for why this is safe
         return static_cast<std::uint16_t>(payload_.size());
     }
-    const ByteChunk& Payload() const { return payload_; }
+    const ByteSlice& Payload() const { return payload_; }
     ByteChunk EncodeOutgoing() const;
     winrt::hstring DebugString();
 
    private:
-    static AudioPacket FromBytes(const ByteChunk& bytes, bool contains_sender);
+    static AudioPacket FromBytes(const ByteSlice& bytes, bool contains_sender);
+    static ByteSlice CopyToSlice(const ByteChunk& bytes) {
+        return ByteSlice::Of(std::vector<std::uint8_t>{bytes.begin(), bytes.end()});
+    }
 
     AudioPacketType type_;
     std::uint32_t target_{0};
@@ -73,7 +116,7 @@ class AudioPacket {
     std::uint64_t frame_seq_;
     bool is_terminator_;
     bool has_position_info_;
-    ByteChunk payload_;
+    ByteSlice payload_;
 };
 
 }  // namespace winrt::blurt::mumble::implementation
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace winrt::blurt::audio::implementation {
+
+// A wraparound ring buffer for audio samples with exactly one producer
+// thread and exactly one consumer thread. Unlike AudioBuffer, no locking is
+// needed: the read and write indexes are atomics that each side only ever
+// advances, so (say) the network thread decoding audio and the audio graph
+// callback consuming it never block each other. Also unlike AudioBuffer,
+// samples are never moved around inside the buffer once written.
+//
+// Because a run of samples can straddle the end of the underlying storage,
+// direct access is through Segments, a pair of contiguous spans; the second
+// is empty unless the run wraps around. Like AudioBuffer, once created an
+// instance does no heap allocation, and throughout, this class deals in total
+// samples, not samples per channel.
+//
+// Methods named for writing may only be called from the producer thread, and
+// methods named for reading only from the consumer thread.
+template <typename SampleT = float, typename SizeT = std::int32_t>
+class AudioRingBuffer {
+   public:
+    using size_type = SizeT;
+
+    template <typename T>
+    struct Span {
+        T* data;
+        size_type size;
+    };
+
+    template <typename T>
+    struct Segments {
+        Span<T> first;
+        Span<T> second;
+        size_type size() const { return first.size + second.size; }
+    };
+
+    // Creates a buffer with a capacity to hold a given number of samples
+    AudioRingBuffer(size_type samples_capacity)
+        : buffer_{new SampleT[samples_capacity + 1]},
+          slots_{samples_capacity + 1},
+          read_idx_{0},
+          write_idx_{0} {
+        assert(samples_capacity > 0);
+    }
+
+    // Get the remaining capacity (in samples) the buffer can hold. The
+    // consumer may free up more capacity concurrently, so this is a lower
+    // bound; it's safe to write up to this many samples.
+    size_type WriteCapacity() const {
+        auto w = write_idx_.load(std::memory_order_relaxed);
+        auto r = read_idx_.load(std::memory_order_acquire);
+        return slots_ - 1 - Distance(r, w);
+    }
+
+    // Get the region where the caller can write N samples. Nothing is
+    // visible to the consumer until CommitWrite() is called. If N is above
+    // WriteCapacity(), behavior is undefined.
+    Segments<SampleT> GetWriteSegments(size_type num_samples) {
+        assert(WriteCapacity() >= num_samples);
+        return SegmentsAt(write_idx_.load(std::memory_order_relaxed), num_samples);
+    }
+
+    // Publish N samples previously written through GetWriteSegments() to the
+    // consumer.
+    void CommitWrite(size_type num_samples) {
+        assert(WriteCapacity() >= num_samples);
+        auto w = write_idx_.load(std::memory_order_relaxed);
+        write_idx_.store(Advance(w, num_samples), std::memory_order_release);
+    }
+
+    // Copy samples into the buffer from the given pointer. If the number of
+    // samples to be copied is above capacity, behavior is undefined.
+    void WriteSamplesFrom(const SampleT* src, size_type num_samples) {
+        auto dest = GetWriteSegments(num_samples);
+        std::memcpy(dest.first.data, src, dest.first.size * sizeof(SampleT));
+        std::memcpy(dest.second.data, src + dest.first.size, dest.second.size * sizeof(SampleT));
+        CommitWrite(num_samples);
+    }
+
+    // Get the number of samples available to read. The producer may add
+    // more concurrently, so this is a lower bound.
+    size_type ReadCapacity() const {
+        auto r = read_idx_.load(std::memory_order_relaxed);
+        auto w = write_idx_.load(std::memory_order_acquire);
+        return Distance(r, w);
+    }
+
+    // Get the region from which the caller can read N samples. The samples
+    // stay put (and the producer won't overwrite them) until CommitRead() is
+    // called. If N is above ReadCapacity(), behavior is undefined.
+    Segments<const SampleT> GetReadSegments(size_type num_samples) const {
+        assert(ReadCapacity() >= num_samples);
+        auto s = const_cast<AudioRingBuffer*>(this)->SegmentsAt(
+            read_idx_.load(std::memory_order_relaxed), num_samples);
+        return {{s.first.data, s.first.size}, {s.second.data, s.second.size}};
+    }
+
+    // Release N samples previously read through GetReadSegments() back to
+    // the producer.
+    void CommitRead(size_type num_samples) {
+        assert(ReadCapacity() >= num_samples);
+        auto r = read_idx_.load(std::memory_order_relaxed);
+        read_idx_.store(Advance(r, num_samples), std::memory_order_release);
+    }
+
+    // Read samples from the buffer into the given pointer, up to the given
+    // number. Returns the (possibly zero) number of samples actually read.
+    size_type ReadSamplesTo(SampleT* dest, size_type num_samples) {
+        auto samples_to_copy = std::min(ReadCapacity(), num_samples);
+        if (samples_to_copy > 0) {
+            auto src = GetReadSegments(samples_to_copy);
+            std::memcpy(dest, src.first.data, src.first.size * sizeof(SampleT));
+            std::memcpy(dest + src.first.size, src.second.data, src.second.size * sizeof(SampleT));
+            CommitRead(samples_to_copy);
+        }
+        return samples_to_copy;
+    }
+
+   private:
+    // One slot always stays empty, so that read_idx_ == write_idx_
+    // unambiguously means the buffer is empty rather than full
+    size_type Distance(size_type from, size_type to) const {
+        return to >= from ? to - from : slots_ - from + to;
+    }
+    size_type Advance(size_type idx, size_type n) const {
+        idx += n;
+        return idx >= slots_ ? idx - slots_ : idx;
+    }
+    Segments<SampleT> SegmentsAt(size_type idx, size_type n) {
+        auto first_len = std::min(n, slots_ - idx);
+        return {{&buffer_[idx], first_len}, {&buffer_[0], n - first_len}};
+    }
+
+    std::unique_ptr<SampleT[]> buffer_;
+    const size_type slots_;
+
+    // Keep the two indexes on separate cache lines so the producer and
+    // consumer don't bounce a line back and forth on every update
+    alignas(64) std::atomic<size_type> read_idx_;
+    alignas(64) std::atomic<size_type> write_idx_;
+};
+
+}  // namespace winrt::blurt::audio::implementation
@@ -2,6 +2,10 @@
 
 #include "AudioSystem.h"
 
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <optional>
 #include "winrt/Windows.Devices.Enumeration.h"
 #include "winrt/Windows.Media.Capture.h"
 #include "winrt/Windows.Media.Devices.h"
@@ -11,24 +15,55 @@
 namespace winrt::blurt::implementation {
 
 namespace {
-float RMSLevel(winrt::Windows::Media::AudioFrame const& frame) {
-    auto read_buffer = frame.LockBuffer(winrt::Windows::Media::AudioBufferAccessMode::Read);
-    auto input_len_bytes = read_buffer.Length();
-    std::uint32_t input_samples = input_len_bytes / sizeof(float);
-    auto frame_ref = read_buffer.CreateReference();
-    const float* pcm = reinterpret_cast<const float*>(frame_ref.data());
-
-    float sum{0};
-    for (std::uint32_t i = 0; i < input_samples; i++) sum += (pcm[i] * pcm[i]);
-    return std::sqrt(sum / input_samples);
+namespace winrtaudio = Windows::Media::Audio;
+namespace threading = Windows::System::Threading;
+
+// Decoded audio kept waiting beyond the jitter buffer's cushion, to cover
+// the output taking a quantum's worth at a time
+constexpr auto kPlayoutHeadroom = std::chrono::milliseconds{10};
+// How often to decode audio that's come due with no packet arriving to
+// prompt it; half a Mumble frame
+constexpr auto kDecodeInterval = std::chrono::milliseconds{5};
+// A speaker losing more than this share of packets gets a deeper jitter
+// buffer, so forward error correction has more of a chance, once there are
+// enough packets to tell
+constexpr double kLossyStreamRate = 0.02;
+constexpr std::uint32_t kLossyStreamMinPackets = 100;
+
+// Jitter on our own link, one way, going by the spread of round trip times
+// on whichever channel has been pinged
+blurt::audio::implementation::JitterBuffer::Clock::duration LinkJitter(
+    const mumble::implementation::ConnectionStats::Snapshot& stats) {
+    const auto& rtt = stats.udp.count > 0 ? stats.udp : stats.tcp;
+    return std::chrono::duration_cast<blurt::audio::implementation::JitterBuffer::Clock::duration>(
+        std::chrono::duration<double, std::milli>{std::sqrt(rtt.variance) / 2});
 }
 
-namespace winrtaudio = Windows::Media::Audio;
+bool IsLossy(const std::optional<mumble::implementation::ConnectionStats::StreamStats>& stream) {
+    return stream && stream->received + stream->lost >= kLossyStreamMinPackets &&
+           stream->LossRate() > kLossyStreamRate;
+}
 }  // namespace
 
+AudioSystem::~AudioSystem() {
+    threading::ThreadPoolTimer timer{nullptr};
+    {
+        // A tick that gets the lock after this finds us shutting down and
+        // does nothing
+        std::lock_guard lock{decode_mutex_};
+        shutting_down_ = true;
+        timer = std::exchange(decode_timer_, nullptr);
+    }
+    if (timer) timer.Cancel();
+    std::unique_lock lock{decode_timers_mutex_};
+    decode_timers_done_.wait(lock, [this] { return live_decode_timers_ == 0; });
+}
+
 Windows::Foundation::IAsyncAction AudioSystem::SetUp() {
-    opus_encoder_.EncodedAudioReady(
-        [this](std::vector<std::uint8_t> bytes) { event_encoded_capture_ready_(bytes); });
+    // Voice activation (on by default) keeps silence off the wire; DTX and
+    // VBR trim what's left during pauses within a talk spurt
+    opus_encoder_.Vbr(true);
+    opus_encoder_.Dtx(true);
 
     {
         Windows::Devices::Enumeration::DeviceInformation output_dev{nullptr};
@@ -66,8 +101,6 @@ Windows::Foundation::IAsyncAction AudioSystem::SetUp() {
         if (capture_graph_result.Status() != winrtaudio::AudioGraphCreationStatus::Success)
             throw std::exception{"capturing audio graph create failed"};
         capture_graph_ = capture_graph_result.Graph();
-        capture_graph_.EncodingProperties().ChannelCount(capture_setup_.NumChannels());
-        capture_graph_.EncodingProperties().SampleRate(capture_setup_.SamplesPerChannelPerSecond());
 
         auto device_result = co_await capture_graph_.CreateDeviceInputNodeAsync(
             Windows::Media::Capture::MediaCategory::GameChat, capture_graph_.EncodingProperties(),
@@ -76,13 +109,83 @@ Windows::Foundation::IAsyncAction AudioSystem::SetUp() {
             throw std::exception{"device input node create failed"};
         capture_output_ = capture_graph_.CreateFrameOutputNode(capture_graph_.EncodingProperties());
         device_result.DeviceInputNode().AddOutgoingConnection(capture_output_);
+
+        // Take frames in the device's own format; the encode worker
+        // converts them
+        auto capture_format = capture_output_.EncodingProperties();
+        encode_worker_.InputFormat(capture_format.SampleRate(), capture_format.ChannelCount());
+        capture_is_int16_ = capture_format.BitsPerSample() == 16;
         capture_graph_.QuantumStarted({this, &AudioSystem::CaptureAudioGraph_QuantumStarted});
+        encode_worker_.Start();
         capture_graph_.Start();
     }
 }
 
-void AudioSystem::DecodeForOutput(const ByteChunk& encoded_bytes) {
-    opus_decoder_.DecodeToBuffer(encoded_bytes);
+void AudioSystem::DecodeForOutput(const mumble::implementation::AudioPacket& packet,
+                                  const mumble::implementation::ConnectionStats& stats) {
+    const auto& payload = packet.Payload();
+    std::uint32_t duration{0};
+    if (payload.size() > 0) {
+        int samples_per_chan = opus_packet_get_nb_samples(
+            payload, payload.size(), output_setup_.SamplesPerChannelPerSecond());
+        if (samples_per_chan <= 0) return;  // TODO: log bogus audio packet
+        duration = samples_per_chan /
+                   output_setup_.SamplesPerChannelPer(blurt::audio::kMumbleFrameDuration);
+    }
+
+    // Take these before the lock; they have a lock of their own
+    auto link = stats.TakeSnapshot();
+    auto stream = stats.Speaker(packet.SenderSession());
+
+    std::lock_guard lock{decode_mutex_};
+    loss_window_.NetworkCounts(link.voice.received, link.voice.lost);
+    auto now = blurt::audio::implementation::JitterBuffer::Clock::now();
+    auto* speaker = mixer_.SpeakerFor(packet.SenderSession(), now);
+    if (speaker == nullptr) return;  // TODO: log too many simultaneous speakers
+    auto& jitter_buffer = speaker->Jitter();
+    jitter_buffer.NetworkHint(LinkJitter(link), IsLossy(stream));
+    jitter_buffer.Put(packet.FrameSequence(), duration, packet.IsTerminator(), payload, now);
+    speaker->PlayoutTarget(jitter_buffer.TargetDepth() * blurt::audio::kMumbleFrameDuration +
+                           kPlayoutHeadroom);
+    NoteReceiveLoss(speaker->DecodeDue(now));
+    ArmDecodeTimer();
+}
+
+void AudioSystem::ArmDecodeTimer() {
+    if (decode_timer_ || shutting_down_ || !mixer_.HoldsFrames()) return;
+    {
+        std::lock_guard lock{decode_timers_mutex_};
+        live_decode_timers_++;
+    }
+    decode_timer_ = threading::ThreadPoolTimer::CreatePeriodicTimer(
+        [this](const threading::ThreadPoolTimer& timer) { DecodeTimer_Tick(timer); },
+        kDecodeInterval, [this](const threading::ThreadPoolTimer&) {
+            // Called once the timer is canceled and none of its ticks are
+            // still running
+            std::lock_guard lock{decode_timers_mutex_};
+            live_decode_timers_--;
+            decode_timers_done_.notify_all();
+        });
+}
+
+void AudioSystem::DecodeTimer_Tick(const threading::ThreadPoolTimer& timer) {
+    {
+        std::lock_guard lock{decode_mutex_};
+        // Ticks can queue up behind the lock after their timer is canceled
+        if (shutting_down_ || timer != decode_timer_) return;
+        NoteReceiveLoss(
+            mixer_.DecodeDue(blurt::audio::implementation::JitterBuffer::Clock::now()));
+        if (mixer_.HoldsFrames()) return;
+        // Nothing left to come due; the next packet arms a new timer
+        decode_timer_ = nullptr;
+    }
+    timer.Cancel();
+}
+
+void AudioSystem::NoteReceiveLoss(blurt::audio::implementation::AudioMixer::DecodeCounts counts) {
+    // Loss on the way in is the best guess we have for loss on the way out
+    if (auto percent = loss_window_.OnDecoded(counts.received, counts.lost))
+        opus_encoder_.ExpectedLossPercent(*percent);
 }
 
 void AudioSystem::OutputAudioGraph_QuantumStarted(
@@ -96,20 +199,49 @@ void AudioSystem::OutputAudioGraph_QuantumStarted(
     // https://blurt.chat/l/8e73WHLf
     auto samples = args.RequiredSamples();
     if (samples == 0) return;
-    auto frame = opus_decoder_.ConsumeAudio(samples);
-    if (frame == nullptr) return;
+    auto samples_to_mix = mixer_.SamplesReady(static_cast<std::int32_t>(samples));
+    if (samples_to_mix == 0) return;
+
+    // AudioFrame constructor is capacity in bytes:
+    // https://docs.microsoft.com/en-us/uwp/api/windows.media.audioframe.-ctor
+    Windows::Media::AudioFrame frame{static_cast<std::uint32_t>(samples_to_mix * sizeof(float))};
+    {
+        auto buffer = frame.LockBuffer(Windows::Media::AudioBufferAccessMode::Write);
+        auto buffer_ref = buffer.CreateReference();
+        float* dest = reinterpret_cast<float*>(buffer_ref.data());
+        mixer_.MixTo(dest, samples_to_mix);
+    }
     node.AddFrame(frame);
 }
 
 void AudioSystem::CaptureAudioGraph_QuantumStarted(winrtaudio::AudioGraph graph,
                                                    Windows::Foundation::IInspectable) {
+    auto start = std::chrono::steady_clock::now();
+    CaptureQuantum();
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    if (elapsed > capture_callback_max_us_.load(std::memory_order_relaxed))
+        capture_callback_max_us_.store(elapsed, std::memory_order_relaxed);
+}
+
+void AudioSystem::CaptureQuantum() {
     auto frame = capture_output_.GetFrame();
     if (frame == nullptr) return;
     std::optional<Windows::Foundation::TimeSpan> duration{frame.Duration()};
     if (!duration.has_value()) return;
     if (duration.value().count() == 0) return;
 
-    opus_encoder_.BufferRawAudio(frame);
+    auto buffer = frame.LockBuffer(Windows::Media::AudioBufferAccessMode::Read);
+    auto buffer_ref = buffer.CreateReference();
+    const auto* data = buffer_ref.data();
+    auto sample_size = capture_is_int16_ ? sizeof(std::int16_t) : sizeof(float);
+    auto samples = static_cast<std::int32_t>(buffer.Length() / sample_size);
+    if (capture_is_int16_) {
+        encode_worker_.Submit(reinterpret_cast<const std::int16_t*>(data), samples);
+    } else {
+        encode_worker_.Submit(reinterpret_cast<const float*>(data), samples);
+    }
 }
 
 }  // namespace winrt::blurt::implementation
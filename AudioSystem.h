@@ -1,12 +1,22 @@
 #pragma once
 
-#include <vector>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include "AudioMixer.h"
+#include "AudioPacket.h"
 #include "ByteChunk.h"
-#include "OpusDecoder.h"
+#include "ConnectionStats.h"
+#include "EncoderWorker.h"
 #include "OpusEncoder.h"
+#include "ReceiveLossWindow.h"
 #include "winrt/Windows.Foundation.h"
 #include "winrt/Windows.Media.Audio.h"
 #include "winrt/Windows.Media.h"
+#include "winrt/Windows.System.Threading.h"
 #include "winrt/base.h"
 
 namespace winrt::blurt::implementation {
@@ -14,35 +24,100 @@ namespace winrt::blurt::implementation {
 class AudioSystem {
    public:
     AudioSystem() = default;
+    ~AudioSystem();
     Windows::Foundation::IAsyncAction SetUp();
-    void DecodeForOutput(const ByteChunk& encoded_bytes);
 
-    winrt::event_token EncodedCaptureReady(
-        winrt::delegate<std::vector<std::uint8_t>> const& handler) {
-        return event_encoded_capture_ready_.add(handler);
+    // Queue a received audio packet for playout, given what the connection
+    // knows about the network, which tunes the jitter buffers and the
+    // encoder's expected loss. Safe from any thread.
+    void DecodeForOutput(const mumble::implementation::AudioPacket& packet,
+                         const mumble::implementation::ConnectionStats& stats);
+
+    // How long received audio has lately been waiting between decoding and
+    // playing, for whichever speaker it's longest
+    std::chrono::microseconds PlayoutDelay() const { return mixer_.PlayoutDelay(); }
+
+    // The longest the capture callback has taken, and how much captured
+    // audio was dropped because the encoder fell behind: samples as the
+    // device delivered them, and as the encoder takes them
+    std::chrono::microseconds CaptureCallbackMaxTime() const {
+        return std::chrono::microseconds{capture_callback_max_us_.load(std::memory_order_relaxed)};
+    }
+    std::uint64_t CaptureDroppedSamples() const { return encode_worker_.DroppedSamples(); }
+    std::uint64_t EncoderDroppedSamples() const { return opus_encoder_.DroppedSamples(); }
+
+    // Set the function that takes each frame of encoded captured audio. It's
+    // called on the encoder's own thread.
+    void EncodedCaptureReady(
+        blurt::audio::implementation::OpusEncoder::EncodedAudioHandler handler) {
+        opus_encoder_.EncodedAudioReady(std::move(handler));
     }
-    void EncodedCaptureReady(winrt::event_token const& token) noexcept {
-        event_encoded_capture_ready_.remove(token);
+
+    // Change how captured audio is cut into packets; it takes effect from the
+    // next packet on
+    void VoiceProfileChanged(blurt::audio::implementation::VoiceProfile profile) {
+        opus_encoder_.Profile(profile);
+    }
+
+    // Tell the encoder the server's bandwidth limit (zero for none) and
+    // whether voice is going over UDP, so it keeps what it sends under the
+    // limit
+    void VoiceLinkChanged(std::uint32_t max_bandwidth, bool is_udp) {
+        using Transport = blurt::audio::implementation::BitrateController::Transport;
+        opus_encoder_.MaxBandwidth(max_bandwidth);
+        opus_encoder_.VoiceTransport(is_udp ? Transport::Udp : Transport::Tcp);
     }
 
    private:
+    // While any jitter buffer holds frames, a timer goes off every few
+    // milliseconds to decode received audio that's come due without a packet
+    // arriving to prompt it. Arming needs decode_mutex_ held.
+    void ArmDecodeTimer();
+    void DecodeTimer_Tick(const Windows::System::Threading::ThreadPoolTimer& timer);
+    void NoteReceiveLoss(blurt::audio::implementation::AudioMixer::DecodeCounts counts);
     void OutputAudioGraph_QuantumStarted(
         Windows::Media::Audio::AudioFrameInputNode,
         Windows::Media::Audio::FrameInputNodeQuantumStartedEventArgs const&);
     void AudioSystem::CaptureAudioGraph_QuantumStarted(Windows::Media::Audio::AudioGraph graph,
                                                        Windows::Foundation::IInspectable);
+    // Take the capture graph's next frame and queue it for encoding
+    void CaptureQuantum();
 
-    winrt::event<winrt::delegate<std::vector<std::uint8_t>>> event_encoded_capture_ready_;
     Windows::Media::Audio::AudioGraph output_graph_{nullptr};
     const blurt::audio::AudioSetup output_setup_{blurt::audio::SampleRate::Of48KHz(),
                                                  blurt::audio::Channels::Stereo()};
     Windows::Media::Audio::AudioGraph capture_graph_{nullptr};
+    // What the encoder takes. Voice goes out mono; the capture device runs in
+    // whatever format it likes, and the encode worker converts between them.
     const blurt::audio::AudioSetup capture_setup_{blurt::audio::SampleRate::Of48KHz(),
-                                                  blurt::audio::Channels::Stereo()};
+                                                  blurt::audio::Channels::Mono()};
     Windows::Media::Audio::AudioFrameOutputNode capture_output_{nullptr};
-    blurt::audio::implementation::OpusDecoder opus_decoder_{output_setup_};
+    bool capture_is_int16_{false};
+    // Packets arrive on the network threads and the decode loop runs on the
+    // thread pool; decode_mutex_ keeps them to one at a time on the mixer's
+    // network side. The output side takes no lock.
+    std::mutex decode_mutex_;
+    blurt::audio::implementation::AudioMixer mixer_{output_setup_};
+    // Loss on the way in, across all speakers, since the encoder's expected
+    // loss was last updated
+    _Guarded_by_(decode_mutex_) blurt::audio::implementation::ReceiveLossWindow loss_window_;
+    _Guarded_by_(decode_mutex_) Windows::System::Threading::ThreadPoolTimer decode_timer_{nullptr};
+    _Guarded_by_(decode_mutex_) bool shutting_down_{false};
+    // Every timer ever armed counts as live until the thread pool says it's
+    // done with it, which the destructor waits for, so none can go off once
+    // the members are gone. This has its own lock so that canceling a timer
+    // never waits on decode_mutex_.
+    std::mutex decode_timers_mutex_;
+    _Guarded_by_(decode_timers_mutex_) std::int32_t live_decode_timers_{0};
+    std::condition_variable decode_timers_done_;
     blurt::audio::implementation::OpusEncoder opus_encoder_{
-        capture_setup_, blurt::audio::implementation::OpusFrameSize::Of20ms()};
+        capture_setup_, blurt::audio::implementation::VoiceProfile::Default()};
+    // Converts and encodes on its own thread, so the capture callback only
+    // has to copy; declared after the encoder so it stops before the encoder
+    // goes away
+    blurt::audio::implementation::EncoderWorker encode_worker_{opus_encoder_, capture_setup_,
+                                                               std::chrono::milliseconds{500}};
+    std::atomic<std::int64_t> capture_callback_max_us_{0};
 };
 
 }  // namespace winrt::blurt::implementation
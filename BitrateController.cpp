@@ -0,0 +1,127 @@
+#include "pch.h"
+
+#include "BitrateController.h"
+
+#include <algorithm>
+
+namespace winrt::blurt::audio::implementation {
+
+namespace {
+// Per packet: IPv4 and UDP headers, the encryption header, then the voice
+// header's type byte and, typically, two bytes each of sequence number and
+// payload length
+constexpr std::int32_t kUdpPacketOverhead = 20 + 8 + 4 + 1 + 2 + 2;
+// Tunneled: IPv4 and TCP headers and the control message header, then the
+// same voice header, unencrypted (TLS costs are the server's to ignore)
+constexpr std::int32_t kTcpPacketOverhead = 20 + 20 + 6 + 1 + 2 + 2;
+
+constexpr double kDefaultCpuBudget = 0.1;
+// Weight of each new encode time in the moving average
+constexpr double kEncodeTimeWeight = 0.1;
+// Frames measured after a complexity change before judging it
+constexpr std::int32_t kSettleFrames = 10;
+// How long to hold off raising complexity after any change, in frames; long
+// enough that a briefly idle machine doesn't make it bounce
+constexpr std::int32_t kRaiseHoldFrames = 250;
+// Raise complexity only if encoding takes less than this share of budget
+constexpr double kRaiseThreshold = 0.5;
+// Opus's forward error correction stops helping much beyond this
+constexpr std::int32_t kMaxLossPercent = 25;
+}  // namespace
+
+BitrateController::BitrateController(std::chrono::milliseconds frame_duration,
+                                     std::int32_t preferred_bitrate)
+    : frame_duration_{frame_duration},
+      preferred_bitrate_{std::clamp(preferred_bitrate, kMinBitrate, kMaxBitrate)},
+      cpu_budget_{kDefaultCpuBudget},
+      settings_{preferred_bitrate_, false, 0, kMaxComplexity} {
+    UpdateBitrate();
+}
+
+void BitrateController::PreferredBitrate(std::int32_t bits_per_second) {
+    preferred_bitrate_ = std::clamp(bits_per_second, kMinBitrate, kMaxBitrate);
+    UpdateBitrate();
+}
+
+void BitrateController::PreferVbr(bool enable) {
+    prefer_vbr_ = enable;
+    UpdateBitrate();
+}
+
+void BitrateController::MaxBandwidth(std::uint32_t bits_per_second) {
+    max_bandwidth_ = bits_per_second;
+    UpdateBitrate();
+}
+
+void BitrateController::VoiceTransport(Transport transport) {
+    transport_ = transport;
+    UpdateBitrate();
+}
+
+void BitrateController::FrameDuration(std::chrono::milliseconds duration) {
+    frame_duration_ = duration;
+    frames_measured_ = 0;
+    UpdateBitrate();
+}
+
+void BitrateController::ObservedLossPercent(std::int32_t percent) {
+    settings_.loss_percent = std::clamp(percent, 0, kMaxLossPercent);
+}
+
+void BitrateController::CpuBudget(double share) { cpu_budget_ = std::clamp(share, 0.0, 1.0); }
+
+void BitrateController::OnFrameEncoded(std::chrono::microseconds encode_time) {
+    auto sample = static_cast<double>(encode_time.count());
+    encode_time_us_ = frames_measured_ == 0
+                          ? sample
+                          : encode_time_us_ + kEncodeTimeWeight * (sample - encode_time_us_);
+    frames_measured_++;
+    if (complexity_hold_ > 0) complexity_hold_--;
+    if (frames_measured_ < kSettleFrames) return;
+
+    auto frame_us = std::chrono::duration_cast<std::chrono::microseconds>(frame_duration_);
+    auto budget_us = cpu_budget_ * frame_us.count();
+    auto& complexity = settings_.complexity;
+    if (encode_time_us_ > budget_us && complexity > kMinComplexity) {
+        complexity--;
+    } else if (encode_time_us_ < budget_us * kRaiseThreshold && complexity < kMaxComplexity &&
+               complexity_hold_ == 0) {
+        complexity++;
+    } else {
+        return;
+    }
+    frames_measured_ = 0;
+    complexity_hold_ = kRaiseHoldFrames;
+}
+
+std::int32_t BitrateController::PacketOverhead() const {
+    return transport_ == Transport::Udp ? kUdpPacketOverhead : kTcpPacketOverhead;
+}
+
+std::int32_t BitrateController::PacketsPerSecond() const {
+    auto ms = std::max<std::int64_t>(frame_duration_.count(), 1);
+    return static_cast<std::int32_t>((1000 + ms - 1) / ms);
+}
+
+std::int32_t BitrateController::WireBitrate() const {
+    return settings_.bitrate + PacketOverhead() * 8 * PacketsPerSecond();
+}
+
+void BitrateController::UpdateBitrate() {
+    auto bitrate = preferred_bitrate_;
+    bool limited = false;
+    if (max_bandwidth_ != 0) {
+        auto available = static_cast<std::int64_t>(max_bandwidth_) -
+                         std::int64_t{PacketOverhead()} * 8 * PacketsPerSecond();
+        if (available < bitrate) {
+            // If even the smallest bitrate doesn't fit, send it anyway;
+            // better that the server drops some than that we send nothing
+            bitrate = static_cast<std::int32_t>(std::max<std::int64_t>(available, kMinBitrate));
+            limited = true;
+        }
+    }
+    settings_.bitrate = bitrate;
+    settings_.vbr = prefer_vbr_ && !limited;
+}
+
+}  // namespace winrt::blurt::audio::implementation
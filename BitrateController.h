@@ -0,0 +1,97 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace winrt::blurt::audio::implementation {
+
+// Decides how the Opus encoder should be tuned, from what's known about the
+// network and the machine, and retunes it as that changes.
+//
+// Bitrate is the preferred bitrate, cut down if need be so that it and the
+// packet headers together fit in the server's bandwidth limit. The headers
+// are counted the way Mumble's server counts them, from the IP header up,
+// so they cost more over the control channel than over UDP, and more per
+// second with shorter frames. VBR is used if wanted, but not while the
+// limit is what's setting the bitrate, since a burst of large frames could
+// then go over it. The expected loss, which decides how much Opus spends on
+// forward error correction, is the observed network loss.
+//
+// Complexity follows the time each frame takes to encode, against a budget
+// that's a share of the frame's duration: it steps down quickly when encoding
+// runs over, and creeps back up when there's plenty of room again.
+//
+// This does no allocation or locking; the caller is responsible for locking
+// access from different threads.
+class BitrateController {
+   public:
+    struct Settings {
+        std::int32_t bitrate;
+        bool vbr;
+        std::int32_t loss_percent;
+        std::int32_t complexity;
+
+        bool operator==(const Settings& other) const {
+            return bitrate == other.bitrate && vbr == other.vbr &&
+                   loss_percent == other.loss_percent && complexity == other.complexity;
+        }
+        bool operator!=(const Settings& other) const { return !(*this == other); }
+    };
+
+    enum class Transport { Udp, Tcp };
+
+    static constexpr std::int32_t kMinBitrate = 6000;
+    static constexpr std::int32_t kMaxBitrate = 510000;
+    static constexpr std::int32_t kMaxComplexity = 10;
+    // Below this, speech quality falls off faster than the CPU saved is worth
+    static constexpr std::int32_t kMinComplexity = 2;
+
+    explicit BitrateController(std::chrono::milliseconds frame_duration,
+                               std::int32_t preferred_bitrate = 40000);
+
+    // What to aim for when nothing else gets in the way
+    void PreferredBitrate(std::int32_t bits_per_second);
+    void PreferVbr(bool enable);
+
+    // The server's limit on everything we send, headers included, in bits
+    // per second; zero means no limit
+    void MaxBandwidth(std::uint32_t bits_per_second);
+    void VoiceTransport(Transport transport);
+    void FrameDuration(std::chrono::milliseconds duration);
+
+    // The share of packets lost on the way, from 0 to 100
+    void ObservedLossPercent(std::int32_t percent);
+
+    // The share of each frame's duration that encoding it may take, from 0
+    // to 1
+    void CpuBudget(double share);
+
+    // Note how long the last frame took to encode
+    void OnFrameEncoded(std::chrono::microseconds encode_time);
+
+    const Settings& Current() const { return settings_; }
+
+    // Header bytes on the wire for each packet, and what the current
+    // settings cost altogether, in bits per second
+    std::int32_t PacketOverhead() const;
+    std::int32_t WireBitrate() const;
+
+   private:
+    void UpdateBitrate();
+    std::int32_t PacketsPerSecond() const;
+
+    std::chrono::milliseconds frame_duration_;
+    std::int32_t preferred_bitrate_;
+    bool prefer_vbr_{false};
+    std::uint32_t max_bandwidth_{0};
+    Transport transport_{Transport::Udp};
+    double cpu_budget_;
+    // A moving average of encode time per frame, in microseconds
+    double encode_time_us_{0};
+    std::int32_t frames_measured_{0};
+    // Frames to wait before complexity may go up again
+    std::int32_t complexity_hold_{0};
+    Settings settings_;
+};
+
+}  // namespace winrt::blurt::audio::implementation
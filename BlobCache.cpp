@@ -0,0 +1,154 @@
+#include "pch.h"
+
+#include "BlobCache.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <utility>
+#include <vector>
+#include "Sha1.h"
+
+namespace winrt::blurt::mumble::implementation {
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr char kHexDigits[] = "0123456789abcdef";
+
+std::string ToHex(const std::string& bytes) {
+    std::string result;
+    result.reserve(bytes.size() * 2);
+    for (unsigned char c : bytes) {
+        result.push_back(kHexDigits[c >> 4]);
+        result.push_back(kHexDigits[c & 0xf]);
+    }
+    return result;
+}
+
+int HexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+// The raw hash a cache file name stands for, or nothing if it isn't one
+std::optional<std::string> FromHex(const std::string& hex) {
+    if (hex.size() != 2 * Sha1::kDigestSize) return std::nullopt;
+    std::string result(Sha1::kDigestSize, '\0');
+    for (std::size_t i = 0; i < result.size(); i++) {
+        int hi = HexValue(hex[2 * i]), lo = HexValue(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) return std::nullopt;
+        result[i] = static_cast<char>((hi << 4) | lo);
+    }
+    return result;
+}
+}  // namespace
+
+BlobCache::BlobCache(fs::path dir, std::uint64_t max_bytes)
+    : dir_{std::move(dir)}, max_bytes_{max_bytes} {
+    std::error_code ec;
+    fs::create_directories(dir_, ec);
+
+    struct Found {
+        std::string hash;
+        std::uint64_t size;
+        fs::file_time_type last_use;
+    };
+    std::vector<Found> found;
+    for (fs::directory_iterator it{dir_, ec}, end; !ec && it != end; it.increment(ec)) {
+        auto hash = FromHex(it->path().filename().string());
+        if (!hash) continue;
+        std::error_code file_ec;
+        auto size = it->file_size(file_ec);
+        auto last_use = it->last_write_time(file_ec);
+        if (!file_ec) found.push_back({std::move(*hash), size, last_use});
+    }
+    std::sort(found.begin(), found.end(),
+              [](const Found& a, const Found& b) { return a.last_use > b.last_use; });
+    for (auto& f : found) {
+        lru_.push_back(f.hash);
+        entries_.emplace(std::move(f.hash), Entry{f.size, std::prev(lru_.end())});
+        total_bytes_ += f.size;
+    }
+    EvictToFit();
+}
+
+std::optional<std::string> BlobCache::Get(const std::string& hash) {
+    auto it = entries_.find(hash);
+    if (it == entries_.end()) return std::nullopt;
+
+    std::ifstream in{PathFor(hash), std::ios::binary};
+    std::string content{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+    // A file that's gone, cut short or scribbled on is no use to anyone
+    if (!in.is_open() || Sha1::Of(content) != hash) {
+        in.close();
+        Remove(hash);
+        return std::nullopt;
+    }
+    Touch(hash, it->second);
+    return content;
+}
+
+void BlobCache::Put(const std::string& hash, const std::string& content) {
+    if (content.empty() || content.size() > max_bytes_) return;
+    auto it = entries_.find(hash);
+    if (it != entries_.end()) {
+        Touch(hash, it->second);
+        return;
+    }
+
+    // Write under another name and rename, so a crash partway through
+    // can't leave a bad file under the real name
+    auto path = PathFor(hash);
+    auto temp_path = path;
+    temp_path += ".tmp";
+    {
+        std::ofstream out{temp_path, std::ios::binary | std::ios::trunc};
+        out.write(content.data(), static_cast<std::streamsize>(content.size()));
+        if (!out) {
+            out.close();
+            std::error_code ec;
+            fs::remove(temp_path, ec);
+            return;
+        }
+    }
+    std::error_code ec;
+    fs::rename(temp_path, path, ec);
+    if (ec) {
+        fs::remove(temp_path, ec);
+        return;
+    }
+
+    lru_.push_front(hash);
+    entries_.emplace(hash, Entry{content.size(), lru_.begin()});
+    total_bytes_ += content.size();
+    EvictToFit();
+}
+
+fs::path BlobCache::PathFor(const std::string& hash) const { return dir_ / ToHex(hash); }
+
+void BlobCache::Touch(const std::string& hash, Entry& entry) {
+    lru_.splice(lru_.begin(), lru_, entry.lru);
+    std::error_code ec;
+    fs::last_write_time(PathFor(hash), fs::file_time_type::clock::now(), ec);
+}
+
+void BlobCache::Remove(const std::string& hash) {
+    auto it = entries_.find(hash);
+    if (it == entries_.end()) return;
+    std::error_code ec;
+    fs::remove(PathFor(hash), ec);
+    total_bytes_ -= it->second.size;
+    lru_.erase(it->second.lru);
+    entries_.erase(it);
+}
+
+void BlobCache::EvictToFit() {
+    while (total_bytes_ > max_bytes_ && !lru_.empty()) {
+        // Copy the hash: Remove() erases the list node it lives in
+        Remove(std::string{lru_.back()});
+    }
+}
+
+}  // namespace winrt::blurt::mumble::implementation
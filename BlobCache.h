@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace winrt::blurt::mumble::implementation {
+
+// An on-disk cache of comments, avatar textures and channel descriptions,
+// keyed by their SHA-1 hashes, so they needn't be downloaded again on every
+// connect. Each blob is a file named for its hash in hex.
+//
+// The cache holds at most a fixed number of bytes; past that, the blobs
+// used least recently go first. Last use is kept as the file's modification
+// time, so it survives restarts.
+//
+// Everything here is best effort: a file that can't be read is a miss, and
+// one that can't be written is simply not cached. Nothing throws. It's not
+// thread-safe.
+class BlobCache {
+   public:
+    static constexpr std::uint64_t kDefaultMaxBytes = 64 * 1024 * 1024;
+
+    explicit BlobCache(std::filesystem::path dir, std::uint64_t max_bytes = kDefaultMaxBytes);
+
+    // The blob with the given raw (20-byte) hash, if it's cached and intact
+    std::optional<std::string> Get(const std::string& hash);
+
+    // Cache a blob under its hash, which the caller has already worked out
+    void Put(const std::string& hash, const std::string& content);
+
+    std::uint64_t TotalBytes() const { return total_bytes_; }
+
+   private:
+    struct Entry {
+        std::uint64_t size;
+        // Position in lru_
+        std::list<std::string>::iterator lru;
+    };
+
+    std::filesystem::path PathFor(const std::string& hash) const;
+    void Touch(const std::string& hash, Entry& entry);
+    void Remove(const std::string& hash);
+    void EvictToFit();
+
+    const std::filesystem::path dir_;
+    const std::uint64_t max_bytes_;
+    std::uint64_t total_bytes_{0};
+    // Raw hashes, most recently used first
+    std::list<std::string> lru_;
+    std::unordered_map<std::string, Entry> entries_;
+};
+
+}  // namespace winrt::blurt::mumble::implementation
@@ -1,48 +1,144 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <limits>
 #include <memory>
 #include <stdexcept>
 #include <string>
 #include <utility>
 #include <vector>
+#include "BytePool.h"
 
 namespace winrt::blurt {
 
-// Very lightly encapsulates a contiguous run of uint8 with storage managed by
-// std::vector under the hood. The only features that really matter here are
-// (1) length is guaranteed to fit in int32 and (2) a ByteChunk can't be
-// implicitly copied, so it's a bit more obvious whether storage is being
-// copied or moved.
+// Very lightly encapsulates a contiguous run of uint8. The only features
+// that really matter here are (1) length is guaranteed to fit in int32 and
+// (2) a ByteChunk can't be implicitly copied, so it's a bit more obvious
+// whether storage is being copied or moved.
+//
+// Storage is either a std::vector handed over by the caller or, for chunks
+// made with Allocate() or CopyOf(), a block recycled through BytePool, so
+// that the steady stream of network messages doesn't hit the heap.
 class ByteChunk {
    public:
-    ByteChunk(ByteChunk&&) = default;
-    ByteChunk(std::vector<std::uint8_t>&& bytes) : bytes_{std::move(bytes)} {
-        if (bytes_.size() > std::numeric_limits<std::int32_t>::max())
-            throw std::overflow_error{"implausibly enormous byte chunk"};
+    // A moved-from chunk is left empty, with no storage
+    ByteChunk(ByteChunk&& other) noexcept
+        : vector_{std::move(other.vector_)},
+          block_{std::move(other.block_)},
+          data_{std::exchange(other.data_, nullptr)},
+          size_{std::exchange(other.size_, 0)} {}
+    ByteChunk& operator=(ByteChunk&& other) noexcept {
+        if (this == &other) return *this;
+        vector_ = std::move(other.vector_);
+        // Blocks swap on assignment; let go of this chunk's old one here,
+        // rather than leave it with the other
+        BytePool::Block old{std::move(block_)};
+        block_ = std::move(other.block_);
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        return *this;
+    }
+    ByteChunk(std::vector<std::uint8_t>&& bytes)
+        : vector_{std::move(bytes)}, data_{vector_.data()}, size_{CheckedSize(vector_.size())} {}
+
+    // Make a chunk of the given size from pooled storage; the contents are
+    // uninitialized
+    static ByteChunk Allocate(std::size_t len, BytePool& pool = BytePool::Default()) {
+        auto size = CheckedSize(len);
+        return ByteChunk{pool.Acquire(len), size};
+    }
+
+    static ByteChunk CopyOf(const std::uint8_t* data, std::size_t len) {
+        auto result = Allocate(len);
+        if (len > 0) std::memcpy(result.data(), data, len);
+        return result;
     }
 
     static ByteChunk CopyOf(const std::string& s) {
-        if (s.size() > std::numeric_limits<std::int32_t>::max())
-            throw std::overflow_error{"implausibly enormous byte chunk"};
-        return ByteChunk{reinterpret_cast<const std::uint8_t*>(s.data()),
-                         static_cast<std::int32_t>(s.size())};
+        return CopyOf(reinterpret_cast<const std::uint8_t*>(s.data()), s.size());
     }
 
-    const std::vector<std::uint8_t>& Bytes() const { return bytes_; }
-    operator const std::uint8_t*() const { return &bytes_[0]; }
-    std::int32_t size() const { return static_cast<std::int32_t>(bytes_.size()); }
-    auto begin() const { return bytes_.cbegin(); }
-    auto end() const { return bytes_.cend(); }
+    std::uint8_t* data() { return data_; }
+    const std::uint8_t* data() const { return data_; }
+    operator const std::uint8_t*() const { return data_; }
+    std::int32_t size() const { return size_; }
+    const std::uint8_t* begin() const { return data_; }
+    const std::uint8_t* end() const { return data_ + size_; }
 
     // Disable accidental copying (and copy-assignment)
     ByteChunk(const ByteChunk&) = delete;
     ByteChunk& operator=(const ByteChunk&) = delete;
 
    private:
-    ByteChunk(const std::uint8_t* data, std::int32_t len) : bytes_{data, data + len} {}
+    ByteChunk(BytePool::Block&& block, std::int32_t size)
+        : block_{std::move(block)}, data_{block_.data()}, size_{size} {}
 
-    const std::vector<std::uint8_t> bytes_;
+    static std::int32_t CheckedSize(std::size_t size) {
+        if (size > static_cast<std::size_t>(std::numeric_limits<std::int32_t>::max()))
+            throw std::overflow_error{"implausibly enormous byte chunk"};
+        return static_cast<std::int32_t>(size);
+    }
+
+    // Deliberately not const, so that moving a ByteChunk moves the storage
+    // rather than copying it. At most one of these is in use.
+    std::vector<std::uint8_t> vector_;
+    BytePool::Block block_;
+
+    std::uint8_t* data_;
+    std::int32_t size_;
 };
+
+// A read-only view of a run of bytes inside a ByteChunk that shares
+// ownership of that chunk (by reference count), so the storage lives as
+// long as any slice of it does. Copying a ByteSlice copies a reference,
+// never the bytes, which makes it a cheap way to hand part of a received
+// message to somebody else without duplicating it.
+class ByteSlice {
+   public:
+    ByteSlice() = default;
+
+    // Make a slice covering the whole of a shared chunk
+    explicit ByteSlice(std::shared_ptr<const ByteChunk> chunk)
+        : data_{chunk->data()}, size_{chunk->size()}, owner_{std::move(chunk)} {}
+
+    // Make a slice of part of a shared chunk; throws out_of_range if the
+    // requested range doesn't fit inside it
+    ByteSlice(std::shared_ptr<const ByteChunk> chunk, std::int32_t offset, std::int32_t len) {
+        if (offset < 0 || len < 0 || offset > chunk->size() || len > chunk->size() - offset)
+            throw std::out_of_range{"byte slice out of range"};
+        data_ = chunk->data() + offset;
+        size_ = len;
+        owner_ = std::move(chunk);
+    }
+
+    // Make a slice covering the whole of a chunk, taking ownership of it
+    static ByteSlice Of(ByteChunk&& chunk) {
+        return ByteSlice{std::make_shared<const ByteChunk>(std::move(chunk))};
+    }
+
+    // Get a narrower slice sharing the same storage; throws out_of_range if
+    // the requested range doesn't fit inside this one
+    ByteSlice Sub(std::int32_t offset, std::int32_t len) const {
+        if (offset < 0 || len < 0 || offset > size_ || len > size_ - offset)
+            throw std::out_of_range{"byte slice out of range"};
+        return ByteSlice{owner_, data_ + offset, len};
+    }
+
+    const std::uint8_t* data() const { return data_; }
+    operator const std::uint8_t*() const { return data_; }
+    std::int32_t size() const { return size_; }
+    const std::uint8_t* begin() const { return data_; }
+    const std::uint8_t* end() const { return data_ + size_; }
+
+   private:
+    ByteSlice(std::shared_ptr<const ByteChunk> owner, const std::uint8_t* data, std::int32_t len)
+        : data_{data}, size_{len}, owner_{std::move(owner)} {}
+
+    const std::uint8_t* data_{nullptr};
+    std::int32_t size_{0};
+    std::shared_ptr<const ByteChunk> owner_;
+};
+
 }  // namespace winrt::blurt
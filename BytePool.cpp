@@ -0,0 +1,72 @@
+#include "pch.h"
+
+#include "BytePool.h"
+
+namespace winrt::blurt {
+
+namespace {
+std::size_t ClassIndexFor(std::size_t size) {
+    std::size_t idx{0};
+    while ((BytePool::kMinBlockSize << idx) < size) idx++;
+    return idx;
+}
+}  // namespace
+
+BytePool& BytePool::Default() {
+    static BytePool* pool = new BytePool{};
+    return *pool;
+}
+
+BytePool::BytePool(std::size_t max_free_per_class) : max_free_per_class_{max_free_per_class} {
+    // Reserve the free lists now so that releasing a block never allocates
+    for (auto& c : classes_) c.free.reserve(max_free_per_class_);
+}
+
+BytePool::~BytePool() {
+    for (auto& c : classes_) {
+        for (auto* p : c.free) delete[] p;
+    }
+}
+
+BytePool::Block BytePool::Acquire(std::size_t size) {
+    if (size > kMaxBlockSize) return Block{nullptr, new std::uint8_t[size], 0};
+
+    auto idx = ClassIndexFor(size);
+    auto& c = classes_[idx];
+    {
+        std::lock_guard lock{c.mutex};
+        if (!c.free.empty()) {
+            auto* p = c.free.back();
+            c.free.pop_back();
+            c.hits.fetch_add(1, std::memory_order_relaxed);
+            return Block{this, p, idx};
+        }
+    }
+    c.misses.fetch_add(1, std::memory_order_relaxed);
+    return Block{this, new std::uint8_t[BlockSizeOf(idx)], idx};
+}
+
+void BytePool::Release(std::uint8_t* data, std::size_t class_idx) {
+    auto& c = classes_[class_idx];
+    {
+        std::lock_guard lock{c.mutex};
+        if (c.free.size() < max_free_per_class_) {
+            c.free.push_back(data);
+            return;
+        }
+    }
+    delete[] data;
+}
+
+std::array<BytePool::ClassStats, BytePool::kNumClasses> BytePool::Stats() const {
+    std::array<ClassStats, kNumClasses> result;
+    for (std::size_t i = 0; i < kNumClasses; i++) {
+        const auto& c = classes_[i];
+        std::lock_guard lock{c.mutex};
+        result[i] = {BlockSizeOf(i), c.hits.load(std::memory_order_relaxed),
+                     c.misses.load(std::memory_order_relaxed), c.free.size()};
+    }
+    return result;
+}
+
+}  // namespace winrt::blurt
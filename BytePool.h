@@ -0,0 +1,103 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace winrt::blurt {
+
+// A recycling allocator for byte buffers, used to keep the steady stream of
+// network messages from hitting the heap on every send and receive.
+//
+// Requests are rounded up to one of a fixed set of power-of-two size
+// classes, from kMinBlockSize to kMaxBlockSize. When a block is released it
+// goes on its class's free list (up to a cap, past which it's really freed)
+// and is handed out again by the next request in that class. Requests
+// bigger than kMaxBlockSize go straight to the heap every time.
+//
+// All methods are thread-safe.
+class BytePool {
+   public:
+    static constexpr std::size_t kMinBlockSize = 64;
+    static constexpr std::size_t kMaxBlockSize = 64 * 1024;
+    static constexpr std::size_t kNumClasses = 11;  // 64 B, 128 B, ..., 64 KiB
+
+    struct ClassStats {
+        std::size_t block_size;
+        std::uint64_t hits;    // requests served from the free list
+        std::uint64_t misses;  // requests that had to go to the heap
+        std::size_t free_blocks;
+    };
+
+    // An owned block of pool memory, returned to the pool on destruction
+    class Block {
+       public:
+        Block() = default;
+        Block(Block&& other) noexcept { *this = std::move(other); }
+        Block& operator=(Block&& other) noexcept {
+            std::swap(pool_, other.pool_);
+            std::swap(data_, other.data_);
+            std::swap(class_idx_, other.class_idx_);
+            return *this;
+        }
+        ~Block() {
+            if (data_ == nullptr) return;
+            if (pool_ != nullptr) {
+                pool_->Release(data_, class_idx_);
+            } else {
+                delete[] data_;
+            }
+        }
+
+        std::uint8_t* data() const { return data_; }
+
+        Block(const Block&) = delete;
+        Block& operator=(const Block&) = delete;
+
+       private:
+        friend class BytePool;
+        Block(BytePool* pool, std::uint8_t* data, std::size_t class_idx)
+            : pool_{pool}, data_{data}, class_idx_{class_idx} {}
+
+        BytePool* pool_{nullptr};  // null for oversized, heap-only blocks
+        std::uint8_t* data_{nullptr};
+        std::size_t class_idx_{0};
+    };
+
+    // The process-wide pool. It's never destroyed, so blocks released
+    // during static destruction are still safe.
+    static BytePool& Default();
+
+    // Create a pool that keeps at most the given number of free blocks
+    // around in each size class
+    explicit BytePool(std::size_t max_free_per_class = 256);
+    ~BytePool();
+
+    // Get a block of at least the given size; contents are uninitialized
+    Block Acquire(std::size_t size);
+
+    // Get a snapshot of hit and miss counts for every size class
+    std::array<ClassStats, kNumClasses> Stats() const;
+
+    BytePool(const BytePool&) = delete;
+    BytePool& operator=(const BytePool&) = delete;
+
+   private:
+    struct SizeClass {
+        mutable std::mutex mutex;
+        std::vector<std::uint8_t*> free;  // capacity reserved up front
+        std::atomic<std::uint64_t> hits{0}, misses{0};
+    };
+
+    static std::size_t BlockSizeOf(std::size_t class_idx) { return kMinBlockSize << class_idx; }
+    void Release(std::uint8_t* data, std::size_t class_idx);
+
+    const std::size_t max_free_per_class_;
+    std::array<SizeClass, kNumClasses> classes_;
+};
+
+}  // namespace winrt::blurt
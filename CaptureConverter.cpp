@@ -0,0 +1,141 @@
+#include "pch.h"
+
+#include "CaptureConverter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <numeric>
+#include "MixKernels.h"
+
+namespace winrt::blurt::audio::implementation {
+
+namespace {
+// Filter length per output sample, when not downsampling. With the window
+// below that's a transition band about a tenth of the input rate wide, and
+// stopband attenuation around 70 dB.
+constexpr std::int32_t kTapsPerPhase = 48;
+constexpr double kKaiserBeta = 7.0;
+// Where the cutoff sits, as a share of the lower Nyquist rate; the middle
+// of the transition band
+constexpr double kRolloff = 0.9;
+// Device rates are all small multiples of one another; a ratio that needs
+// more phases than this is a mistake somewhere
+constexpr std::int32_t kMaxPhases = 1024;
+
+constexpr double kPi = 3.14159265358979323846;
+
+// The zeroth-order modified Bessel function of the first kind, which the
+// Kaiser window is made of
+double BesselI0(double x) {
+    double sum = 1, term = 1;
+    for (int k = 1; k < 50 && term > sum * 1e-12; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+}  // namespace
+
+CaptureConverter::CaptureConverter(std::uint32_t input_rate, std::uint32_t input_channels,
+                                   AudioSetup output_setup)
+    : input_channels_{static_cast<std::int32_t>(input_channels)} {
+    if (output_setup.NumChannels() != 1) throw std::exception{"capture output must be mono"};
+    std::uint32_t output_rate = output_setup.SamplesPerChannelPerSecond();
+    if (input_rate == 0 || input_channels == 0) throw std::exception{"bad capture format"};
+    auto divisor = std::gcd(input_rate, output_rate);
+    if (output_rate / divisor > kMaxPhases || input_rate / divisor > kMaxPhases)
+        throw std::exception{"unsupported capture sample rate"};
+    up_ = static_cast<std::int32_t>(output_rate / divisor);
+    down_ = static_cast<std::int32_t>(input_rate / divisor);
+    if (IsPassthrough()) return;
+
+    // Downsampling narrows the passband relative to the input, so the filter
+    // needs proportionally more input samples for the same sharpness
+    taps_per_phase_ = kTapsPerPhase;
+    if (down_ > up_) taps_per_phase_ = (kTapsPerPhase * down_ + up_ - 1) / up_;
+
+    // The prototype runs at up_ times the input rate; its cutoff is the lower
+    // of the two Nyquist rates, in cycles per prototype sample
+    const std::int32_t length = taps_per_phase_ * up_;
+    const double cutoff = kRolloff * 0.5 / std::max(up_, down_);
+    const double center = (length - 1) / 2.0;
+    const double window_scale = 1 / BesselI0(kKaiserBeta);
+    std::vector<double> prototype(length);
+    for (std::int32_t n = 0; n < length; n++) {
+        double t = n - center;
+        double sinc = t == 0 ? 1 : std::sin(2 * kPi * cutoff * t) / (2 * kPi * cutoff * t);
+        double r = t / center;
+        double window = BesselI0(kKaiserBeta * std::sqrt(1 - r * r)) * window_scale;
+        prototype[n] = sinc * window;
+    }
+
+    // Phase p takes taps p, p + up_, p + 2 * up_ and so on. Each phase is
+    // scaled to sum to one on its own, so a constant input comes out
+    // constant rather than with a faint ripple at the phase rate.
+    coefficients_.resize(length);
+    for (std::int32_t p = 0; p < up_; p++) {
+        double sum = 0;
+        for (std::int32_t k = 0; k < taps_per_phase_; k++) sum += prototype[k * up_ + p];
+        float* phase = coefficients_.data() + p * taps_per_phase_;
+        for (std::int32_t k = 0; k < taps_per_phase_; k++)
+            phase[taps_per_phase_ - 1 - k] = static_cast<float>(prototype[k * up_ + p] / sum);
+    }
+
+    history_.assign(taps_per_phase_ - 1, 0.0f);
+    next_input_ = taps_per_phase_ - 1;
+}
+
+const std::vector<float>& CaptureConverter::Convert(const float* in, std::int32_t frames) {
+    Downmix(in, frames);
+    Resample();
+    return output_;
+}
+
+const std::vector<float>& CaptureConverter::Convert(const std::int16_t* in, std::int32_t frames) {
+    widened_.resize(static_cast<std::size_t>(frames) * input_channels_);
+    Int16ToFloat(in, widened_.data(), static_cast<std::int32_t>(widened_.size()));
+    return Convert(widened_.data(), frames);
+}
+
+void CaptureConverter::Downmix(const float* in, std::int32_t frames) {
+    auto& dest = IsPassthrough() ? output_ : mono_;
+    dest.resize(frames);
+    if (input_channels_ == 1) {
+        std::copy(in, in + frames, dest.begin());
+    } else if (input_channels_ == 2) {
+        DownmixStereo(in, dest.data(), frames);
+    } else {
+        const float scale = 1.0f / input_channels_;
+        for (std::int32_t i = 0; i < frames; i++) {
+            const float* frame = in + static_cast<std::size_t>(i) * input_channels_;
+            float sum = 0;
+            for (std::int32_t c = 0; c < input_channels_; c++) sum += frame[c];
+            dest[i] = sum * scale;
+        }
+    }
+}
+
+void CaptureConverter::Resample() {
+    if (IsPassthrough()) return;
+    history_.insert(history_.end(), mono_.begin(), mono_.end());
+    const auto available = static_cast<std::int32_t>(history_.size());
+
+    output_.clear();
+    output_.reserve(static_cast<std::size_t>(mono_.size()) * up_ / down_ + 1);
+    while (next_input_ < available) {
+        const float* window = history_.data() + next_input_ - (taps_per_phase_ - 1);
+        const float* phase = coefficients_.data() + next_phase_ * taps_per_phase_;
+        output_.push_back(DotProduct(phase, window, taps_per_phase_));
+        next_phase_ += down_;
+        next_input_ += next_phase_ / up_;
+        next_phase_ %= up_;
+    }
+
+    // Keep only what the next output sample's window reaches back to
+    auto consumed = std::min(next_input_ - (taps_per_phase_ - 1), available);
+    history_.erase(history_.begin(), history_.begin() + consumed);
+    next_input_ -= consumed;
+}
+
+}  // namespace winrt::blurt::audio::implementation
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "AudioParams.h"
+
+namespace winrt::blurt::audio::implementation {
+
+// Turns audio as the capture device delivers it into what the encoder
+// wants: interleaved float or 16-bit samples, any number of channels, at
+// whatever rate the device runs, in; mono float at the encoder's rate, out.
+//
+// Channels are averaged down to one first, so the resampler only has to run
+// once. Resampling is polyphase, with a Kaiser-windowed sinc filter that
+// passes the bottom 90% or so of the lower of the two Nyquist rates. The
+// filter keeps its history from call to call, so it can be fed device
+// buffers of any size without clicks at the seams.
+//
+// It's not thread-safe; it lives on the encoder worker's thread, which
+// converts the audio the capture thread queues for it.
+class CaptureConverter {
+   public:
+    // Throws std::exception if the output isn't mono, or if the two rates
+    // don't have a small enough ratio to make a sensible filter from
+    CaptureConverter(std::uint32_t input_rate, std::uint32_t input_channels,
+                     AudioSetup output_setup);
+
+    // Convert a buffer of interleaved input frames. The result is good until
+    // the next call.
+    const std::vector<float>& Convert(const float* in, std::int32_t frames);
+    const std::vector<float>& Convert(const std::int16_t* in, std::int32_t frames);
+
+    // Whether the rates match, so nothing is resampled
+    bool IsPassthrough() const { return up_ == 1 && down_ == 1; }
+
+   private:
+    // Downmix into mono_, then resample into output_
+    void Downmix(const float* in, std::int32_t frames);
+    void Resample();
+
+    const std::int32_t input_channels_;
+    // The output rate is the input rate times up_ over down_
+    std::int32_t up_{1};
+    std::int32_t down_{1};
+    std::int32_t taps_per_phase_{0};
+    // up_ filter phases, each taps_per_phase_ long and stored back to
+    // front, so each output sample is a plain dot product with the input
+    std::vector<float> coefficients_;
+
+    std::vector<float> widened_;
+    std::vector<float> mono_;
+    // Mono input still needed by the filter; the first taps_per_phase_ - 1
+    // samples are left over from the last call
+    std::vector<float> history_;
+    // Where in history_ the next output sample's newest input is, and which
+    // filter phase makes it
+    std::int32_t next_input_{0};
+    std::int32_t next_phase_{0};
+    std::vector<float> output_;
+};
+
+}  // namespace winrt::blurt::audio::implementation
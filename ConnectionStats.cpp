@@ -0,0 +1,143 @@
+#include "pch.h"
+
+#include "ConnectionStats.h"
+
+#include <algorithm>
+
+namespace winrt::blurt::mumble::implementation {
+
+namespace {
+// A jump in sequence of more packets than this (about a second of audio) is
+// taken to be the speaker starting over, not that many packets lost
+constexpr std::uint64_t kMaxLossRun = 50;
+// How many times running a larger step between packets has to come up
+// before it's taken to be the speaker's frames getting longer
+constexpr std::uint32_t kStepChangeRun = 3;
+}  // namespace
+
+std::uint64_t ConnectionStats::PingTimestamp(Clock::time_point now) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+}
+
+void ConnectionStats::OnTcpPingReply(std::uint64_t timestamp, Clock::time_point now) {
+    auto received = PingTimestamp(now);
+    if (timestamp > received) return;  // not one of ours
+    double rtt = (received - timestamp) / 1000.0;
+    std::lock_guard lock{mutex_};
+    AddSample(tcp_, rtt);
+}
+
+void ConnectionStats::OnUdpPingReply(std::uint64_t timestamp, Clock::time_point now) {
+    auto received = PingTimestamp(now);
+    if (timestamp > received) return;  // not one of ours
+    double rtt = (received - timestamp) / 1000.0;
+    std::lock_guard lock{mutex_};
+    AddSample(udp_, rtt);
+}
+
+void ConnectionStats::AddSample(RttStats& stats, double sample) {
+    // Welford's method, which doesn't lose precision as the count grows
+    stats.count++;
+    double delta = sample - stats.mean;
+    stats.mean += delta / stats.count;
+    double m2 = stats.variance * (stats.count - 1) + delta * (sample - stats.mean);
+    stats.variance = m2 / stats.count;
+}
+
+void ConnectionStats::OnVoicePacket(std::uint32_t session, std::uint64_t seq,
+                                    bool is_terminator) {
+    std::lock_guard lock{mutex_};
+    auto& stream = streams_[session];
+
+    if (stream.after_terminator) {
+        stream.highest_seq = seq;
+        stream.seen = 1;
+    } else if (seq > stream.highest_seq) {
+        std::uint64_t delta = seq - stream.highest_seq;
+        if (stream.step == 0 || delta < stream.step) {
+            stream.step = delta;
+        } else if (delta > stream.step) {
+            if (delta != stream.longer_step) {
+                stream.longer_step = delta;
+                stream.longer_step_run = 0;
+                stream.longer_step_lost = 0;
+            }
+            if (++stream.longer_step_run == kStepChangeRun) {
+                // The speaker switched to longer frames; nothing was lost
+                CountLost(stream, -static_cast<std::int64_t>(stream.longer_step_lost));
+                stream.step = delta;
+            } else if (std::uint64_t missing = delta / stream.step - 1; missing <= kMaxLossRun) {
+                CountLost(stream, static_cast<std::int64_t>(missing));
+                stream.longer_step_lost += static_cast<std::uint32_t>(missing);
+            }
+        }
+        if (delta == stream.step) {
+            stream.longer_step = 0;
+            stream.longer_step_run = 0;
+            stream.longer_step_lost = 0;
+        }
+        stream.highest_seq = seq;
+        stream.seen = (delta < 64 ? stream.seen << delta : 0) | 1;
+    } else if (std::uint64_t age = stream.highest_seq - seq;
+               age < 64 && (stream.seen & (std::uint64_t{1} << age))) {
+        return;  // a repeat
+    } else if (stream.step != 0 && age / stream.step > kMaxLossRun) {
+        // Far too old to be late; the speaker must have started over
+        stream.highest_seq = seq;
+        stream.seen = 1;
+    } else {
+        // A late packet fills a gap that was counted as lost
+        if (age < 64) stream.seen |= std::uint64_t{1} << age;
+        stream.stats.late++;
+        voice_.late++;
+        CountLost(stream, -1);
+        if (stream.longer_step_lost > 0) stream.longer_step_lost--;
+    }
+    if (seq >= stream.highest_seq) stream.after_terminator = is_terminator;
+    stream.stats.received++;
+    voice_.received++;
+}
+
+void ConnectionStats::CountLost(Stream& stream, std::int64_t lost) {
+    // Taking back more than was counted can't make the counts negative
+    auto taken = static_cast<std::uint32_t>(
+        std::max<std::int64_t>(lost, -static_cast<std::int64_t>(stream.stats.lost)));
+    stream.stats.lost += taken;
+    voice_.lost += taken;
+}
+
+void ConnectionStats::ForgetSpeaker(std::uint32_t session) {
+    std::lock_guard lock{mutex_};
+    streams_.erase(session);
+}
+
+ConnectionStats::Snapshot ConnectionStats::TakeSnapshot() const {
+    std::lock_guard lock{mutex_};
+    return Snapshot{tcp_, udp_, voice_};
+}
+
+std::optional<ConnectionStats::StreamStats> ConnectionStats::Speaker(
+    std::uint32_t session) const {
+    std::lock_guard lock{mutex_};
+    auto it = streams_.find(session);
+    if (it == streams_.end()) return std::nullopt;
+    return it->second.stats;
+}
+
+void ConnectionStats::FillPing(MumbleProto::Ping& ping,
+                               const CryptState::Counters& udp_counters) const {
+    ping.set_good(udp_counters.good);
+    ping.set_late(udp_counters.late);
+    ping.set_lost(udp_counters.lost);
+    ping.set_resync(udp_counters.resync);
+
+    std::lock_guard lock{mutex_};
+    ping.set_udp_packets(udp_.count);
+    ping.set_tcp_packets(tcp_.count);
+    ping.set_udp_ping_avg(static_cast<float>(udp_.mean));
+    ping.set_udp_ping_var(static_cast<float>(udp_.variance));
+    ping.set_tcp_ping_avg(static_cast<float>(tcp_.mean));
+    ping.set_tcp_ping_var(static_cast<float>(tcp_.variance));
+}
+
+}  // namespace winrt::blurt::mumble::implementation
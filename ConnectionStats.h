@@ -0,0 +1,108 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include "CryptState.h"
+#include "Mumble.pb.h"
+
+namespace winrt::blurt::mumble::implementation {
+
+// Keeps the numbers Mumble's Ping message reports about a connection, and
+// makes them available to anything else that wants to adapt to the link.
+//
+// Round trip times come from ping replies, over the control channel and
+// over UDP separately, and are kept as a running mean and variance over
+// the whole connection, the way Mumble's own client does it. Incoming voice
+// is followed per speaker by frame sequence number, which gives counts of
+// frames lost and frames arriving late for each.
+//
+// Everything here is thread-safe. TakeSnapshot() makes a small copy under
+// a lock, so it's cheap enough to call for every audio frame.
+class ConnectionStats {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    struct RttStats {
+        std::uint32_t count{0};
+        // In milliseconds, and milliseconds squared
+        double mean{0};
+        double variance{0};
+    };
+
+    // Voice from one speaker, in packets
+    struct StreamStats {
+        std::uint32_t received{0};
+        std::uint32_t late{0};
+        std::uint32_t lost{0};
+
+        // Share of packets that never came, from 0 to 1
+        double LossRate() const {
+            auto expected = received + lost;
+            return expected == 0 ? 0 : static_cast<double>(lost) / expected;
+        }
+    };
+
+    struct Snapshot {
+        RttStats tcp;
+        RttStats udp;
+        // Across every speaker
+        StreamStats voice;
+    };
+
+    // The opaque timestamp to put in an outgoing ping; the server sends it
+    // back as-is
+    static std::uint64_t PingTimestamp(Clock::time_point now = Clock::now());
+
+    // Note a ping reply carrying a timestamp from PingTimestamp()
+    void OnTcpPingReply(std::uint64_t timestamp, Clock::time_point now = Clock::now());
+    void OnUdpPingReply(std::uint64_t timestamp, Clock::time_point now = Clock::now());
+
+    // Note an incoming voice packet from the given speaker
+    void OnVoicePacket(std::uint32_t session, std::uint64_t seq, bool is_terminator);
+    // Stop following a speaker, who has left
+    void ForgetSpeaker(std::uint32_t session);
+
+    Snapshot TakeSnapshot() const;
+    std::optional<StreamStats> Speaker(std::uint32_t session) const;
+
+    // Fill in the statistics fields of a ping to the server, given the UDP
+    // decryption counts
+    void FillPing(MumbleProto::Ping& ping, const CryptState::Counters& udp_counters) const;
+
+   private:
+    struct Stream {
+        StreamStats stats;
+        // The highest sequence number seen, and the step between consecutive
+        // packets, which is how many frames each holds. The step drops at
+        // once to any smaller one seen; a larger one looks just like loss,
+        // so it's only believed after it's come up several times running.
+        std::uint64_t highest_seq{0};
+        std::uint64_t step{0};
+        // A larger step seen lately, how many times running, and how many
+        // packets those times counted as lost, to take back if it sticks
+        std::uint64_t longer_step{0};
+        std::uint32_t longer_step_run{0};
+        std::uint32_t longer_step_lost{0};
+        // Bit i is set if highest_seq - i has been seen, to tell repeats
+        // from late arrivals
+        std::uint64_t seen{0};
+        // A jump in sequence after a terminator is silence, not loss; so is
+        // the start of the stream
+        bool after_terminator{true};
+    };
+
+    static void AddSample(RttStats& stats, double sample);
+    // Add to (or, if negative, take away from) the lost count; needs mutex_ held
+    void CountLost(Stream& stream, std::int64_t lost);
+
+    mutable std::mutex mutex_;
+    _Guarded_by_(mutex_) RttStats tcp_;
+    _Guarded_by_(mutex_) RttStats udp_;
+    _Guarded_by_(mutex_) StreamStats voice_;
+    _Guarded_by_(mutex_) std::unordered_map<std::uint32_t, Stream> streams_;
+};
+
+}  // namespace winrt::blurt::mumble::implementation
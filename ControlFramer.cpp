@@ -0,0 +1,82 @@
+#include "pch.h"
+
+#include "ControlFramer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+
+namespace winrt::blurt::mumble::implementation {
+
+namespace {
+// Whether nobody else holds a slice of the block, so it can be written over.
+// The fence orders our writes after whatever the last other holder did
+// before letting go of it.
+bool IsUnshared(const std::shared_ptr<ByteChunk>& block) {
+    if (block.use_count() != 1) return false;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return true;
+}
+}  // namespace
+
+std::uint8_t* ControlFramer::PrepareInput(std::size_t min_size) {
+    const std::size_t pending = end_ - begin_;
+    if (block_ && pending == 0 && IsUnshared(block_)) begin_ = end_ = 0;
+    if (InputCapacity() >= min_size) return block_->data() + end_;
+
+    // Move the partial message to the front of a block with room: this one,
+    // if it's big enough and nobody is still using it, or else another
+    if (block_ && IsUnshared(block_) &&
+        static_cast<std::size_t>(block_->size()) >= pending + min_size) {
+        std::memmove(block_->data(), block_->data() + begin_, pending);
+    } else {
+        auto next = FreeBlock(pending + min_size);
+        if (pending > 0) std::memcpy(next->data(), block_->data() + begin_, pending);
+        if (block_ && static_cast<std::size_t>(block_->size()) == kBlockSize &&
+            spares_.size() < kMaxSpareBlocks)
+            spares_.push_back(std::move(block_));
+        block_ = std::move(next);
+    }
+    begin_ = 0;
+    end_ = pending;
+    return block_->data() + end_;
+}
+
+std::shared_ptr<ByteChunk> ControlFramer::FreeBlock(std::size_t size) {
+    if (size <= kBlockSize) {
+        for (auto it = spares_.begin(); it != spares_.end(); ++it) {
+            if (!IsUnshared(*it)) continue;
+            auto block = std::move(*it);
+            spares_.erase(it);
+            return block;
+        }
+    }
+    return std::make_shared<ByteChunk>(ByteChunk::Allocate(std::max(size, kBlockSize)));
+}
+
+std::uint32_t ControlFramer::PeekPayloadSize() const {
+    const std::uint8_t* p = block_->data() + begin_;
+    return (std::uint32_t{p[2]} << 24) | (std::uint32_t{p[3]} << 16) |
+           (std::uint32_t{p[4]} << 8) | std::uint32_t{p[5]};
+}
+
+bool ControlFramer::HasFrame() const {
+    return end_ - begin_ >= kHeaderSize && end_ - begin_ >= kHeaderSize + PeekPayloadSize();
+}
+
+bool ControlFramer::NextFrame(Frame& frame) {
+    if (end_ - begin_ < kHeaderSize) return false;
+    const auto size = PeekPayloadSize();
+    if (size > max_payload_size_) throw std::exception{"control message too long"};
+    if (end_ - begin_ < kHeaderSize + size) return false;
+
+    const std::uint8_t* p = block_->data() + begin_;
+    frame.type = static_cast<std::uint16_t>((p[0] << 8) | p[1]);
+    frame.payload = ByteSlice{block_, static_cast<std::int32_t>(begin_ + kHeaderSize),
+                              static_cast<std::int32_t>(size)};
+    begin_ += kHeaderSize + size;
+    return true;
+}
+
+}  // namespace winrt::blurt::mumble::implementation
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "ByteChunk.h"
+#include "BytePool.h"
+
+namespace winrt::blurt::mumble::implementation {
+
+// Splits the Mumble control stream into messages: each one is a 16-bit
+// big-endian type, a 32-bit big-endian payload length, and then the
+// payload.
+//
+// Bytes go in however they arrive off the socket, in as big a read as the
+// caller likes, and every message they complete comes back out without
+// another read. Input goes into big blocks of pooled storage, and each
+// message's payload is a slice of the block it arrived in, so passing a
+// message on never copies it. A block isn't written over while any slice of
+// it is still alive; the framer keeps a few spare blocks to carry on with
+// in the meantime, so steady traffic doesn't touch the heap. Nothing here
+// knows about sockets or WinRT.
+class ControlFramer {
+   public:
+    static constexpr std::size_t kHeaderSize = 6;
+    // Mumble's own server refuses messages bigger than this
+    static constexpr std::uint32_t kDefaultMaxPayloadSize = 0x7fffff;
+    // The size of an input block; a message too big for one gets a bigger
+    // block of its own
+    static constexpr std::size_t kBlockSize = BytePool::kMaxBlockSize;
+
+    explicit ControlFramer(std::uint32_t max_payload_size = kDefaultMaxPayloadSize)
+        : max_payload_size_{max_payload_size} {
+        spares_.reserve(kMaxSpareBlocks);
+    }
+
+    // One message. The payload shares the block it was read into, which
+    // stays put for as long as the slice (or any copy of it) is alive.
+    struct Frame {
+        std::uint16_t type;
+        ByteSlice payload;
+    };
+
+    // Make room for at least min_size more bytes of input, and return where
+    // they should go; the room available is InputCapacity()
+    std::uint8_t* PrepareInput(std::size_t min_size);
+    std::size_t InputCapacity() const {
+        return block_ ? static_cast<std::size_t>(block_->size()) - end_ : 0;
+    }
+
+    // Add n bytes, just written where PrepareInput() said, to the input
+    void CommitInput(std::size_t n) { end_ += n; }
+
+    // Take the next complete message, if the input has one. Throws
+    // std::exception if a message claims to be longer than the limit; the
+    // stream can't be trusted after that.
+    bool NextFrame(Frame& frame);
+
+    // Whether NextFrame() would return a message right now
+    bool HasFrame() const;
+
+    // How many input bytes are waiting for the rest of their message
+    std::size_t BufferedSize() const { return end_ - begin_; }
+
+   private:
+    // Spare blocks kept for when the current one is still in use
+    static constexpr std::size_t kMaxSpareBlocks = 4;
+
+    // The length in the message header at the front of the input, which
+    // must hold at least a whole header
+    std::uint32_t PeekPayloadSize() const;
+
+    // Get a block nobody else is using with room for at least size bytes: a
+    // spare, if one's free, or else a new one
+    std::shared_ptr<ByteChunk> FreeBlock(std::size_t size);
+
+    const std::uint32_t max_payload_size_;
+    std::shared_ptr<ByteChunk> block_;
+    // Blocks given up on while still in use, to switch to once they're not;
+    // capacity reserved up front
+    std::vector<std::shared_ptr<ByteChunk>> spares_;
+    // Unconsumed input is block_[begin_, end_)
+    std::size_t begin_{0};
+    std::size_t end_{0};
+};
+
+}  // namespace winrt::blurt::mumble::implementation
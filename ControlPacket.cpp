@@ -5,7 +5,6 @@
 #include <limits>
 #include <map>
 #include <sstream>
-#include "google/protobuf/dynamic_message.h"
 
 namespace winrt::blurt::mumble::implementation {
 
@@ -50,40 +49,74 @@ const std::string ToString(ControlPacketType t) {
     return it->second;
 }
 
-std::string ControlPacket::DebugString() const {
-    static std::map<ControlPacketType, const google::protobuf::Descriptor*> m{
-        {ControlPacketType::Version, MumbleProto::Version::GetDescriptor()},
+ControlPacket ControlPacket::FromProto(ControlPacketType t,
+                                       const google::protobuf::MessageLite& proto) {
+    auto msg = ByteChunk::Allocate(proto.ByteSizeLong());
+    // ByteSizeLong() just cached the sizes, so this skips recomputing them
+    proto.SerializeWithCachedSizesToArray(msg.data());
+    return ControlPacket{t, std::move(msg)};
+}
+
+namespace {
+// The generated message for each control packet type, or nullptr for
+// UDPTunnel, which isn't a protobuf message
+const google::protobuf::Message* PrototypeOf(ControlPacketType t) {
+    static std::map<ControlPacketType, const google::protobuf::Message*> m{
+        {ControlPacketType::Version, &MumbleProto::Version::default_instance()},
         {ControlPacketType::UDPTunnel, nullptr},  // special non-protobuf message type
-        {ControlPacketType::Authenticate, MumbleProto::Authenticate::GetDescriptor()},
-        {ControlPacketType::Ping, MumbleProto::Ping::GetDescriptor()},
-        {ControlPacketType::Reject, MumbleProto::Reject::GetDescriptor()},
-        {ControlPacketType::ServerSync, MumbleProto::ServerSync::GetDescriptor()},
-        {ControlPacketType::ChannelRemove, MumbleProto::ChannelRemove::GetDescriptor()},
-        {ControlPacketType::ChannelState, MumbleProto::ChannelState::GetDescriptor()},
-        {ControlPacketType::UserRemove, MumbleProto::UserRemove::GetDescriptor()},
-        {ControlPacketType::UserState, MumbleProto::UserState::GetDescriptor()},
-        {ControlPacketType::BanList, MumbleProto::BanList::GetDescriptor()},
-        {ControlPacketType::TextMessage, MumbleProto::TextMessage::GetDescriptor()},
-        {ControlPacketType::PermissionDenied, MumbleProto::PermissionDenied::GetDescriptor()},
-        {ControlPacketType::ACL, MumbleProto::ACL::GetDescriptor()},
-        {ControlPacketType::QueryUsers, MumbleProto::QueryUsers::GetDescriptor()},
-        {ControlPacketType::CryptSetup, MumbleProto::CryptSetup::GetDescriptor()},
-        {ControlPacketType::ContextActionModify, MumbleProto::ContextActionModify::GetDescriptor()},
-        {ControlPacketType::ContextAction, MumbleProto::ContextAction::GetDescriptor()},
-        {ControlPacketType::UserList, MumbleProto::UserList::GetDescriptor()},
-        {ControlPacketType::VoiceTarget, MumbleProto::VoiceTarget::GetDescriptor()},
-        {ControlPacketType::PermissionQuery, MumbleProto::PermissionQuery::GetDescriptor()},
-        {ControlPacketType::CodecVersion, MumbleProto::CodecVersion::GetDescriptor()},
-        {ControlPacketType::UserStats, MumbleProto::UserStats::GetDescriptor()},
-        {ControlPacketType::RequestBlob, MumbleProto::RequestBlob::GetDescriptor()},
-        {ControlPacketType::ServerConfig, MumbleProto::ServerConfig::GetDescriptor()},
-        {ControlPacketType::SuggestConfig, MumbleProto::SuggestConfig::GetDescriptor()},
+        {ControlPacketType::Authenticate, &MumbleProto::Authenticate::default_instance()},
+        {ControlPacketType::Ping, &MumbleProto::Ping::default_instance()},
+        {ControlPacketType::Reject, &MumbleProto::Reject::default_instance()},
+        {ControlPacketType::ServerSync, &MumbleProto::ServerSync::default_instance()},
+        {ControlPacketType::ChannelRemove, &MumbleProto::ChannelRemove::default_instance()},
+        {ControlPacketType::ChannelState, &MumbleProto::ChannelState::default_instance()},
+        {ControlPacketType::UserRemove, &MumbleProto::UserRemove::default_instance()},
+        {ControlPacketType::UserState, &MumbleProto::UserState::default_instance()},
+        {ControlPacketType::BanList, &MumbleProto::BanList::default_instance()},
+        {ControlPacketType::TextMessage, &MumbleProto::TextMessage::default_instance()},
+        {ControlPacketType::PermissionDenied,
+         &MumbleProto::PermissionDenied::default_instance()},
+        {ControlPacketType::ACL, &MumbleProto::ACL::default_instance()},
+        {ControlPacketType::QueryUsers, &MumbleProto::QueryUsers::default_instance()},
+        {ControlPacketType::CryptSetup, &MumbleProto::CryptSetup::default_instance()},
+        {ControlPacketType::ContextActionModify,
+         &MumbleProto::ContextActionModify::default_instance()},
+        {ControlPacketType::ContextAction, &MumbleProto::ContextAction::default_instance()},
+        {ControlPacketType::UserList, &MumbleProto::UserList::default_instance()},
+        {ControlPacketType::VoiceTarget, &MumbleProto::VoiceTarget::default_instance()},
+        {ControlPacketType::PermissionQuery, &MumbleProto::PermissionQuery::default_instance()},
+        {ControlPacketType::CodecVersion, &MumbleProto::CodecVersion::default_instance()},
+        {ControlPacketType::UserStats, &MumbleProto::UserStats::default_instance()},
+        {ControlPacketType::RequestBlob, &MumbleProto::RequestBlob::default_instance()},
+        {ControlPacketType::ServerConfig, &MumbleProto::ServerConfig::default_instance()},
+        {ControlPacketType::SuggestConfig, &MumbleProto::SuggestConfig::default_instance()},
         {ControlPacketType::PluginDataTransmission,
-         MumbleProto::PluginDataTransmission::GetDescriptor()},
+         &MumbleProto::PluginDataTransmission::default_instance()},
     };
-    auto it = m.find(type_);
+    auto it = m.find(t);
     assert(it != m.end());
+    return it->second;
+}
+}  // namespace
 
+const google::protobuf::Message& ControlPacket::Parsed() const {
+    if (parsed_) return *parsed_;
+    if (parse_failed_) throw PacketParseError("invalid protobuf message");
+
+    const auto* prototype = PrototypeOf(type_);
+    if (prototype == nullptr) throw std::invalid_argument("not a protobuf control packet");
+    // New() on a generated message's prototype makes another of the same
+    // generated type, so ResolveProto() can downcast it
+    std::unique_ptr<google::protobuf::Message, ProtoDeleter> msg{prototype->New(arena_)};
+    if (!msg->ParseFromArray(msg_, msg_.size())) {
+        parse_failed_ = true;
+        throw PacketParseError("invalid protobuf message");
+    }
+    parsed_ = std::move(msg);
+    return *parsed_;
+}
+
+std::string ControlPacket::DebugString() const {
     std::stringstream result;
     result << ToString(type_) << ": ";
 
@@ -92,13 +125,9 @@ std::string ControlPacket::DebugString() const {
         return result.str();
     }
 
-    assert(it->second);
-    google::protobuf::DynamicMessageFactory factory;
-    auto* protomsg = factory.GetPrototype(it->second);
-    std::unique_ptr<google::protobuf::Message> msg{protomsg->New()};
-    if (msg->ParseFromArray(msg_, msg_.size())) {
-        result << msg->Utf8DebugString();
-    } else {
+    try {
+        result << Parsed().Utf8DebugString();
+    } catch (const PacketParseError&) {
         result << "protobuf parse failed";
     }
     return result.str();
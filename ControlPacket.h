@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <limits>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <type_traits>
@@ -9,8 +10,9 @@
 #include <vector>
 #include "AudioPacket.h"
 #include "ByteChunk.h"
+#include "ControlFramer.h"
 #include "Mumble.pb.h"
-#include "WireMessage.h"
+#include "google/protobuf/arena.h"
 
 namespace winrt::blurt::mumble::implementation {
 
@@ -66,35 +68,40 @@ class ControlPacket {
    public:
     // Move a vector of bytes efficiently to a new ControlPacket
     ControlPacket(ControlPacketType t, std::vector<std::uint8_t>&& msg)
-        : type_{t}, msg_{std::move(msg)} {}
+        : type_{t}, msg_{ByteSlice::Of(ByteChunk{std::move(msg)})} {}
 
     // Move a byte chunk efficiently to a new ControlPacket
-    ControlPacket(ControlPacketType t, ByteChunk&& msg) : type_{t}, msg_{std::move(msg)} {}
+    ControlPacket(ControlPacketType t, ByteChunk&& msg)
+        : type_{t}, msg_{ByteSlice::Of(std::move(msg))} {}
 
     // Make a new ControlPacket by taking a copy of a string
-    ControlPacket(ControlPacketType t, std::string s) : type_{t}, msg_{ByteChunk::CopyOf(s)} {}
+    ControlPacket(ControlPacketType t, std::string s)
+        : type_{t}, msg_{ByteSlice::Of(ByteChunk::CopyOf(s))} {}
 
-    // Move a WireMessage efficiently to a new ControlPacket
-    ControlPacket(mumble::WireMessage&& wire_msg)
-        : type_{ControlPacketTypeOf(wire_msg.TypeNumber())},
-          msg_{winrt::get_self<implementation::WireMessage>(wire_msg)->StealPayload()} {}
+    // Make a ControlPacket from a message just framed off the wire, sharing
+    // the framer's storage rather than copying it. If an arena is given, the
+    // parsed protobuf message (see ResolveProto()) is allocated there, and
+    // the packet must not outlive the arena's next Reset(). Throws
+    // PacketParseError if the message type is out of range.
+    explicit ControlPacket(ControlFramer::Frame&& frame, google::protobuf::Arena* arena = nullptr)
+        : type_{ControlPacketTypeOf(frame.type)}, msg_{std::move(frame.payload)}, arena_{arena} {}
 
     ControlPacketType Type() const { return type_; }
     std::uint16_t TypeAsUInt() const { return static_cast<std::uint16_t>(type_); }
     std::int32_t PayloadSize() const { return msg_.size(); }
-    const std::vector<std::uint8_t>& Bytes() const { return msg_.Bytes(); }
+    winrt::array_view<const std::uint8_t> Bytes() const { return {msg_.begin(), msg_.end()}; }
     std::string DebugString() const;
 
     // Resolve<ControlPacketType::T>() parses the packet's payload into the
     // protobuf message of type MumbleProto::T; throws PacketParseError if the
-    // byte payload doesn't parse
-#define RESOLVE_PROTO_IMPL(T)                                                           \
-    template <ControlPacketType Ty>                                                     \
-    std::enable_if_t<Ty == ControlPacketType::T, MumbleProto::T> ResolveProto() const { \
-        MumbleProto::T result;                                                          \
-        if (!result.ParseFromArray(msg_, msg_.size()))                                  \
-            throw PacketParseError("invalid protobuf message");                         \
-        return result;                                                                  \
+    // byte payload doesn't parse. The payload is parsed at most once, however
+    // many times this (or DebugString()) is called; the result lives as
+    // long as the packet.
+#define RESOLVE_PROTO_IMPL(T)                                           \
+    template <ControlPacketType Ty>                                     \
+    std::enable_if_t<Ty == ControlPacketType::T, const MumbleProto::T&> \
+    ResolveProto() const {                                              \
+        return static_cast<const MumbleProto::T&>(Parsed());            \
     }
 
     RESOLVE_PROTO_IMPL(Version)
@@ -125,18 +132,19 @@ class ControlPacket {
     RESOLVE_PROTO_IMPL(SuggestConfig)
     RESOLVE_PROTO_IMPL(PluginDataTransmission)
 
+    // Parse the packet's payload as an incoming audio packet; the audio
+    // packet shares the payload's storage rather than copying it
     AudioPacket ResolveAudioPacket() const {
         if (type_ != ControlPacketType::UDPTunnel)
             throw std::invalid_argument("not an audio control packet");
-        return AudioPacket::FromIncomingBytes(msg_);
+        return AudioPacket::FromIncomingFrame(msg_);
     }
 
-    // From(proto) creates a ControlPacket from a protobuf message.
-    //
-    // TODO: Avoid the extra copy here
-#define FROM_PROTO_IMPL(T)                                                     \
-    static ControlPacket From(const MumbleProto::T& proto) {                   \
-        return ControlPacket(ControlPacketType::T, proto.SerializeAsString()); \
+    // From(proto) creates a ControlPacket from a protobuf message, which is
+    // serialized straight into pooled storage
+#define FROM_PROTO_IMPL(T)                                   \
+    static ControlPacket From(const MumbleProto::T& proto) { \
+        return FromProto(ControlPacketType::T, proto);       \
     }
 
     FROM_PROTO_IMPL(Version)
@@ -173,8 +181,25 @@ class ControlPacket {
     }
 
    private:
+    static ControlPacket FromProto(ControlPacketType t, const google::protobuf::MessageLite& proto);
+
+    // The payload parsed as the protobuf message for this packet's type,
+    // parsing it on first use; throws PacketParseError if it doesn't parse
+    const google::protobuf::Message& Parsed() const;
+
+    // Arena-owned messages are freed with the arena, not one at a time
+    struct ProtoDeleter {
+        void operator()(google::protobuf::Message* m) const {
+            if (m->GetArena() == nullptr) delete m;
+        }
+    };
+
     const ControlPacketType type_;
-    const ByteChunk msg_;
+    ByteSlice msg_;
+    google::protobuf::Arena* arena_{nullptr};
+    // The parse cache; not thread-safe, like the rest of a packet
+    mutable std::unique_ptr<google::protobuf::Message, ProtoDeleter> parsed_;
+    mutable bool parse_failed_{false};
 };
 
 }  // namespace winrt::blurt::mumble::implementation
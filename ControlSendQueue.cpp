@@ -0,0 +1,60 @@
+#include "pch.h"
+
+#include "ControlSendQueue.h"
+
+namespace winrt::blurt::mumble::implementation {
+
+void ControlSendQueue::Push(ControlPacket&& packet) {
+    if (packet.Type() == ControlPacketType::Ping) {
+        pings_.push_back(std::move(packet));
+    } else {
+        control_.push_back(std::move(packet));
+    }
+}
+
+void ControlSendQueue::Push(OutgoingVoiceFrame frame, Clock::time_point now) {
+    if (voice_.size() >= kMaxVoiceFrames) {
+        voice_.pop_front();
+        dropped_voice_frames_++;
+    }
+    voice_.push_back({std::move(frame), now});
+}
+
+void ControlSendQueue::TakeBatch(Clock::time_point now, Batch& batch) {
+    std::size_t bytes{0};
+    auto has_room = [&](std::size_t size) {
+        // Always take at least one message, however big
+        return bytes == 0 || bytes + size <= kMaxBatchBytes;
+    };
+
+    while (!voice_.empty()) {
+        auto& queued = voice_.front();
+        if (now - queued.queued > kMaxVoiceDelay) {
+            dropped_voice_frames_++;
+        } else {
+            auto size = static_cast<std::size_t>(queued.frame.WireSize());
+            if (!has_room(size)) return;
+            bytes += size;
+            batch.voice.push_back(std::move(queued.frame));
+        }
+        voice_.pop_front();
+    }
+    for (auto* queue : {&pings_, &control_}) {
+        while (!queue->empty()) {
+            auto size = ControlFramer::kHeaderSize +
+                        static_cast<std::size_t>(queue->front().PayloadSize());
+            if (!has_room(size)) return;
+            bytes += size;
+            batch.control.push_back(std::move(queue->front()));
+            queue->pop_front();
+        }
+    }
+}
+
+void ControlSendQueue::Clear() {
+    voice_.clear();
+    pings_.clear();
+    control_.clear();
+}
+
+}  // namespace winrt::blurt::mumble::implementation
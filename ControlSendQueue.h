@@ -0,0 +1,70 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "ControlPacket.h"
+#include "OutgoingVoiceFrame.h"
+
+namespace winrt::blurt::mumble::implementation {
+
+// What the control channel has waiting to be written, and how it's picked
+// out a write at a time.
+//
+// Voice goes first, then pings, then everything else. At most
+// kMaxVoiceFrames voice frames wait; past that, the oldest are dropped, and
+// so is any frame that has waited longer than kMaxVoiceDelay by the time
+// there's a write for it, since it's too late to be worth playing. A write
+// takes roughly kMaxBatchBytes at most, so one slow write doesn't hold up
+// what's queued behind it for long.
+//
+// Nothing here locks; ControlSocket keeps it behind its queue mutex.
+class ControlSendQueue {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::size_t kMaxVoiceFrames = 10;
+    static constexpr Clock::duration kMaxVoiceDelay = std::chrono::milliseconds{200};
+    static constexpr std::size_t kMaxBatchBytes = 64 * 1024;
+
+    // The messages for one write, in the order they're written
+    struct Batch {
+        std::vector<OutgoingVoiceFrame> voice;
+        std::vector<ControlPacket> control;
+
+        bool empty() const { return voice.empty() && control.empty(); }
+        void clear() {
+            voice.clear();
+            control.clear();
+        }
+    };
+
+    void Push(ControlPacket&& packet);
+    void Push(OutgoingVoiceFrame frame, Clock::time_point now);
+
+    // Move as much as goes in one write into the batch, as of now; leaves it
+    // empty if nothing is queued
+    void TakeBatch(Clock::time_point now, Batch& batch);
+
+    void Clear();
+
+    std::size_t QueuedVoiceFrames() const { return voice_.size(); }
+
+    // How many voice frames have been dropped, for the cap or for being stale
+    std::uint64_t DroppedVoiceFrames() const { return dropped_voice_frames_; }
+
+   private:
+    struct QueuedVoice {
+        OutgoingVoiceFrame frame;
+        Clock::time_point queued;
+    };
+
+    std::deque<QueuedVoice> voice_;
+    std::deque<ControlPacket> pings_;
+    std::deque<ControlPacket> control_;
+    std::uint64_t dropped_voice_frames_{0};
+};
+
+}  // namespace winrt::blurt::mumble::implementation
@@ -3,6 +3,7 @@
 #include "ControlSocket.h"
 
 #include <winerror.h>
+#include "PacketTrace.h"
 #include "winrt/Windows.Networking.h"
 #include "winrt/Windows.Storage.Streams.h"
 
@@ -13,12 +14,33 @@ namespace net = winrt::Windows::Networking;
 namespace sockets = winrt::Windows::Networking::Sockets;
 namespace streams = winrt::Windows::Storage::Streams;
 
+namespace {
+// How much to ask for in one read; a partial read returns whatever's there
+constexpr std::uint32_t kReadSize = 64 * 1024;
+}  // namespace
+
 ControlSocket::ControlSocket() : open_{false} {
     socket_.Control().QualityOfService(sockets::SocketQualityOfService::LowLatency);
 }
 
+ControlSocket::~ControlSocket() {
+    Close();
+    // Canceling the pump doesn't stop it touching this once whatever it's
+    // waiting on finishes, so wait for it to finish; with the socket closed,
+    // that's soon
+    std::unique_lock lock{queue_mutex_};
+    failed_ = true;
+    if (pump_task_) pump_task_.Cancel();
+    pump_done_.wait(lock, [this] { return !pumping_; });
+}
+
 void ControlSocket::Close() {
     if (!open_) return;
+    {
+        std::lock_guard lock{queue_mutex_};
+        failed_ = true;
+        if (pump_task_) pump_task_.Cancel();
+    }
     socket_.Close();
     open_ = false;
 }
@@ -28,55 +50,93 @@ foundation::IAsyncAction ControlSocket::ConnectAsync(const winrt::hstring& host,
     net::EndpointPair endpoint{nullptr, L"", net::HostName{host}, port};
     // TODO: handle connect exceptions
     co_await socket_.ConnectAsync(endpoint, sockets::SocketProtectionLevel::Tls12);
+    writer_ = streams::DataWriter{socket_.OutputStream()};
+    writer_.ByteOrder(streams::ByteOrder::BigEndian);
+    reader_ = streams::DataReader{socket_.InputStream()};
+    reader_.InputStreamOptions(streams::InputStreamOptions::Partial);
     open_ = true;
 }
 
-foundation::IAsyncOperation<blurt::mumble::WireMessage> ControlSocket::ReadPacketAsync() {
-    streams::DataReader reader{socket_.InputStream()};
-    reader.ByteOrder(streams::ByteOrder::BigEndian);
+foundation::IAsyncAction ControlSocket::ReadMoreAsync() {
+    auto read_op = reader_.LoadAsync(kReadSize);
+    auto n = co_await read_op;
+    if (read_op.ErrorCode() != S_OK) {
+        winrt::throw_hresult(read_op.ErrorCode());
+    }
+    if (n == 0) {
+        // TODO: Handle remote end close properly
+        throw std::exception{"remote end closed"};
+    }
+    auto* dest = framer_.PrepareInput(n);
+    reader_.ReadBytes({dest, dest + n});
+    framer_.CommitInput(n);
+}
+
+void ControlSocket::Send(ControlPacket&& packet) {
+    TracePacket(TraceDirection::ControlOut, static_cast<std::uint16_t>(packet.Type()),
+                static_cast<std::uint32_t>(packet.PayloadSize()));
     {
-        auto read_op = reader.LoadAsync(6);
-        auto bytes_read = co_await read_op;
-        if (bytes_read != 6) {
-            if (read_op.ErrorCode() != S_OK) {
-                winrt::throw_hresult(read_op.ErrorCode());
-            }
-            // TODO: Handle remote end close properly
-            throw std::exception{"remote end closed"};
-        }
+        std::lock_guard lock{queue_mutex_};
+        if (failed_) return;
+        queue_.Push(std::move(packet));
     }
-    const auto msg_type = reader.ReadUInt16();
-    const auto msg_len = reader.ReadUInt32();
-    auto bytes_to_read = msg_len;
-    auto buf = std::make_unique<std::uint8_t[]>(msg_len);
-    auto* b = buf.get();
-    while (bytes_to_read > 0) {
-        auto read_op = reader.LoadAsync(bytes_to_read);
-        auto n = co_await read_op;
-        if (read_op.ErrorCode() != S_OK) {
-            winrt::throw_hresult(read_op.ErrorCode());
-        }
-        if (n == 0) {
-            // TODO: Handle remote end close properly
-            throw std::exception{"remote end closed"};
-        }
-        reader.ReadBytes({b, b + n});
-        b += n;
-        bytes_to_read -= n;
+    StartPumpIfIdle();
+}
+
+void ControlSocket::Send(OutgoingVoiceFrame frame) {
+    {
+        std::lock_guard lock{queue_mutex_};
+        if (failed_) return;
+        queue_.Push(std::move(frame), ControlSendQueue::Clock::now());
     }
-    reader.DetachStream();
-    co_return {msg_type, {buf.get(), b}};
+    StartPumpIfIdle();
 }
 
-foundation::IAsyncAction ControlSocket::WritePacketAsync(ControlPacket&& packet) {
-    streams::DataWriter writer{socket_.OutputStream()};
-    writer.ByteOrder(streams::ByteOrder::BigEndian);
+void ControlSocket::StartPumpIfIdle() {
+    std::lock_guard lock{queue_mutex_};
+    if (pumping_ || failed_) return;
+    pumping_ = true;
+    pump_task_ = PumpAsync();
+}
 
-    writer.WriteUInt16(packet.TypeAsUInt());
-    writer.WriteUInt32(packet.PayloadSize());
-    writer.WriteBytes(packet.Bytes());
-    co_await writer.StoreAsync();
-    writer.DetachStream();
+foundation::IAsyncAction ControlSocket::PumpAsync() {
+    try {
+        // Get off the sender's thread; it's holding queue_mutex_
+        co_await winrt::resume_background();
+        while (true) {
+            {
+                std::lock_guard lock{queue_mutex_};
+                queue_.TakeBatch(ControlSendQueue::Clock::now(), batch_);
+                if (batch_.empty()) {
+                    pumping_ = false;
+                    pump_done_.notify_all();
+                    co_return;
+                }
+            }
+
+            for (const auto& frame : batch_.voice)
+                writer_.WriteBytes({frame.WireData(), frame.WireData() + frame.WireSize()});
+            for (const auto& packet : batch_.control) {
+                writer_.WriteUInt16(packet.TypeAsUInt());
+                writer_.WriteUInt32(packet.PayloadSize());
+                writer_.WriteBytes(packet.Bytes());
+            }
+            batch_.clear();
+            co_await writer_.StoreAsync();
+        }
+    } catch (const winrt::hresult_error& e) {
+        {
+            std::lock_guard lock{queue_mutex_};
+            failed_ = true;
+            queue_.Clear();
+        }
+        batch_.clear();
+        // Being cancelled by Close() isn't a failure anyone needs to hear of
+        if (write_failed_ && e.code() != HRESULT_FROM_WIN32(ERROR_CANCELLED)) write_failed_(e);
+    }
+    std::lock_guard lock{queue_mutex_};
+    pumping_ = false;
+    pump_done_.notify_all();
 }
 
 }  // namespace winrt::blurt::mumble::implementation
@@ -1,17 +1,30 @@
 #pragma once
 
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include "ControlFramer.h"
 #include "ControlPacket.h"
-#include "WireMessage.h"
+#include "ControlSendQueue.h"
+#include "OutgoingVoiceFrame.h"
 #include "winrt/Windows.Foundation.h"
 #include "winrt/Windows.Networking.Sockets.h"
+#include "winrt/Windows.Storage.Streams.h"
 
 namespace winrt::blurt::mumble::implementation {
 
 // A thin abstraction over the Mumble protocol TCP control socket
+//
+// Outgoing messages go through a single send queue, so they can never
+// interleave on the wire. Whatever has piled up while a write was in flight
+// goes out together in the next write, voice first, then pings, then
+// everything else. Voice that has waited too long to be worth playing is
+// dropped rather than sent late. (See ControlSendQueue.)
 class ControlSocket {
    public:
     ControlSocket();
-    ~ControlSocket() { Close(); }
+    ~ControlSocket();
 
     // TODO: Work out how close should work
     void Close();
@@ -22,19 +35,65 @@ class ControlSocket {
     Windows::Foundation::IAsyncAction ConnectAsync(const winrt::hstring& host,
                                                    const winrt::hstring& port);
 
-    // Read the next control message off the wire
-    //
-    // TODO: Handle errors properly
-    Windows::Foundation::IAsyncOperation<blurt::mumble::WireMessage> ReadPacketAsync();
+    // Take the next control message already read off the wire, if there is
+    // one. Its payload shares the socket's read buffer; it's fine to hold on
+    // to it, but steady traffic only avoids allocating if it's let go soon.
+    // Throws if the stream has gone bad.
+    bool NextFrame(ControlFramer::Frame& frame) { return framer_.NextFrame(frame); }
 
-    // Write a control packet to the wire
+    // Read more of the wire, waiting for at least a byte. The socket is read
+    // in big chunks, so one read often completes several messages. Only one
+    // read may be outstanding at a time.
     //
     // TODO: Handle errors properly
-    Windows::Foundation::IAsyncAction WritePacketAsync(ControlPacket&& packet);
+    Windows::Foundation::IAsyncAction ReadMoreAsync();
+
+    // Whether NextFrame() has a whole message already read
+    bool HasBufferedPacket() const { return framer_.HasFrame(); }
+
+    // Queue a control packet to be written to the wire; this returns right
+    // away. This and the other Send() are thread-safe.
+    void Send(ControlPacket&& packet);
+
+    // Queue a finished voice frame to be written to the wire, tunneled over
+    // the control channel; the frame already carries its own message header
+    void Send(OutgoingVoiceFrame frame);
+
+    // Set the function called (on a thread pool thread) if a write fails;
+    // after that, nothing more is written
+    void WriteFailed(std::function<void(const winrt::hresult_error&)> handler) {
+        write_failed_ = std::move(handler);
+    }
+
+    // How many queued voice frames have been dropped for being stale
+    std::uint64_t DroppedVoiceFrames() const {
+        std::lock_guard lock{queue_mutex_};
+        return queue_.DroppedVoiceFrames();
+    }
 
    private:
+    void StartPumpIfIdle();
+    Windows::Foundation::IAsyncAction PumpAsync();
+
     bool open_;
     Windows::Networking::Sockets::StreamSocket socket_;
+    Windows::Storage::Streams::DataReader reader_{nullptr};
+    ControlFramer framer_;
+    Windows::Storage::Streams::DataWriter writer_{nullptr};
+    std::function<void(const winrt::hresult_error&)> write_failed_;
+
+    mutable std::mutex queue_mutex_;
+    _Guarded_by_(queue_mutex_) ControlSendQueue queue_;
+    // Set while PumpAsync() is running; it's the only thing that writes.
+    // The pump clears it, and signals pump_done_, as the last thing it does
+    // with this object, which the destructor waits for.
+    _Guarded_by_(queue_mutex_) bool pumping_{false};
+    std::condition_variable pump_done_;
+    _Guarded_by_(queue_mutex_) bool failed_{false};
+    Windows::Foundation::IAsyncAction pump_task_{nullptr};
+
+    // The messages in the write in flight; only touched by the pump
+    ControlSendQueue::Batch batch_;
 };
 
 }  // namespace winrt::blurt::mumble::implementation
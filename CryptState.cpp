@@ -0,0 +1,272 @@
+#include "pch.h"
+
+#include "CryptState.h"
+
+#include <algorithm>
+#include <cstring>
+
+// The OCB2 mode and the nonce handling here follow Mumble's CryptState[1],
+// which is copyright The Mumble Developers and used under license. Full
+// license text is available in our LICENSE file and the Mumble website[2].
+//
+// 1. https://github.com/mumble-voip/mumble/blob/1d45d99/src/crypto/CryptStateOCB2.cpp
+// 2. https://www.mumble.info/LICENSE
+
+namespace winrt::blurt::mumble::implementation {
+
+namespace {
+constexpr std::size_t kBlockSize = Aes128::kBlockSize;
+
+// Each block's delta depends only on the one before, so the deltas for a
+// run of blocks are worked out first and the cipher then does the whole run
+// at once, which hardware AES can overlap
+constexpr std::size_t kBatchBlocks = 8;
+
+inline void XorBlock(std::uint8_t* dst, const std::uint8_t* a, const std::uint8_t* b) {
+    for (std::size_t i = 0; i < kBlockSize; i++) dst[i] = a[i] ^ b[i];
+}
+
+// Multiply by x (S2) or x + 1 (S3) in GF(2^128), big-endian
+inline void S2(std::uint8_t* block) {
+    std::uint8_t carry = block[0] >> 7;
+    for (std::size_t i = 0; i < kBlockSize - 1; i++)
+        block[i] = static_cast<std::uint8_t>((block[i] << 1) | (block[i + 1] >> 7));
+    block[kBlockSize - 1] =
+        static_cast<std::uint8_t>((block[kBlockSize - 1] << 1) ^ (carry * 0x87));
+}
+
+inline void S3(std::uint8_t* block) {
+    std::uint8_t doubled[kBlockSize];
+    std::memcpy(doubled, block, kBlockSize);
+    S2(doubled);
+    XorBlock(block, block, doubled);
+}
+
+// Put the bit length of a final partial block in the last bytes of a block
+inline void StoreLengthBits(std::size_t len, std::uint8_t* block) {
+    std::memset(block, 0, kBlockSize);
+    std::uint64_t bits = static_cast<std::uint64_t>(len) * 8;
+    for (std::size_t i = 0; i < 8; i++)
+        block[kBlockSize - 1 - i] = static_cast<std::uint8_t>(bits >> (8 * i));
+}
+
+inline void IncrementFrom(std::uint8_t* iv, std::size_t first) {
+    for (std::size_t i = first; i < kBlockSize; i++)
+        if (++iv[i] != 0) break;
+}
+
+inline void DecrementFrom(std::uint8_t* iv, std::size_t first) {
+    for (std::size_t i = first; i < kBlockSize; i++)
+        if (iv[i]-- != 0) break;
+}
+}  // namespace
+
+bool CryptState::SetKey(const std::string& key, const std::string& encrypt_nonce,
+                        const std::string& decrypt_nonce) {
+    if (key.size() != kKeySize || encrypt_nonce.size() != kNonceSize ||
+        decrypt_nonce.size() != kNonceSize)
+        return false;
+    aes_.SetKey(reinterpret_cast<const std::uint8_t*>(key.data()));
+    std::memcpy(encrypt_iv_.data(), encrypt_nonce.data(), kNonceSize);
+    std::memcpy(decrypt_iv_.data(), decrypt_nonce.data(), kNonceSize);
+    decrypt_history_.fill(0);
+    counters_ = Counters{};
+    is_valid_ = true;
+    return true;
+}
+
+bool CryptState::SetDecryptNonce(const std::string& nonce) {
+    if (nonce.size() != kNonceSize) return false;
+    std::memcpy(decrypt_iv_.data(), nonce.data(), kNonceSize);
+    counters_.resync++;
+    return true;
+}
+
+void CryptState::Encrypt(const std::uint8_t* plain, std::uint8_t* dst, std::size_t plain_len) {
+    IncrementFrom(encrypt_iv_.data(), 0);
+    Block tag;
+    OcbEncrypt(plain, dst + kHeaderSize, plain_len, encrypt_iv_, tag);
+    dst[0] = encrypt_iv_[0];
+    dst[1] = tag[0];
+    dst[2] = tag[1];
+    dst[3] = tag[2];
+}
+
+bool CryptState::Decrypt(const std::uint8_t* crypted, std::uint8_t* dst, std::size_t crypted_len) {
+    if (crypted_len < kHeaderSize) return false;
+    const std::size_t plain_len = crypted_len - kHeaderSize;
+    const std::uint8_t ivbyte = crypted[0];
+    const Block saved_iv = decrypt_iv_;
+    bool restore{false};
+    int late{0}, lost{0};
+
+    if (static_cast<std::uint8_t>(decrypt_iv_[0] + 1) == ivbyte) {
+        // In order, as expected
+        if (ivbyte < decrypt_iv_[0]) IncrementFrom(decrypt_iv_.data(), 1);
+        decrypt_iv_[0] = ivbyte;
+    } else {
+        // Out of order, or a repeat
+        int diff = ivbyte - decrypt_iv_[0];
+        if (diff > 128) {
+            diff -= 256;
+        } else if (diff < -128) {
+            diff += 256;
+        }
+
+        if (ivbyte < decrypt_iv_[0] && diff > -30 && diff < 0) {
+            // Late, no wraparound
+            late = 1;
+            lost = -1;
+            decrypt_iv_[0] = ivbyte;
+            restore = true;
+        } else if (ivbyte > decrypt_iv_[0] && diff > -30 && diff < 0) {
+            // Late, from before the last wraparound
+            late = 1;
+            lost = -1;
+            decrypt_iv_[0] = ivbyte;
+            DecrementFrom(decrypt_iv_.data(), 1);
+            restore = true;
+        } else if (ivbyte > decrypt_iv_[0] && diff > 0) {
+            // Some packets lost in between, no wraparound
+            lost = ivbyte - decrypt_iv_[0] - 1;
+            decrypt_iv_[0] = ivbyte;
+        } else if (ivbyte < decrypt_iv_[0] && diff > 0) {
+            // Some packets lost in between, with a wraparound
+            lost = 256 - decrypt_iv_[0] + ivbyte - 1;
+            decrypt_iv_[0] = ivbyte;
+            IncrementFrom(decrypt_iv_.data(), 1);
+        } else {
+            return false;
+        }
+
+        if (decrypt_history_[decrypt_iv_[0]] == decrypt_iv_[1]) {
+            decrypt_iv_ = saved_iv;
+            return false;
+        }
+    }
+
+    Block tag;
+    bool ok = OcbDecrypt(crypted + kHeaderSize, dst, plain_len, decrypt_iv_, tag);
+    if (!ok || std::memcmp(tag.data(), crypted + 1, kHeaderSize - 1) != 0) {
+        decrypt_iv_ = saved_iv;
+        return false;
+    }
+    decrypt_history_[decrypt_iv_[0]] = decrypt_iv_[1];
+    if (restore) decrypt_iv_ = saved_iv;
+
+    counters_.good++;
+    counters_.late += late;
+    // A late packet fills a gap counted as lost earlier, but the count
+    // mustn't wrap around if the gap was from before the last resync
+    if (lost >= 0) {
+        counters_.lost += lost;
+    } else if (counters_.lost > 0) {
+        counters_.lost--;
+    }
+    return true;
+}
+
+void CryptState::OcbEncrypt(const std::uint8_t* plain, std::uint8_t* encrypted, std::size_t len,
+                            const Block& nonce, Block& tag) {
+    std::uint8_t checksum[kBlockSize] = {}, delta[kBlockSize], tmp[kBlockSize], pad[kBlockSize];
+    aes_.EncryptBlock(nonce.data(), delta);
+
+    // All but the last block, whether or not it's full, go through the
+    // cipher in batches. Everything read from plain is read before the same
+    // bytes of encrypted are written, which is what makes encrypting in
+    // place work.
+    std::uint8_t deltas[kBatchBlocks][kBlockSize], batch[kBatchBlocks * kBlockSize];
+    while (len > kBlockSize) {
+        std::size_t n = std::min((len - 1) / kBlockSize, kBatchBlocks);
+        for (std::size_t i = 0; i < n; i++) {
+            const std::uint8_t* p = plain + i * kBlockSize;
+            std::uint8_t* b = batch + i * kBlockSize;
+            S2(delta);
+            std::memcpy(deltas[i], delta, kBlockSize);
+            XorBlock(b, delta, p);
+            XorBlock(checksum, checksum, p);
+
+            if (len - i * kBlockSize - kBlockSize <= kBlockSize) {
+                // The second-to-last block of an XEX* attack is all zero but
+                // for its last byte. Digital silence makes these by the
+                // bucketful, so rather than refuse them, perturb one bit of
+                // the audio.
+                std::uint8_t sum{0};
+                for (std::size_t j = 0; j < kBlockSize - 1; j++) sum |= p[j];
+                if (sum == 0) {
+                    b[0] ^= 1;
+                    checksum[0] ^= 1;
+                }
+            }
+        }
+        aes_.EncryptBlocks(batch, batch, n);
+        for (std::size_t i = 0; i < n; i++)
+            XorBlock(encrypted + i * kBlockSize, deltas[i], batch + i * kBlockSize);
+
+        len -= n * kBlockSize;
+        plain += n * kBlockSize;
+        encrypted += n * kBlockSize;
+    }
+
+    S2(delta);
+    StoreLengthBits(len, tmp);
+    XorBlock(tmp, tmp, delta);
+    aes_.EncryptBlock(tmp, pad);
+    std::memcpy(tmp, plain, len);
+    std::memcpy(tmp + len, pad + len, kBlockSize - len);
+    XorBlock(checksum, checksum, tmp);
+    XorBlock(tmp, pad, tmp);
+    std::memcpy(encrypted, tmp, len);
+
+    S3(delta);
+    XorBlock(tmp, delta, checksum);
+    aes_.EncryptBlock(tmp, tag.data());
+}
+
+bool CryptState::OcbDecrypt(const std::uint8_t* encrypted, std::uint8_t* plain, std::size_t len,
+                            const Block& nonce, Block& tag) {
+    std::uint8_t checksum[kBlockSize] = {}, delta[kBlockSize], tmp[kBlockSize], pad[kBlockSize];
+    bool ok{true};
+    aes_.EncryptBlock(nonce.data(), delta);
+
+    std::uint8_t deltas[kBatchBlocks][kBlockSize], batch[kBatchBlocks * kBlockSize];
+    while (len > kBlockSize) {
+        std::size_t n = std::min((len - 1) / kBlockSize, kBatchBlocks);
+        for (std::size_t i = 0; i < n; i++) {
+            S2(delta);
+            std::memcpy(deltas[i], delta, kBlockSize);
+            XorBlock(batch + i * kBlockSize, delta, encrypted + i * kBlockSize);
+        }
+        aes_.DecryptBlocks(batch, batch, n);
+        for (std::size_t i = 0; i < n; i++) {
+            std::uint8_t* p = plain + i * kBlockSize;
+            XorBlock(p, deltas[i], batch + i * kBlockSize);
+            XorBlock(checksum, checksum, p);
+        }
+
+        len -= n * kBlockSize;
+        plain += n * kBlockSize;
+        encrypted += n * kBlockSize;
+    }
+
+    S2(delta);
+    StoreLengthBits(len, tmp);
+    XorBlock(tmp, tmp, delta);
+    aes_.EncryptBlock(tmp, pad);
+    std::memset(tmp, 0, kBlockSize);
+    std::memcpy(tmp, encrypted, len);
+    XorBlock(tmp, tmp, pad);
+    XorBlock(checksum, checksum, tmp);
+    std::memcpy(plain, tmp, len);
+
+    // In an XEX* attack, the last decrypted block would have to equal delta
+    // in every byte but the last (which holds the length)
+    if (std::memcmp(tmp, delta, kBlockSize - 1) == 0) ok = false;
+
+    S3(delta);
+    XorBlock(tmp, delta, checksum);
+    aes_.EncryptBlock(tmp, tag.data());
+    return ok;
+}
+
+}  // namespace winrt::blurt::mumble::implementation
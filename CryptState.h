@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "Aes128.h"
+
+namespace winrt::blurt::mumble::implementation {
+
+// Encryption for voice datagrams sent over UDP, using Mumble's OCB2-AES128
+// construction. The key and the two starting nonces come from the server's
+// CryptSetup message.
+//
+// Each encrypted packet is a 4-byte header (the low byte of the nonce and
+// the first three bytes of the authentication tag) followed by ciphertext
+// the same length as the plaintext. The nonce goes up by one per packet in
+// each direction; the receiving side rebuilds the full nonce from the low
+// byte, which allows for some loss and reordering, and rejects replays.
+//
+// If the nonces drift too far apart for that to work, either end can ask
+// the other for its current encryption nonce (via CryptSetup) to resync.
+//
+// Encryption and decryption keep separate nonces but share the key, so the
+// caller is responsible for locking access from different threads.
+class CryptState {
+   public:
+    static constexpr std::size_t kHeaderSize = 4;
+    static constexpr std::size_t kKeySize = Aes128::kKeySize;
+    static constexpr std::size_t kNonceSize = Aes128::kBlockSize;
+
+    // Counts of incoming packets, as reported in Mumble's Ping message.
+    // Late packets are ones that arrived after a later one did; lost counts
+    // the gaps, less any late packets that later filled them.
+    struct Counters {
+        std::uint32_t good{0};
+        std::uint32_t late{0};
+        std::uint32_t lost{0};
+        std::uint32_t resync{0};
+    };
+
+    // Set the key and both nonces; returns false (and changes nothing) if
+    // any of them is the wrong size
+    bool SetKey(const std::string& key, const std::string& encrypt_nonce,
+                const std::string& decrypt_nonce);
+
+    // Resync the decryption nonce to the one the other end says it's at;
+    // returns false (and changes nothing) if it's the wrong size
+    bool SetDecryptNonce(const std::string& nonce);
+
+    // The current encryption nonce, for when the other end asks to resync
+    std::string EncryptNonce() const {
+        return std::string{reinterpret_cast<const char*>(encrypt_iv_.data()), kNonceSize};
+    }
+
+    bool IsValid() const { return is_valid_; }
+    const Counters& Stats() const { return counters_; }
+
+    // Encrypt plain_len bytes from plain into dst, which must have room for
+    // kHeaderSize + plain_len bytes. To encrypt in place, dst may be exactly
+    // plain - kHeaderSize.
+    void Encrypt(const std::uint8_t* plain, std::uint8_t* dst, std::size_t plain_len);
+
+    // Decrypt a crypted_len-byte packet into dst, which must have room for
+    // crypted_len - kHeaderSize bytes. To decrypt in place, dst may be
+    // exactly crypted + kHeaderSize. Returns false if the packet is too
+    // short, doesn't authenticate, or is a replay.
+    bool Decrypt(const std::uint8_t* crypted, std::uint8_t* dst, std::size_t crypted_len);
+
+   private:
+    using Block = std::array<std::uint8_t, Aes128::kBlockSize>;
+
+    // Decryption returns false if the input looks like the XEX* attack on
+    // OCB2 (see https://eprint.iacr.org/2019/311, section 9); encryption
+    // sidesteps it by flipping a bit of the plaintext instead.
+    void OcbEncrypt(const std::uint8_t* plain, std::uint8_t* encrypted, std::size_t len,
+                    const Block& nonce, Block& tag);
+    bool OcbDecrypt(const std::uint8_t* encrypted, std::uint8_t* plain, std::size_t len,
+                    const Block& nonce, Block& tag);
+
+    bool is_valid_{false};
+    Aes128 aes_;
+    Block encrypt_iv_{};
+    Block decrypt_iv_{};
+    // For each low nonce byte, the second byte of the last nonce that
+    // decrypted with it, to catch replays
+    std::array<std::uint8_t, 256> decrypt_history_{};
+    Counters counters_;
+};
+
+}  // namespace winrt::blurt::mumble::implementation
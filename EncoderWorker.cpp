@@ -0,0 +1,117 @@
+#include "pch.h"
+
+#include "EncoderWorker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include "MixKernels.h"
+
+namespace winrt::blurt::audio::implementation {
+
+namespace {
+// The longest the worker sleeps without checking the queue; about half an
+// audio graph quantum
+constexpr auto kWakeTimeout = std::chrono::milliseconds{5};
+// The most taken off the queue at once; even upsampled from 8 kHz, that
+// keeps well inside the encoder's own buffer
+constexpr std::int32_t kMaxChunkSamples = 4800;
+}  // namespace
+
+EncoderWorker::EncoderWorker(OpusEncoder& encoder, AudioSetup encoder_setup,
+                             std::chrono::milliseconds queue_duration)
+    : encoder_{encoder},
+      encoder_setup_{encoder_setup},
+      queue_duration_{queue_duration},
+      queue_{std::make_unique<AudioRingBuffer<float>>(
+          encoder_setup.TotalSamplesPer(queue_duration))},
+      chunk_(kMaxChunkSamples) {}
+
+void EncoderWorker::InputFormat(std::uint32_t rate, std::uint32_t channels) {
+    converter_.emplace(rate, channels, encoder_setup_);
+    input_channels_ = static_cast<std::int32_t>(channels);
+    auto samples = static_cast<std::int64_t>(rate) * channels * queue_duration_.count() / 1000;
+    queue_ = std::make_unique<AudioRingBuffer<float>>(static_cast<std::int32_t>(samples));
+}
+
+void EncoderWorker::Start() {
+    if (thread_.joinable()) return;
+    stopping_ = false;
+    thread_ = std::thread{[this] { Run(); }};
+}
+
+void EncoderWorker::Stop() {
+    if (!thread_.joinable()) return;
+    stopping_ = true;
+    wake_.notify_one();
+    thread_.join();
+}
+
+bool EncoderWorker::HasRoomFor(std::int32_t n) noexcept {
+    if (n <= 0) return false;
+    if (queue_->WriteCapacity() >= n) return true;
+    overflows_.fetch_add(1, std::memory_order_relaxed);
+    dropped_samples_.fetch_add(n, std::memory_order_relaxed);
+    return false;
+}
+
+void EncoderWorker::Submit(const float* pcm, std::int32_t n) noexcept {
+    if (!HasRoomFor(n)) return;
+    queue_->WriteSamplesFrom(pcm, n);
+    wake_.notify_one();
+}
+
+void EncoderWorker::Submit(const std::int16_t* pcm, std::int32_t n) noexcept {
+    if (!HasRoomFor(n)) return;
+    auto dest = queue_->GetWriteSegments(n);
+    Int16ToFloat(pcm, dest.first.data, dest.first.size);
+    Int16ToFloat(pcm + dest.first.size, dest.second.data, dest.second.size);
+    queue_->CommitWrite(n);
+    wake_.notify_one();
+}
+
+void EncoderWorker::Run() {
+    while (!stopping_) {
+        {
+            std::unique_lock lock{wake_mutex_};
+            wake_.wait_for(lock, kWakeTimeout,
+                           [this] { return stopping_ || queue_->ReadCapacity() > 0; });
+        }
+        if (stopping_) break;
+        Drain();
+    }
+}
+
+void EncoderWorker::Drain() {
+    // Whole frames at a time, so the converter never sees part of one
+    const std::int32_t max_chunk = kMaxChunkSamples - kMaxChunkSamples % input_channels_;
+    while (true) {
+        auto available = queue_->ReadCapacity();
+        auto n = std::min(available - available % input_channels_, max_chunk);
+        if (n == 0) break;
+        auto src = queue_->GetReadSegments(n);
+        try {
+            if (!converter_) {
+                encoder_.BufferRawAudio(src.first.data, src.first.size);
+                if (src.second.size > 0)
+                    encoder_.BufferRawAudio(src.second.data, src.second.size);
+            } else {
+                const float* in = src.first.data;
+                if (src.second.size > 0) {
+                    std::copy(src.first.data, src.first.data + src.first.size, chunk_.data());
+                    std::copy(src.second.data, src.second.data + src.second.size,
+                              chunk_.data() + src.first.size);
+                    in = chunk_.data();
+                }
+                const auto& pcm = converter_->Convert(in, n / input_channels_);
+                encoder_.BufferRawAudio(pcm.data(), static_cast<std::int32_t>(pcm.size()));
+            }
+        } catch (const std::exception&) {
+            // TODO: log encoding failure
+            encode_errors_.fetch_add(1, std::memory_order_relaxed);
+        }
+        queue_->CommitRead(n);
+    }
+}
+
+}  // namespace winrt::blurt::audio::implementation
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include "AudioParams.h"
+#include "AudioRingBuffer.h"
+#include "CaptureConverter.h"
+#include "OpusEncoder.h"
+
+namespace winrt::blurt::audio::implementation {
+
+// Runs an OpusEncoder on a thread of its own, fed from the audio graph's
+// capture callback, so that the callback never waits on a lock, an encode
+// or the network.
+//
+// Captured audio goes into a single-producer, single-consumer ring buffer
+// with Submit(), just as the device delivered it; Submit() only copies
+// (widening 16-bit samples to float on the way) and returns. The worker
+// thread drains the buffer, converts the audio to what the encoder takes,
+// and feeds the encoder, which hands encoded frames on from there. If the
+// worker falls so far behind that the buffer fills, the audio that doesn't
+// fit is dropped and counted, rather than the capture thread waiting or
+// throwing.
+class EncoderWorker {
+   public:
+    // Make a worker for an encoder with the given setup, with room to queue
+    // the given duration of audio
+    EncoderWorker(OpusEncoder& encoder, AudioSetup encoder_setup,
+                  std::chrono::milliseconds queue_duration);
+    ~EncoderWorker() { Stop(); }
+
+    EncoderWorker(const EncoderWorker&) = delete;
+    EncoderWorker& operator=(const EncoderWorker&) = delete;
+
+    // Set the format captured audio comes in: its sample rate and number of
+    // interleaved channels. Until this is called, it's taken to be in the
+    // encoder's setup already. Only call this while the worker is stopped;
+    // it throws std::exception if there's no converting from the format.
+    void InputFormat(std::uint32_t rate, std::uint32_t channels);
+
+    // Start and stop the worker thread. Audio still queued at Stop() waits
+    // for the next Start().
+    void Start();
+    void Stop();
+
+    // Queue n samples (total, not per channel, in whole frames) of captured
+    // audio for encoding; capture thread only. This never blocks, allocates
+    // or throws.
+    void Submit(const float* pcm, std::int32_t n) noexcept;
+    void Submit(const std::int16_t* pcm, std::int32_t n) noexcept;
+
+    // How many times audio didn't fit in the queue, and how many samples, as
+    // the device delivered them, were dropped because of it
+    std::uint64_t Overflows() const { return overflows_.load(std::memory_order_relaxed); }
+    std::uint64_t DroppedSamples() const {
+        return dropped_samples_.load(std::memory_order_relaxed);
+    }
+
+    // How many times the encoder failed on a chunk of audio
+    std::uint64_t EncodeErrors() const { return encode_errors_.load(std::memory_order_relaxed); }
+
+   private:
+    // Whether there's room to queue n samples; if not, they're counted as
+    // dropped
+    bool HasRoomFor(std::int32_t n) noexcept;
+    void Run();
+    void Drain();
+
+    OpusEncoder& encoder_;
+    const AudioSetup encoder_setup_;
+    const std::chrono::milliseconds queue_duration_;
+    std::unique_ptr<AudioRingBuffer<float>> queue_;
+    // Worker thread only, while it runs. Without a converter, queued audio
+    // goes straight to the encoder.
+    std::optional<CaptureConverter> converter_;
+    std::int32_t input_channels_{1};
+    // Where queued audio that wraps around the end of the queue is made
+    // contiguous for the converter
+    std::vector<float> chunk_;
+    std::thread thread_;
+    std::atomic<bool> stopping_{false};
+    // The capture thread wakes the worker without taking wake_mutex_, so a
+    // wakeup can slip past; the worker never sleeps longer than a short
+    // timeout, which bounds what that costs
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    std::atomic<std::uint64_t> overflows_{0}, dropped_samples_{0}, encode_errors_{0};
+};
+
+}  // namespace winrt::blurt::audio::implementation
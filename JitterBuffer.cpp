@@ -0,0 +1,163 @@
+#include "pch.h"
+
+#include "JitterBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace winrt::blurt::audio::implementation {
+
+namespace {
+// If a frame shows up this far behind what we've already played, assume the
+// sender reset its counter rather than that the frame is just very late
+constexpr std::uint64_t kSequenceResetThreshold = 1000;
+
+// How many jitter deviations of headroom to keep in the target depth
+constexpr double kJitterHeadroom = 3.0;
+
+constexpr double FrameTicks() {
+    return static_cast<double>(
+        std::chrono::duration_cast<JitterBuffer::Clock::duration>(kMumbleFrameDuration).count());
+}
+}  // namespace
+
+JitterBuffer::PutResult JitterBuffer::Put(std::uint64_t seq, std::uint32_t duration,
+                                          bool is_terminator, ByteSlice payload,
+                                          Clock::time_point arrival) {
+    if (seq + kSequenceResetThreshold < release_floor_) {
+        Clear();
+        next_seq_.reset();
+        release_floor_ = 0;
+        last_transit_.reset();
+    }
+    if (IsHeld(seq)) {
+        duplicate_count_++;
+        return PutResult::Duplicate;
+    }
+
+    // Late frames are exactly the ones the jitter estimate needs to hear
+    // about, so update it before deciding whether to keep this one
+    last_duration_ = std::max<std::uint32_t>(duration, 1);
+    UpdateJitter(seq, arrival);
+    if (seq < release_floor_ || (held_count_ != 0 && seq + kSlots <= last_held_)) {
+        late_count_++;
+        return PutResult::Late;
+    }
+
+    if (held_count_ == 0) {
+        first_held_ = last_held_ = seq;
+    } else if (seq > last_held_) {
+        // Make room by giving up on whatever is too far behind this; it's
+        // waited far longer than any target depth anyway
+        while (held_count_ != 0 && seq >= first_held_ + kSlots) {
+            late_count_++;
+            DropFirst();
+        }
+        if (seq >= kSlots) release_floor_ = std::max(release_floor_, seq - kSlots + 1);
+        if (held_count_ == 0) first_held_ = seq;
+        last_held_ = seq;
+    } else {
+        first_held_ = std::min(first_held_, seq);
+    }
+    Slot(seq) = Held{true, seq, last_duration_, is_terminator, arrival, std::move(payload)};
+    held_count_++;
+    return PutResult::Accepted;
+}
+
+std::optional<JitterBuffer::Frame> JitterBuffer::Pop(Clock::time_point now) {
+    if (held_count_ == 0) return std::nullopt;
+    const auto& first = Slot(first_held_);
+    auto target = target_depth_ * kMumbleFrameDuration;
+    bool waited_long_enough = now - first.arrival >= target;
+
+    if (!next_seq_) {
+        // Between talk spurts: hold off until there's enough cushion, unless
+        // the whole (short) spurt is already here
+        if (HeldDuration() < target_depth_ && !HoldsTerminator() && !waited_long_enough)
+            return std::nullopt;
+        next_seq_ = first_held_;
+    }
+
+    if (first_held_ <= *next_seq_) return Release();
+
+    // There's a hole before the earliest frame we have; wait for it to fill
+    // until we'd otherwise be eating into the target depth
+    if (HeldDuration() < target_depth_ && !waited_long_enough) return std::nullopt;
+    auto gap = first_held_ - *next_seq_;
+    if (gap > max_depth_) {
+        // Too big to be packet loss; more likely the sender paused without
+        // us seeing a terminator, so just pick up where it resumed
+        next_seq_ = first_held_;
+        return Release();
+    }
+    Frame result{*next_seq_, static_cast<std::uint32_t>(gap), false, std::nullopt};
+    next_seq_ = first_held_;
+    release_floor_ = first_held_;
+    gap_count_++;
+    return result;
+}
+
+void JitterBuffer::Clear() {
+    for (auto& held : held_) held = Held{};
+    held_count_ = 0;
+}
+
+void JitterBuffer::DropFirst() {
+    Slot(first_held_) = Held{};
+    if (--held_count_ == 0) return;
+    do {
+        first_held_++;
+    } while (!IsHeld(first_held_));
+}
+
+std::uint32_t JitterBuffer::HeldDuration() const {
+    std::uint32_t total{0};
+    if (held_count_ == 0) return total;
+    for (auto seq = first_held_; seq <= last_held_; seq++) {
+        if (IsHeld(seq)) total += Slot(seq).duration;
+    }
+    return total;
+}
+
+bool JitterBuffer::HoldsTerminator() const {
+    if (held_count_ == 0) return false;
+    for (auto seq = first_held_; seq <= last_held_; seq++) {
+        if (IsHeld(seq) && Slot(seq).is_terminator) return true;
+    }
+    return false;
+}
+
+void JitterBuffer::UpdateJitter(std::uint64_t seq, Clock::time_point arrival) {
+    // Transit time relative to the sender's clock, up to an unknown constant
+    // offset that cancels out in the difference below
+    double transit = static_cast<double>(arrival.time_since_epoch().count()) -
+                     static_cast<double>(seq) * FrameTicks();
+    if (last_transit_) {
+        double d = std::abs(transit - *last_transit_);
+        jitter_ += (d - jitter_) / 16.0;
+    }
+    last_transit_ = transit;
+
+    auto headroom = static_cast<std::uint32_t>(
+        std::ceil(kJitterHeadroom * std::max(jitter_, link_jitter_) / FrameTicks()));
+    if (lossy_) headroom += last_duration_;
+    target_depth_ = std::clamp(last_duration_ + headroom, min_depth_, max_depth_);
+}
+
+JitterBuffer::Frame JitterBuffer::Release() {
+    auto seq = first_held_;
+    auto& held = Slot(seq);
+    Frame result{seq, held.duration, held.is_terminator, std::move(held.payload)};
+    DropFirst();
+
+    release_floor_ = seq + result.duration_;
+    if (result.is_terminator_) {
+        next_seq_.reset();
+    } else {
+        next_seq_ = release_floor_;
+    }
+    return result;
+}
+
+}  // namespace winrt::blurt::audio::implementation
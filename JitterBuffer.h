@@ -0,0 +1,170 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include "AudioParams.h"
+#include "ByteChunk.h"
+
+namespace winrt::blurt::audio::implementation {
+
+// Reorders the encoded audio frames from a single speaker by frame
+// sequence number and decides when each one is due for decoding.
+//
+// Frames go in with Put() as they arrive off the network, in whatever
+// order; frames come out of Pop() in sequence order. At the start of a talk
+// spurt, nothing comes out until enough audio is held to cover the target
+// depth, so the downstream playout buffer starts out with that much cushion
+// against uneven arrivals. After that, frames come out as soon as their
+// predecessors have. If a frame is still missing once the target depth's
+// worth of audio has piled up behind it, Pop() reports the gap and moves
+// on; if the missing frame turns up after that, it's dropped as late.
+//
+// The target depth adapts to the measured inter-arrival jitter, so a clean
+// link gets close to zero added latency and a bumpy one gets enough to
+// avoid running dry. What's known about the network from elsewhere can
+// raise it further; see NetworkHint().
+//
+// Sequence numbers and durations are in Mumble frames (kMumbleFrameDuration,
+// i.e. 10 ms each). Held frames live in a fixed ring of slots indexed by
+// sequence number, so nothing here allocates. Nothing here reads a clock
+// either; every time comes from the caller, so behavior is fully
+// deterministic. The caller is responsible for locking access from
+// different threads.
+class JitterBuffer {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class PutResult {
+        Accepted,
+        Duplicate,
+        Late,
+    };
+
+    // A frame due to be decoded. If IsGap() is true, the frame never
+    // arrived in time and Payload() is null; the caller should conceal it.
+    class Frame {
+       public:
+        std::uint64_t Sequence() const { return seq_; }
+        std::uint32_t Duration() const { return duration_; }
+        bool IsTerminator() const { return is_terminator_; }
+        bool IsGap() const { return !payload_.has_value(); }
+        const ByteSlice* Payload() const { return payload_ ? &*payload_ : nullptr; }
+
+       private:
+        friend class JitterBuffer;
+        Frame(std::uint64_t seq, std::uint32_t duration, bool is_terminator,
+              std::optional<ByteSlice>&& payload)
+            : seq_{seq},
+              duration_{duration},
+              is_terminator_{is_terminator},
+              payload_{std::move(payload)} {}
+
+        std::uint64_t seq_;
+        std::uint32_t duration_;
+        bool is_terminator_;
+        std::optional<ByteSlice> payload_;
+    };
+
+    // Bounds on the adaptive target depth, in Mumble frames
+    JitterBuffer(std::uint32_t min_depth = 2, std::uint32_t max_depth = 20)
+        : min_depth_{min_depth}, max_depth_{max_depth}, target_depth_{min_depth} {}
+
+    // Offer a frame that arrived at the given time; `duration` is how many
+    // Mumble frames' worth of audio the payload holds.
+    PutResult Put(std::uint64_t seq, std::uint32_t duration, bool is_terminator,
+                  ByteSlice payload, Clock::time_point arrival);
+
+    // Tell the buffer what's known about the network apart from this
+    // speaker's arrivals: the jitter on our own link, which every speaker's
+    // audio crosses, and whether this speaker's packets are often lost, in
+    // which case holding one more packet gives the forward error correction
+    // in the packet after a gap time to arrive. Either can only raise the
+    // target depth, from the next Put() on.
+    void NetworkHint(Clock::duration link_jitter, bool lossy) {
+        link_jitter_ = static_cast<double>(link_jitter.count());
+        lossy_ = lossy;
+    }
+
+    // Take the next frame that's due, if any. Call repeatedly until it
+    // returns nothing.
+    std::optional<Frame> Pop(Clock::time_point now);
+
+    // Get the payload of the earliest frame still held, if any; useful for
+    // recovering a gap from the forward error correction data in the frame
+    // after it. The pointer is only good until the next Put() or Pop().
+    const ByteSlice* PeekNextPayload() const {
+        return held_count_ == 0 ? nullptr : &Slot(first_held_).payload;
+    }
+
+    // How many frames are held, waiting to be due
+    std::size_t HeldFrames() const { return held_count_; }
+
+    // The current target depth, in Mumble frames
+    std::uint32_t TargetDepth() const { return target_depth_; }
+
+    // Smoothed inter-arrival jitter estimate (RFC 3550, section 6.4.1)
+    Clock::duration Jitter() const {
+        return std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double, Clock::period>{jitter_});
+    }
+
+    std::uint64_t LateCount() const { return late_count_; }
+    std::uint64_t DuplicateCount() const { return duplicate_count_; }
+    std::uint64_t GapCount() const { return gap_count_; }
+
+   private:
+    // How far apart, in sequence numbers, held frames can be; 1.28 s of
+    // audio, well past the deepest the target gets
+    static constexpr std::size_t kSlots = 128;
+
+    struct Held {
+        bool in_use{false};
+        std::uint64_t seq{0};
+        std::uint32_t duration{0};
+        bool is_terminator{false};
+        Clock::time_point arrival;
+        ByteSlice payload;
+    };
+
+    Held& Slot(std::uint64_t seq) { return held_[seq % kSlots]; }
+    const Held& Slot(std::uint64_t seq) const { return held_[seq % kSlots]; }
+    bool IsHeld(std::uint64_t seq) const {
+        const auto& held = Slot(seq);
+        return held.in_use && held.seq == seq;
+    }
+    void Clear();
+    // Throw away the earliest held frame
+    void DropFirst();
+    std::uint32_t HeldDuration() const;
+    bool HoldsTerminator() const;
+    void UpdateJitter(std::uint64_t seq, Clock::time_point arrival);
+    // Release the earliest held frame
+    Frame Release();
+
+    const std::uint32_t min_depth_, max_depth_;
+    std::uint32_t target_depth_;
+    std::array<Held, kSlots> held_;
+    // How many frames are held, and the first and last of their sequence
+    // numbers, which are less than kSlots apart
+    std::size_t held_count_{0};
+    std::uint64_t first_held_{0}, last_held_{0};
+
+    // Set while a talk spurt is playing; the sequence number of the next
+    // frame we expect to release
+    std::optional<std::uint64_t> next_seq_;
+    // Everything before this has been released or given up on
+    std::uint64_t release_floor_{0};
+
+    std::optional<double> last_transit_;
+    double jitter_{0};
+    std::uint32_t last_duration_{2};
+    // From NetworkHint()
+    double link_jitter_{0};
+    bool lossy_{false};
+
+    std::uint64_t late_count_{0}, duplicate_count_{0}, gap_count_{0};
+};
+
+}  // namespace winrt::blurt::audio::implementation
@@ -5,8 +5,11 @@
 #include "MainPage.g.cpp"
 
 #include <debugapi.h>
+#include <sstream>
+#include <string>
 #include <utility>
 #include <vector>
+#include "PacketTrace.h"
 
 using namespace winrt;
 using namespace Windows::UI::Xaml;
@@ -28,14 +31,42 @@ Windows::Foundation::IAsyncAction MainPage::Connect_Click(IInspectable const&,
     connection_.ConnectionClosed(OnMessage);
     connection_.PacketReceived(OnMessage);
     connection_.AudioPacketReceived([this](const mumble::implementation::AudioPacket& packet) {
-        audio_system_.DecodeForOutput(packet.Payload());
+        audio_system_.DecodeForOutput(packet, connection_.Stats());
     });
     co_await connection_.Connect(params.Host(), params.Port(), params.UserName(),
                                  params.Password());
-    audio_system_.EncodedCaptureReady([this](std::vector<std::uint8_t> bytes) {
-        // TODO: this move is a bug; can't have more than one handler
-        connection_.SendAudioAsync(std::move(bytes));
+    audio_system_.EncodedCaptureReady([this](mumble::implementation::OutgoingVoiceFrame&& frame) {
+        connection_.SendAudioAsync(std::move(frame));
+        std::pair link{connection_.MaxBandwidth(), connection_.IsUdpUp()};
+        if (voice_link_ == link) return;
+        voice_link_ = link;
+        audio_system_.VoiceLinkChanged(link.first, link.second);
     });
 }
 
+void MainPage::DumpTrace_Click(IInspectable const&, RoutedEventArgs const&) {
+    // A line at a time, since the debugger cuts long strings short
+    std::istringstream trace{mumble::implementation::FormatPacketTrace()};
+    for (std::string line; std::getline(trace, line);) OutputDebugStringA((line + "\n").c_str());
+}
+
+void MainPage::VoiceProfile_SelectionChanged(IInspectable const& sender,
+                                             Controls::SelectionChangedEventArgs const&) {
+    using audio::implementation::VoiceProfile;
+    switch (sender.as<Controls::ComboBox>().SelectedIndex()) {
+        case 0:
+            audio_system_.VoiceProfileChanged(VoiceProfile::LowDelay());
+            break;
+        case 1:
+            audio_system_.VoiceProfileChanged(VoiceProfile::Default());
+            break;
+        case 2:
+            audio_system_.VoiceProfileChanged(VoiceProfile::SaveBandwidth40ms());
+            break;
+        case 3:
+            audio_system_.VoiceProfileChanged(VoiceProfile::SaveBandwidth60ms());
+            break;
+    }
+}
+
 }  // namespace winrt::blurt::implementation
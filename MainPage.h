@@ -2,6 +2,9 @@
 
 #include "MainPage.g.h"
 
+#include <cstdint>
+#include <optional>
+#include <utility>
 #include "AudioSystem.h"
 #include "ConnectionViewModel.h"
 #include "ServerConnection.h"
@@ -13,11 +16,20 @@ struct MainPage : MainPageT<MainPage> {
     blurt::ConnectionViewModel MainViewModel() const noexcept { return view_model_; }
     Windows::Foundation::IAsyncAction Connect_Click(Windows::Foundation::IInspectable const& sender,
                                                     Windows::UI::Xaml::RoutedEventArgs const& args);
+    void VoiceProfile_SelectionChanged(
+        Windows::Foundation::IInspectable const& sender,
+        Windows::UI::Xaml::Controls::SelectionChangedEventArgs const& args);
+    void DumpTrace_Click(Windows::Foundation::IInspectable const& sender,
+                         Windows::UI::Xaml::RoutedEventArgs const& args);
 
    private:
     blurt::ConnectionViewModel view_model_{nullptr};
     blurt::mumble::implementation::ServerConnection connection_;
     AudioSystem audio_system_;
+    // The server's bandwidth limit and whether voice was going over UDP, as
+    // last passed on to the audio system; only the encoder's thread touches
+    // this
+    std::optional<std::pair<std::uint32_t, bool>> voice_link_;
 };
 }  // namespace winrt::blurt::implementation
 
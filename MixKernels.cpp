@@ -0,0 +1,319 @@
+#include "pch.h"
+
+#include "MixKernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BLURT_MIX_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__) || defined(__ARM_NEON)
+#define BLURT_MIX_NEON
+#include <arm_neon.h>
+#endif
+
+// MSVC lets us use any intrinsic anywhere; GCC and Clang want to be told
+// which functions may use instructions beyond the baseline
+#if defined(__GNUC__) || defined(__clang__)
+#define BLURT_TARGET_AVX __attribute__((target("avx")))
+#else
+#define BLURT_TARGET_AVX
+#endif
+
+namespace winrt::blurt::audio::implementation {
+
+namespace {
+// The soft clipper leaves samples alone up to the knee. Past it, the rest of
+// the way to full scale follows a rational approximation of tanh,
+// u(27 + u^2) / (27 + 9u^2), with u the distance past the knee in units of
+// what's left above it; that curve starts with slope 1, so there's no kink
+// at the knee, and reaches exactly 1 with zero slope at u = 3, beyond which
+// it's clamped. All told, |x| up to 0.8 passes through and 1.4 or more comes
+// out as full scale.
+constexpr float kClipKnee = 0.8f;
+constexpr float kClipSpan = 1.0f - kClipKnee;
+constexpr float kClipSpanInverse = 1.0f / kClipSpan;
+constexpr float kClipCurveEnd = 3.0f;
+
+constexpr float kInt16Scale = 1.0f / 32768.0f;
+
+void MixAccumulateScalar(float* acc, const float* src, std::int32_t n, float gain) {
+    for (std::int32_t i = 0; i < n; i++) acc[i] += src[i] * gain;
+}
+
+void SoftClipScalar(float* buf, std::int32_t n) {
+    for (std::int32_t i = 0; i < n; i++) {
+        // Below the knee, u is zero and so is the curve
+        float a = std::abs(buf[i]);
+        float u = std::min(std::max(a - kClipKnee, 0.0f) * kClipSpanInverse, kClipCurveEnd);
+        float u2 = u * u;
+        float y = std::min(a, kClipKnee) + kClipSpan * (u * (27.0f + u2) / (27.0f + 9.0f * u2));
+        buf[i] = std::copysign(y, buf[i]);
+    }
+}
+
+float DotProductScalar(const float* a, const float* b, std::int32_t n) {
+    float sum{0};
+    for (std::int32_t i = 0; i < n; i++) sum += a[i] * b[i];
+    return sum;
+}
+
+void DownmixStereoScalar(const float* in, float* out, std::int32_t frames) {
+    for (std::int32_t i = 0; i < frames; i++) out[i] = 0.5f * (in[2 * i] + in[2 * i + 1]);
+}
+
+void Int16ToFloatScalar(const std::int16_t* in, float* out, std::int32_t n) {
+    for (std::int32_t i = 0; i < n; i++) out[i] = in[i] * kInt16Scale;
+}
+
+#ifdef BLURT_MIX_X86
+inline float HorizontalSum(__m128 v) {
+    __m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(v, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+}
+
+void MixAccumulateSSE(float* acc, const float* src, std::int32_t n, float gain) {
+    const __m128 g = _mm_set1_ps(gain);
+    std::int32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 a = _mm_loadu_ps(acc + i);
+        __m128 s = _mm_loadu_ps(src + i);
+        _mm_storeu_ps(acc + i, _mm_add_ps(a, _mm_mul_ps(s, g)));
+    }
+    MixAccumulateScalar(acc + i, src + i, n - i, gain);
+}
+
+void SoftClipSSE(float* buf, std::int32_t n) {
+    const __m128 sign = _mm_set1_ps(-0.0f), zero = _mm_setzero_ps();
+    const __m128 knee = _mm_set1_ps(kClipKnee), span = _mm_set1_ps(kClipSpan);
+    const __m128 span_inv = _mm_set1_ps(kClipSpanInverse), end = _mm_set1_ps(kClipCurveEnd);
+    const __m128 c27 = _mm_set1_ps(27.0f), c9 = _mm_set1_ps(9.0f);
+    std::int32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 x = _mm_loadu_ps(buf + i);
+        __m128 a = _mm_andnot_ps(sign, x);
+        __m128 u = _mm_min_ps(_mm_mul_ps(_mm_max_ps(_mm_sub_ps(a, knee), zero), span_inv), end);
+        __m128 u2 = _mm_mul_ps(u, u);
+        __m128 num = _mm_mul_ps(u, _mm_add_ps(c27, u2));
+        __m128 den = _mm_add_ps(c27, _mm_mul_ps(c9, u2));
+        __m128 y = _mm_add_ps(_mm_min_ps(a, knee), _mm_mul_ps(span, _mm_div_ps(num, den)));
+        _mm_storeu_ps(buf + i, _mm_or_ps(y, _mm_and_ps(sign, x)));
+    }
+    SoftClipScalar(buf + i, n - i);
+}
+
+float DotProductSSE(const float* a, const float* b, std::int32_t n) {
+    // Two accumulators, so consecutive adds don't wait on each other
+    __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+    std::int32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    return HorizontalSum(_mm_add_ps(sum0, sum1)) + DotProductScalar(a + i, b + i, n - i);
+}
+
+void DownmixStereoSSE(const float* in, float* out, std::int32_t frames) {
+    const __m128 half = _mm_set1_ps(0.5f);
+    std::int32_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        __m128 a = _mm_loadu_ps(in + 2 * i), b = _mm_loadu_ps(in + 2 * i + 4);
+        __m128 left = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_add_ps(left, right), half));
+    }
+    DownmixStereoScalar(in + 2 * i, out + i, frames - i);
+}
+
+void Int16ToFloatSSE(const std::int16_t* in, float* out, std::int32_t n) {
+    const __m128 scale = _mm_set1_ps(kInt16Scale);
+    std::int32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        // Sign-extend by putting each sample in the top half of a 32-bit
+        // lane and shifting it back down
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    Int16ToFloatScalar(in + i, out + i, n - i);
+}
+
+BLURT_TARGET_AVX void MixAccumulateAVX(float* acc, const float* src, std::int32_t n, float gain) {
+    const __m256 g = _mm256_set1_ps(gain);
+    std::int32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 a = _mm256_loadu_ps(acc + i);
+        __m256 s = _mm256_loadu_ps(src + i);
+        _mm256_storeu_ps(acc + i, _mm256_add_ps(a, _mm256_mul_ps(s, g)));
+    }
+    MixAccumulateSSE(acc + i, src + i, n - i, gain);
+}
+
+BLURT_TARGET_AVX void SoftClipAVX(float* buf, std::int32_t n) {
+    const __m256 sign = _mm256_set1_ps(-0.0f), zero = _mm256_setzero_ps();
+    const __m256 knee = _mm256_set1_ps(kClipKnee), span = _mm256_set1_ps(kClipSpan);
+    const __m256 span_inv = _mm256_set1_ps(kClipSpanInverse);
+    const __m256 end = _mm256_set1_ps(kClipCurveEnd);
+    const __m256 c27 = _mm256_set1_ps(27.0f), c9 = _mm256_set1_ps(9.0f);
+    std::int32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 x = _mm256_loadu_ps(buf + i);
+        __m256 a = _mm256_andnot_ps(sign, x);
+        __m256 u = _mm256_min_ps(
+            _mm256_mul_ps(_mm256_max_ps(_mm256_sub_ps(a, knee), zero), span_inv), end);
+        __m256 u2 = _mm256_mul_ps(u, u);
+        __m256 num = _mm256_mul_ps(u, _mm256_add_ps(c27, u2));
+        __m256 den = _mm256_add_ps(c27, _mm256_mul_ps(c9, u2));
+        __m256 y =
+            _mm256_add_ps(_mm256_min_ps(a, knee), _mm256_mul_ps(span, _mm256_div_ps(num, den)));
+        _mm256_storeu_ps(buf + i, _mm256_or_ps(y, _mm256_and_ps(sign, x)));
+    }
+    SoftClipSSE(buf + i, n - i);
+}
+
+BLURT_TARGET_AVX float DotProductAVX(const float* a, const float* b, std::int32_t n) {
+    __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+    std::int32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        sum0 = _mm256_add_ps(sum0,
+                             _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        sum1 = _mm256_add_ps(
+            sum1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+    }
+    __m256 sum = _mm256_add_ps(sum0, sum1);
+    __m128 folded = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    return HorizontalSum(folded) + DotProductSSE(a + i, b + i, n - i);
+}
+
+bool CpuHasAVX() {
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, 1);
+    bool osxsave = (regs[2] & (1 << 27)) != 0;
+    bool avx = (regs[2] & (1 << 28)) != 0;
+    // The OS also has to be saving the upper halves of the YMM registers
+    return osxsave && avx && (_xgetbv(0) & 0x6) == 0x6;
+#else
+    return __builtin_cpu_supports("avx");
+#endif
+}
+#endif  // BLURT_MIX_X86
+
+#ifdef BLURT_MIX_NEON
+void MixAccumulateNEON(float* acc, const float* src, std::int32_t n, float gain) {
+    std::int32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t a = vld1q_f32(acc + i);
+        float32x4_t s = vld1q_f32(src + i);
+        vst1q_f32(acc + i, vmlaq_n_f32(a, s, gain));
+    }
+    MixAccumulateScalar(acc + i, src + i, n - i, gain);
+}
+
+float DotProductNEON(const float* a, const float* b, std::int32_t n) {
+    float32x4_t sum0 = vdupq_n_f32(0), sum1 = vdupq_n_f32(0);
+    std::int32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        sum0 = vmlaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));
+        sum1 = vmlaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    return vaddvq_f32(vaddq_f32(sum0, sum1)) + DotProductScalar(a + i, b + i, n - i);
+}
+
+void DownmixStereoNEON(const float* in, float* out, std::int32_t frames) {
+    std::int32_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        float32x4x2_t lr = vld2q_f32(in + 2 * i);
+        vst1q_f32(out + i, vmulq_n_f32(vaddq_f32(lr.val[0], lr.val[1]), 0.5f));
+    }
+    DownmixStereoScalar(in + 2 * i, out + i, frames - i);
+}
+
+void Int16ToFloatNEON(const std::int16_t* in, float* out, std::int32_t n) {
+    std::int32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t x = vld1q_s16(in + i);
+        vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))), kInt16Scale));
+        vst1q_f32(out + i + 4,
+                  vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))), kInt16Scale));
+    }
+    Int16ToFloatScalar(in + i, out + i, n - i);
+}
+
+void SoftClipNEON(float* buf, std::int32_t n) {
+    const float32x4_t zero = vdupq_n_f32(0), knee = vdupq_n_f32(kClipKnee);
+    const float32x4_t end = vdupq_n_f32(kClipCurveEnd), c27 = vdupq_n_f32(27.0f);
+    const uint32x4_t sign = vdupq_n_u32(0x80000000u);
+    std::int32_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t x = vld1q_f32(buf + i);
+        float32x4_t a = vabsq_f32(x);
+        float32x4_t u =
+            vminq_f32(vmulq_n_f32(vmaxq_f32(vsubq_f32(a, knee), zero), kClipSpanInverse), end);
+        float32x4_t u2 = vmulq_f32(u, u);
+        float32x4_t num = vmulq_f32(u, vaddq_f32(c27, u2));
+        float32x4_t den = vmlaq_n_f32(c27, u2, 9.0f);
+        float32x4_t y = vmlaq_n_f32(vminq_f32(a, knee), vdivq_f32(num, den), kClipSpan);
+        // Put the sign back
+        vst1q_f32(buf + i, vbslq_f32(sign, x, y));
+    }
+    SoftClipScalar(buf + i, n - i);
+}
+#endif  // BLURT_MIX_NEON
+
+struct Kernels {
+    void (*mix_accumulate)(float*, const float*, std::int32_t, float);
+    void (*soft_clip)(float*, std::int32_t);
+    float (*dot_product)(const float*, const float*, std::int32_t);
+    void (*downmix_stereo)(const float*, float*, std::int32_t);
+    void (*int16_to_float)(const std::int16_t*, float*, std::int32_t);
+};
+
+Kernels PickKernels() {
+#if defined(BLURT_MIX_X86)
+    // The shuffles in downmixing and conversion don't get any wider with
+    // AVX, so those stay SSE
+    if (CpuHasAVX())
+        return {MixAccumulateAVX, SoftClipAVX, DotProductAVX, DownmixStereoSSE, Int16ToFloatSSE};
+    return {MixAccumulateSSE, SoftClipSSE, DotProductSSE, DownmixStereoSSE, Int16ToFloatSSE};
+#elif defined(BLURT_MIX_NEON)
+    return {MixAccumulateNEON, SoftClipNEON, DotProductNEON, DownmixStereoNEON, Int16ToFloatNEON};
+#else
+    return {MixAccumulateScalar, SoftClipScalar, DotProductScalar, DownmixStereoScalar,
+            Int16ToFloatScalar};
+#endif
+}
+
+const Kernels& TheKernels() {
+    static const Kernels kernels = PickKernels();
+    return kernels;
+}
+}  // namespace
+
+void MixAccumulate(float* acc, const float* src, std::int32_t n, float gain) {
+    TheKernels().mix_accumulate(acc, src, n, gain);
+}
+
+void SoftClip(float* buf, std::int32_t n) { TheKernels().soft_clip(buf, n); }
+
+float DotProduct(const float* a, const float* b, std::int32_t n) {
+    return TheKernels().dot_product(a, b, n);
+}
+
+void DownmixStereo(const float* in, float* out, std::int32_t frames) {
+    TheKernels().downmix_stereo(in, out, frames);
+}
+
+void Int16ToFloat(const std::int16_t* in, float* out, std::int32_t n) {
+    TheKernels().int16_to_float(in, out, n);
+}
+
+}  // namespace winrt::blurt::audio::implementation
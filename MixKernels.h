@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+namespace winrt::blurt::audio::implementation {
+
+// Vectorized inner loops for mixing and converting float PCM audio. Each picks the widest
+// implementation the CPU supports at runtime (AVX or SSE on x86, NEON on
+// ARM), falling back to plain scalar code. None of these allocate, lock, or
+// otherwise do anything unsafe to call from a real-time audio callback.
+//
+// Buffers may have any alignment, and counts are in total samples.
+
+// acc[i] += src[i] * gain, for i in [0, n)
+void MixAccumulate(float* acc, const float* src, std::int32_t n, float gain);
+
+// Soft-clip the samples in buf in place so they land in [-1, 1]. Samples
+// within [-0.8, 0.8] pass through untouched, so ordinary speech levels keep
+// their dynamics; louder ones bend smoothly toward full scale rather than
+// hard clipping.
+void SoftClip(float* buf, std::int32_t n);
+
+// The sum of a[i] * b[i], for i in [0, n)
+float DotProduct(const float* a, const float* b, std::int32_t n);
+
+// out[i] = the average of the left and right samples of interleaved stereo
+// frame i, for i in [0, frames)
+void DownmixStereo(const float* in, float* out, std::int32_t frames);
+
+// Convert 16-bit PCM samples to floats in [-1, 1)
+void Int16ToFloat(const std::int16_t* in, float* out, std::int32_t n);
+
+}  // namespace winrt::blurt::audio::implementation
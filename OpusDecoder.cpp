@@ -4,19 +4,27 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cstring>
 
 namespace winrt::blurt::audio::implementation {
-namespace media = winrt::Windows::Media;
-
 namespace {
-// The maximum Opus can encode in one frame is 60 ms of audio.
-// (48000 Hz) * (60 ms) is 2880 samples per channel, so a 2-channel frame
-// decodes to at most 5760 floats, a bit over 11 KiB.
+// The maximum Opus can encode in one frame is 60 ms of audio, which is
+// also the most concealment synthesizes in one go
 constexpr auto kMaxFrameDuration = std::chrono::milliseconds(60);
+// A packet can hold several frames, though, up to 120 ms in all (RFC 6716,
+// section 3.2.5). (48000 Hz) * (120 ms) is 5760 samples per channel, so a
+// 2-channel packet decodes to at most 11520 floats, 45 KiB.
+constexpr auto kMaxPacketDuration = std::chrono::milliseconds(120);
+// Playout keeps the buffer near its target, and drops anything more than a
+// little over; this is only room for the jitter buffer to release a burst
+// of frames at once on top of that
+constexpr auto kBufferDuration = std::chrono::milliseconds(480);
 }  // namespace
 
 OpusDecoder::OpusDecoder(AudioSetup audio_setup)
-    : audio_setup_{audio_setup}, buffer_{audio_setup_.TotalSamplesPer(kMaxFrameDuration) * 50} {
+    : audio_setup_{audio_setup},
+      buffer_{audio_setup_.TotalSamplesPer(kBufferDuration)},
+      wrap_scratch_{new float[audio_setup_.TotalSamplesPer(kMaxPacketDuration)]} {
     int err;
     decoder_ = opus_decoder_create(audio_setup_.SamplesPerChannelPerSecond(),
                                    audio_setup_.NumChannels(), &err);
@@ -25,7 +33,7 @@ OpusDecoder::OpusDecoder(AudioSetup audio_setup)
 
 OpusDecoder::~OpusDecoder() { opus_decoder_destroy(decoder_); }
 
-std::int32_t OpusDecoder::DecodeToBuffer(const ByteChunk& input) {
+std::int32_t OpusDecoder::DecodeToBuffer(const ByteSlice& input) {
     assert(input.size() < std::numeric_limits<std::int32_t>::max());
     auto input_size = static_cast<std::int32_t>(input.size());
 
@@ -37,38 +45,71 @@ std::int32_t OpusDecoder::DecodeToBuffer(const ByteChunk& input) {
     if (samples_per_chan <= 0)
         throw std::exception{"OpusDecoder::Decode: zany result from opus_decoder_get_nb_samples()"};
 
+    return DecodeInto(input, input_size, samples_per_chan, false);
+}
+
+std::int32_t OpusDecoder::RecoverToBuffer(const ByteSlice& next, std::int32_t samples_per_chan) {
+    // Opus keeps a low-bitrate copy of the previous frame (LBRR) only in
+    // SILK and hybrid mode packets, which have TOC configs 0 through 15;
+    // CELT-only packets never carry one. Asking a packet without LBRR data
+    // for FEC makes Opus fall back to ordinary concealment, so that's what
+    // we count it as.
+    if (next.size() == 0) return ConcealToBuffer(samples_per_chan);
+    // FEC only ever covers the one packet before, so no more than a packet
+    samples_per_chan =
+        std::min(samples_per_chan, audio_setup_.SamplesPerChannelPer(kMaxPacketDuration));
+    bool may_have_fec = (next.data()[0] >> 3) < 16;
+    auto input_size = static_cast<std::int32_t>(next.size());
+    auto samples = DecodeInto(next, input_size, samples_per_chan, true);
+    if (samples > 0) (may_have_fec ? fec_recovered_ : concealed_) += samples;
+    return samples;
+}
+
+std::int32_t OpusDecoder::ConcealToBuffer(std::int32_t samples_per_chan) {
+    // Opus can only synthesize up to one maximal frame at a time
+    const auto max_chunk = audio_setup_.SamplesPerChannelPer(kMaxFrameDuration);
+    std::int32_t total{0};
+    while (total < samples_per_chan) {
+        auto chunk = std::min(samples_per_chan - total, max_chunk);
+        auto samples = DecodeInto(nullptr, 0, chunk, false);
+        if (samples == 0) break;
+        total += samples;
+    }
+    concealed_ += total;
+    return total;
+}
+
+std::int32_t OpusDecoder::DecodeInto(const std::uint8_t* input, std::int32_t input_size,
+                                     std::int32_t samples_per_chan, bool decode_fec) {
+    // Opus never produces more than a packet's worth, which is all the
+    // scratch space has room for
+    if (samples_per_chan > audio_setup_.SamplesPerChannelPer(kMaxPacketDuration))
+        throw std::exception{"OpusDecoder::Decode: audio packet longer than Opus allows"};
     auto needed_floats = samples_per_chan * audio_setup_.NumChannels();
-    std::lock_guard lock{mutex_};
     if (buffer_.WriteCapacity() < needed_floats) {
         // We're out of buffer space, so tell Opus that we're dropping the packet
         opus_decode_float(decoder_, nullptr, input_size, nullptr, samples_per_chan, 0);
         return 0;
     }
-    auto samples =
-        opus_decode_float(decoder_, input, input_size, buffer_.GetWriteDest(needed_floats),
-                          samples_per_chan, 0 /* decode_fec */);
+
+    // Decode straight into the ring buffer unless the free space wraps
+    // around the end, which happens about once per trip around the buffer
+    auto dest = buffer_.GetWriteSegments(needed_floats);
+    bool wrapped = dest.second.size > 0;
+    auto samples = opus_decode_float(decoder_, input, input_size,
+                                     wrapped ? wrap_scratch_.get() : dest.first.data,
+                                     samples_per_chan, decode_fec ? 1 : 0);
     if (samples <= 0) throw std::exception{"OpusDecoder::Decode: decode step failed; possible bug"};
     if (samples < samples_per_chan)
         throw std::exception{"OpusDecoder::Decode: decode step returned too few samples"};
     assert(samples == samples_per_chan);
+    if (wrapped) {
+        std::memcpy(dest.first.data, wrap_scratch_.get(), dest.first.size * sizeof(float));
+        std::memcpy(dest.second.data, wrap_scratch_.get() + dest.first.size,
+                    dest.second.size * sizeof(float));
+    }
+    buffer_.CommitWrite(needed_floats);
     return samples;
 }
 
-media::AudioFrame OpusDecoder::ConsumeAudio(std::int32_t samples_per_chan) {
-    std::lock_guard lock{mutex_};
-    auto buffered_samples = static_cast<std::uint32_t>(buffer_.ReadCapacity());
-    auto samples_to_read =
-        std::min<std::uint32_t>(buffered_samples, samples_per_chan * audio_setup_.NumChannels());
-    if (samples_to_read == 0) return nullptr;
-
-    // AudioFrame constructor is capacity in bytes:
-    // https://docs.microsoft.com/en-us/uwp/api/windows.media.audioframe.-ctor
-    media::AudioFrame frame{samples_to_read * sizeof(float)};
-    auto buffer = frame.LockBuffer(media::AudioBufferAccessMode::Write);
-    auto buffer_ref = buffer.CreateReference();
-    float* dest = reinterpret_cast<float*>(buffer_ref.data());
-    buffer_.ReadSamplesTo(dest, samples_to_read);
-    return frame;
-}
-
 }  // namespace winrt::blurt::audio::implementation
@@ -1,12 +1,11 @@
 #pragma once
 
 #include <cstdint>
-#include <mutex>
-#include "AudioBuffer.h"
+#include <memory>
 #include "AudioParams.h"
+#include "AudioRingBuffer.h"
 #include "ByteChunk.h"
 #include "opus/opus.h"
-#include "winrt/Windows.Media.Audio.h"
 
 namespace winrt::blurt::audio::implementation {
 class OpusDecoder {
@@ -14,20 +13,57 @@ class OpusDecoder {
     OpusDecoder(AudioSetup);
     ~OpusDecoder();
 
-    // Decode the given audio bytes to the internal buffer. This is thread-safe
-    // to be used concurrently with ConsumeFrame().
-    std::int32_t DecodeToBuffer(const ByteChunk& encoded);
+    // The methods below come in two groups. DecodeToBuffer() and Reset()
+    // must only be called from one (producer) thread; BufferedSamples(),
+    // PeekAudio() and ReleaseAudio() must only be called from one (consumer)
+    // thread. The two threads never block each other.
 
-    // Read PCM audio from the internal buffer, up to the given number of
-    // samples per channel; returns nullptr if the buffer is empty. This
-    // method is thread-safe for concurrent use with DecodeToBuffer(). Any PCM
-    // audio returned from this method is no longer available to be consumed.
-    Windows::Media::AudioFrame ConsumeAudio(std::int32_t samples_per_chan);
+    // Decode the given audio bytes to the internal buffer
+    std::int32_t DecodeToBuffer(const ByteSlice& encoded);
+
+    // Fill in for a lost frame of the given length using the forward error
+    // correction data in the packet that followed it, or by concealment if
+    // that packet has none. Call this before DecodeToBuffer(next).
+    std::int32_t RecoverToBuffer(const ByteSlice& next, std::int32_t samples_per_chan);
+
+    // Fill in for lost audio of the given length by packet loss concealment
+    std::int32_t ConcealToBuffer(std::int32_t samples_per_chan);
+
+    // Reset the decoder state, e.g. before decoding an unrelated stream
+    void Reset() { opus_decoder_ctl(decoder_, OPUS_RESET_STATE); }
+
+    // Get the number of samples (total, not per channel) of decoded PCM
+    // audio available to read
+    std::int32_t BufferedSamples() const { return buffer_.ReadCapacity(); }
+
+    // Get a view of the next N samples of decoded PCM audio (total, not per
+    // channel) without consuming them. If N is above BufferedSamples(),
+    // behavior is undefined.
+    AudioRingBuffer<float>::Segments<const float> PeekAudio(std::int32_t num_samples) const {
+        return buffer_.GetReadSegments(num_samples);
+    }
+
+    // Consume N samples previously viewed with PeekAudio()
+    void ReleaseAudio(std::int32_t num_samples) { buffer_.CommitRead(num_samples); }
+
+    // Counts of samples per channel filled in for lost audio, by method;
+    // producer thread only
+    std::uint64_t FecRecoveredSamples() const { return fec_recovered_; }
+    std::uint64_t ConcealedSamples() const { return concealed_; }
 
    private:
+    std::int32_t DecodeInto(const std::uint8_t* input, std::int32_t input_size,
+                            std::int32_t samples_per_chan, bool decode_fec);
+
     struct ::OpusDecoder* decoder_{nullptr};
     AudioSetup audio_setup_;
-    std::mutex mutex_;
-    _Guarded_by_(mutex_) AudioBuffer<float> buffer_;
+    AudioRingBuffer<float> buffer_;
+
+    // Opus needs somewhere contiguous to decode into; when the free space in
+    // buffer_ wraps around, we decode here and then copy. It holds the
+    // longest packet Opus allows.
+    std::unique_ptr<float[]> wrap_scratch_;
+
+    std::uint64_t fec_recovered_{0}, concealed_{0};
 };
 }  // namespace winrt::blurt::audio::implementation
@@ -2,55 +2,246 @@
 
 #include "OpusEncoder.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
 namespace winrt::blurt::audio::implementation {
-namespace media = winrt::Windows::Media;
 
 namespace {
 constexpr auto kMaxRecommendedOpusFrameSize = 4000;
+// How much captured audio can wait to be encoded
+constexpr auto kBufferDuration = std::chrono::milliseconds{1000};
 }  // namespace
 
-OpusEncoder::OpusEncoder(AudioSetup audio_setup, OpusFrameSize frame_size)
-    : samples_per_frame_{audio_setup.TotalSamplesPer(frame_size.Duration())},
-      audio_setup_{audio_setup},
-      pcm_buffer_{samples_per_frame_ * 50},
-      encoding_buffer_{new std::uint8_t[kMaxRecommendedOpusFrameSize]} {
+OpusEncoder::OpusEncoder(AudioSetup audio_setup, VoiceProfile profile)
+    : audio_setup_{audio_setup},
+      profile_{profile},
+      samples_per_frame_{audio_setup.TotalSamplesPer(profile.FrameDuration())},
+      mumble_frames_per_frame_{
+          static_cast<std::uint32_t>(profile.FrameDuration() / kMumbleFrameDuration)},
+      pcm_buffer_{audio_setup.TotalSamplesPer(kBufferDuration)},
+      vad_{profile.FrameDuration()},
+      controller_{profile.PacketDuration()} {
     int err;
     encoder_ = opus_encoder_create(audio_setup_.SamplesPerChannelPerSecond(),
-                                   audio_setup_.NumChannels(), OPUS_APPLICATION_AUDIO, &err);
+                                   audio_setup_.NumChannels(), profile.Application(), &err);
     if (err != OPUS_OK) abort();
-    opus_encoder_ctl(encoder_, OPUS_SET_BITRATE(40000));
-    opus_encoder_ctl(encoder_, OPUS_SET_VBR(0));
+    repacketizer_ = opus_repacketizer_create();
+    if (repacketizer_ == nullptr) abort();
+    std::lock_guard lock{mutex_};
+    StartProfile(profile);
 }
 
-OpusEncoder::~OpusEncoder() { opus_encoder_destroy(encoder_); }
+OpusEncoder::~OpusEncoder() {
+    opus_repacketizer_destroy(repacketizer_);
+    opus_encoder_destroy(encoder_);
+}
 
-void OpusEncoder::BufferRawAudio(media::AudioFrame const& frame) {
-    auto read_buffer = frame.LockBuffer(media::AudioBufferAccessMode::Read);
-    std::int32_t input_len_bytes = read_buffer.Length();
-    std::int32_t input_samples = input_len_bytes / sizeof(float);
+void OpusEncoder::Profile(VoiceProfile profile) {
+    std::lock_guard lock{mutex_};
+    pending_profile_ = profile;
+}
 
+void OpusEncoder::ExpectedLossPercent(std::int32_t percent) {
     std::lock_guard lock{mutex_};
-    if (pcm_buffer_.WriteCapacity() < input_samples) {
-        // TODO: warn about overfull audio send buffer
-        throw std::exception{"audio send buffer is overfull"};
+    controller_.ObservedLossPercent(percent);
+    ApplySettings();
+}
+
+void OpusEncoder::Bitrate(std::int32_t bits_per_second) {
+    std::lock_guard lock{mutex_};
+    controller_.PreferredBitrate(bits_per_second);
+    ApplySettings();
+}
+
+void OpusEncoder::MaxBandwidth(std::uint32_t bits_per_second) {
+    std::lock_guard lock{mutex_};
+    controller_.MaxBandwidth(bits_per_second);
+    ApplySettings();
+}
+
+void OpusEncoder::VoiceTransport(BitrateController::Transport transport) {
+    std::lock_guard lock{mutex_};
+    controller_.VoiceTransport(transport);
+    ApplySettings();
+}
+
+void OpusEncoder::CpuBudget(double share) {
+    std::lock_guard lock{mutex_};
+    controller_.CpuBudget(share);
+}
+
+BitrateController::Settings OpusEncoder::CurrentSettings() {
+    std::lock_guard lock{mutex_};
+    return controller_.Current();
+}
+
+void OpusEncoder::VoiceActivation(bool enable) {
+    std::lock_guard lock{mutex_};
+    voice_activation_ = enable;
+    vad_.Reset();
+}
+
+void OpusEncoder::Vbr(bool enable) {
+    std::lock_guard lock{mutex_};
+    controller_.PreferVbr(enable);
+    ApplySettings();
+}
+
+void OpusEncoder::Dtx(bool enable) {
+    std::lock_guard lock{mutex_};
+    dtx_ = enable;
+    opus_encoder_ctl(encoder_, OPUS_SET_DTX(enable ? 1 : 0));
+}
+
+void OpusEncoder::BufferRawAudio(const float* pcm_in, std::int32_t n) {
+    std::lock_guard lock{mutex_};
+    if (pcm_buffer_.WriteCapacity() < n) {
+        dropped_samples_.fetch_add(n, std::memory_order_relaxed);
+        return;
+    }
+
+    pcm_buffer_.WriteSamplesFrom(pcm_in, n);
+    while (true) {
+        if (pending_profile_ && frames_pending_ == 0) {
+            StartProfile(*pending_profile_);
+            pending_profile_.reset();
+        }
+        if (pcm_buffer_.ReadCapacity() < samples_per_frame_) break;
+        const float* pcm = pcm_buffer_.GetReadSourceFor(samples_per_frame_);
+        if (!voice_activation_) {
+            EncodeFrame(pcm, false);
+            continue;
+        }
+        switch (vad_.Process(pcm, samples_per_frame_)) {
+            case VoiceActivityDetector::Decision::Silent:
+                // Frames can only be waiting here if voice activation was
+                // just turned on in the middle of a packet
+                FlushPacket(true);
+                frame_seq_ += mumble_frames_per_frame_;
+                frames_skipped_.fetch_add(1, std::memory_order_relaxed);
+                break;
+            case VoiceActivityDetector::Decision::Start:
+                // Start each spurt from a clean slate rather than from
+                // whatever the encoder last heard, possibly seconds ago
+                opus_encoder_ctl(encoder_, OPUS_RESET_STATE);
+                EncodeFrame(pcm, false);
+                break;
+            case VoiceActivityDetector::Decision::Continue:
+                EncodeFrame(pcm, false);
+                break;
+            case VoiceActivityDetector::Decision::End:
+                EncodeFrame(pcm, true);
+                break;
+        }
+    }
+}
+
+void OpusEncoder::EncodeFrame(const float* pcm, bool is_terminator) {
+    if (profile_.FramesPerPacket() == 1) {
+        // Encode straight into the outgoing frame's payload area, so the
+        // bytes never need to move again before they hit the socket
+        mumble::implementation::OutgoingVoiceFrame out{kMaxRecommendedOpusFrameSize};
+        out.PayloadSize(EncodeInto(pcm, out.PayloadDest(), out.PayloadCapacity()));
+        SendPacket(std::move(out), is_terminator);
+        return;
     }
 
-    auto frame_ref = read_buffer.CreateReference();
-    pcm_buffer_.WriteSamplesFrom(reinterpret_cast<const float*>(frame_ref.data()), input_samples);
-    if (pcm_buffer_.ReadCapacity() < samples_per_frame_) return;
+    std::uint8_t* dest = frame_store_.data() + frames_pending_ * kMaxRecommendedOpusFrameSize;
+    auto size = EncodeInto(pcm, dest, kMaxRecommendedOpusFrameSize);
+    if (frames_pending_ == 0) opus_repacketizer_init(repacketizer_);
+    if (opus_repacketizer_cat(repacketizer_, dest, size) != OPUS_OK) {
+        // Only frames of the same mode and bandwidth go in one packet; when
+        // Opus switches, send what's been collected and start again
+        FlushPacket(false);
+        std::memmove(frame_store_.data(), dest, size);
+        opus_repacketizer_init(repacketizer_);
+        if (opus_repacketizer_cat(repacketizer_, frame_store_.data(), size) != OPUS_OK)
+            throw std::exception{"Opus repacketizer error"};
+    }
+    frames_pending_++;
+    if (is_terminator || frames_pending_ == profile_.FramesPerPacket()) FlushPacket(is_terminator);
+}
 
-    auto encoded_bytes =
-        opus_encode_float(encoder_, pcm_buffer_.GetReadSourceFor(samples_per_frame_),
-                          samples_per_frame_ / audio_setup_.NumChannels(), encoding_buffer_.get(),
-                          kMaxRecommendedOpusFrameSize);
+std::int32_t OpusEncoder::EncodeInto(const float* pcm, std::uint8_t* dest,
+                                     std::int32_t capacity) {
+    auto start = std::chrono::steady_clock::now();
+    auto encoded_bytes = opus_encode_float(
+        encoder_, pcm, samples_per_frame_ / audio_setup_.NumChannels(), dest, capacity);
     if (encoded_bytes <= 0) {
         // TODO: log Opus encoding error
         throw std::exception{"Opus encoder error"};
     }
-    assert(encoded_bytes < kMaxRecommendedOpusFrameSize);
-    std::vector<std::uint8_t> result{encoding_buffer_.get(),
-                                     encoding_buffer_.get() + encoded_bytes};
-    encoded_audio_ready_(result);
+    controller_.OnFrameEncoded(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start));
+    ApplySettings();
+    frames_sent_.fetch_add(1, std::memory_order_relaxed);
+    return encoded_bytes;
+}
+
+void OpusEncoder::FlushPacket(bool is_terminator) {
+    if (frames_pending_ == 0) return;
+    mumble::implementation::OutgoingVoiceFrame out{
+        std::min(frames_pending_ * kMaxRecommendedOpusFrameSize,
+                 mumble::implementation::OutgoingVoiceFrame::kMaxPayloadSize)};
+    auto size = opus_repacketizer_out(repacketizer_, out.PayloadDest(), out.PayloadCapacity());
+    frames_pending_ = 0;
+    if (size <= 0) throw std::exception{"Opus repacketizer error"};
+    out.PayloadSize(size);
+    SendPacket(std::move(out), is_terminator);
+}
+
+void OpusEncoder::SendPacket(mumble::implementation::OutgoingVoiceFrame&& out,
+                             bool is_terminator) {
+    // The sequence number advances by however long the packet actually is,
+    // which needn't be a whole profile's worth
+    auto samples = opus_packet_get_nb_samples(out.PayloadDest(), out.PayloadSize(),
+                                              audio_setup_.SamplesPerChannelPerSecond());
+    if (samples <= 0) throw std::exception{"Opus encoder made a bad packet"};
+    out.FrameSequence(frame_seq_);
+    out.IsTerminator(is_terminator);
+    frame_seq_ += samples / audio_setup_.SamplesPerChannelPer(kMumbleFrameDuration);
+    if (encoded_audio_ready_) encoded_audio_ready_(std::move(out));
+}
+
+void OpusEncoder::StartProfile(const VoiceProfile& profile) {
+    // Opus only takes a new application mode when it starts afresh
+    if (opus_encoder_init(encoder_, audio_setup_.SamplesPerChannelPerSecond(),
+                          audio_setup_.NumChannels(), profile.Application()) != OPUS_OK)
+        throw std::exception{"Opus encoder init failed"};
+    // Constrained VBR keeps each frame near the target bitrate, which is
+    // kinder to the jitter buffers on the other end
+    opus_encoder_ctl(encoder_, OPUS_SET_VBR_CONSTRAINT(1));
+    opus_encoder_ctl(encoder_, OPUS_SET_DTX(dtx_ ? 1 : 0));
+    applied_.reset();
+
+    if (profile.FrameDuration() != profile_.FrameDuration())
+        vad_ = VoiceActivityDetector{profile.FrameDuration()};
+    profile_ = profile;
+    samples_per_frame_ = audio_setup_.TotalSamplesPer(profile.FrameDuration());
+    mumble_frames_per_frame_ =
+        static_cast<std::uint32_t>(profile.FrameDuration() / kMumbleFrameDuration);
+    frame_store_.resize(
+        static_cast<std::size_t>(profile.FramesPerPacket()) * kMaxRecommendedOpusFrameSize);
+    controller_.FrameDuration(profile.PacketDuration());
+    ApplySettings();
+}
+
+void OpusEncoder::ApplySettings() {
+    const auto& want = controller_.Current();
+    if (applied_ && *applied_ == want) return;
+    if (!applied_ || applied_->bitrate != want.bitrate)
+        opus_encoder_ctl(encoder_, OPUS_SET_BITRATE(want.bitrate));
+    if (!applied_ || applied_->vbr != want.vbr)
+        opus_encoder_ctl(encoder_, OPUS_SET_VBR(want.vbr ? 1 : 0));
+    if (!applied_ || applied_->loss_percent != want.loss_percent) {
+        opus_encoder_ctl(encoder_, OPUS_SET_PACKET_LOSS_PERC(want.loss_percent));
+        opus_encoder_ctl(encoder_, OPUS_SET_INBAND_FEC(want.loss_percent > 0 ? 1 : 0));
+    }
+    if (!applied_ || applied_->complexity != want.complexity)
+        opus_encoder_ctl(encoder_, OPUS_SET_COMPLEXITY(want.complexity));
+    applied_ = want;
 }
 
 }  // namespace winrt::blurt::audio::implementation
@@ -1,59 +1,176 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <mutex>
-#include <opus/opus.h>
+#include <optional>
 #include <vector>
+#include <opus/opus.h>
 #include "AudioBuffer.h"
 #include "AudioParams.h"
-#include "winrt/Windows.Media.Audio.h"
+#include "BitrateController.h"
+#include "OutgoingVoiceFrame.h"
+#include "VoiceActivityDetector.h"
 #include "winrt/base.h"
 
 namespace winrt::blurt::audio::implementation {
 
-class OpusFrameSize {
+// How captured audio is cut into Opus frames, and the frames into packets.
+// Mumble counts time in 10-ms frames, so every profile's packets are a
+// multiple of that.
+class VoiceProfile {
    public:
-    static OpusFrameSize Of10ms() { return OpusFrameSize{std::chrono::milliseconds{10}}; }
-    static OpusFrameSize Of20ms() { return OpusFrameSize{std::chrono::milliseconds{20}}; }
-    static OpusFrameSize Of40ms() { return OpusFrameSize{std::chrono::milliseconds{40}}; }
-    static OpusFrameSize Of80ms() { return OpusFrameSize{std::chrono::milliseconds{80}}; }
+    // 10-ms packets from Opus's restricted low-delay mode, which gives up its
+    // speech-specific coding to shave off a few more milliseconds
+    static VoiceProfile LowDelay() {
+        return VoiceProfile{std::chrono::milliseconds{10}, 1, OPUS_APPLICATION_RESTRICTED_LOWDELAY};
+    }
+    // 20-ms packets, as Mumble's own client sends by default
+    static VoiceProfile Default() {
+        return VoiceProfile{std::chrono::milliseconds{20}, 1, OPUS_APPLICATION_AUDIO};
+    }
+    // Two or three 20-ms frames to a packet, so fewer packets carry the
+    // header costs. Frames are encoded one at a time and packed together,
+    // rather than encoded as one long frame, so a talk spurt can end with a
+    // packet that's only partly full.
+    static VoiceProfile SaveBandwidth40ms() {
+        return VoiceProfile{std::chrono::milliseconds{20}, 2, OPUS_APPLICATION_AUDIO};
+    }
+    static VoiceProfile SaveBandwidth60ms() {
+        return VoiceProfile{std::chrono::milliseconds{20}, 3, OPUS_APPLICATION_AUDIO};
+    }
 
-    std::chrono::milliseconds Duration() const { return duration_; }
+    std::chrono::milliseconds FrameDuration() const { return frame_duration_; }
+    std::int32_t FramesPerPacket() const { return frames_per_packet_; }
+    std::chrono::milliseconds PacketDuration() const {
+        return frame_duration_ * frames_per_packet_;
+    }
+    // One of the OPUS_APPLICATION_* constants
+    int Application() const { return application_; }
 
    private:
-    OpusFrameSize(std::chrono::milliseconds duration) : duration_{duration} {}
-    const std::chrono::milliseconds duration_;
+    VoiceProfile(std::chrono::milliseconds frame_duration, std::int32_t frames_per_packet,
+                 int application)
+        : frame_duration_{frame_duration},
+          frames_per_packet_{frames_per_packet},
+          application_{application} {}
+    std::chrono::milliseconds frame_duration_;
+    std::int32_t frames_per_packet_;
+    int application_;
 };
 
 class OpusEncoder {
    public:
-    // Create a new Opus encoder with the given desired frame size
-    OpusEncoder(AudioSetup audio_setup, OpusFrameSize frame_size);
+    // Create a new Opus encoder that starts out with the given profile
+    OpusEncoder(AudioSetup audio_setup, VoiceProfile profile);
     ~OpusEncoder();
 
-    // Read raw audio into the encoder's buffer. If this input frame adds
-    // enough to the buffer that the buffer has enough audio to fill this
-    // encoder's frame size, then encoding is performed and the
-    // EncodedAudioReady event is fired.
-    void BufferRawAudio(winrt::Windows::Media::AudioFrame const& frame);
+    // Read n samples of raw audio, already in this encoder's setup, into the
+    // encoder's buffer. If this adds enough to the buffer that the buffer
+    // has enough audio to fill this encoder's frame size, then encoding is
+    // performed and the encoded audio handler is called. With voice
+    // activation on, frames that fall outside a talk spurt are dropped
+    // without being encoded. If the buffer has no room for all n samples,
+    // they're dropped and counted in DroppedSamples().
+    void BufferRawAudio(const float* pcm, std::int32_t n);
+
+    // Switch to another profile. The switch happens at the next packet
+    // boundary, so no packet mixes the two.
+    void Profile(VoiceProfile profile);
+
+    // Turn voice activation on (the default) or off; off means every frame
+    // is sent, as with push-to-talk held down
+    void VoiceActivation(bool enable);
 
-    // TODO: Avoid copying the byte vector so much?
-    event_token EncodedAudioReady(delegate<std::vector<std::uint8_t>> const& handler) {
-        return encoded_audio_ready_.add(handler);
+    // Turn Opus variable bitrate and discontinuous transmission on or off.
+    // Both are off by default. DTX lets the encoder spend almost nothing on
+    // the quiet stretches inside a talk spurt. VBR is only a preference: it's
+    // not used while the server's bandwidth limit is holding the bitrate
+    // down.
+    void Vbr(bool enable);
+    void Dtx(bool enable);
+
+    // Tell the encoder what percentage of packets are expected to be lost.
+    // Anything above zero turns on in-band forward error correction, which
+    // lets the receiver rebuild a lost frame from the one after it.
+    void ExpectedLossPercent(std::int32_t percent);
+
+    // The bitrate to use when the network allows; 40 kb/s by default
+    void Bitrate(std::int32_t bits_per_second);
+
+    // Tell the encoder what it's allowed to send, headers included, and how
+    // it's being sent, so it can keep under the limit. Calling these when
+    // nothing has changed is cheap.
+    void MaxBandwidth(std::uint32_t bits_per_second);
+    void VoiceTransport(BitrateController::Transport transport);
+
+    // The share of each frame's duration that encoding may take, from 0 to
+    // 1; past that, the encoder trades quality for speed
+    void CpuBudget(double share);
+
+    // How the encoder is tuned right now
+    BitrateController::Settings CurrentSettings();
+
+    // Set the function that takes each encoded frame. The encoder writes
+    // straight into the frame's payload area, and the frame is handed over
+    // by move, so there's exactly one handler rather than an event.
+    using EncodedAudioHandler = std::function<void(mumble::implementation::OutgoingVoiceFrame&&)>;
+    void EncodedAudioReady(EncodedAudioHandler handler) {
+        std::lock_guard lock{mutex_};
+        encoded_audio_ready_ = std::move(handler);
     }
-    void EncodedAudioReady(winrt::event_token const& token) noexcept {
-        encoded_audio_ready_.remove(token);
+
+    // How many Opus frames have been encoded and sent, and how many dropped
+    // as silence, since the encoder was created
+    std::uint64_t FramesSent() const { return frames_sent_.load(std::memory_order_relaxed); }
+    std::uint64_t FramesSkipped() const { return frames_skipped_.load(std::memory_order_relaxed); }
+
+    // How many samples of raw audio were dropped for want of buffer space
+    std::uint64_t DroppedSamples() const {
+        return dropped_samples_.load(std::memory_order_relaxed);
     }
 
    private:
+    void EncodeFrame(const float* pcm, bool is_terminator);
+    // Encode one frame into dest, returning its size
+    std::int32_t EncodeInto(const float* pcm, std::uint8_t* dest, std::int32_t capacity);
+    // Pack up the frames collected so far into one packet, and send it
+    void FlushPacket(bool is_terminator);
+    void SendPacket(mumble::implementation::OutgoingVoiceFrame&& out, bool is_terminator);
+    // Set up Opus, and everything that depends on frame size, for a profile
+    void StartProfile(const VoiceProfile& profile);
+    // Pass any changes the controller has made on to Opus
+    void ApplySettings();
+
     struct ::OpusEncoder* encoder_{nullptr};
-    AudioSetup audio_setup_;
-    const std::int32_t samples_per_frame_;
+    OpusRepacketizer* repacketizer_{nullptr};
+    const AudioSetup audio_setup_;
     std::recursive_mutex mutex_;
+    _Guarded_by_(mutex_) VoiceProfile profile_;
+    // A profile to switch to once the packet being collected is sent
+    _Guarded_by_(mutex_) std::optional<VoiceProfile> pending_profile_;
+    _Guarded_by_(mutex_) std::int32_t samples_per_frame_;
+    // Frame duration in Mumble frames, i.e. how far each skipped frame
+    // advances the sequence number
+    _Guarded_by_(mutex_) std::uint32_t mumble_frames_per_frame_;
     _Guarded_by_(mutex_) AudioBuffer<float> pcm_buffer_;
-    _Guarded_by_(mutex_) std::unique_ptr<std::uint8_t[]> encoding_buffer_;
-    winrt::event<winrt::delegate<std::vector<std::uint8_t>>> encoded_audio_ready_;
+    // Encoded frames waiting to be packed together, each in a slot of the
+    // largest size a frame can be; the repacketizer points into this
+    _Guarded_by_(mutex_) std::vector<std::uint8_t> frame_store_;
+    _Guarded_by_(mutex_) std::int32_t frames_pending_{0};
+    _Guarded_by_(mutex_) bool dtx_{false};
+    _Guarded_by_(mutex_) VoiceActivityDetector vad_;
+    _Guarded_by_(mutex_) bool voice_activation_{true};
+    // The sequence number keeps counting through silence, so receivers can
+    // tell how long the sender was quiet
+    _Guarded_by_(mutex_) std::uint64_t frame_seq_{0};
+    _Guarded_by_(mutex_) BitrateController controller_;
+    // What Opus was last told; nothing, before the first time
+    _Guarded_by_(mutex_) std::optional<BitrateController::Settings> applied_;
+    _Guarded_by_(mutex_) EncodedAudioHandler encoded_audio_ready_;
+    std::atomic<std::uint64_t> frames_sent_{0}, frames_skipped_{0}, dropped_samples_{0};
 };
 }  // namespace winrt::blurt::audio::implementation
@@ -0,0 +1,56 @@
+#include "pch.h"
+
+#include "OutgoingVoiceFrame.h"
+
+#include <assert.h>
+#include <cstring>
+#include <stdexcept>
+#include "AudioPacket.h"
+#include "ControlPacket.h"
+
+namespace winrt::blurt::mumble::implementation {
+
+namespace {
+std::int32_t CheckedCapacity(std::int32_t payload_capacity) {
+    if (payload_capacity < 0 || payload_capacity > OutgoingVoiceFrame::kMaxPayloadSize)
+        throw std::out_of_range{"voice frame payload capacity out of range"};
+    return payload_capacity;
+}
+}  // namespace
+
+OutgoingVoiceFrame::OutgoingVoiceFrame(std::int32_t payload_capacity)
+    : buffer_{ByteChunk::Allocate(kReservedHeaderSize + CheckedCapacity(payload_capacity))} {}
+
+void OutgoingVoiceFrame::PayloadSize(std::int32_t size) {
+    if (size < 0 || size > PayloadCapacity())
+        throw std::out_of_range{"voice frame payload size out of range"};
+    payload_size_ = size;
+}
+
+void OutgoingVoiceFrame::Finish(std::uint32_t target) {
+    assert(start_ == kReservedHeaderSize);
+    std::uint8_t datagram_header[kReservedHeaderSize - kControlHeaderSize];
+    std::size_t header_len{0};
+    datagram_header[header_len++] =
+        (static_cast<std::uint8_t>(AudioPacketType::Opus) << 5) | (target & 0x1f);
+    header_len += EncodeVarInt(frame_seq_, datagram_header + header_len);
+    auto len_and_terminator = static_cast<std::uint16_t>(payload_size_) & 0x1fff;
+    if (is_terminator_) len_and_terminator |= 0x2000;
+    header_len += EncodeVarInt(len_and_terminator, datagram_header + header_len);
+
+    auto datagram_len = static_cast<std::uint32_t>(header_len + payload_size_);
+    start_ = kReservedHeaderSize - static_cast<std::int32_t>(header_len) - kControlHeaderSize;
+    std::uint8_t* p = buffer_.data() + start_;
+
+    // Control channel header: big-endian message type, then length
+    auto type = static_cast<std::uint16_t>(ControlPacketType::UDPTunnel);
+    p[0] = static_cast<std::uint8_t>(type >> 8);
+    p[1] = static_cast<std::uint8_t>(type);
+    p[2] = static_cast<std::uint8_t>(datagram_len >> 24);
+    p[3] = static_cast<std::uint8_t>(datagram_len >> 16);
+    p[4] = static_cast<std::uint8_t>(datagram_len >> 8);
+    p[5] = static_cast<std::uint8_t>(datagram_len);
+    std::memcpy(p + kControlHeaderSize, datagram_header, header_len);
+}
+
+}  // namespace winrt::blurt::mumble::implementation
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "ByteChunk.h"
+#include "VarInt.h"
+
+namespace winrt::blurt::mumble::implementation {
+
+// A voice packet laid out exactly as it goes on the wire over the control
+// channel (the 6-byte UDPTunnel message header, then the legacy datagram
+// header, then the Opus payload) in one pooled buffer.
+//
+// The encoder writes the payload first, straight into PayloadDest(). Room
+// for the largest possible headers is reserved in front of it, and Finish()
+// fills them in right up against the payload once the payload size, and the
+// voice target, are known. So a frame goes from encoder to socket without
+// being copied.
+class OutgoingVoiceFrame {
+   public:
+    // Largest Opus payload the datagram header's 13-bit length can describe
+    static constexpr std::int32_t kMaxPayloadSize = 0x1fff;
+
+    // Make a frame with room for a payload of up to the given size
+    explicit OutgoingVoiceFrame(std::int32_t payload_capacity);
+
+    OutgoingVoiceFrame(OutgoingVoiceFrame&&) = default;
+
+    std::uint8_t* PayloadDest() { return buffer_.data() + kReservedHeaderSize; }
+    std::int32_t PayloadCapacity() const { return buffer_.size() - kReservedHeaderSize; }
+
+    // Record how much of PayloadDest() the encoder used
+    void PayloadSize(std::int32_t size);
+    std::int32_t PayloadSize() const { return payload_size_; }
+
+    // The frame's sequence number, in 10-ms Mumble frames
+    void FrameSequence(std::uint64_t frame_seq) { frame_seq_ = frame_seq; }
+    std::uint64_t FrameSequence() const { return frame_seq_; }
+
+    // Whether this is the last frame of a talk spurt
+    void IsTerminator(bool is_terminator) { is_terminator_ = is_terminator; }
+    bool IsTerminator() const { return is_terminator_; }
+
+    // Lay out the headers in front of the payload. Call this once, after
+    // everything above has been set.
+    void Finish(std::uint32_t target);
+
+    // The complete message, ready to write to the socket, once Finish() has
+    // been called
+    const std::uint8_t* WireData() const { return buffer_.data() + start_; }
+    std::int32_t WireSize() const { return kReservedHeaderSize + payload_size_ - start_; }
+
+    // Just the voice datagram, without the control channel header, for
+    // sending over UDP
+    const std::uint8_t* DatagramData() const { return WireData() + kControlHeaderSize; }
+    std::int32_t DatagramSize() const { return WireSize() - kControlHeaderSize; }
+
+   private:
+    // The control channel header is a 2-byte type and a 4-byte length; the
+    // datagram header is a type/target byte and two varints, the second of
+    // which holds at most 14 bits and so takes at most 2 bytes
+    static constexpr std::int32_t kControlHeaderSize = 6;
+    static constexpr std::int32_t kReservedHeaderSize =
+        kControlHeaderSize + 1 + static_cast<std::int32_t>(kMaxVarIntSize) + 2;
+
+    ByteChunk buffer_;
+    std::int32_t payload_size_{0};
+    std::uint64_t frame_seq_{0};
+    bool is_terminator_{false};
+    std::int32_t start_{kReservedHeaderSize};
+};
+
+}  // namespace winrt::blurt::mumble::implementation
@@ -0,0 +1,150 @@
+#include "pch.h"
+
+#include "PacketTrace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include "AudioPacket.h"
+#include "ControlPacket.h"
+
+namespace winrt::blurt::mumble::implementation {
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// Every thread's ring, so FormatPacketTrace() can find them. Rings are
+// never removed, so a thread's last events survive it; the thread pool
+// keeps the number of threads, and so rings, small.
+struct RingRegistry {
+    std::mutex mutex;
+    _Guarded_by_(mutex) std::vector<std::shared_ptr<PacketTraceRing>> rings;
+};
+
+RingRegistry& TheRegistry() {
+    static RingRegistry registry;
+    return registry;
+}
+
+PacketTraceRing& ThisThreadRing() {
+    thread_local std::shared_ptr<PacketTraceRing> ring = [] {
+        auto ring = std::make_shared<PacketTraceRing>();
+        auto& registry = TheRegistry();
+        std::lock_guard lock{registry.mutex};
+        registry.rings.push_back(ring);
+        return ring;
+    }();
+    return *ring;
+}
+
+const char* ToString(TraceDirection direction) {
+    switch (direction) {
+        case TraceDirection::ControlIn:
+            return "control in";
+        case TraceDirection::ControlOut:
+            return "control out";
+        case TraceDirection::VoiceIn:
+            return "voice in";
+        case TraceDirection::VoiceOut:
+            return "voice out";
+    }
+    return "?";
+}
+
+const char* ToString(AudioPacketType type) {
+    switch (type) {
+        case AudioPacketType::CELTAlpha:
+            return "CELTAlpha";
+        case AudioPacketType::Ping:
+            return "Ping";
+        case AudioPacketType::Speex:
+            return "Speex";
+        case AudioPacketType::CELTBeta:
+            return "CELTBeta";
+        case AudioPacketType::Opus:
+            return "Opus";
+    }
+    return "INVALID";
+}
+}  // namespace
+
+void PacketTraceRing::Record(TraceDirection direction, std::uint16_t type, std::uint32_t size,
+                             std::uint32_t session) {
+    // Say which slot is about to change before changing it, so that a
+    // snapshot taken meanwhile knows to leave it out
+    const auto n = written_.load(std::memory_order_relaxed);
+    started_.store(n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    auto& slot = slots_[n & (kCapacity - 1)];
+    slot.timestamp.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    slot.session_size.store((std::uint64_t{session} << 32) | size, std::memory_order_relaxed);
+    slot.direction_type.store((static_cast<std::uint32_t>(direction) << 16) | type,
+                              std::memory_order_relaxed);
+    written_.store(n + 1, std::memory_order_release);
+}
+
+void PacketTraceRing::Snapshot(std::vector<TraceEvent>& out) const {
+    const auto end = written_.load(std::memory_order_acquire);
+    auto begin = end > kCapacity ? end - kCapacity : 0;
+    const auto first = out.size();
+    for (auto i = begin; i < end; i++) {
+        const auto& slot = slots_[i & (kCapacity - 1)];
+        const auto session_size = slot.session_size.load(std::memory_order_relaxed);
+        const auto direction_type = slot.direction_type.load(std::memory_order_relaxed);
+        out.push_back({slot.timestamp.load(std::memory_order_relaxed),
+                       static_cast<std::uint32_t>(session_size >> 32),
+                       static_cast<std::uint32_t>(session_size),
+                       static_cast<std::uint16_t>(direction_type),
+                       static_cast<TraceDirection>(direction_type >> 16)});
+    }
+
+    // Anything the owner started overwriting while we copied is suspect
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const auto started = started_.load(std::memory_order_relaxed);
+    if (started > kCapacity && started - kCapacity > begin) {
+        auto torn = std::min(started - kCapacity - begin, end - begin);
+        out.erase(out.begin() + first, out.begin() + first + torn);
+    }
+}
+
+void TracePacket(TraceDirection direction, std::uint16_t type, std::uint32_t size,
+                 std::uint32_t session) {
+    ThisThreadRing().Record(direction, type, size, session);
+}
+
+std::string FormatPacketTrace() {
+    std::vector<TraceEvent> events;
+    {
+        auto& registry = TheRegistry();
+        std::lock_guard lock{registry.mutex};
+        for (const auto& ring : registry.rings) ring->Snapshot(events);
+    }
+    std::stable_sort(events.begin(), events.end(),
+                     [](const TraceEvent& a, const TraceEvent& b) {
+                         return a.timestamp < b.timestamp;
+                     });
+
+    std::stringstream result;
+    const auto origin = events.empty() ? 0 : events.front().timestamp;
+    for (const auto& e : events) {
+        std::chrono::duration<double, std::milli> since{Clock::duration{e.timestamp - origin}};
+        char when[32];
+        std::snprintf(when, sizeof when, "%10.3f", since.count());
+        result << when << " ms  " << ToString(e.direction) << ": ";
+        if (e.direction == TraceDirection::ControlIn || e.direction == TraceDirection::ControlOut) {
+            result << ToString(static_cast<ControlPacketType>(e.type));
+        } else {
+            result << ToString(static_cast<AudioPacketType>(e.type));
+        }
+        result << ", " << e.size << " bytes";
+        if (e.session != 0) result << ", session " << e.session;
+        result << "\n";
+    }
+    return result.str();
+}
+
+}  // namespace winrt::blurt::mumble::implementation
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace winrt::blurt::mumble::implementation {
+
+// A cheap, always-on record of the packets going in and out, for finding
+// out after the fact what happened on a connection.
+//
+// Recording a packet costs a clock read and a few stores into a fixed-size
+// ring buffer that belongs to the calling thread, so there's no locking and
+// no allocation. Nothing is formatted until someone asks for the text with
+// FormatPacketTrace(). Each ring holds only the most recent kCapacity
+// packets its thread saw.
+
+enum class TraceDirection : std::uint8_t {
+    ControlIn,
+    ControlOut,
+    VoiceIn,
+    VoiceOut,
+};
+
+struct TraceEvent {
+    // Clock ticks of std::chrono::steady_clock
+    std::int64_t timestamp;
+    // The user session the packet is about, where that's known; zero if not
+    std::uint32_t session;
+    std::uint32_t size;
+    // A ControlPacketType for control packets, or an AudioPacketType for
+    // voice
+    std::uint16_t type;
+    TraceDirection direction;
+};
+
+// One thread's ring of trace events. Only the owning thread writes to it;
+// any thread may take a snapshot.
+class PacketTraceRing {
+   public:
+    static constexpr std::size_t kCapacity = 4096;
+
+    void Record(TraceDirection direction, std::uint16_t type, std::uint32_t size,
+                std::uint32_t session);
+
+    // Add the events still in the ring to out, oldest first. Events that the
+    // owner overwrites while this is copying them are left out.
+    void Snapshot(std::vector<TraceEvent>& out) const;
+
+   private:
+    static_assert((kCapacity & (kCapacity - 1)) == 0, "capacity must be a power of two");
+
+    // An event packed into words that can be read while they're written
+    struct Slot {
+        std::atomic<std::int64_t> timestamp;
+        // session << 32 | size
+        std::atomic<std::uint64_t> session_size;
+        // direction << 16 | type
+        std::atomic<std::uint32_t> direction_type;
+    };
+
+    std::array<Slot, kCapacity> slots_{};
+    // How many events have been, or are being, recorded; started_ runs one
+    // ahead of written_ while an event is being written
+    std::atomic<std::uint64_t> started_{0};
+    std::atomic<std::uint64_t> written_{0};
+};
+
+// Record a packet in the calling thread's ring
+void TracePacket(TraceDirection direction, std::uint16_t type, std::uint32_t size,
+                 std::uint32_t session = 0);
+
+// Every thread's trace events merged in time order, one per line
+std::string FormatPacketTrace();
+
+}  // namespace winrt::blurt::mumble::implementation
@@ -0,0 +1,85 @@
+#include "pch.h"
+
+#include "PlayoutController.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace winrt::blurt::audio::implementation {
+
+namespace {
+// How quickly the smoothed fill follows the real one, in seconds; long
+// enough to see past the sawtooth of packets arriving and quanta leaving
+constexpr double kFillTimeConstant = 0.5;
+// Speed change per unit of relative error between fill and target. Small,
+// so the speed changes slowly; the steady error it leaves against a clock
+// skew s is s / kSpeedGain of the target, e.g. 2.5% for 500 ppm.
+constexpr double kSpeedGain = 0.02;
+constexpr double kMaxSpeedAdjustment = 0.01;
+// More than this much over the target is dropped rather than played fast
+constexpr std::int32_t kMaxExcessMs = 100;
+}  // namespace
+
+PlayoutController::PlayoutController(std::int32_t frames_per_second)
+    : frames_per_second_{frames_per_second} {}
+
+PlayoutController::Plan PlayoutController::Next(std::int32_t buffered_frames,
+                                                std::int32_t wanted_frames,
+                                                std::int32_t target_frames) {
+    Plan plan{0, 0, 0, 0, 0, 1};
+    if (buffered_frames <= 0 || wanted_frames <= 0) {
+        if (buffered_frames <= 0) {
+            // Between talk spurts; start afresh with the next
+            fill_ = -1;
+            adjust_ = 0;
+            position_ = 0;
+        }
+        return plan;
+    }
+    target_frames = std::max(target_frames, 1);
+
+    const std::int32_t max_excess = frames_per_second_ / 1000 * kMaxExcessMs;
+    if (buffered_frames > target_frames + max_excess) {
+        plan.drop_frames = buffered_frames - target_frames;
+        buffered_frames = target_frames;
+        fill_ = target_frames;
+        position_ = 0;
+    }
+
+    if (fill_ < 0) {
+        fill_ = buffered_frames;
+    } else {
+        double weight = std::min(1.0, wanted_frames / (frames_per_second_ * kFillTimeConstant));
+        fill_ += weight * (buffered_frames - fill_);
+    }
+    adjust_ = std::clamp(kSpeedGain * (fill_ - target_frames) / target_frames,
+                         -kMaxSpeedAdjustment, kMaxSpeedAdjustment);
+
+    // Interpolating needs the frame after the last position read; near the
+    // end of what's buffered, what's there is played as it is
+    const double step = 1 + adjust_;
+    const double last = position_ + (wanted_frames - 1) * step;
+    const auto read_frames = static_cast<std::int32_t>(std::floor(last)) + 2;
+    if (read_frames <= buffered_frames) {
+        const double end = position_ + wanted_frames * step;
+        plan.output_frames = wanted_frames;
+        plan.consumed_frames = static_cast<std::int32_t>(std::floor(end));
+        plan.read_frames = read_frames;
+        plan.start = position_;
+        plan.step = step;
+        position_ = end - plan.consumed_frames;
+    } else {
+        plan.output_frames = std::min(wanted_frames, buffered_frames);
+        plan.consumed_frames = plan.output_frames;
+        plan.read_frames = plan.output_frames;
+        position_ = 0;
+    }
+    return plan;
+}
+
+std::chrono::microseconds PlayoutController::Delay() const {
+    if (fill_ <= 0) return std::chrono::microseconds{0};
+    return std::chrono::microseconds{static_cast<std::int64_t>(fill_ * 1e6 / frames_per_second_)};
+}
+
+}  // namespace winrt::blurt::audio::implementation
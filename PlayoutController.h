@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace winrt::blurt::audio::implementation {
+
+// Keeps one speaker's decoded audio from piling up or running dry while it
+// waits to be played.
+//
+// The sender's clock and our output device's never quite agree, so left to
+// itself the buffer of decoded audio creeps steadily fuller or emptier, and
+// a burst of late packets arriving together leaves it fuller for good. So
+// each time the output wants audio, this compares how much is buffered
+// (smoothed over the last half second or so) against a target, and plays
+// the audio a little faster or slower to close the gap: at most 1% off
+// speed, which is well short of audible. If the buffer gets far too full for
+// that to fix in reasonable time, the excess is dropped outright.
+//
+// Everything is in frames, i.e. samples per channel. Nothing here reads a
+// clock, allocates or locks; it belongs to the output thread.
+class PlayoutController {
+   public:
+    // How to play the next stretch of audio. First throw away drop_frames;
+    // then output frame i is the buffered audio at position start + i * step,
+    // interpolating between frames, for i in [0, output_frames); then
+    // consume consumed_frames. Interpolating needs the frame after each
+    // position, so reading looks at the first read_frames frames, which can
+    // be more than are consumed; all of them are always buffered.
+    struct Plan {
+        std::int32_t drop_frames;
+        std::int32_t output_frames;
+        std::int32_t consumed_frames;
+        std::int32_t read_frames;
+        double start;
+        double step;
+
+        // Whether this is a plain copy, with no interpolation needed
+        bool IsExact() const { return start == 0 && step == 1; }
+    };
+
+    explicit PlayoutController(std::int32_t frames_per_second);
+
+    // Plan the next stretch of output, given how many frames are buffered,
+    // how many the output wants, and how many should ideally be buffered
+    Plan Next(std::int32_t buffered_frames, std::int32_t wanted_frames,
+              std::int32_t target_frames);
+
+    // How long audio waits in the buffer before it's played, smoothed
+    std::chrono::microseconds Delay() const;
+
+    // The current playout speed, less one: positive means faster
+    double SpeedAdjustment() const { return adjust_; }
+
+   private:
+    const std::int32_t frames_per_second_;
+    // Smoothed buffered frames; negative until the first measurement of a
+    // talk spurt
+    double fill_{-1};
+    double adjust_{0};
+    // Fractional position of the next frame to play, from 0 to 1, in the
+    // buffered audio
+    double position_{0};
+};
+
+}  // namespace winrt::blurt::audio::implementation
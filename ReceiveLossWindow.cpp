@@ -0,0 +1,32 @@
+#include "pch.h"
+
+#include "ReceiveLossWindow.h"
+
+#include <algorithm>
+
+namespace winrt::blurt::audio::implementation {
+
+namespace {
+std::int32_t LossPercent(std::int64_t lost, std::int64_t total) {
+    if (lost <= 0 || total <= 0) return 0;
+    return static_cast<std::int32_t>((lost * 100 + total - 1) / total);
+}
+}  // namespace
+
+std::optional<std::int32_t> ReceiveLossWindow::OnDecoded(std::uint32_t received,
+                                                         std::uint32_t lost) {
+    received_ += received;
+    lost_ += lost;
+    auto total = received_ + lost_;
+    if (total < kWindowFrames) return std::nullopt;
+
+    auto network_lost = std::int64_t{network_lost_} - start_lost_;
+    auto network_total = network_lost + network_received_ - start_received_;
+    auto percent = std::max(LossPercent(lost_, total), LossPercent(network_lost, network_total));
+    received_ = lost_ = 0;
+    start_received_ = network_received_;
+    start_lost_ = network_lost_;
+    return percent;
+}
+
+}  // namespace winrt::blurt::audio::implementation
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+namespace winrt::blurt::audio::implementation {
+
+// Works out, from loss on the way in, how much loss the encoder should
+// expect on the way out, which decides how much forward error correction
+// it sends.
+//
+// Two counts go in. Decoding sees the gaps the jitter buffer gave up
+// waiting on; the connection sees what the network lost outright, even
+// where the next packet's forward error correction covered for it. Once
+// enough received audio has been decoded to make a window, the worse of the
+// two loss rates over that window comes out, and a new window starts.
+//
+// Nothing here locks; whoever decodes owns it.
+class ReceiveLossWindow {
+   public:
+    // Mumble frames of decoded audio, received or filled in, to a window
+    static constexpr std::uint32_t kWindowFrames = 500;
+
+    // The connection's running counts of voice packets received and lost,
+    // as of now
+    void NetworkCounts(std::uint32_t received, std::uint32_t lost) {
+        network_received_ = received;
+        network_lost_ = lost;
+    }
+
+    // Count a round of decoding, in Mumble frames taken as received and
+    // filled in for. Once that completes a window, returns the percentage
+    // of packets to expect to lose, rounded up, and starts a new window.
+    std::optional<std::int32_t> OnDecoded(std::uint32_t received, std::uint32_t lost);
+
+   private:
+    std::uint32_t received_{0};
+    std::uint32_t lost_{0};
+    std::uint32_t network_received_{0};
+    std::uint32_t network_lost_{0};
+    // The connection's counts as of the start of this window
+    std::uint32_t start_received_{0};
+    std::uint32_t start_lost_{0};
+};
+
+}  // namespace winrt::blurt::audio::implementation
@@ -2,15 +2,37 @@
 
 #include "ServerConnection.h"
 
+#include <algorithm>
 #include <chrono>
+#include <filesystem>
 #include <sstream>
+#include <unordered_set>
 #include <utility>
 #include "AudioPacket.h"
 #include "ControlPacket.h"
+#include "PacketTrace.h"
+#include "VarInt.h"
+#include "winrt/Windows.Storage.h"
 
 namespace winrt::blurt::mumble::implementation {
 
 namespace foundation = winrt::Windows::Foundation;
+namespace storage = winrt::Windows::Storage;
+
+namespace {
+// How often to ping the server over UDP, and how long to go without hearing
+// anything back over UDP before falling back to the control channel
+constexpr std::chrono::seconds kUdpPingInterval{2};
+constexpr std::chrono::seconds kUdpTimeout{6};
+// If datagrams stop decrypting for this long, ask the server to resync
+// nonces, and don't ask again any more often than this
+constexpr std::chrono::seconds kResyncInterval{5};
+// The most IDs of each kind to ask for in one RequestBlob message
+constexpr std::size_t kMaxBlobRequestBatch = 32;
+// Let the control packet arena grow this big before starting it over; the
+// state burst on joining a busy server fits without a reset
+constexpr std::size_t kMaxArenaSize = 1024 * 1024;
+}  // namespace
 
 foundation::IAsyncAction ServerConnection::SendPings() {
     while (true) {
@@ -18,23 +40,306 @@ foundation::IAsyncAction ServerConnection::SendPings() {
         // canceled and destroyed when it's suspended here
         co_await std::chrono::seconds(10);
         MumbleProto::Ping ping;
-        auto now = std::chrono::system_clock::now();
-        ping.set_timestamp(
-            std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count());
-        socket_.WritePacketAsync(ControlPacket::From(ping));
+        ping.set_timestamp(ConnectionStats::PingTimestamp());
+        stats_.FillPing(ping, UdpCounters());
+        socket_.Send(ControlPacket::From(ping));
+    }
+}
+
+foundation::IAsyncAction ServerConnection::SendUdpPings() {
+    try {
+        co_await voice_socket_.ConnectAsync(host_, port_);
+        bool was_up{false};
+        while (true) {
+            std::uint8_t ping[1 + kMaxVarIntSize];
+            ping[0] = static_cast<std::uint8_t>(static_cast<int>(AudioPacketType::Ping) << 5);
+            auto len = 1 + EncodeVarInt(ConnectionStats::PingTimestamp(), ping + 1);
+            auto datagram = ByteChunk::Allocate(CryptState::kHeaderSize + len);
+            {
+                std::lock_guard lock{crypt_mutex_};
+                crypt_.Encrypt(ping, datagram.data(), len);
+            }
+            voice_socket_.WriteDatagramAsync(std::move(datagram));
+
+            bool is_up = IsUdpUp();
+            if (is_up != was_up) {
+                event_packet_recv_(is_up ? L"voice switched to UDP"
+                                         : L"voice switched to the control channel");
+                was_up = is_up;
+            }
+            // When the connection closes, this coroutine gets canceled and
+            // destroyed when it's suspended here
+            co_await kUdpPingInterval;
+        }
+    } catch (const winrt::hresult_canceled&) {
+        co_return;
+    } catch (const winrt::hresult_error& e) {
+        // Without UDP, voice just stays on the control channel
+        std::wstringstream ss;
+        ss << "UDP voice unavailable: " << e.message().c_str();
+        event_packet_recv_(winrt::hstring{ss.str()});
+    }
+}
+
+bool ServerConnection::IsUdpUp() const {
+    auto last = Clock::time_point{Clock::duration{last_udp_receipt_.load()}};
+    return last != Clock::time_point{} && Clock::now() - last < kUdpTimeout;
+}
+
+void ServerConnection::SetUpCrypt(const MumbleProto::CryptSetup& msg) {
+    if (msg.has_key() && msg.has_client_nonce() && msg.has_server_nonce()) {
+        {
+            std::lock_guard lock{crypt_mutex_};
+            if (!crypt_.SetKey(msg.key(), msg.client_nonce(), msg.server_nonce())) return;
+        }
+        if (!udp_ping_task_) udp_ping_task_ = SendUdpPings();
+        return;
+    }
+
+    if (msg.has_server_nonce()) {
+        // The answer to our resync request
+        std::lock_guard lock{crypt_mutex_};
+        crypt_.SetDecryptNonce(msg.server_nonce());
+        return;
+    }
+
+    // The server can't decrypt what we send and wants our nonce
+    MumbleProto::CryptSetup reply;
+    {
+        std::lock_guard lock{crypt_mutex_};
+        if (!crypt_.IsValid()) return;
+        reply.set_client_nonce(crypt_.EncryptNonce());
+    }
+    socket_.Send(ControlPacket::From(reply));
+}
+
+void ServerConnection::RequestResync() {
+    auto now = Clock::now();
+    auto last_good = Clock::time_point{Clock::duration{last_udp_receipt_.load()}};
+    auto last_request = Clock::time_point{Clock::duration{last_resync_request_.load()}};
+    if (now - last_good < kResyncInterval || now - last_request < kResyncInterval) return;
+    last_resync_request_ = now.time_since_epoch().count();
+    socket_.Send(ControlPacket::From(MumbleProto::CryptSetup{}));
+}
+
+CryptState::Counters ServerConnection::UdpCounters() {
+    std::lock_guard lock{crypt_mutex_};
+    return crypt_.Stats();
+}
+
+void ServerConnection::OnDatagram(ByteChunk&& datagram) {
+    auto len = static_cast<std::size_t>(datagram.size());
+    if (len <= CryptState::kHeaderSize) return;
+    bool ok;
+    {
+        std::lock_guard lock{crypt_mutex_};
+        if (!crypt_.IsValid()) return;
+        auto* p = datagram.data();
+        ok = crypt_.Decrypt(p, p + CryptState::kHeaderSize, len);
+    }
+    if (!ok) {
+        RequestResync();
+        return;
+    }
+    last_udp_receipt_ = Clock::now().time_since_epoch().count();
+
+    auto plain = ByteSlice::Of(std::move(datagram))
+                     .Sub(CryptState::kHeaderSize, len - CryptState::kHeaderSize);
+    if (static_cast<AudioPacketType>(plain.data()[0] >> 5) == AudioPacketType::Ping) {
+        std::uint64_t timestamp;
+        auto body_len = static_cast<std::size_t>(plain.size()) - 1;
+        if (DecodeVarInt(plain.data() + 1, body_len, &timestamp) != 0)
+            stats_.OnUdpPingReply(timestamp);
+        return;
+    }
+    try {
+        DeliverAudio(AudioPacket::FromIncomingFrame(plain));
+    } catch (const AudioParseFailure&) {
+        // TODO: log bogus audio datagram
+    }
+}
+
+bool ServerConnection::ApplyToState(const ControlPacket& packet) {
+    try {
+        std::lock_guard lock{state_mutex_};
+        switch (packet.Type()) {
+            case ControlPacketType::UserState:
+                state_.Apply(packet.ResolveProto<ControlPacketType::UserState>());
+                return true;
+            case ControlPacketType::UserRemove: {
+                const auto& msg = packet.ResolveProto<ControlPacketType::UserRemove>();
+                state_.Apply(msg);
+                stats_.ForgetSpeaker(msg.session());
+                return true;
+            }
+            case ControlPacketType::ChannelState:
+                state_.Apply(packet.ResolveProto<ControlPacketType::ChannelState>());
+                return true;
+            case ControlPacketType::ChannelRemove:
+                state_.Apply(packet.ResolveProto<ControlPacketType::ChannelRemove>());
+                return true;
+            default:
+                return false;
+        }
+    } catch (const PacketParseError&) {
+        // TODO: log bogus state message
+        return false;
+    }
+}
+
+void ServerConnection::PublishStateChanges() {
+    ServerState::Changes changes;
+    {
+        std::lock_guard lock{state_mutex_};
+        if (!state_.HasChanges()) return;
+        changes = state_.TakeChanges();
     }
+    event_state_changed_(changes);
+}
+
+void ServerConnection::SyncBlobs(const ControlPacket& packet) {
+    if (packet.Type() == ControlPacketType::UserState) {
+        const auto& msg = packet.ResolveProto<ControlPacketType::UserState>();
+        std::string comment_hash, texture_hash;
+        {
+            std::lock_guard lock{state_mutex_};
+            const auto* user = state_.FindUser(msg.session());
+            if (user == nullptr) return;
+            comment_hash = user->comment_hash;
+            texture_hash = user->texture_hash;
+        }
+        if (msg.has_comment() || msg.has_comment_hash())
+            SyncBlob(comment_hash, msg.has_comment() ? &msg.comment() : nullptr,
+                     wanted_comments_, msg.session());
+        if (msg.has_texture() || msg.has_texture_hash())
+            SyncBlob(texture_hash, msg.has_texture() ? &msg.texture() : nullptr,
+                     wanted_textures_, msg.session());
+    } else if (packet.Type() == ControlPacketType::ChannelState) {
+        const auto& msg = packet.ResolveProto<ControlPacketType::ChannelState>();
+        if (!msg.has_description() && !msg.has_description_hash()) return;
+        std::string description_hash;
+        {
+            std::lock_guard lock{state_mutex_};
+            const auto* channel = state_.FindChannel(msg.channel_id());
+            if (channel == nullptr) return;
+            description_hash = channel->description_hash;
+        }
+        SyncBlob(description_hash, msg.has_description() ? &msg.description() : nullptr,
+                 wanted_descriptions_, msg.channel_id());
+    }
+}
+
+void ServerConnection::SyncBlob(const std::string& hash, const std::string* content,
+                                std::vector<std::uint32_t>& wanted, std::uint32_t id) {
+    if (hash.empty()) return;
+    if (content != nullptr) {
+        if (blob_cache_) blob_cache_->Put(hash, *content);
+        return;
+    }
+    {
+        std::lock_guard lock{state_mutex_};
+        if (state_.FindBlob(hash) != nullptr) return;
+    }
+    if (blob_cache_) {
+        if (auto cached = blob_cache_->Get(hash)) {
+            std::lock_guard lock{state_mutex_};
+            state_.AddBlob(hash, std::move(*cached));
+            return;
+        }
+    }
+    wanted.push_back(id);
+}
+
+void ServerConnection::RequestMissingBlobs() {
+    if (wanted_comments_.empty() && wanted_textures_.empty() && wanted_descriptions_.empty())
+        return;
+
+    // What's in our own channel is what the user sees first, so ask for
+    // that first
+    {
+        std::lock_guard lock{state_mutex_};
+        const auto* me = state_.FindUser(own_session_);
+        const auto own_channel = me ? me->channel_id : ServerState::kNoChannel;
+        auto in_own_channel = [&](std::uint32_t session) {
+            const auto* user = state_.FindUser(session);
+            return user != nullptr && user->channel_id == own_channel;
+        };
+        std::stable_partition(wanted_comments_.begin(), wanted_comments_.end(), in_own_channel);
+        std::stable_partition(wanted_textures_.begin(), wanted_textures_.end(), in_own_channel);
+        std::stable_partition(wanted_descriptions_.begin(), wanted_descriptions_.end(),
+                              [&](std::uint32_t id) { return id == own_channel; });
+    }
+
+    for (auto* wanted : {&wanted_comments_, &wanted_textures_, &wanted_descriptions_}) {
+        std::unordered_set<std::uint32_t> seen;
+        wanted->erase(std::remove_if(wanted->begin(), wanted->end(),
+                                     [&](std::uint32_t id) { return !seen.insert(id).second; }),
+                      wanted->end());
+    }
+
+    const auto longest = std::max(
+        {wanted_comments_.size(), wanted_textures_.size(), wanted_descriptions_.size()});
+    for (std::size_t i = 0; i < longest; i += kMaxBlobRequestBatch) {
+        MumbleProto::RequestBlob request;
+        auto add = [i](const std::vector<std::uint32_t>& wanted, auto* field) {
+            auto end = std::min(wanted.size(), i + kMaxBlobRequestBatch);
+            for (auto j = i; j < end; j++) field->Add(wanted[j]);
+        };
+        add(wanted_comments_, request.mutable_session_comment());
+        add(wanted_textures_, request.mutable_session_texture());
+        add(wanted_descriptions_, request.mutable_channel_description());
+        socket_.Send(ControlPacket::From(request));
+    }
+    wanted_comments_.clear();
+    wanted_textures_.clear();
+    wanted_descriptions_.clear();
+}
+
+void ServerConnection::DeliverAudio(const AudioPacket& packet) {
+    TracePacket(TraceDirection::VoiceIn, static_cast<std::uint16_t>(packet.Type()),
+                static_cast<std::uint32_t>(packet.Payload().size()), packet.SenderSession());
+    stats_.OnVoicePacket(packet.SenderSession(), packet.FrameSequence(), packet.IsTerminator());
+    std::lock_guard lock{audio_recv_mutex_};
+    audio_packet_recv_(packet);
 }
 
 foundation::IAsyncAction ServerConnection::ReadControlPackets() {
     try {
         while (true) {
-            mumble::WireMessage wire_packet = co_await socket_.ReadPacketAsync();
+            // No packet parsed into the arena outlives one trip around this
+            // loop, so it's safe to throw everything away here
+            if (arena_.SpaceUsed() > kMaxArenaSize) arena_.Reset();
+            ControlFramer::Frame frame;
             // TODO: What happens on a read exception?
-            ControlPacket packet{std::move(wire_packet)};
+            while (!socket_.NextFrame(frame)) co_await socket_.ReadMoreAsync();
+            ControlPacket packet{std::move(frame), &arena_};
+            TracePacket(TraceDirection::ControlIn, static_cast<std::uint16_t>(packet.Type()),
+                        static_cast<std::uint32_t>(packet.PayloadSize()));
             if (packet.Type() == ControlPacketType::UDPTunnel) {
-                audio_packet_recv_(packet.ResolveAudioPacket());
-            } else {
-                event_packet_recv_(L"packet received: " + winrt::to_hstring(packet.DebugString()));
+                DeliverAudio(packet.ResolveAudioPacket());
+                continue;
+            }
+            if (packet.Type() == ControlPacketType::CryptSetup) {
+                SetUpCrypt(packet.ResolveProto<ControlPacketType::CryptSetup>());
+            }
+            if (packet.Type() == ControlPacketType::Ping) {
+                const auto& ping = packet.ResolveProto<ControlPacketType::Ping>();
+                if (ping.has_timestamp()) stats_.OnTcpPingReply(ping.timestamp());
+            }
+            bool is_state = ApplyToState(packet);
+            if (is_state) SyncBlobs(packet);
+            if (packet.Type() == ControlPacketType::ServerSync) {
+                const auto& sync = packet.ResolveProto<ControlPacketType::ServerSync>();
+                own_session_ = sync.session();
+                if (sync.has_max_bandwidth()) max_bandwidth_ = sync.max_bandwidth();
+            }
+            if (packet.Type() == ControlPacketType::ServerConfig) {
+                const auto& config = packet.ResolveProto<ControlPacketType::ServerConfig>();
+                if (config.has_max_bandwidth()) max_bandwidth_ = config.max_bandwidth();
+            }
+            if (announcer_.OnMessage(packet.Type(), is_state, socket_.HasBufferedPacket())) {
+                PublishStateChanges();
+                RequestMissingBlobs();
             }
         }
     } catch (const winrt::hresult_canceled&) {
@@ -49,19 +354,36 @@ foundation::IAsyncAction ServerConnection::ReadControlPackets() {
 foundation::IAsyncAction ServerConnection::Connect(hstring host, hstring port, hstring userName,
                                                    hstring password) {
     try {
+        host_ = host;
+        port_ = port;
+        try {
+            auto cache_dir = storage::ApplicationData::Current().LocalCacheFolder().Path();
+            blob_cache_ = std::make_unique<BlobCache>(std::filesystem::path{cache_dir.c_str()} /
+                                                      L"blobs");
+        } catch (const winrt::hresult_error&) {
+            // No cache, then; everything gets downloaded
+        }
+        voice_socket_.DatagramReceived(
+            [this](ByteChunk&& datagram) { OnDatagram(std::move(datagram)); });
+        socket_.WriteFailed([this](const winrt::hresult_error& e) {
+            std::wstringstream ss;
+            ss << "failed to write control packet: " << e.message().c_str();
+            event_conn_failed_(winrt::hstring{ss.str()});
+        });
         co_await socket_.ConnectAsync(host, port);
 
         {
-            mumble::WireMessage wire_packet = co_await socket_.ReadPacketAsync();
+            ControlFramer::Frame frame;
             // TODO: What happens on a read exception?
-            ControlPacket packet{std::move(wire_packet)};
+            while (!socket_.NextFrame(frame)) co_await socket_.ReadMoreAsync();
+            ControlPacket packet{std::move(frame), &arena_};
             if (packet.Type() != ControlPacketType::Version) {
                 event_conn_failed_(L"server did not send the required version message; giving up");
                 co_return;
             }
 
             try {
-                auto version = packet.ResolveProto<ControlPacketType::Version>();
+                const auto& version = packet.ResolveProto<ControlPacketType::Version>();
                 event_packet_recv_(L"packet received: " + winrt::to_hstring(packet.DebugString()));
             } catch (const PacketParseError&) {
                 // TODO: Handle errors
@@ -74,13 +396,13 @@ foundation::IAsyncAction ServerConnection::Connect(hstring host, hstring port, h
         my_version.set_version((1 << 16) + (2 << 8) + 4);  // 1.2.4
         my_version.set_os("UWP");
         my_version.set_release("Blurt 0.0.0");
-        co_await socket_.WritePacketAsync(ControlPacket::From(my_version));
+        socket_.Send(ControlPacket::From(my_version));
 
         MumbleProto::Authenticate auth;
         auth.set_username(winrt::to_string(userName));
         auth.set_password(winrt::to_string(password));
         auth.set_opus(true);
-        co_await socket_.WritePacketAsync(ControlPacket::From(auth));
+        socket_.Send(ControlPacket::From(auth));
 
         // TODO: Handle auth failure
 
@@ -95,17 +417,31 @@ foundation::IAsyncAction ServerConnection::Connect(hstring host, hstring port, h
     }
 }
 
-foundation::IAsyncAction ServerConnection::SendAudioAsync(std::vector<std::uint8_t>&& bytes) {
-    AudioPacket ap(AudioPacketType::Opus, audio_frame_seq_, std::move(bytes));
-    audio_frame_seq_ += 2;  // TODO: magical constant only works for 20-ms audio frames
-    co_await socket_.WritePacketAsync(ControlPacket::From(std::move(ap)));
+foundation::IAsyncAction ServerConnection::SendAudioAsync(OutgoingVoiceFrame frame) {
+    frame.Finish(0);
+    TracePacket(TraceDirection::VoiceOut, static_cast<std::uint16_t>(AudioPacketType::Opus),
+                static_cast<std::uint32_t>(frame.DatagramSize()));
+    if (!IsUdpUp()) {
+        socket_.Send(std::move(frame));
+        co_return;
+    }
+
+    auto len = static_cast<std::size_t>(frame.DatagramSize());
+    auto datagram = ByteChunk::Allocate(CryptState::kHeaderSize + len);
+    {
+        std::lock_guard lock{crypt_mutex_};
+        crypt_.Encrypt(frame.DatagramData(), datagram.data(), len);
+    }
+    co_await voice_socket_.WriteDatagramAsync(std::move(datagram));
 }
 
 void ServerConnection::Close() noexcept {
     if (closed_) return;
     ping_task_.Cancel();
     read_task_.Cancel();
+    if (udp_ping_task_) udp_ping_task_.Cancel();
     socket_.Close();
+    voice_socket_.Close();
     event_conn_closed_(L"closed");
     closed_ = true;
 }
@@ -138,6 +474,13 @@ winrt::event_token ServerConnection::PacketReceived(
 void ServerConnection::PacketReceived(winrt::event_token const& token) noexcept {
     event_packet_recv_.remove(token);
 }
+winrt::event_token ServerConnection::StateChanged(
+    winrt::delegate<const ServerState::Changes&> const& handler) {
+    return event_state_changed_.add(handler);
+}
+void ServerConnection::StateChanged(winrt::event_token const& token) noexcept {
+    event_state_changed_.remove(token);
+}
 winrt::event_token ServerConnection::AudioPacketReceived(
     winrt::delegate<const AudioPacket&> const& handler) {
     return audio_packet_recv_.add(handler);
@@ -1,9 +1,20 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 #include "AudioPacket.h"
+#include "BlobCache.h"
+#include "ConnectionStats.h"
 #include "ControlSocket.h"
+#include "CryptState.h"
+#include "ServerState.h"
+#include "StateAnnouncer.h"
+#include "VoiceSocket.h"
 #include "winrt/Windows.Foundation.h"
 #include "winrt/base.h"
 
@@ -15,9 +26,26 @@ class ServerConnection {
 
     Windows::Foundation::IAsyncAction Connect(hstring host, hstring port, hstring userName,
                                               hstring password);
-    Windows::Foundation::IAsyncAction SendAudioAsync(std::vector<std::uint8_t>&& bytes);
+
+    // Send a frame of encoded audio. It goes over UDP when the server has
+    // been answering there lately, and tunneled over the control channel
+    // otherwise.
+    Windows::Foundation::IAsyncAction SendAudioAsync(OutgoingVoiceFrame frame);
     void Close() noexcept;
 
+    // Whether voice is currently going over UDP
+    bool IsUdpUp() const;
+
+    // Counts of voice datagrams received over UDP
+    CryptState::Counters UdpCounters();
+
+    // Round trip times and voice loss on this connection
+    const ConnectionStats& Stats() const { return stats_; }
+
+    // The server's limit on the bandwidth voice may use, in bits per second,
+    // headers included; zero if it hasn't said
+    std::uint32_t MaxBandwidth() const { return max_bandwidth_.load(std::memory_order_relaxed); }
+
     winrt::event_token ConnectionSucceeded(winrt::delegate<winrt::hstring> const& handler);
     void ConnectionSucceeded(winrt::event_token const& token) noexcept;
     winrt::event_token ConnectionFailed(winrt::delegate<winrt::hstring> const& handler);
@@ -26,21 +54,76 @@ class ServerConnection {
     void ConnectionClosed(winrt::event_token const& token) noexcept;
     winrt::event_token PacketReceived(winrt::delegate<winrt::hstring> const& handler);
     void PacketReceived(winrt::event_token const& token) noexcept;
+    // Call f with the server's channels and users, which are locked for the
+    // duration; don't hang on to anything from it afterwards
+    template <typename F>
+    void ReadState(F&& f) {
+        std::lock_guard lock{state_mutex_};
+        f(static_cast<const ServerState&>(state_));
+    }
+
+    // Fired on the control channel's thread when users or channels change.
+    // Changes are gathered up: the whole initial sync comes as one, and
+    // after that, everything that arrived together comes together.
+    winrt::event_token StateChanged(winrt::delegate<const ServerState::Changes&> const& handler);
+    void StateChanged(winrt::event_token const& token) noexcept;
     winrt::event_token AudioPacketReceived(winrt::delegate<const AudioPacket&> const& handler);
     void AudioPacketReceived(winrt::event_token const& token) noexcept;
 
    private:
+    using Clock = std::chrono::steady_clock;
+
     Windows::Foundation::IAsyncAction SendPings();
+    Windows::Foundation::IAsyncAction SendUdpPings();
     Windows::Foundation::IAsyncAction ReadControlPackets();
+    void SetUpCrypt(const MumbleProto::CryptSetup& msg);
+    void OnDatagram(ByteChunk&& datagram);
+    void RequestResync();
+    void DeliverAudio(const AudioPacket& packet);
+    // Returns whether the packet was a user or channel update
+    bool ApplyToState(const ControlPacket& packet);
+    void PublishStateChanges();
+    // Keep newly arrived comments, textures and descriptions in the blob
+    // cache, and fill in ones the server only named from it. Whatever the
+    // cache doesn't have gets asked for by RequestMissingBlobs().
+    void SyncBlobs(const ControlPacket& packet);
+    void SyncBlob(const std::string& hash, const std::string* content,
+                  std::vector<std::uint32_t>& wanted, std::uint32_t id);
+    void RequestMissingBlobs();
 
     bool closed_{false};
-    Windows::Foundation::IAsyncAction ping_task_, read_task_;
+    winrt::hstring host_, port_;
+    Windows::Foundation::IAsyncAction ping_task_, read_task_, udp_ping_task_{nullptr};
     ControlSocket socket_;
-    std::uint32_t audio_frame_seq_{0};
+    // Incoming control packets are parsed into this; only the control
+    // reader uses it, and it's reset between packets once it gets big
+    google::protobuf::Arena arena_;
+    std::mutex state_mutex_;
+    _Guarded_by_(state_mutex_) ServerState state_;
+    // Only the control reader touches this
+    StateAnnouncer announcer_;
+    std::uint32_t own_session_{0};
+    std::atomic<std::uint32_t> max_bandwidth_{0};
+    // Null if there's nowhere to keep one
+    std::unique_ptr<BlobCache> blob_cache_;
+    // Sessions and channel IDs whose blobs we still need to ask for; only
+    // the control reader touches these
+    std::vector<std::uint32_t> wanted_comments_, wanted_textures_, wanted_descriptions_;
+    VoiceSocket voice_socket_;
+    std::mutex crypt_mutex_;
+    _Guarded_by_(crypt_mutex_) CryptState crypt_;
+    // When the last datagram that decrypted properly came in, in clock ticks
+    std::atomic<Clock::rep> last_udp_receipt_{0};
+    std::atomic<Clock::rep> last_resync_request_{0};
+    ConnectionStats stats_;
+    // Audio can come in over UDP and the control channel at the same time,
+    // but listeners expect one packet at a time
+    std::mutex audio_recv_mutex_;
     winrt::event<winrt::delegate<winrt::hstring>> event_conn_succeeded_;
     winrt::event<winrt::delegate<winrt::hstring>> event_conn_failed_;
     winrt::event<winrt::delegate<winrt::hstring>> event_conn_closed_;
     winrt::event<winrt::delegate<winrt::hstring>> event_packet_recv_;
+    winrt::event<winrt::delegate<const ServerState::Changes&>> event_state_changed_;
     winrt::event<winrt::delegate<const AudioPacket&>> audio_packet_recv_;
 };
 }  // namespace winrt::blurt::mumble::implementation
@@ -0,0 +1,217 @@
+#include "pch.h"
+
+#include "ServerState.h"
+
+#include <algorithm>
+#include "Sha1.h"
+
+namespace winrt::blurt::mumble::implementation {
+
+namespace {
+void SetFlag(std::uint16_t& flags, std::uint16_t flag, bool value) {
+    flags = static_cast<std::uint16_t>(value ? (flags | flag) : (flags & ~flag));
+}
+
+void Erase(std::vector<std::uint32_t>& ids, std::uint32_t id) {
+    ids.erase(std::remove(ids.begin(), ids.end(), id), ids.end());
+}
+}  // namespace
+
+void ServerState::Apply(const MumbleProto::UserState& msg) {
+    if (!msg.has_session()) return;
+    const auto session = msg.session();
+    auto it = user_index_.find(session);
+    if (it == user_index_.end()) {
+        it = user_index_.emplace(session, users_.size()).first;
+        users_.push_back(User{session});
+    }
+    pending_.users[session] = ChangeKind::kChanged;
+
+    auto& user = users_[it->second];
+    if (msg.has_name()) user.name = msg.name();
+    if (msg.has_user_id()) user.user_id = msg.user_id();
+    if (msg.has_channel_id()) user.channel_id = msg.channel_id();
+    if (msg.has_mute()) SetFlag(user.flags, kMute, msg.mute());
+    if (msg.has_deaf()) SetFlag(user.flags, kDeaf, msg.deaf());
+    if (msg.has_suppress()) SetFlag(user.flags, kSuppress, msg.suppress());
+    if (msg.has_self_mute()) SetFlag(user.flags, kSelfMute, msg.self_mute());
+    if (msg.has_self_deaf()) SetFlag(user.flags, kSelfDeaf, msg.self_deaf());
+    if (msg.has_priority_speaker()) SetFlag(user.flags, kPrioritySpeaker, msg.priority_speaker());
+    if (msg.has_recording()) SetFlag(user.flags, kRecording, msg.recording());
+
+    if (msg.has_comment()) {
+        SetBlob(&user.comment_hash, msg.comment());
+    } else if (msg.has_comment_hash()) {
+        SetBlobHash(&user.comment_hash, msg.comment_hash());
+    }
+    if (msg.has_texture()) {
+        SetBlob(&user.texture_hash, msg.texture());
+    } else if (msg.has_texture_hash()) {
+        SetBlobHash(&user.texture_hash, msg.texture_hash());
+    }
+}
+
+void ServerState::Apply(const MumbleProto::UserRemove& msg) {
+    auto it = user_index_.find(msg.session());
+    if (it == user_index_.end()) return;
+    const auto index = it->second;
+    user_index_.erase(it);
+    pending_.users[msg.session()] = ChangeKind::kRemoved;
+
+    ReleaseBlob(users_[index].comment_hash);
+    ReleaseBlob(users_[index].texture_hash);
+    if (index != users_.size() - 1) {
+        users_[index] = std::move(users_.back());
+        user_index_[users_[index].session] = index;
+    }
+    users_.pop_back();
+}
+
+void ServerState::Apply(const MumbleProto::ChannelState& msg) {
+    if (!msg.has_channel_id()) return;
+    const auto channel_id = msg.channel_id();
+    ChannelFor(channel_id);
+    if (msg.has_parent()) SetParent(channel_id, msg.parent());
+    // Links may name channels we haven't heard of yet; make them first, so
+    // that nothing below moves the channel we're changing
+    for (auto id : msg.links()) ChannelFor(id);
+    for (auto id : msg.links_add()) ChannelFor(id);
+
+    auto& channel = channels_[channel_index_[channel_id]];
+    if (msg.has_name()) channel.name = msg.name();
+    if (msg.has_position()) channel.position = msg.position();
+    if (msg.has_max_users()) channel.max_users = msg.max_users();
+    if (msg.has_temporary()) channel.temporary = msg.temporary();
+    if (msg.has_description()) {
+        SetBlob(&channel.description_hash, msg.description());
+    } else if (msg.has_description_hash()) {
+        SetBlobHash(&channel.description_hash, msg.description_hash());
+    }
+
+    if (msg.links_size() > 0) channel.links.assign(msg.links().begin(), msg.links().end());
+    for (auto id : msg.links_add())
+        if (std::find(channel.links.begin(), channel.links.end(), id) == channel.links.end())
+            channel.links.push_back(id);
+    for (auto id : msg.links_remove()) Erase(channel.links, id);
+}
+
+void ServerState::Apply(const MumbleProto::ChannelRemove& msg) {
+    const auto channel_id = msg.channel_id();
+    auto it = channel_index_.find(channel_id);
+    if (it == channel_index_.end()) return;
+
+    // The server removes subchannels first, but don't count on it
+    SetParent(channel_id, kNoChannel);
+    const auto index = it->second;
+    for (auto child : channels_[index].children) {
+        channels_[channel_index_[child]].parent = kNoChannel;
+        pending_.channels[child] = ChangeKind::kChanged;
+    }
+    for (auto link : channels_[index].links) {
+        auto linked = channel_index_.find(link);
+        if (linked != channel_index_.end()) Erase(channels_[linked->second].links, channel_id);
+    }
+    ReleaseBlob(channels_[index].description_hash);
+
+    channel_index_.erase(channel_id);
+    pending_.channels[channel_id] = ChangeKind::kRemoved;
+    if (index != channels_.size() - 1) {
+        channels_[index] = std::move(channels_.back());
+        channel_index_[channels_[index].channel_id] = index;
+    }
+    channels_.pop_back();
+}
+
+ServerState::Changes ServerState::TakeChanges() {
+    Changes changes;
+    for (const auto& [session, kind] : pending_.users)
+        (kind == ChangeKind::kRemoved ? changes.users_removed : changes.users_changed)
+            .push_back(session);
+    for (const auto& [channel_id, kind] : pending_.channels)
+        (kind == ChangeKind::kRemoved ? changes.channels_removed : changes.channels_changed)
+            .push_back(channel_id);
+    pending_ = PendingChanges{};
+    return changes;
+}
+
+void ServerState::Clear() {
+    for (const auto& user : users_) pending_.users[user.session] = ChangeKind::kRemoved;
+    for (const auto& channel : channels_)
+        pending_.channels[channel.channel_id] = ChangeKind::kRemoved;
+    users_.clear();
+    user_index_.clear();
+    channels_.clear();
+    channel_index_.clear();
+    blobs_.clear();
+}
+
+const ServerState::User* ServerState::FindUser(std::uint32_t session) const {
+    auto it = user_index_.find(session);
+    return it == user_index_.end() ? nullptr : &users_[it->second];
+}
+
+const ServerState::Channel* ServerState::FindChannel(std::uint32_t channel_id) const {
+    auto it = channel_index_.find(channel_id);
+    return it == channel_index_.end() ? nullptr : &channels_[it->second];
+}
+
+const std::string* ServerState::FindBlob(const std::string& hash) const {
+    auto it = blobs_.find(hash);
+    if (it == blobs_.end() || it->second.data.empty()) return nullptr;
+    return &it->second.data;
+}
+
+void ServerState::AddBlob(const std::string& hash, std::string content) {
+    auto it = blobs_.find(hash);
+    if (it != blobs_.end() && it->second.data.empty()) it->second.data = std::move(content);
+}
+
+ServerState::Channel& ServerState::ChannelFor(std::uint32_t channel_id) {
+    auto it = channel_index_.find(channel_id);
+    if (it == channel_index_.end()) {
+        it = channel_index_.emplace(channel_id, channels_.size()).first;
+        channels_.push_back(Channel{channel_id});
+    }
+    pending_.channels[channel_id] = ChangeKind::kChanged;
+    return channels_[it->second];
+}
+
+void ServerState::SetParent(std::uint32_t channel_id, std::uint32_t parent) {
+    const auto old_parent = channels_[channel_index_[channel_id]].parent;
+    if (old_parent == parent) return;
+    if (old_parent != kNoChannel) {
+        auto it = channel_index_.find(old_parent);
+        if (it != channel_index_.end()) {
+            Erase(channels_[it->second].children, channel_id);
+            pending_.channels[old_parent] = ChangeKind::kChanged;
+        }
+    }
+    if (parent != kNoChannel) ChannelFor(parent).children.push_back(channel_id);
+    channels_[channel_index_[channel_id]].parent = parent;
+}
+
+void ServerState::SetBlob(std::string* hash_field, const std::string& content) {
+    if (content.empty()) {
+        SetBlobHash(hash_field, std::string{});
+        return;
+    }
+    auto hash = Sha1::Of(content);
+    auto& blob = blobs_[hash];
+    if (blob.data.empty()) blob.data = content;
+    SetBlobHash(hash_field, hash);
+}
+
+void ServerState::SetBlobHash(std::string* hash_field, const std::string& hash) {
+    if (*hash_field == hash) return;
+    if (!hash.empty()) blobs_[hash].refs++;
+    ReleaseBlob(*hash_field);
+    *hash_field = hash;
+}
+
+void ServerState::ReleaseBlob(const std::string& hash) {
+    if (hash.empty()) return;
+    auto it = blobs_.find(hash);
+    if (it != blobs_.end() && --it->second.refs == 0) blobs_.erase(it);
+}
+
+}  // namespace winrt::blurt::mumble::implementation
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Mumble.pb.h"
+
+namespace winrt::blurt::mumble::implementation {
+
+// What the server has told us about its channels and the users in them,
+// built up from the UserState, ChannelState, UserRemove and ChannelRemove
+// messages it sends.
+//
+// Users and channels each live in one flat vector, found by session or
+// channel ID through a hash index; removing one moves the last into its
+// place. Comments, avatar textures and channel descriptions can be big, so
+// records only hold their SHA-1 hashes, and the bytes are kept once in a
+// separate reference-counted blob table. A hash with no blob behind it
+// means the server hasn't sent the content, only said what it is.
+//
+// Changes aren't announced one at a time. Apply as many messages as are at
+// hand, then TakeChanges() to get every user and channel they touched.
+//
+// None of this is thread-safe.
+class ServerState {
+   public:
+    static constexpr std::uint32_t kNoChannel = 0xffffffff;
+    static constexpr std::uint32_t kUnregistered = 0xffffffff;
+
+    struct User {
+        std::uint32_t session;
+        // Registered user ID, or kUnregistered
+        std::uint32_t user_id{kUnregistered};
+        std::uint32_t channel_id{0};
+        std::uint16_t flags{0};
+        std::string name;
+        // SHA-1 hashes of the comment and avatar texture, or empty for none
+        std::string comment_hash;
+        std::string texture_hash;
+    };
+
+    // Bits in User::flags
+    enum UserFlag : std::uint16_t {
+        kMute = 1 << 0,
+        kDeaf = 1 << 1,
+        kSuppress = 1 << 2,
+        kSelfMute = 1 << 3,
+        kSelfDeaf = 1 << 4,
+        kPrioritySpeaker = 1 << 5,
+        kRecording = 1 << 6,
+    };
+
+    struct Channel {
+        std::uint32_t channel_id;
+        // kNoChannel for the root
+        std::uint32_t parent{kNoChannel};
+        std::int32_t position{0};
+        std::uint32_t max_users{0};
+        bool temporary{false};
+        std::string name;
+        std::string description_hash;
+        std::vector<std::uint32_t> children;
+        std::vector<std::uint32_t> links;
+    };
+
+    // Everything touched since the last TakeChanges(), each ID once
+    struct Changes {
+        std::vector<std::uint32_t> users_changed;
+        std::vector<std::uint32_t> users_removed;
+        std::vector<std::uint32_t> channels_changed;
+        std::vector<std::uint32_t> channels_removed;
+
+        bool empty() const {
+            return users_changed.empty() && users_removed.empty() && channels_changed.empty() &&
+                   channels_removed.empty();
+        }
+    };
+
+    void Apply(const MumbleProto::UserState& msg);
+    void Apply(const MumbleProto::UserRemove& msg);
+    void Apply(const MumbleProto::ChannelState& msg);
+    void Apply(const MumbleProto::ChannelRemove& msg);
+
+    Changes TakeChanges();
+    bool HasChanges() const { return !pending_.empty(); }
+
+    // Forget everything, as on disconnecting
+    void Clear();
+
+    // Null if there's no such user or channel. The pointers are good until
+    // the next Apply().
+    const User* FindUser(std::uint32_t session) const;
+    const Channel* FindChannel(std::uint32_t channel_id) const;
+
+    const std::vector<User>& Users() const { return users_; }
+    const std::vector<Channel>& Channels() const { return channels_; }
+
+    // The content with the given SHA-1 hash, or null if we don't have it
+    const std::string* FindBlob(const std::string& hash) const;
+
+    // Supply content from elsewhere (like a cache) for a hash that's in use
+    // but missing; it's dropped if nothing refers to that hash
+    void AddBlob(const std::string& hash, std::string content);
+
+   private:
+    enum class ChangeKind { kChanged, kRemoved };
+    struct PendingChanges {
+        std::unordered_map<std::uint32_t, ChangeKind> users;
+        std::unordered_map<std::uint32_t, ChangeKind> channels;
+        bool empty() const { return users.empty() && channels.empty(); }
+    };
+
+    struct Blob {
+        std::string data;
+        std::uint32_t refs{0};
+    };
+
+    // The channel with this ID, made empty if it's new, and marked changed
+    Channel& ChannelFor(std::uint32_t channel_id);
+    // Move a channel in the tree; this may make a placeholder parent, so
+    // Channel references don't survive it
+    void SetParent(std::uint32_t channel_id, std::uint32_t parent);
+
+    // Point *hash_field at new content or a new hash, keeping the blob
+    // reference counts straight
+    void SetBlob(std::string* hash_field, const std::string& content);
+    void SetBlobHash(std::string* hash_field, const std::string& hash);
+    void ReleaseBlob(const std::string& hash);
+
+    std::vector<User> users_;
+    std::unordered_map<std::uint32_t, std::size_t> user_index_;
+    std::vector<Channel> channels_;
+    std::unordered_map<std::uint32_t, std::size_t> channel_index_;
+    std::unordered_map<std::string, Blob> blobs_;
+    PendingChanges pending_;
+};
+
+}  // namespace winrt::blurt::mumble::implementation
@@ -0,0 +1,98 @@
+#include "pch.h"
+
+#include "Sha1.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace winrt::blurt {
+
+namespace {
+inline std::uint32_t Rotl(std::uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+}  // namespace
+
+void Sha1::Reset() {
+    state_ = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+    block_len_ = 0;
+    total_len_ = 0;
+}
+
+void Sha1::Update(const std::uint8_t* data, std::size_t len) {
+    total_len_ += len;
+    if (block_len_ > 0) {
+        auto n = std::min(len, block_.size() - block_len_);
+        std::memcpy(block_.data() + block_len_, data, n);
+        block_len_ += n;
+        data += n;
+        len -= n;
+        if (block_len_ < block_.size()) return;
+        Transform(block_.data());
+        block_len_ = 0;
+    }
+    for (; len >= block_.size(); data += block_.size(), len -= block_.size()) Transform(data);
+    std::memcpy(block_.data(), data, len);
+    block_len_ = len;
+}
+
+Sha1::Digest Sha1::Final() {
+    const std::uint64_t bits = total_len_ * 8;
+    const std::uint8_t pad = 0x80;
+    Update(&pad, 1);
+    const std::uint8_t zero = 0;
+    while (block_len_ != 56) Update(&zero, 1);
+    std::uint8_t length[8];
+    for (int i = 0; i < 8; i++) length[i] = static_cast<std::uint8_t>(bits >> (56 - 8 * i));
+    Update(length, 8);
+
+    Digest digest;
+    for (std::size_t i = 0; i < state_.size(); i++)
+        for (int j = 0; j < 4; j++)
+            digest[4 * i + j] = static_cast<std::uint8_t>(state_[i] >> (24 - 8 * j));
+    return digest;
+}
+
+std::string Sha1::Of(const std::uint8_t* data, std::size_t len) {
+    Sha1 sha;
+    sha.Update(data, len);
+    auto digest = sha.Final();
+    return std::string{digest.begin(), digest.end()};
+}
+
+void Sha1::Transform(const std::uint8_t* block) {
+    std::uint32_t w[80];
+    for (int i = 0; i < 16; i++)
+        w[i] = (std::uint32_t{block[4 * i]} << 24) | (std::uint32_t{block[4 * i + 1]} << 16) |
+               (std::uint32_t{block[4 * i + 2]} << 8) | std::uint32_t{block[4 * i + 3]};
+    for (int i = 16; i < 80; i++) w[i] = Rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    auto [a, b, c, d, e] = state_;
+    for (int i = 0; i < 80; i++) {
+        std::uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdc;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+        const std::uint32_t t = Rotl(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = Rotl(b, 30);
+        b = a;
+        a = t;
+    }
+    state_[0] += a;
+    state_[1] += b;
+    state_[2] += c;
+    state_[3] += d;
+    state_[4] += e;
+}
+
+}  // namespace winrt::blurt
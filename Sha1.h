@@ -0,0 +1,41 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace winrt::blurt {
+
+// The SHA-1 hash, which Mumble uses to name comments, avatar textures and
+// channel descriptions so that clients can skip downloading ones they
+// already have. That's not a security-sensitive use, which is just as well.
+class Sha1 {
+   public:
+    static constexpr std::size_t kDigestSize = 20;
+    using Digest = std::array<std::uint8_t, kDigestSize>;
+
+    Sha1() { Reset(); }
+
+    void Reset();
+    void Update(const std::uint8_t* data, std::size_t len);
+    // Finish the hash; call Reset() before hashing anything else
+    Digest Final();
+
+    // Hash a whole buffer in one go, returning the digest as the 20 raw
+    // bytes that Mumble's *_hash protobuf fields carry
+    static std::string Of(const std::uint8_t* data, std::size_t len);
+    static std::string Of(const std::string& s) {
+        return Of(reinterpret_cast<const std::uint8_t*>(s.data()), s.size());
+    }
+
+   private:
+    void Transform(const std::uint8_t* block);
+
+    std::array<std::uint32_t, 5> state_;
+    std::array<std::uint8_t, 64> block_;
+    std::size_t block_len_;
+    std::uint64_t total_len_;
+};
+
+}  // namespace winrt::blurt
@@ -0,0 +1,16 @@
+#include "pch.h"
+
+#include "StateAnnouncer.h"
+
+namespace winrt::blurt::mumble::implementation {
+
+bool StateAnnouncer::OnMessage(ControlPacketType type, bool is_state, bool more_buffered) {
+    if (type == ControlPacketType::ServerSync) {
+        synced_ = true;
+    } else if (!is_state) {
+        return false;
+    }
+    return synced_ && !more_buffered;
+}
+
+}  // namespace winrt::blurt::mumble::implementation
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "ControlPacket.h"
+
+namespace winrt::blurt::mumble::implementation {
+
+// Decides when the control channel's read loop announces what's changed in
+// its ServerState.
+//
+// Nothing is announced during the initial sync, so the whole of it comes as
+// one set of changes, once ServerSync ends it. After that, changes are
+// announced whenever the loop has caught up with what's been read, so
+// everything that arrived together comes together.
+//
+// Nothing here locks; the read loop owns it.
+class StateAnnouncer {
+   public:
+    // Note a message the read loop has handled: its type, whether it was a
+    // state message applied to the ServerState, and whether another whole
+    // message is already waiting to be read. Returns whether to announce
+    // changes now.
+    bool OnMessage(ControlPacketType type, bool is_state, bool more_buffered);
+
+    // Whether the server has finished sending its initial state
+    bool Synced() const { return synced_; }
+
+   private:
+    bool synced_{false};
+};
+
+}  // namespace winrt::blurt::mumble::implementation
@@ -0,0 +1,151 @@
+#include "pch.h"
+
+#include "VarInt.h"
+
+#include <array>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <stdlib.h>
+#endif
+
+namespace winrt::blurt::mumble::implementation {
+
+namespace {
+// Per first byte: total encoded length, and which of the first byte's bits
+// belong to the value. A length of zero marks the 0xf8 negation prefix,
+// whose length depends on what follows.
+struct Prefix {
+    std::uint8_t length;
+    std::uint8_t value_mask;
+};
+
+constexpr Prefix PrefixOf(std::uint8_t v) {
+    if ((v & 0x80) == 0x00) return {1, 0x7f};  // positive, 7 bits
+    if ((v & 0xc0) == 0x80) return {2, 0x3f};  // positive, 14 bits
+    if ((v & 0xe0) == 0xc0) return {3, 0x1f};  // positive, 21 bits
+    if ((v & 0xf0) == 0xe0) return {4, 0x0f};  // positive, 28 bits
+    switch (v & 0xfc) {
+        case 0xf0:
+            return {5, 0x00};  // positive, 32 bits
+        case 0xf4:
+            return {9, 0x00};  // positive, 64 bits
+        case 0xf8:
+            return {0, 0x00};  // negation of the following varint
+        default:
+            return {1, 0x03};  // 0xfc: negative, 2 bits (really??)
+    }
+}
+
+constexpr std::array<Prefix, 256> MakePrefixTable() {
+    std::array<Prefix, 256> table{};
+    for (int i = 0; i < 256; i++) table[i] = PrefixOf(static_cast<std::uint8_t>(i));
+    return table;
+}
+
+constexpr std::array<Prefix, 256> kPrefixes = MakePrefixTable();
+
+inline std::uint64_t ByteSwap(std::uint64_t v) {
+#ifdef _MSC_VER
+    return _byteswap_uint64(v);
+#else
+    return __builtin_bswap64(v);
+#endif
+}
+
+// Read n (1 to 8) bytes as a big-endian integer; `avail` is how many bytes
+// are readable from p, which must be at least n. Every platform we target is
+// little-endian.
+inline std::uint64_t LoadBigEndian(const std::uint8_t* p, std::size_t n, std::size_t avail) {
+    if (avail >= 8) {
+        std::uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        return ByteSwap(word) >> (64 - 8 * n);
+    }
+    std::uint64_t result{0};
+    for (std::size_t i = 0; i < n; i++) result = result << 8 | p[i];
+    return result;
+}
+}  // namespace
+
+// Decoding is derived from Mumble[1], which is copyright The Mumble
+// Developers and used under license. Full license text is available in our
+// LICENSE file and the Mumble website[2].
+//
+// 1. https://github.com/mumble-voip/mumble/blob/1d45d99/src/PacketDataStream.h
+// 2. https://www.mumble.info/LICENSE
+std::size_t DecodeVarInt(const std::uint8_t* data, std::size_t len, std::uint64_t* out) {
+    if (len == 0) return 0;
+    const std::uint8_t v = data[0];
+    const Prefix prefix = kPrefixes[v];
+
+    if (prefix.length == 0) {
+        // Two's-complement negative: NOT of the varint that follows
+        std::uint64_t inner;
+        auto n = DecodeVarInt(data + 1, len - 1, &inner);
+        if (n == 0) return 0;
+        *out = ~inner;
+        return n + 1;
+    }
+    if (prefix.length > len) return 0;
+
+    if (prefix.length == 1) {
+        *out = (v & 0x80) == 0 ? v : ~static_cast<std::uint64_t>(v & prefix.value_mask);
+        return 1;
+    }
+
+    const std::size_t body = prefix.length - 1u;
+    std::uint64_t result = LoadBigEndian(data + 1, body, len - 1);
+    if (prefix.value_mask != 0) {
+        result |= static_cast<std::uint64_t>(v & prefix.value_mask) << (8 * body);
+    }
+    *out = result;
+    return prefix.length;
+}
+
+std::size_t EncodeVarInt(std::uint64_t n, std::uint8_t* dest) {
+    std::size_t pos{0};
+    if ((n & 0x8000000000000000LL) && (~n < 0x100000000LL)) {
+        // two's-complement negative
+        n = ~n;
+        if (n <= 0x3) {
+            // shortcut encoding for -1 to -4 (really??)
+            dest[0] = static_cast<std::uint8_t>((n & 0x3) | 0xfc);
+            return 1;
+        }
+        dest[pos++] = 0xf8;
+        // fall through to encode ~n
+    }
+
+    std::size_t body;
+    if (n < 0x80) {
+        // 1-byte encoding, positive, 7 bits
+        dest[pos] = static_cast<std::uint8_t>(n);
+        return pos + 1;
+    } else if (n < 0x4000) {
+        // 2-byte encoding, positive, 14 bits
+        dest[pos++] = static_cast<std::uint8_t>((n >> 8) | 0x80);
+        body = 1;
+    } else if (n < 0x200000) {
+        // 3-byte encoding, positive, 21 bits
+        dest[pos++] = static_cast<std::uint8_t>((n >> 16) | 0xc0);
+        body = 2;
+    } else if (n < 0x10000000) {
+        // 4-byte encoding, positive, 28 bits
+        dest[pos++] = static_cast<std::uint8_t>((n >> 24) | 0xe0);
+        body = 3;
+    } else if (n < 0x100000000ll) {
+        // 5-byte encoding, positive, 32 bits
+        dest[pos++] = 0xf0;
+        body = 4;
+    } else {
+        // 9-byte encoding, positive, 64 bits
+        dest[pos++] = 0xf4;
+        body = 8;
+    }
+    for (std::size_t i = 0; i < body; i++)
+        dest[pos + i] = static_cast<std::uint8_t>(n >> (8 * (body - 1 - i)));
+    return pos + body;
+}
+
+}  // namespace winrt::blurt::mumble::implementation
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace winrt::blurt::mumble::implementation {
+
+// Codec for the variable-length integers in Mumble's legacy voice datagram
+// format, bit-exact with Mumble's PacketDataStream: 1- to 5-byte and 9-byte
+// big-endian forms for positive values, a 1-byte form for -1 through -4,
+// and an 0xf8 prefix meaning "bitwise NOT of the varint that follows."
+//
+// These are built for hot loops: the length of a varint is looked up from
+// its first byte and checked against the input once, and the body is read
+// with a single wide load when there's room. Nothing here throws or
+// allocates.
+
+// The most bytes a single encoded varint can take (0xf8 prefix plus a
+// 9-byte body)
+constexpr std::size_t kMaxVarIntSize = 10;
+
+// Decode one varint from the start of the given bytes into *out. Returns the
+// number of bytes consumed, or zero if the input is truncated.
+std::size_t DecodeVarInt(const std::uint8_t* data, std::size_t len, std::uint64_t* out);
+
+// Encode a varint into dest, which must have room for at least
+// kMaxVarIntSize bytes. Returns the number of bytes written.
+std::size_t EncodeVarInt(std::uint64_t n, std::uint8_t* dest);
+
+}  // namespace winrt::blurt::mumble::implementation
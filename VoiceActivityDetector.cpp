@@ -0,0 +1,83 @@
+#include "pch.h"
+
+#include "VoiceActivityDetector.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace winrt::blurt::audio::implementation {
+
+namespace {
+// A frame must be this far above the noise floor to start a spurt, and at
+// least this loud in absolute terms, so a dead-quiet room can't trigger it
+constexpr float kOpenMarginDb = 9.0f;
+constexpr float kMinOpenLevelDb = -55.0f;
+// Once talking, frames count as quiet below this much less than the start
+// threshold
+constexpr float kHysteresisDb = 4.0f;
+// How long audio has to stay quiet before the spurt ends
+constexpr std::chrono::milliseconds kHangover{300};
+
+// The noise floor drops quickly toward quieter audio but creeps up slowly,
+// so speech doesn't pull it up much; it's capped so that even constant
+// talking can't become the floor
+constexpr float kFloorFallRate = 0.2f;
+constexpr float kFloorRiseDbPerSecond = 2.0f;
+constexpr float kInitialNoiseFloorDb = -60.0f;
+constexpr float kMaxNoiseFloorDb = -40.0f;
+constexpr float kMinLevelDb = -100.0f;
+
+float RMSLevelDb(const float* pcm, std::int32_t num_samples) {
+    if (num_samples <= 0) return kMinLevelDb;
+    float sum{0};
+    for (std::int32_t i = 0; i < num_samples; i++) sum += pcm[i] * pcm[i];
+    float rms = std::sqrt(sum / num_samples);
+    return std::max(20.0f * std::log10(std::max(rms, 1e-9f)), kMinLevelDb);
+}
+}  // namespace
+
+VoiceActivityDetector::VoiceActivityDetector(std::chrono::milliseconds frame_duration)
+    : hangover_frames_{static_cast<std::int32_t>(
+          (kHangover.count() + frame_duration.count() - 1) / frame_duration.count())},
+      floor_rise_per_frame_db_{kFloorRiseDbPerSecond * frame_duration.count() / 1000.0f},
+      level_db_{kMinLevelDb},
+      noise_floor_db_{kInitialNoiseFloorDb} {}
+
+VoiceActivityDetector::Decision VoiceActivityDetector::Process(const float* pcm,
+                                                               std::int32_t num_samples) {
+    level_db_ = RMSLevelDb(pcm, num_samples);
+
+    // Thresholds come from the floor as it stood before this frame, so a
+    // sudden loud frame is judged against the quiet that came before it
+    float open_db = std::max(noise_floor_db_ + kOpenMarginDb, kMinOpenLevelDb);
+    float close_db = open_db - kHysteresisDb;
+
+    if (level_db_ < noise_floor_db_) {
+        noise_floor_db_ += (level_db_ - noise_floor_db_) * kFloorFallRate;
+    } else {
+        noise_floor_db_ = std::min({noise_floor_db_ + floor_rise_per_frame_db_, level_db_,
+                                    kMaxNoiseFloorDb});
+    }
+
+    if (!active_) {
+        if (level_db_ < open_db) return Decision::Silent;
+        active_ = true;
+        quiet_frames_ = 0;
+        return Decision::Start;
+    }
+
+    if (level_db_ >= close_db) {
+        quiet_frames_ = 0;
+        return Decision::Continue;
+    }
+    if (++quiet_frames_ < hangover_frames_) return Decision::Continue;
+    active_ = false;
+    return Decision::End;
+}
+
+void VoiceActivityDetector::Reset() {
+    active_ = false;
+    quiet_frames_ = 0;
+}
+
+}  // namespace winrt::blurt::audio::implementation
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace winrt::blurt::audio::implementation {
+
+// Decides, one frame of captured audio at a time, whether the user is
+// talking, so the encoder can skip silence entirely instead of encoding and
+// sending it.
+//
+// The decision is made on frame loudness (RMS level, in dB relative to full
+// scale) against a noise floor that tracks the quietest recent audio. A
+// spurt starts as soon as one frame is loud enough to clear the floor by a
+// margin; it ends only once frames have stayed below a lower threshold for
+// a hangover period, so brief pauses between words don't chop the audio.
+//
+// This does no allocation or locking; the caller is responsible for locking
+// access from different threads.
+class VoiceActivityDetector {
+   public:
+    enum class Decision {
+        Silent,    // no talk spurt; don't send this frame
+        Start,     // first frame of a talk spurt
+        Continue,  // a frame in the middle of a talk spurt
+        End,       // last frame of a talk spurt; send it as a terminator
+    };
+
+    // Create a detector for frames of the given duration
+    explicit VoiceActivityDetector(std::chrono::milliseconds frame_duration);
+
+    // Classify the next frame of audio, given as num_samples float samples
+    Decision Process(const float* pcm, std::int32_t num_samples);
+
+    // Forget any talk spurt in progress
+    void Reset();
+
+    bool IsActive() const { return active_; }
+
+    // The RMS level of the last frame processed, and the current noise floor
+    // estimate, both in dBFS
+    float LevelDb() const { return level_db_; }
+    float NoiseFloorDb() const { return noise_floor_db_; }
+
+   private:
+    std::int32_t hangover_frames_;
+    float floor_rise_per_frame_db_;
+    bool active_{false};
+    std::int32_t quiet_frames_{0};
+    float level_db_;
+    float noise_floor_db_;
+};
+
+}  // namespace winrt::blurt::audio::implementation
@@ -0,0 +1,54 @@
+#include "pch.h"
+
+#include "VoiceSocket.h"
+
+#include "winrt/Windows.Networking.h"
+#include "winrt/Windows.Storage.Streams.h"
+
+namespace winrt::blurt::mumble::implementation {
+
+namespace foundation = winrt::Windows::Foundation;
+namespace net = winrt::Windows::Networking;
+namespace sockets = winrt::Windows::Networking::Sockets;
+namespace streams = winrt::Windows::Storage::Streams;
+
+VoiceSocket::VoiceSocket() {
+    socket_.Control().QualityOfService(sockets::SocketQualityOfService::LowLatency);
+    // UWP insists this be hooked up before the socket is bound or connected
+    socket_.MessageReceived({this, &VoiceSocket::OnMessageReceived});
+}
+
+void VoiceSocket::Close() {
+    if (!open_) return;
+    socket_.Close();
+    open_ = false;
+}
+
+foundation::IAsyncAction VoiceSocket::ConnectAsync(const winrt::hstring& host,
+                                                   const winrt::hstring& port) {
+    co_await socket_.ConnectAsync(net::HostName{host}, port);
+    open_ = true;
+}
+
+foundation::IAsyncAction VoiceSocket::WriteDatagramAsync(ByteChunk datagram) {
+    streams::DataWriter writer{socket_.OutputStream()};
+    writer.WriteBytes({datagram.data(), datagram.data() + datagram.size()});
+    co_await writer.StoreAsync();
+    writer.DetachStream();
+}
+
+void VoiceSocket::OnMessageReceived(sockets::DatagramSocket const&,
+                                    sockets::DatagramSocketMessageReceivedEventArgs const& args) {
+    try {
+        auto reader = args.GetDataReader();
+        auto len = reader.UnconsumedBufferLength();
+        auto datagram = ByteChunk::Allocate(len);
+        reader.ReadBytes({datagram.data(), datagram.data() + len});
+        if (datagram_received_) datagram_received_(std::move(datagram));
+    } catch (const winrt::hresult_error&) {
+        // Most likely an ICMP error for an earlier send, e.g. the server
+        // isn't listening for UDP; the lack of replies will say as much
+    }
+}
+
+}  // namespace winrt::blurt::mumble::implementation
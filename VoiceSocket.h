@@ -0,0 +1,43 @@
+#pragma once
+
+#include <functional>
+#include "ByteChunk.h"
+#include "winrt/Windows.Foundation.h"
+#include "winrt/Windows.Networking.Sockets.h"
+
+namespace winrt::blurt::mumble::implementation {
+
+// A thin abstraction over the Mumble protocol UDP voice socket. Datagrams
+// go out and come in as-is; encryption is the caller's business.
+class VoiceSocket {
+   public:
+    VoiceSocket();
+    ~VoiceSocket() { Close(); }
+
+    void Close();
+
+    // Set the function that takes each incoming datagram. It's called on a
+    // thread pool thread, and must be set before connecting.
+    using DatagramHandler = std::function<void(ByteChunk&&)>;
+    void DatagramReceived(DatagramHandler handler) { datagram_received_ = std::move(handler); }
+
+    // Connect to the given host and port asynchronously
+    Windows::Foundation::IAsyncAction ConnectAsync(const winrt::hstring& host,
+                                                   const winrt::hstring& port);
+
+    bool IsOpen() const { return open_; }
+
+    // Send one datagram
+    Windows::Foundation::IAsyncAction WriteDatagramAsync(ByteChunk datagram);
+
+   private:
+    void OnMessageReceived(
+        Windows::Networking::Sockets::DatagramSocket const& socket,
+        Windows::Networking::Sockets::DatagramSocketMessageReceivedEventArgs const& args);
+
+    bool open_{false};
+    Windows::Networking::Sockets::DatagramSocket socket_;
+    DatagramHandler datagram_received_;
+};
+
+}  // namespace winrt::blurt::mumble::implementation
@@ -1,7 +0,0 @@
-#include "pch.h"
-
-#include "WireMessage.h"
-
-#include "mumble.WireMessage.g.cpp"
-
-namespace winrt::blurt::mumble::implementation {}  // namespace winrt::blurt::mumble::implementation
@@ -0,0 +1,735 @@
+#include "pch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AudioBuffer.h"
+#include "AudioMixer.h"
+#include "AudioPacket.h"
+#include "AudioRingBuffer.h"
+#include "ByteChunk.h"
+#include "BytePool.h"
+#include "ControlFramer.h"
+#include "MixKernels.h"
+#include "OpusDecoder.h"
+#include "VarInt.h"
+#ifdef BLURT_HAVE_PROTOBUF
+#include "ControlPacket.h"
+#include "OpusEncoder.h"
+#include "PacketTrace.h"
+#include "ServerState.h"
+#endif
+
+// Microbenchmarks for the hot paths of receiving, mixing and sending audio.
+//
+// Each benchmark runs its operation in batches, timing every batch, and
+// reports percentiles of the time per operation across batches along with
+// overall throughput. Batches are short enough that a preemption or a slow
+// path shows up in the tail rather than vanishing into an average.
+//
+// Usage: blurt_bench [--batches N] [name filter]
+
+using namespace winrt::blurt;
+using namespace winrt::blurt::audio::implementation;
+using namespace winrt::blurt::mumble::implementation;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Somewhere for results to go so the compiler can't throw the work away
+volatile std::uint64_t g_sink;
+
+struct Options {
+    std::int32_t batches{2000};
+    std::string filter;
+};
+
+struct Benchmark {
+    const char* name;
+    // Operations per timed batch
+    std::int32_t batch_size;
+    // What one operation processes, for the throughput column: so many
+    // units of what kind
+    double units_per_op;
+    const char* unit;
+    // Set up, then return the operation to time; it's given the operation's
+    // index within its batch
+    std::function<std::function<void(std::int32_t)>()> setup;
+};
+
+double Percentile(const std::vector<double>& sorted, double p) {
+    auto idx = static_cast<std::size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+void Run(const Benchmark& bench, const Options& options) {
+    auto op = bench.setup();
+    const std::int32_t warmup = std::max(options.batches / 20, 1);
+    std::vector<double> per_op_ns;
+    per_op_ns.reserve(options.batches);
+    Clock::duration total{0};
+    for (std::int32_t b = -warmup; b < options.batches; b++) {
+        auto start = Clock::now();
+        for (std::int32_t i = 0; i < bench.batch_size; i++) op(i);
+        auto elapsed = Clock::now() - start;
+        if (b < 0) continue;
+        total += elapsed;
+        per_op_ns.push_back(std::chrono::duration<double, std::nano>(elapsed).count() /
+                            bench.batch_size);
+    }
+    std::sort(per_op_ns.begin(), per_op_ns.end());
+
+    double ops = static_cast<double>(options.batches) * bench.batch_size;
+    double seconds = std::chrono::duration<double>(total).count();
+    double rate = ops * bench.units_per_op / seconds;
+    const char* scale = "";
+    if (rate >= 1e9) {
+        rate /= 1e9;
+        scale = "G";
+    } else if (rate >= 1e6) {
+        rate /= 1e6;
+        scale = "M";
+    } else if (rate >= 1e3) {
+        rate /= 1e3;
+        scale = "k";
+    }
+    std::printf("%-28s %9.1f %9.1f %9.1f %9.1f %9.2f %s%s/s\n", bench.name,
+                Percentile(per_op_ns, 0.5), Percentile(per_op_ns, 0.99),
+                Percentile(per_op_ns, 0.999), per_op_ns.back(), rate, scale, bench.unit);
+}
+
+// 10 ms of 48 kHz mono, the audio graph's usual quantum
+constexpr std::int32_t kQuantum = 480;
+// 20 ms of 48 kHz mono, a typical Opus frame
+constexpr std::int32_t kFrame = 960;
+
+std::vector<float> Noise(std::size_t n, float scale) {
+    std::mt19937 rng{1};
+    std::uniform_real_distribution<float> dist{-scale, scale};
+    std::vector<float> v(n);
+    for (auto& x : v) x = dist(rng);
+    return v;
+}
+
+// Values spread over every varint length, weighted toward the short ones the
+// voice header mostly carries
+std::vector<std::uint64_t> VarIntValues(std::size_t n) {
+    std::mt19937_64 rng{2};
+    std::vector<std::uint64_t> v(n);
+    for (auto& x : v) {
+        auto bits = std::uniform_int_distribution<int>{0, 99}(rng);
+        int width = bits < 50 ? 7 : bits < 80 ? 14 : bits < 90 ? 21 : bits < 95 ? 32 : 64;
+        x = rng() >> (64 - width);
+    }
+    return v;
+}
+
+// A burst of voice datagrams as they'd come off the wire, after decryption
+std::vector<ByteSlice> Datagrams(std::size_t n) {
+    std::vector<ByteSlice> frames;
+    for (std::size_t i = 0; i < n; i++) {
+        std::vector<std::uint8_t> payload(60 + i % 40, static_cast<std::uint8_t>(i));
+        AudioPacket packet{AudioPacketType::Opus, 1000 + i, ByteChunk{std::move(payload)}};
+        auto out = packet.EncodeOutgoing();
+        // Incoming datagrams carry the sender's session after the type byte
+        std::vector<std::uint8_t> bytes{out.begin(), out.end()};
+        bytes.insert(bytes.begin() + 1, static_cast<std::uint8_t>(i % 100));
+        frames.push_back(ByteSlice::Of(ByteChunk{std::move(bytes)}));
+    }
+    return frames;
+}
+
+// A control stream as a busy server sends it: mostly tunneled voice, with
+// pings, user state and the occasional texture mixed in. Each message is
+// laid out on the wire just as it would be read off the socket.
+std::vector<std::uint8_t> ControlStream(std::size_t n) {
+    std::mt19937 rng{3};
+    std::vector<std::uint8_t> stream;
+    for (std::size_t i = 0; i < n; i++) {
+        auto roll = rng() % 1000;
+        // UDPTunnel, Ping, or UserState (which carries textures too)
+        std::uint16_t type = roll < 900 ? 1 : roll < 950 ? 3 : 9;
+        std::uint32_t size = roll < 900   ? 60 + rng() % 80
+                             : roll < 950 ? 20 + rng() % 40
+                             : roll < 999 ? 30 + rng() % 300
+                                          : 10000 + rng() % 30000;
+        std::uint8_t header[ControlFramer::kHeaderSize] = {
+            static_cast<std::uint8_t>(type >> 8), static_cast<std::uint8_t>(type),
+            static_cast<std::uint8_t>(size >> 24), static_cast<std::uint8_t>(size >> 16),
+            static_cast<std::uint8_t>(size >> 8),  static_cast<std::uint8_t>(size)};
+        stream.insert(stream.end(), header, header + sizeof(header));
+        stream.resize(stream.size() + size, static_cast<std::uint8_t>(i));
+    }
+    return stream;
+}
+
+// A whole 10 ms tick of the receive side with this many people talking at
+// once: a packet from each into its jitter buffer, decoding what's due, and
+// mixing it all down to the output's stereo quantum
+Benchmark MixTick(const char* name, std::uint32_t speakers) {
+    return {name, 16, static_cast<double>(speakers), "speaker-ticks", [speakers] {
+                struct State {
+                    AudioMixer mixer{
+                        audio::AudioSetup{audio::SampleRate::Of48KHz(), audio::Channels::Stereo()}};
+                    std::vector<float> out = std::vector<float>(2 * kQuantum);
+                    JitterBuffer::Clock::time_point now{std::chrono::seconds{1000}};
+                    std::uint64_t seq{0};
+                    // Loud enough that the sum needs clipping
+                    ByteSlice packet =
+                        ByteSlice::Of(ByteChunk{std::vector<std::uint8_t>{0x90, 224}});
+                };
+                auto state = std::make_shared<State>();
+                return [state, speakers](std::int32_t) {
+                    auto& s = *state;
+                    for (std::uint32_t session = 1; session <= speakers; session++) {
+                        s.mixer.SpeakerFor(session, s.now)->Jitter().Put(s.seq, 1, false, s.packet,
+                                                                         s.now);
+                    }
+                    g_sink = s.mixer.DecodeDue(s.now).received;
+                    while (auto n = s.mixer.SamplesReady(kQuantum)) s.mixer.MixTo(s.out.data(), n);
+                    s.seq++;
+                    s.now += std::chrono::milliseconds{10};
+                };
+            }};
+}
+
+// 20 ms of mono noise, as Opus encodes it at 40 kb/s
+std::vector<std::uint8_t> EncodedFrame() {
+    int err;
+    std::shared_ptr<::OpusEncoder> encoder{
+        opus_encoder_create(48000, 1, OPUS_APPLICATION_AUDIO, &err), opus_encoder_destroy};
+    opus_encoder_ctl(encoder.get(), OPUS_SET_BITRATE(40000));
+    auto pcm = Noise(kFrame, 0.1f);
+    std::vector<std::uint8_t> packet(4000);
+    auto size = opus_encode_float(encoder.get(), pcm.data(), kFrame, packet.data(),
+                                  static_cast<opus_int32>(packet.size()));
+    packet.resize(std::max(size, 0));
+    return packet;
+}
+
+#ifdef BLURT_HAVE_PROTOBUF
+// A user as the server describes them on joining, typical of the bulk of an
+// initial sync
+MumbleProto::UserState SampleUserState() {
+    MumbleProto::UserState user;
+    user.set_session(42);
+    user.set_actor(1);
+    user.set_name("Somebody With A Longish Name");
+    user.set_user_id(1234);
+    user.set_channel_id(7);
+    user.set_self_mute(false);
+    user.set_self_deaf(false);
+    user.set_hash("0123456789abcdef0123456789abcdef01234567");
+    user.set_comment_hash(std::string(20, '\x5a'));
+    return user;
+}
+
+// Joining a busy server: its channels, then everyone on it, then ServerSync,
+// laid out as they come down the control channel
+constexpr std::int32_t kJoinChannels = 50;
+constexpr std::int32_t kJoinUsers = 500;
+constexpr std::int32_t kJoinMessages = kJoinChannels + kJoinUsers + 1;
+
+void AppendMessage(std::vector<std::uint8_t>& wire, ControlPacketType type,
+                   const google::protobuf::MessageLite& msg) {
+    auto payload = msg.SerializeAsString();
+    auto t = static_cast<std::uint16_t>(type);
+    auto len = static_cast<std::uint32_t>(payload.size());
+    const std::uint8_t header[ControlFramer::kHeaderSize] = {
+        static_cast<std::uint8_t>(t >> 8),   static_cast<std::uint8_t>(t),
+        static_cast<std::uint8_t>(len >> 24), static_cast<std::uint8_t>(len >> 16),
+        static_cast<std::uint8_t>(len >> 8),  static_cast<std::uint8_t>(len)};
+    wire.insert(wire.end(), header, header + sizeof header);
+    wire.insert(wire.end(), payload.begin(), payload.end());
+}
+
+std::vector<std::uint8_t> JoinBurst() {
+    std::vector<std::uint8_t> wire;
+    for (std::int32_t i = 0; i < kJoinChannels; i++) {
+        MumbleProto::ChannelState channel;
+        channel.set_channel_id(i);
+        if (i > 0) channel.set_parent(i / 8);
+        channel.set_name("Channel number " + std::to_string(i));
+        channel.set_position(i);
+        channel.set_description_hash(std::string(20, '\x33'));
+        AppendMessage(wire, ControlPacketType::ChannelState, channel);
+    }
+    for (std::int32_t i = 0; i < kJoinUsers; i++) {
+        auto user = SampleUserState();
+        user.set_session(100 + i);
+        user.set_user_id(1000 + i);
+        user.set_channel_id(i % kJoinChannels);
+        AppendMessage(wire, ControlPacketType::UserState, user);
+    }
+    MumbleProto::ServerSync sync;
+    sync.set_session(100);
+    sync.set_max_bandwidth(558000);
+    sync.set_welcome_text("Welcome to a busy server");
+    AppendMessage(wire, ControlPacketType::ServerSync, sync);
+    return wire;
+}
+
+// ServerConnection's read loop over a join burst: the wire read 64 KiB at
+// a time, framed, and every message parsed, into the heap or into an arena
+// that starts over once it passes 1 MiB, as the read loop's does
+Benchmark ParseJoinBurst(const char* name, bool use_arena) {
+    return {name, 1, kJoinMessages, "packets", [use_arena] {
+                constexpr std::size_t kReadSize = 64 * 1024;
+                constexpr std::size_t kMaxArenaSize = 1024 * 1024;
+                auto wire = std::make_shared<std::vector<std::uint8_t>>(JoinBurst());
+                auto framer = std::make_shared<ControlFramer>();
+                auto arena = std::make_shared<google::protobuf::Arena>();
+                return [=](std::int32_t) {
+                    std::uint64_t sum{0};
+                    ControlFramer::Frame frame;
+                    for (std::size_t at = 0; at < wire->size();) {
+                        auto n = std::min(kReadSize, wire->size() - at);
+                        std::memcpy(framer->PrepareInput(n), wire->data() + at, n);
+                        framer->CommitInput(n);
+                        at += n;
+                        while (framer->NextFrame(frame)) {
+                            if (use_arena && arena->SpaceUsed() > kMaxArenaSize) arena->Reset();
+                            ControlPacket packet{std::move(frame),
+                                                 use_arena ? arena.get() : nullptr};
+                            switch (packet.Type()) {
+                                case ControlPacketType::ChannelState:
+                                    sum += packet.ResolveProto<ControlPacketType::ChannelState>()
+                                               .channel_id();
+                                    break;
+                                case ControlPacketType::UserState:
+                                    sum += packet.ResolveProto<ControlPacketType::UserState>()
+                                               .session();
+                                    break;
+                                default:
+                                    sum += packet.ResolveProto<ControlPacketType::ServerSync>()
+                                               .session();
+                            }
+                        }
+                    }
+                    g_sink = sum;
+                };
+            }};
+}
+
+// Applying an initial sync's worth of already-parsed state to a fresh
+// ServerState and taking the one set of changes it announces, as
+// ServerConnection does on joining
+Benchmark ApplyInitialSync(const char* name) {
+    return {name, 1, kJoinChannels + kJoinUsers, "messages", [] {
+                auto channels = std::make_shared<std::vector<MumbleProto::ChannelState>>();
+                auto users = std::make_shared<std::vector<MumbleProto::UserState>>();
+                for (std::int32_t i = 0; i < kJoinChannels; i++) {
+                    MumbleProto::ChannelState channel;
+                    channel.set_channel_id(i);
+                    if (i > 0) channel.set_parent(i / 8);
+                    channel.set_name("Channel number " + std::to_string(i));
+                    channel.set_description_hash(std::string(20, static_cast<char>(i)));
+                    channels->push_back(std::move(channel));
+                }
+                for (std::int32_t i = 0; i < kJoinUsers; i++) {
+                    auto user = SampleUserState();
+                    user.set_session(100 + i);
+                    user.set_channel_id(i % kJoinChannels);
+                    user.set_comment_hash(std::string(20, static_cast<char>(i)));
+                    users->push_back(std::move(user));
+                }
+                return [=](std::int32_t) {
+                    ServerState state;
+                    for (const auto& channel : *channels) state.Apply(channel);
+                    for (const auto& user : *users) state.Apply(user);
+                    g_sink = state.TakeChanges().users_changed.size();
+                };
+            }};
+}
+
+// The send side of a voice profile: 10 ms of mono capture at a time into an
+// encoder, which encodes and packs up frames as they fill
+Benchmark EncodeCapture(const char* name, VoiceProfile profile) {
+    return {name, 32, kQuantum, "samples", [profile] {
+                auto encoder = std::make_shared<audio::implementation::OpusEncoder>(
+                    audio::AudioSetup{audio::SampleRate::Of48KHz(), audio::Channels::Mono()},
+                    profile);
+                encoder->VoiceActivation(false);
+                encoder->EncodedAudioReady(
+                    [](OutgoingVoiceFrame&& frame) { g_sink = frame.PayloadSize(); });
+                auto src = std::make_shared<std::vector<float>>(Noise(kQuantum, 0.1f));
+                return [=](std::int32_t) { encoder->BufferRawAudio(src->data(), kQuantum); };
+            }};
+}
+#endif
+
+std::vector<Benchmark> Benchmarks() {
+    std::vector<Benchmark> all;
+
+    all.push_back({"ring/write+read quantum", 64, kQuantum, "samples", [] {
+                       auto ring = std::make_shared<AudioRingBuffer<float>>(kQuantum * 8);
+                       auto src = std::make_shared<std::vector<float>>(Noise(kQuantum, 1));
+                       auto dest = std::make_shared<std::vector<float>>(kQuantum);
+                       return [=](std::int32_t) {
+                           ring->WriteSamplesFrom(src->data(), kQuantum);
+                           g_sink = ring->ReadSamplesTo(dest->data(), kQuantum);
+                       };
+                   }});
+
+    // For comparison, the locked buffer the ring replaced on the receive
+    // path, taking the lock each side would
+    all.push_back({"buffer/write+read quantum", 64, kQuantum, "samples", [] {
+                       struct State {
+                           std::mutex mutex;
+                           AudioBuffer<float> buffer{kQuantum * 8};
+                           std::vector<float> src = Noise(kQuantum, 1);
+                           std::vector<float> dest = std::vector<float>(kQuantum);
+                       };
+                       auto state = std::make_shared<State>();
+                       return [state](std::int32_t) {
+                           {
+                               std::lock_guard lock{state->mutex};
+                               state->buffer.WriteSamplesFrom(state->src.data(), kQuantum);
+                           }
+                           std::lock_guard lock{state->mutex};
+                           g_sink = state->buffer.ReadSamplesTo(state->dest.data(), kQuantum);
+                       };
+                   }});
+
+    // The producer side, with a consumer draining concurrently on another
+    // thread; this is what the network thread sees writing decoded audio
+    all.push_back({"ring/spsc write quantum", 64, kQuantum, "samples", [] {
+                       struct State {
+                           AudioRingBuffer<float> ring{kQuantum * 16};
+                           std::vector<float> src = Noise(kQuantum, 1);
+                           std::atomic<bool> stop{false};
+                           std::thread consumer;
+                           ~State() {
+                               stop = true;
+                               consumer.join();
+                           }
+                       };
+                       auto state = std::make_shared<State>();
+                       state->consumer = std::thread{[s = state.get()] {
+                           std::vector<float> dest(kQuantum);
+                           while (!s->stop) {
+                               if (s->ring.ReadSamplesTo(dest.data(), kQuantum) == 0)
+                                   std::this_thread::yield();
+                           }
+                       }};
+                       return [state](std::int32_t) {
+                           while (state->ring.WriteCapacity() < kQuantum) std::this_thread::yield();
+                           state->ring.WriteSamplesFrom(state->src.data(), kQuantum);
+                       };
+                   }});
+    all.push_back({"buffer/spsc write quantum", 64, kQuantum, "samples", [] {
+                       struct State {
+                           std::mutex mutex;
+                           AudioBuffer<float> buffer{kQuantum * 16};
+                           std::vector<float> src = Noise(kQuantum, 1);
+                           std::atomic<bool> stop{false};
+                           std::thread consumer;
+                           ~State() {
+                               stop = true;
+                               consumer.join();
+                           }
+                       };
+                       auto state = std::make_shared<State>();
+                       state->consumer = std::thread{[s = state.get()] {
+                           std::vector<float> dest(kQuantum);
+                           while (!s->stop) {
+                               std::unique_lock lock{s->mutex};
+                               if (s->buffer.ReadSamplesTo(dest.data(), kQuantum) == 0) {
+                                   lock.unlock();
+                                   std::this_thread::yield();
+                               }
+                           }
+                       }};
+                       return [state](std::int32_t) {
+                           while (true) {
+                               {
+                                   std::lock_guard lock{state->mutex};
+                                   if (state->buffer.WriteCapacity() >= kQuantum) {
+                                       state->buffer.WriteSamplesFrom(state->src.data(),
+                                                                      kQuantum);
+                                       return;
+                                   }
+                               }
+                               std::this_thread::yield();
+                           }
+                       };
+                   }});
+
+    all.push_back({"varint/decode", 1024, 1, "varints", [] {
+                       auto values = VarIntValues(1024);
+                       auto encoded = std::make_shared<std::vector<std::uint8_t>>();
+                       auto offsets = std::make_shared<std::vector<std::size_t>>();
+                       std::uint8_t buf[kMaxVarIntSize];
+                       for (auto v : values) {
+                           offsets->push_back(encoded->size());
+                           auto n = EncodeVarInt(v, buf);
+                           encoded->insert(encoded->end(), buf, buf + n);
+                       }
+                       return [=](std::int32_t i) {
+                           std::uint64_t v;
+                           auto off = (*offsets)[i];
+                           g_sink = DecodeVarInt(encoded->data() + off, encoded->size() - off, &v);
+                           g_sink = v;
+                       };
+                   }});
+
+    all.push_back({"varint/encode", 1024, 1, "varints", [] {
+                       auto values =
+                           std::make_shared<std::vector<std::uint64_t>>(VarIntValues(1024));
+                       return [=](std::int32_t i) {
+                           std::uint8_t buf[kMaxVarIntSize];
+                           g_sink = EncodeVarInt((*values)[i], buf);
+                           g_sink = buf[0];
+                       };
+                   }});
+
+    // A burst of 32 datagrams parsed in one pass, as the voice socket does
+    all.push_back({"packet/parse burst of 32", 16, 32, "packets", [] {
+                       auto frames = std::make_shared<std::vector<ByteSlice>>(Datagrams(32));
+                       auto headers = std::make_shared<std::vector<AudioPacketHeader>>(32);
+                       return [=](std::int32_t) {
+                           g_sink = ParseIncomingHeaders(frames->data(), frames->size(),
+                                                         headers->data());
+                       };
+                   }});
+
+    all.push_back({"packet/from header", 256, 1, "packets", [] {
+                       auto frames = std::make_shared<std::vector<ByteSlice>>(Datagrams(32));
+                       auto headers = std::make_shared<std::vector<AudioPacketHeader>>(32);
+                       ParseIncomingHeaders(frames->data(), frames->size(), headers->data());
+                       return [=](std::int32_t i) {
+                           auto packet =
+                               AudioPacket::FromHeader((*headers)[i % 32], (*frames)[i % 32]);
+                           g_sink = packet.PayloadSize();
+                       };
+                   }});
+
+    all.push_back({"packet/encode outgoing", 256, 1, "packets", [] {
+                       auto packet = std::make_shared<AudioPacket>(
+                           AudioPacketType::Opus, 12345,
+                           ByteChunk{std::vector<std::uint8_t>(80, 0x55)});
+                       return [=](std::int32_t) { g_sink = packet->EncodeOutgoing().size(); };
+                   }});
+
+    // One TLS record's worth of the control stream at a time, framed into
+    // every message it completes
+    constexpr std::int32_t kRecord = 16 * 1024;
+    all.push_back({"framer/control stream read", 16, kRecord, "B", [] {
+                       struct State {
+                           std::vector<std::uint8_t> stream = ControlStream(20000);
+                           std::size_t pos{0};
+                           std::optional<ControlFramer> framer{std::in_place};
+                       };
+                       auto state = std::make_shared<State>();
+                       return [state](std::int32_t) {
+                           auto& s = *state;
+                           if (s.pos + kRecord > s.stream.size()) {
+                               // Start over on a message boundary
+                               s.pos = 0;
+                               s.framer.emplace();
+                           }
+                           std::memcpy(s.framer->PrepareInput(kRecord), s.stream.data() + s.pos,
+                                       kRecord);
+                           s.framer->CommitInput(kRecord);
+                           s.pos += kRecord;
+                           ControlFramer::Frame frame;
+                           while (s.framer->NextFrame(frame)) g_sink = frame.payload.size();
+                       };
+                   }});
+
+    // Sizes typical of control messages and voice datagrams, through the
+    // pool and, for comparison, straight from the heap
+    static constexpr std::size_t kSizes[] = {40, 90, 200, 700, 1500, 90, 60, 3000};
+    all.push_back({"pool/acquire+release", 1024, 1, "blocks", [] {
+                       auto pool = std::make_shared<BytePool>();
+                       return [=](std::int32_t i) {
+                           auto block = pool->Acquire(kSizes[i % 8]);
+                           block.data()[0] = static_cast<std::uint8_t>(i);
+                           g_sink = block.data()[0];
+                       };
+                   }});
+    all.push_back({"pool/heap baseline", 1024, 1, "blocks", [] {
+                       return [](std::int32_t i) {
+                           auto block = std::make_unique<std::uint8_t[]>(kSizes[i % 8]);
+                           block[0] = static_cast<std::uint8_t>(i);
+                           // Publishing the address keeps the allocation
+                           // from being optimized away
+                           g_sink = reinterpret_cast<std::uintptr_t>(block.get()) + block[0];
+                       };
+                   }});
+
+    all.push_back({"mix/accumulate frame", 64, kFrame, "samples", [] {
+                       auto acc = std::make_shared<std::vector<float>>(kFrame);
+                       auto src = std::make_shared<std::vector<float>>(Noise(kFrame, 0.1f));
+                       return [=](std::int32_t) {
+                           MixAccumulate(acc->data(), src->data(), kFrame, 0.5f);
+                       };
+                   }});
+    all.push_back({"mix/soft clip frame", 64, kFrame, "samples", [] {
+                       auto buf = std::make_shared<std::vector<float>>(Noise(kFrame, 2));
+                       return [=](std::int32_t) { SoftClip(buf->data(), kFrame); };
+                   }});
+    all.push_back(MixTick("mix/2 speakers tick", 2));
+    all.push_back(MixTick("mix/8 speakers tick", 8));
+    all.push_back(MixTick("mix/32 speakers tick", 32));
+    all.push_back(MixTick("mix/128 speakers tick", 128));
+    all.push_back({"mix/dot product frame", 64, kFrame, "samples", [] {
+                       auto a = std::make_shared<std::vector<float>>(Noise(kFrame, 1));
+                       return [=](std::int32_t) {
+                           g_sink = static_cast<std::uint64_t>(
+                               DotProduct(a->data(), a->data(), kFrame) * 1000);
+                       };
+                   }});
+    all.push_back({"mix/downmix stereo frame", 64, kFrame, "frames", [] {
+                       auto in = std::make_shared<std::vector<float>>(Noise(kFrame * 2, 1));
+                       auto out = std::make_shared<std::vector<float>>(kFrame);
+                       return [=](std::int32_t) {
+                           DownmixStereo(in->data(), out->data(), kFrame);
+                       };
+                   }});
+    all.push_back({"mix/int16 to float frame", 64, kFrame, "samples", [] {
+                       auto in = std::make_shared<std::vector<std::int16_t>>(kFrame);
+                       for (std::int32_t i = 0; i < kFrame; i++) (*in)[i] = (i * 37) & 0x7fff;
+                       auto out = std::make_shared<std::vector<float>>(kFrame);
+                       return [=](std::int32_t) {
+                           Int16ToFloat(in->data(), out->data(), kFrame);
+                       };
+                   }});
+
+    // The codec on its own, a 20 ms frame at a time, without the encoder's
+    // and decoder's buffering around it
+    all.push_back({"opus/encode 20 ms frame", 16, kFrame, "samples", [] {
+                       int err;
+                       std::shared_ptr<::OpusEncoder> encoder{
+                           opus_encoder_create(48000, 1, OPUS_APPLICATION_AUDIO, &err),
+                           opus_encoder_destroy};
+                       opus_encoder_ctl(encoder.get(), OPUS_SET_BITRATE(40000));
+                       auto pcm = std::make_shared<std::vector<float>>(Noise(kFrame, 0.1f));
+                       auto out = std::make_shared<std::vector<std::uint8_t>>(4000);
+                       return [=](std::int32_t) {
+                           g_sink = opus_encode_float(encoder.get(), pcm->data(), kFrame,
+                                                      out->data(),
+                                                      static_cast<opus_int32>(out->size()));
+                       };
+                   }});
+    all.push_back({"opus/decode 20 ms frame", 16, kFrame, "samples", [] {
+                       auto decoder = std::make_shared<audio::implementation::OpusDecoder>(
+                           audio::AudioSetup{audio::SampleRate::Of48KHz(),
+                                             audio::Channels::Mono()});
+                       auto packet = std::make_shared<ByteSlice>(
+                           ByteSlice::Of(ByteChunk{EncodedFrame()}));
+                       return [=](std::int32_t) {
+                           g_sink = decoder->DecodeToBuffer(*packet);
+                           decoder->ReleaseAudio(decoder->BufferedSamples());
+                       };
+                   }});
+
+#ifdef BLURT_HAVE_PROTOBUF
+    // Serializing a message to send, and parsing one received, each into
+    // or out of its own pooled buffer; the parse goes to the heap here
+    all.push_back({"control/from proto", 256, 1, "packets", [] {
+                       auto user = std::make_shared<MumbleProto::UserState>(SampleUserState());
+                       return [=](std::int32_t) {
+                           g_sink = ControlPacket::From(*user).PayloadSize();
+                       };
+                   }});
+    all.push_back({"control/resolve proto", 256, 1, "packets", [] {
+                       auto bytes = std::make_shared<ByteSlice>(ByteSlice::Of(
+                           ByteChunk::CopyOf(SampleUserState().SerializeAsString())));
+                       return [=](std::int32_t) {
+                           ControlPacket packet{ControlFramer::Frame{
+                               static_cast<std::uint16_t>(ControlPacketType::UserState), *bytes}};
+                           g_sink = packet.ResolveProto<ControlPacketType::UserState>().session();
+                       };
+                   }});
+    all.push_back(ParseJoinBurst("control/join burst, heap", false));
+    all.push_back(ParseJoinBurst("control/join burst, arena", true));
+    all.push_back(ApplyInitialSync("state/initial sync"));
+    // One user changing once synced, as most traffic after joining is
+    all.push_back({"state/user update", 256, 1, "messages", [] {
+                       auto state = std::make_shared<ServerState>();
+                       for (std::int32_t i = 0; i < kJoinUsers; i++) {
+                           auto user = SampleUserState();
+                           user.set_session(100 + i);
+                           state->Apply(user);
+                       }
+                       state->TakeChanges();
+                       auto update = std::make_shared<MumbleProto::UserState>();
+                       update->set_session(142);
+                       return [=](std::int32_t i) {
+                           update->set_self_mute(i % 2 == 0);
+                           state->Apply(*update);
+                           g_sink = state->TakeChanges().users_changed.size();
+                       };
+                   }});
+
+    // What tracing adds to every packet sent or received, always on
+    all.push_back({"trace/record packet", 1024, 1, "packets", [] {
+                       return [](std::int32_t i) {
+                           TracePacket(TraceDirection::ControlIn,
+                                       static_cast<std::uint16_t>(ControlPacketType::UDPTunnel),
+                                       60 + i % 80, i % 100);
+                       };
+                   }});
+    // Only when someone asks for it; everything this thread has recorded
+    // above fills its ring
+    all.push_back({"trace/format full ring", 1, PacketTraceRing::kCapacity, "events", [] {
+                       for (std::size_t i = 0; i < PacketTraceRing::kCapacity; i++) {
+                           TracePacket(TraceDirection::VoiceIn, 4, 80, 7);
+                       }
+                       return [](std::int32_t) { g_sink = FormatPacketTrace().size(); };
+                   }});
+    // The encoder's side of sending, for comparison with encoding outgoing
+    // packets above: headers laid out in front of a payload already in place
+    all.push_back({"packet/outgoing voice frame", 256, 1, "frames", [] {
+                       return [](std::int32_t i) {
+                           OutgoingVoiceFrame frame{80};
+                           std::memset(frame.PayloadDest(), 0x55, 80);
+                           frame.PayloadSize(80);
+                           frame.FrameSequence(12345 + i);
+                           frame.Finish(0);
+                           g_sink = frame.WireSize();
+                       };
+                   }});
+    all.push_back(EncodeCapture("encode/low delay 10 ms", VoiceProfile::LowDelay()));
+    all.push_back(EncodeCapture("encode/default 20 ms", VoiceProfile::Default()));
+    all.push_back(EncodeCapture("encode/save bandwidth 40 ms", VoiceProfile::SaveBandwidth40ms()));
+    all.push_back(EncodeCapture("encode/save bandwidth 60 ms", VoiceProfile::SaveBandwidth60ms()));
+#endif
+
+    return all;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--batches") == 0 && i + 1 < argc) {
+            options.batches = std::max(std::atoi(argv[++i]), 1);
+        } else {
+            options.filter = argv[i];
+        }
+    }
+
+    std::printf("%-28s %9s %9s %9s %9s %s\n", "benchmark (ns per op)", "p50", "p99", "p99.9",
+                "max", "throughput");
+    for (const auto& bench : Benchmarks()) {
+        if (std::string{bench.name}.find(options.filter) == std::string::npos) continue;
+        Run(bench, options);
+    }
+    return 0;
+}
@@ -0,0 +1,537 @@
+#include "pch.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <queue>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "AudioMixer.h"
+#include "AudioPacket.h"
+#include "AudioParams.h"
+#include "ByteChunk.h"
+#include "ControlFramer.h"
+#include "ControlPacket.h"
+#include "CryptState.h"
+#include "JitterBuffer.h"
+#include "VarInt.h"
+#include "opus/opus.h"
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// A load generator for the receive side of voice: a stand-in server relays
+// N simulated speakers to a client made of the app's own receive pipeline,
+// over a simulated network with jitter and loss, and this reports what the
+// client's share of the work costs as the number of speakers grows.
+//
+// Some speakers come over UDP, encrypted with CryptState; the rest are
+// tunneled through the control channel as UDPTunnel messages, all sharing
+// the one TCP stream, which the client splits with ControlFramer. Either
+// way the client parses each AudioPacket, puts it in that speaker's jitter
+// buffer and decodes what's due, just like AudioSystem; every 5 ms it
+// decodes whatever else is due, and every 10 ms it mixes a quantum of
+// output, like the audio graph would.
+//
+// Time is simulated, so a run takes as long as the work does rather than
+// as long as the audio lasts. Only the client's work is timed. With libopus
+// found at configure time the speakers send (random, but well-formed) CELT
+// frames and decoding costs what it really would; with the fake, it costs
+// next to nothing and only the rest of the pipeline is measured.
+//
+// Usage: blurt_loadgen [--speakers N,N,...] [--seconds S] [--delay MS]
+//                      [--jitter MS] [--loss PERCENT] [--tunneled PERCENT]
+//                      [--seed N]
+//
+// For each speaker count, it prints the client's CPU use as a share of one
+// core; percentiles of the time to take in one packet or datagram and of
+// one decode tick (with a mix every other tick); how much audio is
+// buffered, in the jitter buffers and waiting to play; and counts of
+// packets sent, lost on the way, arriving too late to play, failing to
+// decrypt, concealed, and refused for want of room in the mixer. Last come
+// the heap allocations the client's work makes per second of audio, once
+// the first tenth of the run has warmed it up, and the process's peak
+// resident set size so far.
+
+// Every allocation in the process goes through these, and is counted while
+// g_counting is set; only the client's work sets it
+namespace {
+bool g_counting{false};
+std::uint64_t g_allocations{0};
+
+void* CountedAlloc(std::size_t size) {
+    if (g_counting) g_allocations++;
+    if (void* p = std::malloc(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc{};
+}
+}  // namespace
+
+void* operator new(std::size_t size) { return CountedAlloc(size); }
+void* operator new[](std::size_t size) { return CountedAlloc(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return CountedAlloc(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+using namespace winrt::blurt;
+using namespace winrt::blurt::audio;
+using namespace winrt::blurt::audio::implementation;
+using namespace winrt::blurt::mumble::implementation;
+
+namespace {
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+using SimTime = JitterBuffer::Clock::time_point;
+
+struct Options {
+    std::vector<std::uint32_t> speakers{1, 2, 4, 8, 16, 32, 64, 128};
+    std::int32_t seconds{20};
+    // One-way network delay before jitter
+    std::int32_t delay_ms{30};
+    // Mean extra delay. It wanders from one send to the next, as it does on
+    // a real path, rather than being drawn afresh for every packet, which
+    // would shuffle them far more than any real network does.
+    std::int32_t jitter_ms{10};
+    double loss_percent{1};
+    double tunneled_percent{25};
+    std::uint32_t seed{1};
+};
+
+// Same as AudioSystem's
+constexpr auto kPlayoutHeadroom = 10ms;
+constexpr auto kDecodeInterval = 5ms;
+constexpr auto kOutputQuantum = 10ms;
+// How much later a TCP segment shows up when the first try is lost
+constexpr auto kRetransmitDelay = 200ms;
+// A CELT-only fullband 10 ms frame (config 30, one frame), about 48 kbps
+constexpr std::uint8_t kOpusToc = 30 << 3;
+constexpr std::size_t kOpusFrameSize = 60;
+
+const std::string kKey(CryptState::kKeySize, '\x42');
+const std::string kServerNonce(CryptState::kNonceSize, '\x01');
+const std::string kClientNonce(CryptState::kNonceSize, '\x02');
+
+// Something arriving at the client: a UDP datagram, or some of the TCP
+// stream
+struct Arrival {
+    SimTime when;
+    // Breaks ties, so the TCP stream stays in order
+    std::uint64_t order;
+    bool tunneled;
+    std::vector<std::uint8_t> bytes;
+
+    bool operator>(const Arrival& other) const {
+        return when != other.when ? when > other.when : order > other.order;
+    }
+};
+
+// The stand-in server, with the speakers it relays and the network between
+// it and the client
+class Server {
+   public:
+    Server(const Options& options, std::uint32_t speakers) : options_{options}, rng_{options.seed} {
+        crypt_.SetKey(kKey, kServerNonce, kClientNonce);
+        std::uniform_int_distribution<int> byte{0, 255};
+        for (auto& frame : frames_) {
+            frame.resize(kOpusFrameSize);
+            for (auto& b : frame) b = static_cast<std::uint8_t>(byte(rng_));
+            frame[0] = kOpusToc;
+        }
+        std::bernoulli_distribution tunneled{options.tunneled_percent / 100};
+        for (std::uint32_t i = 0; i < speakers; i++) {
+            Speaker speaker;
+            speaker.session = i + 1;
+            speaker.tunneled = tunneled(rng_);
+            // Stagger the first spurts
+            speaker.spurt_start = SpurtFrames(20, 100);
+            speaker.spurt_end = speaker.spurt_start + SpurtFrames(100, 500);
+            speakers_.push_back(speaker);
+        }
+    }
+
+    // Send whatever every speaker says in Mumble frame `seq` (each 10 ms
+    // long), which goes out at the given time
+    void SendFrame(std::uint64_t seq, SimTime now) {
+        if (options_.jitter_ms > 0) path_jitter_ms_ += (jitter_(rng_) - path_jitter_ms_) / 8;
+        auto when = now + std::chrono::milliseconds{options_.delay_ms} +
+                    std::chrono::duration_cast<SimTime::duration>(
+                        std::chrono::duration<double, std::milli>{path_jitter_ms_});
+        for (auto& speaker : speakers_) {
+            if (seq < speaker.spurt_start) continue;
+            bool is_terminator = seq + 1 == speaker.spurt_end;
+            Send(speaker, seq, is_terminator, when);
+            sent_++;
+            if (is_terminator) {
+                speaker.spurt_start = seq + SpurtFrames(20, 200);
+                speaker.spurt_end = speaker.spurt_start + SpurtFrames(100, 500);
+            }
+        }
+    }
+
+    bool HasArrival(SimTime by) const { return !arrivals_.empty() && arrivals_.top().when <= by; }
+    Arrival TakeArrival() {
+        auto arrival = arrivals_.top();
+        arrivals_.pop();
+        return arrival;
+    }
+
+    std::uint64_t Sent() const { return sent_; }
+    std::uint64_t NetworkLost() const { return network_lost_; }
+
+   private:
+    struct Speaker {
+        std::uint32_t session;
+        bool tunneled;
+        // Talks for Mumble frames [spurt_start, spurt_end)
+        std::uint64_t spurt_start, spurt_end;
+    };
+
+    std::uint64_t SpurtFrames(std::uint64_t min, std::uint64_t max) {
+        return std::uniform_int_distribution<std::uint64_t>{min, max}(rng_);
+    }
+
+    // Send one speaker's packet, which gets to the client at the given time
+    // unless it's lost
+    void Send(const Speaker& speaker, std::uint64_t seq, bool is_terminator, SimTime when) {
+        // What the speaker's client sent, relayed with its session added
+        // after the first byte
+        const auto& opus = frames_[seq % frames_.size()];
+        AudioPacket packet{AudioPacketType::Opus,
+                           0,
+                           seq,
+                           0,
+                           is_terminator,
+                           false,
+                           ByteSlice::Of(ByteChunk::CopyOf(opus.data(), opus.size()))};
+        auto encoded = packet.EncodeOutgoing();
+        std::vector<std::uint8_t> relayed{encoded.begin(), encoded.end()};
+        std::uint8_t session[kMaxVarIntSize];
+        auto session_size = EncodeVarInt(speaker.session, session);
+        relayed.insert(relayed.begin() + 1, session, session + session_size);
+
+        bool lost = loss_(rng_);
+        Arrival arrival{when, order_++, speaker.tunneled, {}};
+        if (speaker.tunneled) {
+            // TCP never loses anything, but getting it there again takes a
+            // while, and everything behind it waits
+            if (lost) arrival.when += kRetransmitDelay;
+            arrival.when = std::max(arrival.when, last_tcp_arrival_);
+            last_tcp_arrival_ = arrival.when;
+            auto size = static_cast<std::uint32_t>(relayed.size());
+            arrival.bytes = {0,
+                             static_cast<std::uint8_t>(ControlPacketType::UDPTunnel),
+                             static_cast<std::uint8_t>(size >> 24),
+                             static_cast<std::uint8_t>(size >> 16),
+                             static_cast<std::uint8_t>(size >> 8),
+                             static_cast<std::uint8_t>(size)};
+            arrival.bytes.insert(arrival.bytes.end(), relayed.begin(), relayed.end());
+        } else {
+            // Encrypted either way, so the nonces stay in step
+            arrival.bytes.resize(relayed.size() + CryptState::kHeaderSize);
+            crypt_.Encrypt(relayed.data(), arrival.bytes.data(), relayed.size());
+            if (lost) {
+                network_lost_++;
+                return;
+            }
+        }
+        arrivals_.push(std::move(arrival));
+    }
+
+    const Options& options_;
+    std::mt19937 rng_;
+    std::exponential_distribution<double> jitter_{
+        1.0 / std::max(options_.jitter_ms, std::int32_t{1})};
+    std::bernoulli_distribution loss_{options_.loss_percent / 100};
+    double path_jitter_ms_{0};
+    CryptState crypt_;
+    std::vector<Speaker> speakers_;
+    std::array<std::vector<std::uint8_t>, 64> frames_;
+    std::priority_queue<Arrival, std::vector<Arrival>, std::greater<Arrival>> arrivals_;
+    std::uint64_t order_{0};
+    SimTime last_tcp_arrival_{};
+    std::uint64_t sent_{0}, network_lost_{0};
+};
+
+// The client's receive pipeline, timed
+class Client {
+   public:
+    Client() { crypt_.SetKey(kKey, kClientNonce, kServerNonce); }
+
+    void Receive(const Arrival& arrival) {
+        auto start = Clock::now();
+        g_counting = counting_;
+        if (arrival.tunneled) {
+            ReceiveStream(arrival);
+        } else {
+            ReceiveDatagram(arrival);
+        }
+        g_counting = false;
+        receive_ns_.push_back(ElapsedNs(start));
+    }
+
+    // Decode what's due for everybody, and mix if it's time to
+    void Tick(SimTime now, bool mix) {
+        auto start = Clock::now();
+        g_counting = counting_;
+        Note(mixer_.DecodeDue(now));
+        if (mix) {
+            auto n = mixer_.SamplesReady(setup_.SamplesPerChannelPer(kOutputQuantum));
+            if (n > 0) mixer_.MixTo(output_.data(), n);
+        }
+        g_counting = false;
+        tick_ns_.push_back(ElapsedNs(start));
+        if (!mix) return;
+
+        // How far behind real time a listener would be hearing each speaker,
+        // beyond the network: the jitter buffer's target, plus what's
+        // waiting to play. PlayoutDelay() is the worst speaker's.
+        if (speakers_.empty()) return;
+        double jitter_ms{0};
+        for (const auto& kv : speakers_) {
+            jitter_ms += kv.second->Jitter().TargetDepth() * 10.0;
+        }
+        jitter_ms /= speakers_.size();
+        buffered_ms_.push_back(jitter_ms + mixer_.PlayoutDelay().count() / 1000.0);
+    }
+
+    // Count the heap allocations the work above makes, from now on
+    void CountAllocations() {
+        if (counting_) return;
+        counting_ = true;
+        g_allocations = 0;
+    }
+    std::uint64_t Allocations() const { return g_allocations; }
+
+    double BusyNs() const {
+        double total{0};
+        for (auto ns : receive_ns_) total += ns;
+        for (auto ns : tick_ns_) total += ns;
+        return total;
+    }
+    std::vector<double>& ReceiveNs() { return receive_ns_; }
+    std::vector<double>& TickNs() { return tick_ns_; }
+    std::vector<double>& BufferedMs() { return buffered_ms_; }
+    std::uint64_t Concealed() const { return concealed_; }
+    std::uint64_t Refused() const { return refused_; }
+    std::uint64_t Undecryptable() const { return undecryptable_; }
+    std::uint64_t Late() const {
+        std::uint64_t late{0};
+        for (const auto& kv : speakers_) late += kv.second->Jitter().LateCount();
+        return late;
+    }
+
+   private:
+    static double ElapsedNs(Clock::time_point start) {
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+
+    void ReceiveStream(const Arrival& arrival) {
+        auto n = arrival.bytes.size();
+        std::memcpy(framer_.PrepareInput(n), arrival.bytes.data(), n);
+        framer_.CommitInput(n);
+        ControlFramer::Frame frame;
+        while (framer_.NextFrame(frame)) {
+            ControlPacket packet{std::move(frame)};
+            if (packet.Type() != ControlPacketType::UDPTunnel) continue;
+            Deliver(packet.ResolveAudioPacket(), arrival.when);
+        }
+    }
+
+    // Like ServerConnection::OnDatagram()
+    void ReceiveDatagram(const Arrival& arrival) {
+        auto len = arrival.bytes.size();
+        auto datagram = ByteChunk::Allocate(len);
+        std::memcpy(datagram.data(), arrival.bytes.data(), len);
+        auto* p = datagram.data();
+        if (!crypt_.Decrypt(p, p + CryptState::kHeaderSize, len)) {
+            undecryptable_++;
+            return;
+        }
+        auto plain = ByteSlice::Of(std::move(datagram))
+                         .Sub(CryptState::kHeaderSize,
+                              static_cast<std::int32_t>(len - CryptState::kHeaderSize));
+        Deliver(AudioPacket::FromIncomingFrame(plain), arrival.when);
+    }
+
+    // Like AudioSystem::OnAudioPacket()
+    void Deliver(const AudioPacket& packet, SimTime now) {
+        const auto& payload = packet.Payload();
+        std::uint32_t duration{0};
+        if (payload.size() > 0) {
+            int samples_per_chan = opus_packet_get_nb_samples(
+                payload, payload.size(), setup_.SamplesPerChannelPerSecond());
+            if (samples_per_chan <= 0) return;
+            duration = samples_per_chan / setup_.SamplesPerChannelPer(kMumbleFrameDuration);
+        }
+        auto* speaker = mixer_.SpeakerFor(packet.SenderSession(), now);
+        if (speaker == nullptr) {
+            refused_++;
+            return;
+        }
+        speakers_.emplace(packet.SenderSession(), speaker);
+        auto& jitter = speaker->Jitter();
+        jitter.Put(packet.FrameSequence(), duration, packet.IsTerminator(), payload, now);
+        speaker->PlayoutTarget(jitter.TargetDepth() * kMumbleFrameDuration + kPlayoutHeadroom);
+        Note(speaker->DecodeDue(now));
+    }
+
+    void Note(AudioMixer::DecodeCounts counts) { concealed_ += counts.lost; }
+
+    const AudioSetup setup_{SampleRate::Of48KHz(), Channels::Stereo()};
+    ControlFramer framer_;
+    CryptState crypt_;
+    AudioMixer mixer_{setup_};
+    std::unordered_map<std::uint32_t, AudioMixer::Speaker*> speakers_;
+    std::vector<float> output_ =
+        std::vector<float>(setup_.SamplesPerChannelPer(kOutputQuantum) * 2);
+
+    std::vector<double> receive_ns_, tick_ns_, buffered_ms_;
+    std::uint64_t concealed_{0}, refused_{0}, undecryptable_{0};
+    bool counting_{false};
+};
+
+double Percentile(std::vector<double>& values, double p) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    auto idx = static_cast<std::size_t>(p * (values.size() - 1) + 0.5);
+    return values[std::min(idx, values.size() - 1)];
+}
+
+// The most memory the process has had resident at once, in MB
+double PeakRssMb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.PeakWorkingSetSize / 1e6;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1e6;
+#else
+    return usage.ru_maxrss / 1e3;
+#endif
+#endif
+}
+
+void Run(const Options& options, std::uint32_t speakers) {
+    Server server{options, speakers};
+    Client client;
+    const SimTime start{std::chrono::seconds{1000}};
+    const auto end = start + std::chrono::seconds{options.seconds};
+    const auto warmed_up = start + (end - start) / 10;
+
+    // Step through time a decode interval at a time, sending on every
+    // Mumble frame boundary and taking whatever has arrived in between
+    const auto ticks_per_frame = kMumbleFrameDuration / kDecodeInterval;
+    const auto ticks_per_quantum = kOutputQuantum / kDecodeInterval;
+    std::uint64_t tick{0};
+    for (auto now = start; now < end; now += kDecodeInterval, tick++) {
+        if (tick % ticks_per_frame == 0) server.SendFrame(tick / ticks_per_frame, now);
+        if (now >= warmed_up) client.CountAllocations();
+        while (server.HasArrival(now)) client.Receive(server.TakeArrival());
+        client.Tick(now, tick % ticks_per_quantum == 0);
+    }
+
+    using Count = unsigned long long;
+    double seconds = options.seconds;
+    std::printf("%8u %9.2f %8.1f %8.1f %8.1f %8.1f %8.0f %8.0f", speakers,
+                100 * client.BusyNs() / (seconds * 1e9),
+                Percentile(client.ReceiveNs(), 0.5) / 1000,
+                Percentile(client.ReceiveNs(), 0.99) / 1000,
+                Percentile(client.TickNs(), 0.5) / 1000, Percentile(client.TickNs(), 0.99) / 1000,
+                Percentile(client.BufferedMs(), 0.5), Percentile(client.BufferedMs(), 0.99));
+    std::printf(" %9llu %7llu %6llu %7llu %9llu %7llu", Count{server.Sent()},
+                Count{server.NetworkLost()}, Count{client.Late()}, Count{client.Undecryptable()},
+                Count{client.Concealed()}, Count{client.Refused()});
+    std::printf(" %9.1f %8.1f\n", client.Allocations() / (0.9 * seconds), PeakRssMb());
+}
+
+const char kUsage[] =
+    "usage: blurt_loadgen [options]\n"
+    "  --speakers N,N,...   speaker counts to run with (1,2,4,...,128)\n"
+    "  --seconds S          seconds of audio per run (20)\n"
+    "  --delay MS           one-way network delay (30)\n"
+    "  --jitter MS          mean extra delay, which wanders (10)\n"
+    "  --loss PERCENT       packets lost; TCP resends them late (1)\n"
+    "  --tunneled PERCENT   speakers tunneled over TCP rather than UDP (25)\n"
+    "  --seed N             random seed (1)\n";
+
+std::vector<std::uint32_t> ParseList(const char* s) {
+    std::vector<std::uint32_t> out;
+    while (*s) {
+        char* rest;
+        auto n = std::strtoul(s, &rest, 10);
+        if (rest == s) break;
+        if (n > 0) out.push_back(static_cast<std::uint32_t>(n));
+        s = *rest == ',' ? rest + 1 : rest;
+    }
+    return out;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 == argc || std::strcmp(argv[i], "--help") == 0) {
+            std::fprintf(stderr, "%s", kUsage);
+            return std::strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+        const char* value = argv[i + 1];
+        if (std::strcmp(argv[i], "--speakers") == 0) {
+            options.speakers = ParseList(value);
+        } else if (std::strcmp(argv[i], "--seconds") == 0) {
+            options.seconds = std::max(std::atoi(value), 1);
+        } else if (std::strcmp(argv[i], "--delay") == 0) {
+            options.delay_ms = std::max(std::atoi(value), 0);
+        } else if (std::strcmp(argv[i], "--jitter") == 0) {
+            options.jitter_ms = std::max(std::atoi(value), 0);
+        } else if (std::strcmp(argv[i], "--loss") == 0) {
+            options.loss_percent = std::clamp(std::atof(value), 0.0, 100.0);
+        } else if (std::strcmp(argv[i], "--tunneled") == 0) {
+            options.tunneled_percent = std::clamp(std::atof(value), 0.0, 100.0);
+        } else if (std::strcmp(argv[i], "--seed") == 0) {
+            options.seed = static_cast<std::uint32_t>(std::strtoul(value, nullptr, 10));
+        } else {
+            std::fprintf(stderr, "unknown option %s\n%s", argv[i], kUsage);
+            return 1;
+        }
+    }
+
+    std::printf("decoder: %s\n", opus_get_version_string());
+    std::printf(
+        "%d s of audio per run; %d ms delay, %d ms mean jitter, %.1f%% loss, "
+        "%.0f%% of speakers tunneled over TCP\n",
+        options.seconds, options.delay_ms, options.jitter_ms, options.loss_percent,
+        options.tunneled_percent);
+    std::printf("%8s %9s %17s %17s %17s\n", "", "", "receive (us)", "tick (us)",
+                "buffered (ms)");
+    std::printf("%8s %9s %8s %8s %8s %8s %8s %8s %9s %7s %6s %7s %9s %7s %9s %8s\n",
+                "speakers", "cpu %", "p50", "p99", "p50", "p99", "p50", "p99", "packets", "lost",
+                "late", "bad", "concealed", "refused", "allocs/s", "peak MB");
+    for (auto speakers : options.speakers) Run(options, speakers);
+    return 0;
+}
@@ -0,0 +1,347 @@
+#include "opus/opus.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstring>
+
+struct OpusDecoder {
+    opus_int32 fs;
+    int channels;
+};
+
+struct OpusEncoder {
+    opus_int32 fs;
+    int channels;
+    // Zero until set, which means the library's own default
+    opus_int32 bitrate;
+};
+
+// An Opus packet holds at most 48 frames (of 2.5 ms, for 120 ms)
+constexpr int kMaxFrames = 48;
+
+struct OpusRepacketizer {
+    unsigned char toc;
+    int nb_frames;
+    const unsigned char* frames[kMaxFrames];
+    opus_int16 sizes[kMaxFrames];
+};
+
+namespace {
+
+// Samples per channel in one frame of the packet, from its TOC byte; see
+// RFC 6716, section 3.1
+int SamplesPerFrame(unsigned char toc, opus_int32 fs) {
+    if (toc & 0x80) return (fs << ((toc >> 3) & 0x3)) / 400;  // CELT: 2.5 to 20 ms
+    if ((toc & 0x60) == 0x60) return (toc & 0x08) ? fs / 50 : fs / 100;  // Hybrid
+    auto size = (toc >> 3) & 0x3;  // SILK: 10 to 60 ms
+    return size == 3 ? fs * 60 / 1000 : (fs << size) / 100;
+}
+
+int FrameCount(const unsigned char packet[], opus_int32 len) {
+    switch (packet[0] & 0x3) {
+        case 0:
+            return 1;
+        case 1:
+        case 2:
+            return 2;
+        default:
+            return len < 2 ? OPUS_INVALID_PACKET : packet[1] & 0x3f;
+    }
+}
+
+// The size of one frame, from the one or two bytes at p; returns the number
+// of bytes read, or -1 if there aren't enough
+int ParseSize(const unsigned char* p, opus_int32 len, opus_int16* size) {
+    if (len < 1) return -1;
+    if (p[0] < 252) {
+        *size = p[0];
+        return 1;
+    }
+    if (len < 2) return -1;
+    *size = static_cast<opus_int16>(4 * p[1] + p[0]);
+    return 2;
+}
+
+int WriteSize(int size, unsigned char* p) {
+    if (size < 252) {
+        p[0] = static_cast<unsigned char>(size);
+        return 1;
+    }
+    p[0] = static_cast<unsigned char>(252 + (size & 0x3));
+    p[1] = static_cast<unsigned char>((size - p[0]) >> 2);
+    return 2;
+}
+
+// Split a packet into its frames, as in RFC 6716, section 3.2; returns the
+// number of frames or an error
+int ParseFrames(const unsigned char* data, opus_int32 len, const unsigned char* frames[],
+                opus_int16 sizes[]) {
+    if (len < 1) return OPUS_INVALID_PACKET;
+    const unsigned char* p = data + 1;
+    const unsigned char* end = data + len;
+    int count;
+    switch (data[0] & 0x3) {
+        case 0:
+            frames[0] = p;
+            sizes[0] = static_cast<opus_int16>(end - p);
+            return 1;
+        case 1:
+            if ((end - p) % 2 != 0) return OPUS_INVALID_PACKET;
+            sizes[0] = sizes[1] = static_cast<opus_int16>((end - p) / 2);
+            frames[0] = p;
+            frames[1] = p + sizes[0];
+            return 2;
+        case 2: {
+            auto n = ParseSize(p, static_cast<opus_int32>(end - p), &sizes[0]);
+            if (n < 0) return OPUS_INVALID_PACKET;
+            p += n;
+            if (sizes[0] > end - p) return OPUS_INVALID_PACKET;
+            frames[0] = p;
+            frames[1] = p + sizes[0];
+            sizes[1] = static_cast<opus_int16>(end - frames[1]);
+            return 2;
+        }
+        default:
+            break;
+    }
+    if (p == end) return OPUS_INVALID_PACKET;
+    const bool vbr = (*p & 0x80) != 0, padded = (*p & 0x40) != 0;
+    count = *p++ & 0x3f;
+    if (count == 0 || count > kMaxFrames) return OPUS_INVALID_PACKET;
+    if (padded) {
+        int padding = 0;
+        while (true) {
+            if (p == end) return OPUS_INVALID_PACKET;
+            auto b = *p++;
+            padding += b == 255 ? 254 : b;
+            if (b != 255) break;
+        }
+        if (padding > end - p) return OPUS_INVALID_PACKET;
+        end -= padding;
+    }
+    if (vbr) {
+        opus_int32 total = 0;
+        for (int i = 0; i < count - 1; i++) {
+            auto n = ParseSize(p, static_cast<opus_int32>(end - p), &sizes[i]);
+            if (n < 0) return OPUS_INVALID_PACKET;
+            p += n;
+            total += sizes[i];
+        }
+        if (total > end - p) return OPUS_INVALID_PACKET;
+        sizes[count - 1] = static_cast<opus_int16>(end - p - total);
+    } else {
+        if ((end - p) % count != 0) return OPUS_INVALID_PACKET;
+        for (int i = 0; i < count; i++) sizes[i] = static_cast<opus_int16>((end - p) / count);
+    }
+    for (int i = 0; i < count; i++) {
+        frames[i] = p;
+        p += sizes[i];
+    }
+    return count;
+}
+
+}  // namespace
+
+OpusDecoder* opus_decoder_create(opus_int32 Fs, int channels, int* error) {
+    if (channels < 1 || channels > 2) {
+        if (error) *error = OPUS_BAD_ARG;
+        return nullptr;
+    }
+    if (error) *error = OPUS_OK;
+    return new OpusDecoder{Fs, channels};
+}
+
+const char* opus_get_version_string(void) { return "fake libopus (made-up audio)"; }
+
+void opus_decoder_destroy(OpusDecoder* st) { delete st; }
+
+int opus_decoder_ctl(OpusDecoder*, int request, ...) {
+    return request == OPUS_RESET_STATE ? OPUS_OK : OPUS_UNIMPLEMENTED;
+}
+
+int opus_packet_get_nb_samples(const unsigned char packet[], opus_int32 len, opus_int32 Fs) {
+    if (len < 1) return OPUS_BAD_ARG;
+    int count = FrameCount(packet, len);
+    if (count < 0) return count;
+    int samples = count * SamplesPerFrame(packet[0], Fs);
+    // Opus packets hold at most 120 ms
+    if (samples * 25 > Fs * 3) return OPUS_INVALID_PACKET;
+    return samples;
+}
+
+int opus_decoder_get_nb_samples(const OpusDecoder* dec, const unsigned char packet[],
+                                opus_int32 len) {
+    return opus_packet_get_nb_samples(packet, len, dec->fs);
+}
+
+int opus_decode_float(OpusDecoder* st, const unsigned char* data, opus_int32 len, float* pcm,
+                      int frame_size, int decode_fec) {
+    int samples = frame_size;
+    float value = 0;
+    if (data != nullptr && len > 0 && !decode_fec) {
+        samples = opus_packet_get_nb_samples(data, len, st->fs);
+        if (samples < 0) return samples;
+        if (samples > frame_size) return OPUS_BUFFER_TOO_SMALL;
+        if (len > 1) value = data[1] / 128.0f - 1;
+    }
+    if (pcm != nullptr) std::fill(pcm, pcm + samples * st->channels, value);
+    return samples;
+}
+
+OpusEncoder* opus_encoder_create(opus_int32 Fs, int channels, int application, int* error) {
+    auto* st = new OpusEncoder{};
+    int err = opus_encoder_init(st, Fs, channels, application);
+    if (error) *error = err;
+    if (err != OPUS_OK) {
+        delete st;
+        return nullptr;
+    }
+    return st;
+}
+
+int opus_encoder_init(OpusEncoder* st, opus_int32 Fs, int channels, int application) {
+    if (channels < 1 || channels > 2) return OPUS_BAD_ARG;
+    if (application != OPUS_APPLICATION_VOIP && application != OPUS_APPLICATION_AUDIO &&
+        application != OPUS_APPLICATION_RESTRICTED_LOWDELAY)
+        return OPUS_BAD_ARG;
+    *st = OpusEncoder{Fs, channels, 0};
+    return OPUS_OK;
+}
+
+void opus_encoder_destroy(OpusEncoder* st) { delete st; }
+
+int opus_encoder_ctl(OpusEncoder* st, int request, ...) {
+    va_list args;
+    va_start(args, request);
+    int result = OPUS_OK;
+    switch (request) {
+        case OPUS_SET_BITRATE_REQUEST:
+            st->bitrate = va_arg(args, opus_int32);
+            break;
+        case OPUS_SET_VBR_REQUEST:
+        case OPUS_SET_COMPLEXITY_REQUEST:
+        case OPUS_SET_INBAND_FEC_REQUEST:
+        case OPUS_SET_PACKET_LOSS_PERC_REQUEST:
+        case OPUS_SET_DTX_REQUEST:
+        case OPUS_SET_VBR_CONSTRAINT_REQUEST:
+            va_arg(args, opus_int32);
+            break;
+        case OPUS_RESET_STATE:
+            break;
+        default:
+            result = OPUS_UNIMPLEMENTED;
+    }
+    va_end(args);
+    return result;
+}
+
+opus_int32 opus_encode_float(OpusEncoder* st, const float* pcm, int frame_size,
+                             unsigned char* data, opus_int32 max_data_bytes) {
+    // Frame sizes in units of 2.5 ms; CELT for up to 20 ms, SILK beyond
+    unsigned char config;
+    switch (frame_size * 400 / st->fs) {
+        case 1:
+            config = 28;
+            break;
+        case 2:
+            config = 29;
+            break;
+        case 4:
+            config = 30;
+            break;
+        case 8:
+            config = 31;
+            break;
+        case 16:
+            config = 10;
+            break;
+        case 24:
+            config = 11;
+            break;
+        default:
+            return OPUS_BAD_ARG;
+    }
+    if (frame_size * 400 % st->fs != 0) return OPUS_BAD_ARG;
+    auto bitrate = st->bitrate > 0 ? st->bitrate : 60 * st->fs / frame_size + st->fs * st->channels;
+    auto size = std::clamp<opus_int32>(
+        static_cast<opus_int32>(static_cast<std::int64_t>(bitrate) * frame_size / st->fs / 8), 2,
+        1276);
+    if (size > max_data_bytes) return OPUS_BUFFER_TOO_SMALL;
+
+    data[0] = static_cast<unsigned char>(config << 3 | (st->channels == 2 ? 0x4 : 0));
+    auto level = std::lround((std::clamp(pcm[0], -1.0f, 1.0f) + 1) * 128);
+    data[1] = static_cast<unsigned char>(std::clamp<long>(level, 0, 255));
+    std::memset(data + 2, 0, size - 2);
+    return size;
+}
+
+OpusRepacketizer* opus_repacketizer_create(void) {
+    return opus_repacketizer_init(new OpusRepacketizer);
+}
+
+OpusRepacketizer* opus_repacketizer_init(OpusRepacketizer* rp) {
+    rp->nb_frames = 0;
+    return rp;
+}
+
+void opus_repacketizer_destroy(OpusRepacketizer* rp) { delete rp; }
+
+int opus_repacketizer_cat(OpusRepacketizer* rp, const unsigned char* data, opus_int32 len) {
+    if (len < 1) return OPUS_INVALID_PACKET;
+    // Every frame in a packet has to share a configuration
+    if (rp->nb_frames > 0 && (data[0] & 0xfc) != (rp->toc & 0xfc)) return OPUS_INVALID_PACKET;
+    const unsigned char* frames[kMaxFrames];
+    opus_int16 sizes[kMaxFrames];
+    int count = ParseFrames(data, len, frames, sizes);
+    if (count < 0) return count;
+    // Nor can the packet hold more than 120 ms
+    if ((rp->nb_frames + count) * SamplesPerFrame(data[0], 8000) > 960) return OPUS_INVALID_PACKET;
+    rp->toc = data[0];
+    std::copy(frames, frames + count, rp->frames + rp->nb_frames);
+    std::copy(sizes, sizes + count, rp->sizes + rp->nb_frames);
+    rp->nb_frames += count;
+    return OPUS_OK;
+}
+
+int opus_repacketizer_get_nb_frames(OpusRepacketizer* rp) { return rp->nb_frames; }
+
+opus_int32 opus_repacketizer_out_range(OpusRepacketizer* rp, int begin, int end,
+                                       unsigned char* data, opus_int32 maxlen) {
+    if (begin < 0 || begin >= end || end > rp->nb_frames) return OPUS_BAD_ARG;
+    const int count = end - begin;
+    const auto* sizes = rp->sizes + begin;
+    const bool equal = std::all_of(sizes, sizes + count, [&](auto s) { return s == sizes[0]; });
+    // Header, room for every frame's size, and the frames
+    unsigned char header[2 + 2 * kMaxFrames];
+    int header_len = 1;
+    const unsigned char toc = rp->toc & 0xfc;
+    if (count == 1) {
+        header[0] = toc;
+    } else if (count == 2 && equal) {
+        header[0] = toc | 1;
+    } else if (count == 2) {
+        header[0] = toc | 2;
+        header_len += WriteSize(sizes[0], header + header_len);
+    } else {
+        header[0] = toc | 3;
+        header[header_len++] = static_cast<unsigned char>(count | (equal ? 0 : 0x80));
+        for (int i = 0; !equal && i < count - 1; i++) {
+            header_len += WriteSize(sizes[i], header + header_len);
+        }
+    }
+    opus_int32 total = header_len;
+    for (int i = 0; i < count; i++) total += sizes[i];
+    if (total > maxlen) return OPUS_BUFFER_TOO_SMALL;
+    std::memcpy(data, header, header_len);
+    auto* p = data + header_len;
+    for (int i = 0; i < count; i++) {
+        std::memcpy(p, rp->frames[begin + i], sizes[i]);
+        p += sizes[i];
+    }
+    return total;
+}
+
+opus_int32 opus_repacketizer_out(OpusRepacketizer* rp, unsigned char* data, opus_int32 maxlen) {
+    return opus_repacketizer_out_range(rp, 0, rp->nb_frames, data, maxlen);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+// Just enough of libopus's API, with the same names and signatures, for the
+// app's encoding, decoding and mixing code to build and run where libopus
+// isn't available. Packets are framed exactly as Opus frames them, so
+// anything that reads a packet's TOC byte sees what it would see with the
+// real library, but the "audio" is made up: every sample a packet decodes to
+// has the value of the packet's second byte, over 128, less 1 (or zero if
+// there's no second byte), and concealment and FEC produce silence. Encoding
+// goes the other way: a frame becomes a single-frame packet whose second
+// byte carries the frame's first sample that way, padded out to the size the
+// bitrate calls for. The repacketizer really does split and join packets.
+// That's enough to follow audio through the encoder, the jitter buffer and
+// the mixer without a real codec.
+
+#include <cstdint>
+
+typedef std::int16_t opus_int16;
+typedef std::int32_t opus_int32;
+
+#define OPUS_OK 0
+#define OPUS_BAD_ARG -1
+#define OPUS_BUFFER_TOO_SMALL -2
+#define OPUS_INTERNAL_ERROR -3
+#define OPUS_INVALID_PACKET -4
+#define OPUS_UNIMPLEMENTED -5
+
+#define OPUS_APPLICATION_VOIP 2048
+#define OPUS_APPLICATION_AUDIO 2049
+#define OPUS_APPLICATION_RESTRICTED_LOWDELAY 2051
+
+#define OPUS_SET_BITRATE_REQUEST 4002
+#define OPUS_SET_VBR_REQUEST 4006
+#define OPUS_SET_COMPLEXITY_REQUEST 4010
+#define OPUS_SET_INBAND_FEC_REQUEST 4012
+#define OPUS_SET_PACKET_LOSS_PERC_REQUEST 4014
+#define OPUS_SET_DTX_REQUEST 4016
+#define OPUS_SET_VBR_CONSTRAINT_REQUEST 4020
+#define OPUS_RESET_STATE 4028
+
+#define OPUS_SET_BITRATE(x) OPUS_SET_BITRATE_REQUEST, static_cast<opus_int32>(x)
+#define OPUS_SET_VBR(x) OPUS_SET_VBR_REQUEST, static_cast<opus_int32>(x)
+#define OPUS_SET_COMPLEXITY(x) OPUS_SET_COMPLEXITY_REQUEST, static_cast<opus_int32>(x)
+#define OPUS_SET_INBAND_FEC(x) OPUS_SET_INBAND_FEC_REQUEST, static_cast<opus_int32>(x)
+#define OPUS_SET_PACKET_LOSS_PERC(x) OPUS_SET_PACKET_LOSS_PERC_REQUEST, static_cast<opus_int32>(x)
+#define OPUS_SET_DTX(x) OPUS_SET_DTX_REQUEST, static_cast<opus_int32>(x)
+#define OPUS_SET_VBR_CONSTRAINT(x) OPUS_SET_VBR_CONSTRAINT_REQUEST, static_cast<opus_int32>(x)
+
+typedef struct OpusDecoder OpusDecoder;
+typedef struct OpusEncoder OpusEncoder;
+typedef struct OpusRepacketizer OpusRepacketizer;
+
+const char* opus_get_version_string(void);
+
+OpusDecoder* opus_decoder_create(opus_int32 Fs, int channels, int* error);
+void opus_decoder_destroy(OpusDecoder* st);
+int opus_decoder_ctl(OpusDecoder* st, int request, ...);
+int opus_decoder_get_nb_samples(const OpusDecoder* dec, const unsigned char packet[],
+                                opus_int32 len);
+int opus_decode_float(OpusDecoder* st, const unsigned char* data, opus_int32 len, float* pcm,
+                      int frame_size, int decode_fec);
+
+int opus_packet_get_nb_samples(const unsigned char packet[], opus_int32 len, opus_int32 Fs);
+
+OpusEncoder* opus_encoder_create(opus_int32 Fs, int channels, int application, int* error);
+int opus_encoder_init(OpusEncoder* st, opus_int32 Fs, int channels, int application);
+void opus_encoder_destroy(OpusEncoder* st);
+int opus_encoder_ctl(OpusEncoder* st, int request, ...);
+opus_int32 opus_encode_float(OpusEncoder* st, const float* pcm, int frame_size,
+                             unsigned char* data, opus_int32 max_data_bytes);
+
+OpusRepacketizer* opus_repacketizer_create(void);
+OpusRepacketizer* opus_repacketizer_init(OpusRepacketizer* rp);
+void opus_repacketizer_destroy(OpusRepacketizer* rp);
+int opus_repacketizer_cat(OpusRepacketizer* rp, const unsigned char* data, opus_int32 len);
+int opus_repacketizer_get_nb_frames(OpusRepacketizer* rp);
+opus_int32 opus_repacketizer_out_range(OpusRepacketizer* rp, int begin, int end,
+                                       unsigned char* data, opus_int32 maxlen);
+opus_int32 opus_repacketizer_out(OpusRepacketizer* rp, unsigned char* data, opus_int32 maxlen);
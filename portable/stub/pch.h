@@ -0,0 +1,30 @@
+#pragma once
+
+// Stands in for the app's precompiled header when the platform-independent
+// parts of the app are built on their own, for the benchmarks and tests in
+// this directory. The real one drags in <windows.h> and the XAML headers,
+// none of which those parts use.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "winrt/base.h"
+
+// SAL's locking annotations, which <windows.h> would bring in; only MSVC's
+// code analysis looks at them
+#ifndef _Guarded_by_
+#define _Guarded_by_(lock)
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+// Just enough of C++/WinRT for the platform-independent parts of the app to
+// build without it
+
+#include <cstdint>
+#include <string>
+
+namespace winrt {
+
+using hstring = std::wstring;
+
+inline hstring to_hstring(const std::string& s) { return hstring(s.begin(), s.end()); }
+
+// A view of a contiguous run of T, as the app gets from and hands to WinRT
+template <typename T>
+class array_view {
+   public:
+    array_view() = default;
+    array_view(T* first, T* last) : data_{first}, size_{static_cast<std::uint32_t>(last - first)} {}
+
+    T* begin() const { return data_; }
+    T* end() const { return data_ + size_; }
+    T* data() const { return data_; }
+    std::uint32_t size() const { return size_; }
+
+   private:
+    T* data_{nullptr};
+    std::uint32_t size_{0};
+};
+
+struct hresult_error {};
+struct hresult_not_implemented : hresult_error {};
+
+}  // namespace winrt
@@ -0,0 +1,76 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include "Aes128.h"
+
+using winrt::blurt::Aes128;
+
+namespace {
+
+using Block = std::array<std::uint8_t, Aes128::kBlockSize>;
+
+// FIPS-197, appendix B
+constexpr Block kKeyB = {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+                         0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c};
+constexpr Block kPlainB = {0x32, 0x43, 0xf6, 0xa8, 0x88, 0x5a, 0x30, 0x8d,
+                           0x31, 0x31, 0x98, 0xa2, 0xe0, 0x37, 0x07, 0x34};
+constexpr Block kCipherB = {0x39, 0x25, 0x84, 0x1d, 0x02, 0xdc, 0x09, 0xfb,
+                            0xdc, 0x11, 0x85, 0x97, 0x19, 0x6a, 0x0b, 0x32};
+
+// FIPS-197, appendix C.1
+constexpr Block kKeyC = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                         0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+constexpr Block kPlainC = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+                           0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
+constexpr Block kCipherC = {0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+                            0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a};
+
+TEST(Aes128Test, Fips197AppendixB) {
+    Aes128 aes{kKeyB.data()};
+    Block out;
+    aes.EncryptBlock(kPlainB.data(), out.data());
+    EXPECT_EQ(out, kCipherB);
+    aes.DecryptBlock(out.data(), out.data());
+    EXPECT_EQ(out, kPlainB);
+}
+
+TEST(Aes128Test, Fips197AppendixC1) {
+    Aes128 aes{kKeyC.data()};
+    Block out;
+    aes.EncryptBlock(kPlainC.data(), out.data());
+    EXPECT_EQ(out, kCipherC);
+    aes.DecryptBlock(out.data(), out.data());
+    EXPECT_EQ(out, kPlainC);
+}
+
+TEST(Aes128Test, RekeyingReplacesTheKey) {
+    Aes128 aes{kKeyB.data()};
+    aes.SetKey(kKeyC.data());
+    Block out;
+    aes.EncryptBlock(kPlainC.data(), out.data());
+    EXPECT_EQ(out, kCipherC);
+}
+
+// The hardware path works on several blocks at once; every block of a run
+// must come out as it would on its own
+TEST(Aes128Test, BlockRunsMatchSingleBlocks) {
+    Aes128 aes{kKeyC.data()};
+    constexpr std::size_t kBlocks = 11;
+    std::array<std::uint8_t, kBlocks * Aes128::kBlockSize> in, run, single;
+    for (std::size_t i = 0; i < in.size(); i++) in[i] = static_cast<std::uint8_t>(i * 7 + 3);
+
+    aes.EncryptBlocks(in.data(), run.data(), kBlocks);
+    for (std::size_t i = 0; i < kBlocks; i++) {
+        auto offset = i * Aes128::kBlockSize;
+        aes.EncryptBlock(in.data() + offset, single.data() + offset);
+    }
+    EXPECT_EQ(run, single);
+
+    aes.DecryptBlocks(run.data(), run.data(), kBlocks);
+    EXPECT_EQ(run, in);
+}
+
+}  // namespace
@@ -0,0 +1,139 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "AudioMixer.h"
+#include "AudioParams.h"
+#include "ByteChunk.h"
+
+// These run against the fake libopus in fakes/ unless the real one was found
+// at configure time; the fake decodes each packet to a constant set by its
+// second byte, which lets the tests follow each packet's audio through
+
+using winrt::blurt::ByteChunk;
+using winrt::blurt::ByteSlice;
+using winrt::blurt::audio::AudioSetup;
+using winrt::blurt::audio::Channels;
+using winrt::blurt::audio::SampleRate;
+using winrt::blurt::audio::implementation::AudioMixer;
+using winrt::blurt::audio::implementation::JitterBuffer;
+
+namespace {
+
+using namespace std::chrono_literals;
+
+const JitterBuffer::Clock::time_point kStart{std::chrono::seconds{1000}};
+constexpr std::int32_t kFramesPerPacket = 480;
+
+AudioSetup Stereo48k() { return AudioSetup{SampleRate::Of48KHz(), Channels::Stereo()}; }
+
+// 10 ms of CELT audio, which the fake decodes to a level of 0.5
+ByteSlice Packet() { return ByteSlice::Of(ByteChunk{std::vector<std::uint8_t>{0x90, 192}}); }
+
+void PutPacket(AudioMixer::Speaker& speaker, std::uint64_t seq) {
+    speaker.Jitter().Put(seq, 1, false, Packet(), kStart + seq * 10ms);
+}
+
+// Mix quanta of output until nobody has anything left to play; returns how
+// many frames had sound in them
+std::int32_t PlayOut(AudioMixer& mixer) {
+    std::vector<float> out(2 * kFramesPerPacket);
+    std::int32_t loud{0};
+    for (int i = 0; i < 100; i++) {
+        auto n = mixer.SamplesReady(kFramesPerPacket);
+        if (n == 0) break;
+        EXPECT_EQ(mixer.MixTo(out.data(), n), n);
+        for (std::int32_t s = 0; s < n; s += 2) {
+            if (out[s] > 0.4f && out[s + 1] > 0.4f) loud++;
+        }
+    }
+    return loud;
+}
+
+// One packet, shorter than the jitter buffer's cushion, with no terminator
+// after it: the output plays all of it with nothing more arriving
+TEST(AudioMixerTest, PlaysOutALoneShortSpurtWithNoTerminator) {
+    AudioMixer mixer{Stereo48k()};
+    auto* speaker = mixer.SpeakerFor(7, kStart);
+    ASSERT_NE(speaker, nullptr);
+    PutPacket(*speaker, 0);
+
+    auto counts = mixer.DecodeDue(kStart);
+    EXPECT_EQ(counts.received, 0u);
+    EXPECT_EQ(mixer.SamplesReady(kFramesPerPacket), 0);
+
+    counts = mixer.DecodeDue(kStart + 20ms);
+    EXPECT_EQ(counts.received, 1u);
+    EXPECT_EQ(counts.lost, 0u);
+    EXPECT_GE(PlayOut(mixer), kFramesPerPacket - 1);
+    EXPECT_EQ(speaker->Decoder().BufferedSamples(), 0);
+}
+
+// A missing packet is filled in once it's been waited for, and what's behind
+// it plays, without another packet coming along
+TEST(AudioMixerTest, FillsAGapWithNoMorePacketsArriving) {
+    AudioMixer mixer{Stereo48k()};
+    auto* speaker = mixer.SpeakerFor(7, kStart);
+    for (std::uint64_t seq : {0, 1, 3}) PutPacket(*speaker, seq);
+
+    auto counts = mixer.DecodeDue(kStart + 30ms);
+    EXPECT_EQ(counts.received, 2u);
+    EXPECT_EQ(counts.lost, 0u);
+    counts = mixer.DecodeDue(kStart + 50ms);
+    EXPECT_EQ(counts.received, 1u);
+    EXPECT_EQ(counts.lost, 1u);
+
+    auto& decoder = speaker->Decoder();
+    ASSERT_EQ(decoder.BufferedSamples(), 4 * 2 * kFramesPerPacket);
+    auto audio = decoder.PeekAudio(decoder.BufferedSamples());
+    std::vector<float> samples(audio.first.data, audio.first.data + audio.first.size);
+    samples.insert(samples.end(), audio.second.data, audio.second.data + audio.second.size);
+    for (std::int32_t frame = 0; frame < 4 * kFramesPerPacket; frame++) {
+        float expected = frame / kFramesPerPacket == 2 ? 0.0f : 0.5f;
+        ASSERT_EQ(samples[2 * frame], expected) << "frame " << frame;
+    }
+}
+
+TEST(AudioMixerTest, DecodesEverySpeakersDueAudio) {
+    AudioMixer mixer{Stereo48k()};
+    for (std::uint32_t session = 1; session <= 3; session++) {
+        PutPacket(*mixer.SpeakerFor(session, kStart), 0);
+    }
+    EXPECT_EQ(mixer.DecodeDue(kStart).received, 0u);
+    EXPECT_EQ(mixer.DecodeDue(kStart + 20ms).received, 3u);
+    EXPECT_EQ(mixer.DecodeDue(kStart + 40ms).received, 0u);
+}
+
+// The audio system keeps its decode timer going only while this says so
+TEST(AudioMixerTest, HoldsFramesUntilTheyAllComeDue) {
+    AudioMixer mixer{Stereo48k()};
+    EXPECT_FALSE(mixer.HoldsFrames());
+    auto* speaker = mixer.SpeakerFor(7, kStart);
+    EXPECT_FALSE(mixer.HoldsFrames());
+    for (std::uint64_t seq : {0, 1, 3}) PutPacket(*speaker, seq);
+    EXPECT_TRUE(mixer.HoldsFrames());
+
+    mixer.DecodeDue(kStart + 30ms);
+    // The one behind the gap is still waiting
+    EXPECT_TRUE(mixer.HoldsFrames());
+    mixer.DecodeDue(kStart + 60ms);
+    EXPECT_FALSE(mixer.HoldsFrames());
+}
+
+// A packet Opus can't make sense of counts as lost rather than throwing out
+// of the decode loop
+TEST(AudioMixerTest, CountsABogusPacketAsLost) {
+    AudioMixer mixer{Stereo48k()};
+    auto* speaker = mixer.SpeakerFor(7, kStart);
+    // Code 3 says a frame count follows, but nothing does
+    speaker->Jitter().Put(0, 1, true, ByteSlice::Of(ByteChunk{std::vector<std::uint8_t>{0x93}}),
+                          kStart);
+    auto counts = mixer.DecodeDue(kStart);
+    EXPECT_EQ(counts.received, 0u);
+    EXPECT_EQ(counts.lost, 1u);
+}
+
+}  // namespace
@@ -0,0 +1,129 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include "AudioPacket.h"
+#include "ByteChunk.h"
+
+using namespace winrt::blurt;
+using namespace winrt::blurt::mumble::implementation;
+
+namespace {
+
+std::vector<std::uint8_t> Payload(std::size_t n) {
+    std::vector<std::uint8_t> v(n);
+    for (std::size_t i = 0; i < n; i++) v[i] = static_cast<std::uint8_t>(i * 3 + 1);
+    return v;
+}
+
+// What a client sends: type and target, sequence number, then length and
+// terminator flag
+std::vector<std::uint8_t> Outgoing(std::uint32_t target, std::uint64_t seq, bool terminator,
+                                   std::size_t payload_size) {
+    AudioPacket packet{AudioPacketType::Opus, target, seq, 0, terminator, false,
+                       ByteSlice::Of(ByteChunk{Payload(payload_size)})};
+    auto bytes = packet.EncodeOutgoing();
+    return {bytes.begin(), bytes.end()};
+}
+
+// What the server relays: the same, with the sender's session after the
+// first byte
+std::vector<std::uint8_t> Incoming(std::uint32_t session, std::uint64_t seq, bool terminator,
+                                   std::size_t payload_size) {
+    auto bytes = Outgoing(3, seq, terminator, payload_size);
+    bytes.insert(bytes.begin() + 1, static_cast<std::uint8_t>(session));
+    return bytes;
+}
+
+ByteSlice Slice(std::vector<std::uint8_t> bytes) {
+    return ByteSlice::Of(ByteChunk{std::move(bytes)});
+}
+
+TEST(AudioPacketTest, EncodesTheLegacyHeader) {
+    auto bytes = Outgoing(2, 0x1234, true, 3);
+    // Opus (4) in the top three bits, target 2; sequence as a 2-byte varint;
+    // length 3 with the terminator bit (0x2000), also a 2-byte varint
+    std::vector<std::uint8_t> expected = {0x82, 0x92, 0x34, 0xa0, 0x03};
+    auto payload = Payload(3);
+    expected.insert(expected.end(), payload.begin(), payload.end());
+    EXPECT_EQ(bytes, expected);
+}
+
+TEST(AudioPacketTest, OutgoingRoundTrips) {
+    for (std::uint64_t seq : {std::uint64_t{0}, std::uint64_t{127}, std::uint64_t{128},
+                              std::uint64_t{70000}, std::uint64_t{1} << 40}) {
+        for (std::size_t size : {0, 1, 60, 127, 128, 0x1fff}) {
+            auto bytes = Outgoing(5, seq, size % 2 == 1, size);
+            auto packet = AudioPacket::FromOutgoingBytes(ByteChunk{std::move(bytes)});
+            EXPECT_EQ(packet.Type(), AudioPacketType::Opus);
+            EXPECT_EQ(packet.Target(), 5u);
+            EXPECT_EQ(packet.FrameSequence(), seq);
+            EXPECT_EQ(packet.IsTerminator(), size % 2 == 1);
+            EXPECT_FALSE(packet.HasPositionInfo());
+            ASSERT_EQ(packet.PayloadSize(), size);
+            EXPECT_TRUE(std::equal(packet.Payload().begin(), packet.Payload().end(),
+                                   Payload(size).begin()));
+        }
+    }
+}
+
+TEST(AudioPacketTest, RefusesOversizedPayloads) {
+    AudioPacket packet{AudioPacketType::Opus, 1, ByteChunk{Payload(0x2000)}};
+    EXPECT_THROW(packet.EncodeOutgoing(), std::out_of_range);
+}
+
+TEST(AudioPacketTest, ParsesABurstOfIncomingHeaders) {
+    std::vector<ByteSlice> frames;
+    for (std::uint32_t i = 0; i < 8; i++)
+        frames.push_back(Slice(Incoming(40 + i, 900 + i, i == 7, 50 + i)));
+    // Positional audio adds three floats after the payload
+    auto positional = Incoming(60, 5, false, 20);
+    positional.resize(positional.size() + 12);
+    frames.push_back(Slice(positional));
+
+    std::vector<AudioPacketHeader> headers(frames.size());
+    ASSERT_EQ(ParseIncomingHeaders(frames.data(), frames.size(), headers.data()), frames.size());
+    for (std::uint32_t i = 0; i < 8; i++) {
+        const auto& h = headers[i];
+        EXPECT_EQ(h.error, nullptr);
+        EXPECT_EQ(h.type, AudioPacketType::Opus);
+        EXPECT_EQ(h.target, 3u);
+        EXPECT_EQ(h.sender_session, 40 + i);
+        EXPECT_EQ(h.frame_seq, 900 + i);
+        EXPECT_EQ(h.payload_size, 50 + i);
+        EXPECT_EQ(h.is_terminator, i == 7);
+        EXPECT_FALSE(h.has_position_info);
+
+        // The payload is a view into the frame, not a copy
+        auto packet = AudioPacket::FromHeader(h, frames[i]);
+        EXPECT_EQ(packet.Payload().data(), frames[i].data() + h.payload_offset);
+        EXPECT_EQ(packet.PayloadSize(), 50 + i);
+    }
+    EXPECT_TRUE(headers[8].has_position_info);
+    EXPECT_EQ(headers[8].payload_size, 20);
+}
+
+TEST(AudioPacketTest, FlagsMalformedFramesWithoutThrowing) {
+    auto good = Incoming(1, 2, false, 10);
+    auto truncated = good;
+    truncated.pop_back();
+    auto bad_type = good;
+    bad_type[0] = 0xe0;  // type 7
+    std::vector<std::uint8_t> just_type = {0x80};
+    std::vector<ByteSlice> frames = {Slice(good), Slice(truncated), Slice(bad_type),
+                                     Slice(just_type), Slice({})};
+
+    std::vector<AudioPacketHeader> headers(frames.size());
+    EXPECT_EQ(ParseIncomingHeaders(frames.data(), frames.size(), headers.data()), 1u);
+    EXPECT_EQ(headers[0].error, nullptr);
+    for (std::size_t i = 1; i < frames.size(); i++) EXPECT_NE(headers[i].error, nullptr) << i;
+
+    EXPECT_THROW(AudioPacket::FromIncomingFrame(frames[1]), AudioParseFailure);
+    EXPECT_NO_THROW(AudioPacket::FromIncomingFrame(frames[0]));
+}
+
+}  // namespace
@@ -0,0 +1,146 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdint>
+#include <numeric>
+#include <thread>
+#include <vector>
+#include "AudioRingBuffer.h"
+
+using winrt::blurt::audio::implementation::AudioRingBuffer;
+
+namespace {
+
+std::vector<float> Ramp(float start, std::int32_t n) {
+    std::vector<float> v(n);
+    std::iota(v.begin(), v.end(), start);
+    return v;
+}
+
+TEST(AudioRingBufferTest, StartsEmpty) {
+    AudioRingBuffer<float> ring{8};
+    EXPECT_EQ(ring.ReadCapacity(), 0);
+    EXPECT_EQ(ring.WriteCapacity(), 8);
+    float dest[8];
+    EXPECT_EQ(ring.ReadSamplesTo(dest, 8), 0);
+}
+
+TEST(AudioRingBufferTest, FillsToExactlyItsCapacity) {
+    AudioRingBuffer<float> ring{8};
+    auto src = Ramp(0, 8);
+    ring.WriteSamplesFrom(src.data(), 8);
+    EXPECT_EQ(ring.WriteCapacity(), 0);
+    EXPECT_EQ(ring.ReadCapacity(), 8);
+
+    // Reading a little frees exactly that much
+    std::vector<float> dest(8);
+    EXPECT_EQ(ring.ReadSamplesTo(dest.data(), 3), 3);
+    EXPECT_EQ(ring.WriteCapacity(), 3);
+    EXPECT_EQ(ring.ReadSamplesTo(dest.data() + 3, 8), 5);
+    EXPECT_EQ(dest, src);
+    EXPECT_EQ(ring.ReadCapacity(), 0);
+    EXPECT_EQ(ring.WriteCapacity(), 8);
+}
+
+// A run that straddles the end of the storage comes back as two segments,
+// and reads back in order
+TEST(AudioRingBufferTest, SplitsARunAcrossTheWrap) {
+    AudioRingBuffer<float> ring{8};
+    std::vector<float> scratch(8);
+    auto first = Ramp(0, 6);
+    ring.WriteSamplesFrom(first.data(), 6);
+    ring.ReadSamplesTo(scratch.data(), 6);
+
+    auto write = ring.GetWriteSegments(5);
+    EXPECT_EQ(write.size(), 5);
+    EXPECT_EQ(write.first.size, 3);
+    EXPECT_EQ(write.second.size, 2);
+    for (std::int32_t i = 0; i < write.first.size; i++) write.first.data[i] = 100.0f + i;
+    for (std::int32_t i = 0; i < write.second.size; i++) write.second.data[i] = 103.0f + i;
+    // Nothing's visible until it's committed
+    EXPECT_EQ(ring.ReadCapacity(), 0);
+    ring.CommitWrite(5);
+    EXPECT_EQ(ring.ReadCapacity(), 5);
+
+    auto read = ring.GetReadSegments(5);
+    EXPECT_EQ(read.first.data, write.first.data);
+    EXPECT_EQ(read.second.data, write.second.data);
+    std::vector<float> dest(5);
+    EXPECT_EQ(ring.ReadSamplesTo(dest.data(), 5), 5);
+    EXPECT_EQ(dest, Ramp(100, 5));
+}
+
+// A run that ends exactly at the end of the storage doesn't wrap
+TEST(AudioRingBufferTest, FillsRightUpToTheEndWithoutWrapping) {
+    AudioRingBuffer<float> ring{8};
+    std::vector<float> scratch(8);
+    auto src = Ramp(0, 4);
+    ring.WriteSamplesFrom(src.data(), 4);
+    ring.ReadSamplesTo(scratch.data(), 4);
+    // Nine slots in all, four used up
+    auto write = ring.GetWriteSegments(5);
+    EXPECT_EQ(write.first.size, 5);
+    EXPECT_EQ(write.second.size, 0);
+}
+
+TEST(AudioRingBufferTest, KeepsOrderOverManyWraps) {
+    AudioRingBuffer<float> ring{7};
+    float next_in = 0, next_out = 0;
+    std::vector<float> dest(7);
+    for (int round = 0; round < 100; round++) {
+        auto n = 1 + round % 7;
+        auto src = Ramp(next_in, n);
+        ring.WriteSamplesFrom(src.data(), n);
+        next_in += n;
+        auto got = ring.ReadSamplesTo(dest.data(), 1 + (round * 3) % 7);
+        for (std::int32_t i = 0; i < got; i++) ASSERT_EQ(dest[i], next_out++);
+        // Drain so the next write always fits
+        if (ring.WriteCapacity() < 7) {
+            got = ring.ReadSamplesTo(dest.data(), 7);
+            for (std::int32_t i = 0; i < got; i++) ASSERT_EQ(dest[i], next_out++);
+        }
+    }
+    EXPECT_EQ(next_in, next_out);
+}
+
+// One thread writing and another reading, with neither locking: everything
+// comes out once, in order
+TEST(AudioRingBufferTest, HandsSamplesAcrossThreadsInOrder) {
+    constexpr std::int32_t kTotal = 1 << 20;
+    AudioRingBuffer<float> ring{480};
+    std::thread producer{[&ring] {
+        std::int32_t written{0};
+        while (written < kTotal) {
+            auto n = std::min({ring.WriteCapacity(), kTotal - written, 97});
+            if (n == 0) {
+                std::this_thread::yield();
+                continue;
+            }
+            auto dest = ring.GetWriteSegments(n);
+            for (std::int32_t i = 0; i < dest.first.size; i++)
+                dest.first.data[i] = static_cast<float>(written + i);
+            for (std::int32_t i = 0; i < dest.second.size; i++)
+                dest.second.data[i] = static_cast<float>(written + dest.first.size + i);
+            ring.CommitWrite(n);
+            written += n;
+        }
+    }};
+
+    std::vector<float> dest(128);
+    std::int32_t read{0};
+    bool in_order = true;
+    while (read < kTotal) {
+        auto n = ring.ReadSamplesTo(dest.data(), 1 + read % 128);
+        if (n == 0) std::this_thread::yield();
+        // Every value up to 2^24 is exact as a float
+        for (std::int32_t i = 0; i < n; i++) in_order &= dest[i] == static_cast<float>(read + i);
+        read += n;
+    }
+    producer.join();
+    EXPECT_TRUE(in_order);
+    EXPECT_EQ(ring.ReadCapacity(), 0);
+}
+
+}  // namespace
@@ -0,0 +1,152 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "BitrateController.h"
+
+using winrt::blurt::audio::implementation::BitrateController;
+using Transport = BitrateController::Transport;
+
+namespace {
+
+using namespace std::chrono_literals;
+
+// A stretch of a call, as far as the controller can tell: what the server
+// allows, how voice gets there, how the UI cuts it up, and how lossy the
+// way back has been
+struct Phase {
+    std::int32_t seconds;
+    std::uint32_t max_bandwidth;
+    Transport transport;
+    std::chrono::milliseconds frame;
+    std::int32_t loss_percent;
+};
+
+// What a server enforcing its limit makes of a second of what we send: the
+// share of it over the limit gets dropped
+struct Second {
+    std::int32_t bitrate;
+    std::int32_t wire_bitrate;
+    bool vbr;
+    std::int32_t loss_percent;
+    double dropped_share;
+};
+
+std::vector<Second> Simulate(BitrateController& controller, const std::vector<Phase>& phases) {
+    std::vector<Second> seconds;
+    for (const auto& phase : phases) {
+        controller.MaxBandwidth(phase.max_bandwidth);
+        controller.VoiceTransport(phase.transport);
+        controller.FrameDuration(phase.frame);
+        for (std::int32_t s = 0; s < phase.seconds; s++) {
+            // Loss is reported a window at a time, by which point it's the
+            // loss of the second just past
+            controller.ObservedLossPercent(phase.loss_percent);
+            const auto& settings = controller.Current();
+            auto wire = controller.WireBitrate();
+            double dropped = 0;
+            if (phase.max_bandwidth != 0 && wire > static_cast<std::int64_t>(phase.max_bandwidth))
+                dropped = 1 - static_cast<double>(phase.max_bandwidth) / wire;
+            seconds.push_back(
+                {settings.bitrate, wire, settings.vbr, settings.loss_percent, dropped});
+        }
+    }
+    return seconds;
+}
+
+// Over a call whose limits change as it goes, what's sent fits the server's
+// limit whenever anything can, goes back to what's preferred once the limit
+// lifts, and only runs VBR when there's room for its bursts
+TEST(BitrateControllerTest, FitsUnderTheServersLimitAsItChanges) {
+    BitrateController controller{20ms, 40000};
+    controller.PreferVbr(true);
+    auto seconds = Simulate(controller, {
+                                            {10, 0, Transport::Udp, 20ms, 0},
+                                            {10, 48000, Transport::Udp, 20ms, 0},
+                                            {10, 48000, Transport::Tcp, 20ms, 0},
+                                            {10, 24000, Transport::Tcp, 60ms, 0},
+                                            {10, 24000, Transport::Udp, 10ms, 0},
+                                            {10, 0, Transport::Udp, 20ms, 0},
+                                        });
+    ASSERT_EQ(seconds.size(), 60u);
+
+    // Unlimited: what's preferred, VBR and all
+    EXPECT_EQ(seconds[0].bitrate, 40000);
+    EXPECT_TRUE(seconds[0].vbr);
+    // 40 kbit/s plus 37 bytes of headers 50 times a second is 54.8 kbit/s,
+    // so the audio gives way
+    EXPECT_EQ(seconds[10].wire_bitrate, 48000);
+    EXPECT_EQ(seconds[10].bitrate, 48000 - 37 * 8 * 50);
+    EXPECT_FALSE(seconds[10].vbr);
+    // Tunneled headers cost more, so the audio gives way further
+    EXPECT_EQ(seconds[20].wire_bitrate, 48000);
+    EXPECT_LT(seconds[20].bitrate, seconds[10].bitrate);
+    // Longer frames mean fewer headers, which buys back some audio
+    EXPECT_EQ(seconds[30].wire_bitrate, 24000);
+    EXPECT_EQ(seconds[30].bitrate, 24000 - 51 * 8 * 17);
+    // 10 ms frames' headers alone are over the limit; the least audio goes
+    // anyway, and the server drops what doesn't fit
+    EXPECT_EQ(seconds[40].bitrate, BitrateController::kMinBitrate);
+    EXPECT_GT(seconds[40].dropped_share, 0);
+    // And back
+    EXPECT_EQ(seconds[50].bitrate, 40000);
+    EXPECT_TRUE(seconds[50].vbr);
+
+    for (std::size_t s = 0; s < seconds.size(); s++) {
+        if (seconds[s].bitrate > BitrateController::kMinBitrate) {
+            EXPECT_EQ(seconds[s].dropped_share, 0) << "second " << s;
+        }
+        if (seconds[s].bitrate < 40000) {
+            EXPECT_FALSE(seconds[s].vbr) << "second " << s;
+        }
+    }
+}
+
+// Forward error correction follows the loss the far end sees, up to the
+// point where it stops helping, and goes back off when the loss stops,
+// without touching the bitrate
+TEST(BitrateControllerTest, FollowsLossWithErrorCorrection) {
+    BitrateController controller{20ms, 40000};
+    auto seconds = Simulate(controller, {
+                                            {5, 48000, Transport::Udp, 20ms, 0},
+                                            {5, 48000, Transport::Udp, 20ms, 8},
+                                            {5, 48000, Transport::Udp, 20ms, 60},
+                                            {5, 48000, Transport::Udp, 20ms, 0},
+                                        });
+    EXPECT_EQ(seconds[0].loss_percent, 0);
+    EXPECT_EQ(seconds[5].loss_percent, 8);
+    EXPECT_EQ(seconds[10].loss_percent, 25);
+    EXPECT_EQ(seconds[15].loss_percent, 0);
+    for (const auto& second : seconds) {
+        EXPECT_EQ(second.bitrate, seconds[0].bitrate);
+        EXPECT_EQ(second.dropped_share, 0);
+    }
+}
+
+// Encoding that runs over budget brings complexity straight down a step at
+// a time until it fits; once there's plenty of room it creeps back up, a
+// step every five seconds, so a briefly idle machine doesn't make it bounce
+TEST(BitrateControllerTest, BacksOffComplexityWhenEncodingRunsLong) {
+    BitrateController controller{20ms};
+    EXPECT_EQ(controller.Current().complexity, BitrateController::kMaxComplexity);
+    // The budget is 10% of 20 ms; each step down saves 300 us here
+    auto encode_time = [&] { return 1000us + 300us * controller.Current().complexity; };
+    for (int frame = 0; frame < 100; frame++) controller.OnFrameEncoded(encode_time());
+    EXPECT_EQ(controller.Current().complexity, 3);
+    EXPECT_LE(encode_time(), 2000us);
+    for (int frame = 0; frame < 1000; frame++) controller.OnFrameEncoded(encode_time());
+    EXPECT_EQ(controller.Current().complexity, 3);
+
+    // The machine frees up
+    for (int frame = 0; frame < 200; frame++) controller.OnFrameEncoded(100us);
+    EXPECT_EQ(controller.Current().complexity, 4);
+    for (int frame = 0; frame < 250; frame++) controller.OnFrameEncoded(100us);
+    EXPECT_EQ(controller.Current().complexity, 5);
+    for (int frame = 0; frame < 1500; frame++) controller.OnFrameEncoded(100us);
+    EXPECT_EQ(controller.Current().complexity, BitrateController::kMaxComplexity);
+}
+
+}  // namespace
@@ -0,0 +1,160 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <system_error>
+#include <utility>
+#include "BlobCache.h"
+#include "Sha1.h"
+
+using winrt::blurt::Sha1;
+using winrt::blurt::mumble::implementation::BlobCache;
+
+namespace {
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+
+// A directory of its own for a test's cache, gone again afterwards
+struct TempDir {
+    fs::path path;
+    TempDir() {
+        std::random_device rd;
+        path = fs::temp_directory_path() / ("blurt_blob_cache_" + std::to_string(rd()));
+        fs::remove_all(path);
+    }
+    ~TempDir() {
+        std::error_code ec;
+        fs::remove_all(path, ec);
+    }
+};
+
+std::string Content(char c, std::size_t size) { return std::string(size, c); }
+
+std::size_t FilesIn(const fs::path& dir) {
+    std::size_t n{0};
+    for (const auto& entry : fs::directory_iterator{dir}) n += entry.is_regular_file();
+    return n;
+}
+
+// Starting with nothing, every lookup misses until the blob's been put,
+// and then it's there under its hash
+TEST(BlobCacheTest, ColdCacheKeepsWhatsPut) {
+    TempDir dir;
+    BlobCache cache{dir.path};
+    EXPECT_EQ(cache.TotalBytes(), 0u);
+    auto comment = Content('c', 1000);
+    auto hash = Sha1::Of(comment);
+    EXPECT_FALSE(cache.Get(hash));
+
+    cache.Put(hash, comment);
+    EXPECT_EQ(cache.Get(hash), comment);
+    EXPECT_EQ(cache.TotalBytes(), 1000u);
+    EXPECT_EQ(FilesIn(dir.path), 1u);
+    // Putting it again changes nothing
+    cache.Put(hash, comment);
+    EXPECT_EQ(cache.TotalBytes(), 1000u);
+}
+
+// Reconnecting later finds everything from before, without downloading it
+TEST(BlobCacheTest, WarmCacheServesAcrossRestarts) {
+    TempDir dir;
+    auto comment = Content('c', 1000), texture = Content('t', 50000);
+    {
+        BlobCache cache{dir.path};
+        cache.Put(Sha1::Of(comment), comment);
+        cache.Put(Sha1::Of(texture), texture);
+    }
+    BlobCache cache{dir.path};
+    EXPECT_EQ(cache.TotalBytes(), 51000u);
+    EXPECT_EQ(cache.Get(Sha1::Of(comment)), comment);
+    EXPECT_EQ(cache.Get(Sha1::Of(texture)), texture);
+    EXPECT_FALSE(cache.Get(Sha1::Of(Content('x', 10))));
+}
+
+// Least recently used goes first, and last use survives a restart
+TEST(BlobCacheTest, EvictsTheLeastRecentlyUsed) {
+    TempDir dir;
+    auto a = Content('a', 400), b = Content('b', 400), c = Content('c', 400);
+    {
+        BlobCache cache{dir.path};
+        for (const auto* blob : {&a, &b, &c}) cache.Put(Sha1::Of(*blob), *blob);
+    }
+    // Last used: b longest ago, then a, then c
+    auto now = fs::file_time_type::clock::now();
+    for (auto [blob, age] : {std::pair{&a, 2h}, std::pair{&b, 3h}, std::pair{&c, 1h}}) {
+        for (const auto& entry : fs::directory_iterator{dir.path}) {
+            std::ifstream in{entry.path(), std::ios::binary};
+            std::string content{std::istreambuf_iterator<char>{in},
+                                std::istreambuf_iterator<char>{}};
+            if (content == *blob) fs::last_write_time(entry.path(), now - age);
+        }
+    }
+
+    // Room for two: b goes as the cache starts
+    BlobCache cache{dir.path, 800};
+    EXPECT_EQ(cache.TotalBytes(), 800u);
+    EXPECT_FALSE(cache.Get(Sha1::Of(b)));
+    // Using a makes c the least recently used, which goes to make room
+    EXPECT_EQ(cache.Get(Sha1::Of(a)), a);
+    auto d = Content('d', 400);
+    cache.Put(Sha1::Of(d), d);
+    EXPECT_FALSE(cache.Get(Sha1::Of(c)));
+    EXPECT_EQ(cache.Get(Sha1::Of(a)), a);
+    EXPECT_EQ(cache.Get(Sha1::Of(d)), d);
+    EXPECT_EQ(FilesIn(dir.path), 2u);
+}
+
+// A file that's been cut short or scribbled on is a miss, and it's cleared
+// out so the blob can be downloaded and cached again
+TEST(BlobCacheTest, DropsDamagedFiles) {
+    TempDir dir;
+    auto comment = Content('c', 1000);
+    auto hash = Sha1::Of(comment);
+    {
+        BlobCache cache{dir.path};
+        cache.Put(hash, comment);
+    }
+    for (const auto& entry : fs::directory_iterator{dir.path})
+        fs::resize_file(entry.path(), 500);
+
+    BlobCache cache{dir.path};
+    EXPECT_FALSE(cache.Get(hash));
+    EXPECT_EQ(cache.TotalBytes(), 0u);
+    EXPECT_EQ(FilesIn(dir.path), 0u);
+    cache.Put(hash, comment);
+    EXPECT_EQ(cache.Get(hash), comment);
+}
+
+// Other files in the directory, like one left half-written by a crash,
+// aren't counted or touched
+TEST(BlobCacheTest, IgnoresFilesThatArentBlobs) {
+    TempDir dir;
+    fs::create_directories(dir.path);
+    auto comment = Content('c', 1000);
+    auto hash_file = dir.path / "0123456789abcdef0123456789abcdef01234567";
+    std::ofstream{dir.path / "notes.txt"} << "hello";
+    std::ofstream{fs::path{hash_file} += ".tmp"} << comment;
+
+    BlobCache cache{dir.path};
+    EXPECT_EQ(cache.TotalBytes(), 0u);
+    EXPECT_EQ(FilesIn(dir.path), 2u);
+}
+
+TEST(BlobCacheTest, RefusesEmptyAndOversizeBlobs) {
+    TempDir dir;
+    BlobCache cache{dir.path, 1000};
+    cache.Put(Sha1::Of(""), "");
+    auto big = Content('b', 1001);
+    cache.Put(Sha1::Of(big), big);
+    EXPECT_EQ(cache.TotalBytes(), 0u);
+    EXPECT_FALSE(cache.Get(Sha1::Of(big)));
+}
+
+}  // namespace
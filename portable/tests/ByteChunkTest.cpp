@@ -0,0 +1,70 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "ByteChunk.h"
+#include "BytePool.h"
+
+using winrt::blurt::ByteChunk;
+using winrt::blurt::BytePool;
+
+namespace {
+
+void ExpectEmpty(const ByteChunk& chunk) {
+    EXPECT_EQ(chunk.data(), nullptr);
+    EXPECT_EQ(chunk.size(), 0);
+    EXPECT_EQ(chunk.begin(), chunk.end());
+}
+
+TEST(ByteChunkTest, MovingLeavesNothingBehind) {
+    BytePool pool;
+    auto pooled = ByteChunk::Allocate(100, pool);
+    const auto* storage = pooled.data();
+    ByteChunk moved{std::move(pooled)};
+    ExpectEmpty(pooled);
+    EXPECT_EQ(moved.data(), storage);
+    EXPECT_EQ(moved.size(), 100);
+
+    ByteChunk vector_backed{std::vector<std::uint8_t>(50, 7)};
+    storage = vector_backed.data();
+    ByteChunk moved_vector{std::move(vector_backed)};
+    ExpectEmpty(vector_backed);
+    EXPECT_EQ(moved_vector.data(), storage);
+    EXPECT_EQ(moved_vector.size(), 50);
+}
+
+TEST(ByteChunkTest, MoveAssignmentLeavesNothingBehind) {
+    BytePool pool;
+    auto from = ByteChunk::Allocate(100, pool);
+    const auto* storage = from.data();
+    ByteChunk to{std::vector<std::uint8_t>(50, 7)};
+    to = std::move(from);
+    ExpectEmpty(from);
+    EXPECT_EQ(to.data(), storage);
+    EXPECT_EQ(to.size(), 100);
+
+    ByteChunk vector_backed{std::vector<std::uint8_t>(50, 7)};
+    storage = vector_backed.data();
+    to = std::move(vector_backed);
+    ExpectEmpty(vector_backed);
+    EXPECT_EQ(to.data(), storage);
+    EXPECT_EQ(to.size(), 50);
+}
+
+// What a chunk held before it was assigned over goes straight back to the
+// pool, not along with the chunk it was assigned from
+TEST(ByteChunkTest, MoveAssignmentReleasesTheOldBlock) {
+    BytePool pool;
+    auto to = ByteChunk::Allocate(100, pool);
+    auto from = ByteChunk::Allocate(100, pool);
+    to = std::move(from);
+    // 100 bytes rounds up to the 128-byte class
+    EXPECT_EQ(pool.Stats()[1].free_blocks, 1u);
+    auto again = ByteChunk::Allocate(100, pool);
+    EXPECT_EQ(pool.Stats()[1].hits, 1u);
+}
+
+}  // namespace
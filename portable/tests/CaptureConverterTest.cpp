@@ -0,0 +1,171 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "AudioParams.h"
+#include "CaptureConverter.h"
+
+using winrt::blurt::audio::AudioSetup;
+using winrt::blurt::audio::Channels;
+using winrt::blurt::audio::SampleRate;
+using winrt::blurt::audio::implementation::CaptureConverter;
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+AudioSetup Mono48k() { return AudioSetup{SampleRate::Of48KHz(), Channels::Mono()}; }
+
+// A second of a tone, the same in every channel
+std::vector<float> Tone(std::uint32_t rate, std::uint32_t channels, double hz, double level) {
+    std::vector<float> in(static_cast<std::size_t>(rate) * channels);
+    for (std::size_t i = 0; i < rate; i++) {
+        auto x = static_cast<float>(level * std::sin(2 * kPi * hz * i / rate));
+        for (std::uint32_t c = 0; c < channels; c++) in[i * channels + c] = x;
+    }
+    return in;
+}
+
+// Everything the converter makes of the input, fed in 10 ms at a time as a
+// device would deliver it
+std::vector<float> ConvertAll(CaptureConverter& converter, const std::vector<float>& in,
+                              std::uint32_t rate, std::uint32_t channels) {
+    std::vector<float> out;
+    const auto chunk = static_cast<std::int32_t>(rate / 100);
+    const auto frames = static_cast<std::int32_t>(in.size() / channels);
+    for (std::int32_t i = 0; i < frames; i += chunk) {
+        const auto& converted =
+            converter.Convert(in.data() + static_cast<std::size_t>(i) * channels,
+                              std::min(chunk, frames - i));
+        out.insert(out.end(), converted.begin(), converted.end());
+    }
+    return out;
+}
+
+// The level in the output, in dB relative to a full-scale tone, once the
+// filter has filled up: of everything, or of just the one frequency
+double LevelDb(const std::vector<float>& out) {
+    double sum = 0;
+    const std::size_t skip = 480;
+    for (std::size_t i = skip; i < out.size(); i++) sum += static_cast<double>(out[i]) * out[i];
+    return 10 * std::log10(2 * sum / (out.size() - skip));
+}
+
+double LevelDb(const std::vector<float>& out, double hz) {
+    double re = 0, im = 0;
+    const std::size_t skip = 480;
+    for (std::size_t i = skip; i < out.size(); i++) {
+        re += out[i] * std::cos(2 * kPi * hz * i / 48000);
+        im += out[i] * std::sin(2 * kPi * hz * i / 48000);
+    }
+    return 20 * std::log10(2 * std::hypot(re, im) / (out.size() - skip));
+}
+
+TEST(CaptureConverterTest, PassesThroughWhenTheRatesMatch) {
+    CaptureConverter converter{48000, 2, Mono48k()};
+    EXPECT_TRUE(converter.IsPassthrough());
+    std::vector<float> in{0.5f, 0.25f, -1.0f, 1.0f};
+    EXPECT_EQ(converter.Convert(in.data(), 2), (std::vector<float>{0.375f, 0.0f}));
+}
+
+TEST(CaptureConverterTest, MakesTheRightNumberOfSamples) {
+    for (std::uint32_t rate : {8000u, 16000u, 22050u, 44100u, 96000u, 192000u}) {
+        CaptureConverter converter{rate, 1, Mono48k()};
+        auto out = ConvertAll(converter, Tone(rate, 1, 440, 0.5), rate, 1);
+        // Give or take the last sample, which waits on input still to come
+        EXPECT_NEAR(static_cast<double>(out.size()), 48000, 1) << rate;
+    }
+}
+
+// Speech frequencies, and well above, come out at the level they went in,
+// across the seams between device buffers
+TEST(CaptureConverterTest, KeepsThePassbandFlat) {
+    for (std::uint32_t rate : {16000u, 44100u, 96000u}) {
+        for (double hz : {100.0, 1000.0, 6000.0, 16000.0}) {
+            if (hz > 0.8 * rate / 2) continue;
+            CaptureConverter converter{rate, 2, Mono48k()};
+            auto out = ConvertAll(converter, Tone(rate, 2, hz, 0.5), rate, 2);
+            EXPECT_NEAR(LevelDb(out, hz), 20 * std::log10(0.5), 0.1) << rate << " Hz in, " << hz;
+        }
+    }
+}
+
+// What's above the output's Nyquist rate is filtered out rather than folded
+// back down into the band as aliases
+TEST(CaptureConverterTest, FiltersOutTheStopband) {
+    for (double hz : {26000.0, 30000.0, 40000.0}) {
+        CaptureConverter converter{96000, 1, Mono48k()};
+        auto out = ConvertAll(converter, Tone(96000, 1, hz, 1.0), 96000, 1);
+        EXPECT_LT(LevelDb(out), -60) << hz;
+    }
+}
+
+// Upsampling makes images of the input around multiples of its rate, which
+// have to go just the same
+TEST(CaptureConverterTest, FiltersOutImages) {
+    CaptureConverter converter{16000, 1, Mono48k()};
+    auto out = ConvertAll(converter, Tone(16000, 1, 6000, 1.0), 16000, 1);
+    EXPECT_NEAR(LevelDb(out, 6000), 0, 0.1);
+    for (double image : {10000.0, 22000.0}) EXPECT_LT(LevelDb(out, image), -60) << image;
+}
+
+// The converter adds half its filter's length to the capture latency: 24
+// samples at the lower of the two rates, so about half a millisecond from the
+// usual device rates and never more than one and a half
+TEST(CaptureConverterTest, AddsHalfItsFilterOfLatency) {
+    for (std::uint32_t rate : {16000u, 44100u, 96000u}) {
+        CaptureConverter converter{rate, 1, Mono48k()};
+        // A step, from silence to half scale, 50 ms in
+        std::vector<float> in(rate / 10, 0.5f);
+        std::fill(in.begin(), in.begin() + rate / 20, 0.0f);
+        auto out = ConvertAll(converter, in, rate, 1);
+        auto crossing = std::find_if(out.begin(), out.end(), [](float x) { return x >= 0.25f; });
+        ASSERT_NE(crossing, out.end());
+        double latency_ms = (crossing - out.begin() - 2400) / 48.0;
+        EXPECT_NEAR(latency_ms, 24000.0 / std::min(rate, 48000u), 0.05) << rate;
+    }
+}
+
+TEST(CaptureConverterTest, SplittingTheInputChangesNothing) {
+    auto in = Tone(44100, 2, 997, 0.8);
+    CaptureConverter whole{44100, 2, Mono48k()};
+    std::vector<float> all = whole.Convert(in.data(), 44100);
+    CaptureConverter pieces{44100, 2, Mono48k()};
+    std::vector<float> split;
+    std::int32_t frame{0};
+    for (std::int32_t n = 1; frame < 44100; n = n * 7 % 1000 + 1) {
+        n = std::min(n, 44100 - frame);
+        const auto& out = pieces.Convert(in.data() + 2 * frame, n);
+        split.insert(split.end(), out.begin(), out.end());
+        frame += n;
+    }
+    EXPECT_EQ(split, all);
+}
+
+TEST(CaptureConverterTest, WidensInt16Samples) {
+    CaptureConverter from_float{44100, 1, Mono48k()};
+    CaptureConverter from_int16{44100, 1, Mono48k()};
+    std::vector<std::int16_t> in(441);
+    std::vector<float> widened(441);
+    for (std::size_t i = 0; i < in.size(); i++) {
+        in[i] = static_cast<std::int16_t>(static_cast<std::int32_t>(i * 331 % 65536) - 32768);
+        widened[i] = in[i] / 32768.0f;
+    }
+    std::vector<float> expected = from_float.Convert(widened.data(), 441);
+    EXPECT_EQ(from_int16.Convert(in.data(), 441), expected);
+}
+
+TEST(CaptureConverterTest, RefusesWhatItCantConvert) {
+    AudioSetup stereo{SampleRate::Of48KHz(), Channels::Stereo()};
+    EXPECT_THROW((CaptureConverter{48000, 1, stereo}), std::exception);
+    EXPECT_THROW((CaptureConverter{0, 1, Mono48k()}), std::exception);
+    EXPECT_THROW((CaptureConverter{48000, 0, Mono48k()}), std::exception);
+    // Coprime with 48 kHz, needing thousands of filter phases
+    EXPECT_THROW((CaptureConverter{44101, 1, Mono48k()}), std::exception);
+}
+
+}  // namespace
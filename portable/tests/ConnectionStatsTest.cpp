@@ -0,0 +1,160 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <initializer_list>
+#include "ConnectionStats.h"
+
+using winrt::blurt::mumble::implementation::ConnectionStats;
+
+namespace {
+
+using namespace std::chrono_literals;
+
+const ConnectionStats::Clock::time_point kStart{std::chrono::seconds{1000}};
+
+// Send a ping every five seconds, each coming back after the matching round
+// trip time
+void Ping(ConnectionStats& stats, bool udp, std::initializer_list<int> rtts_ms) {
+    auto sent = kStart;
+    for (auto rtt : rtts_ms) {
+        auto timestamp = ConnectionStats::PingTimestamp(sent);
+        auto now = sent + std::chrono::milliseconds{rtt};
+        if (udp) {
+            stats.OnUdpPingReply(timestamp, now);
+        } else {
+            stats.OnTcpPingReply(timestamp, now);
+        }
+        sent += 5s;
+    }
+}
+
+void Voice(ConnectionStats& stats, std::uint32_t session, std::initializer_list<int> seqs,
+           bool terminate_last = false) {
+    auto left = seqs.size();
+    for (auto seq : seqs) {
+        bool is_terminator = terminate_last && --left == 0;
+        stats.OnVoicePacket(session, static_cast<std::uint64_t>(seq), is_terminator);
+    }
+}
+
+TEST(ConnectionStatsTest, KeepsRttMeanAndVariancePerChannel) {
+    ConnectionStats stats;
+    Ping(stats, true, {20, 30, 40});
+    Ping(stats, false, {100});
+
+    auto snapshot = stats.TakeSnapshot();
+    EXPECT_EQ(snapshot.udp.count, 3u);
+    EXPECT_NEAR(snapshot.udp.mean, 30, 1e-9);
+    EXPECT_NEAR(snapshot.udp.variance, 200.0 / 3, 1e-9);
+    EXPECT_EQ(snapshot.tcp.count, 1u);
+    EXPECT_NEAR(snapshot.tcp.mean, 100, 1e-9);
+    EXPECT_NEAR(snapshot.tcp.variance, 0, 1e-9);
+}
+
+TEST(ConnectionStatsTest, IgnoresRepliesFromTheFuture) {
+    ConnectionStats stats;
+    stats.OnUdpPingReply(ConnectionStats::PingTimestamp(kStart + 1s), kStart);
+    EXPECT_EQ(stats.TakeSnapshot().udp.count, 0u);
+}
+
+TEST(ConnectionStatsTest, CountsMissingPackets) {
+    ConnectionStats stats;
+    // Two frames a packet; 4 and 10 and 12 never come
+    Voice(stats, 7, {0, 2, 6, 8, 14, 16});
+    auto speaker = stats.Speaker(7);
+    ASSERT_TRUE(speaker);
+    EXPECT_EQ(speaker->received, 6u);
+    EXPECT_EQ(speaker->lost, 3u);
+    EXPECT_EQ(speaker->late, 0u);
+    EXPECT_DOUBLE_EQ(speaker->LossRate(), 3.0 / 9);
+    EXPECT_EQ(stats.TakeSnapshot().voice.lost, 3u);
+}
+
+TEST(ConnectionStatsTest, LatePacketsAreNotLost) {
+    ConnectionStats stats;
+    Voice(stats, 7, {0, 2, 6, 4, 8});
+    auto speaker = stats.Speaker(7);
+    EXPECT_EQ(speaker->received, 5u);
+    EXPECT_EQ(speaker->lost, 0u);
+    EXPECT_EQ(speaker->late, 1u);
+}
+
+TEST(ConnectionStatsTest, IgnoresRepeats) {
+    ConnectionStats stats;
+    Voice(stats, 7, {0, 2, 2, 4, 2});
+    EXPECT_EQ(stats.Speaker(7)->received, 3u);
+}
+
+TEST(ConnectionStatsTest, SilenceAfterATerminatorIsNotLoss) {
+    ConnectionStats stats;
+    Voice(stats, 7, {0, 2, 4}, true);
+    Voice(stats, 7, {40, 42});
+    EXPECT_EQ(stats.Speaker(7)->lost, 0u);
+}
+
+TEST(ConnectionStatsTest, AHugeJumpIsAStartOverNotLoss) {
+    ConnectionStats stats;
+    Voice(stats, 7, {0, 2, 4, 1000, 1002});
+    EXPECT_EQ(stats.Speaker(7)->lost, 0u);
+    // And going back a long way is too
+    Voice(stats, 7, {10, 12});
+    EXPECT_EQ(stats.Speaker(7)->lost, 0u);
+    EXPECT_EQ(stats.Speaker(7)->late, 0u);
+}
+
+// A speaker switching from 20 ms to 60 ms packets mid-stream looks at first
+// like losing two of every three packets; once the longer step keeps up it's
+// believed, what was counted is taken back and nothing more is
+TEST(ConnectionStatsTest, FollowsASwitchToLongerPackets) {
+    ConnectionStats stats;
+    Voice(stats, 7, {0, 2, 4, 6, 12, 18, 24, 30, 36, 42, 48});
+    EXPECT_EQ(stats.Speaker(7)->lost, 0u);
+
+    // Loss at the new step counts as loss, at the new step
+    Voice(stats, 7, {60, 66});
+    EXPECT_EQ(stats.Speaker(7)->lost, 1u);
+}
+
+TEST(ConnectionStatsTest, KeepsRealLossCountedWhenTheStepGoesBack) {
+    ConnectionStats stats;
+    // One lost, then one more; the step never changes
+    Voice(stats, 7, {0, 2, 4, 8, 10, 12, 16, 18});
+    EXPECT_EQ(stats.Speaker(7)->lost, 2u);
+}
+
+TEST(ConnectionStatsTest, FollowsASwitchToShorterPackets) {
+    ConnectionStats stats;
+    Voice(stats, 7, {0, 6, 12, 18, 20, 22, 24, 28, 30});
+    EXPECT_EQ(stats.Speaker(7)->lost, 1u);
+}
+
+TEST(ConnectionStatsTest, ForgetsSpeakersWhoLeave) {
+    ConnectionStats stats;
+    Voice(stats, 7, {0, 2});
+    stats.ForgetSpeaker(7);
+    EXPECT_FALSE(stats.Speaker(7));
+    EXPECT_EQ(stats.TakeSnapshot().voice.received, 2u);
+}
+
+TEST(ConnectionStatsTest, FillsPings) {
+    ConnectionStats stats;
+    Ping(stats, true, {20, 40});
+    Ping(stats, false, {50});
+    MumbleProto::Ping ping;
+    winrt::blurt::mumble::implementation::CryptState::Counters counters{};
+    counters.good = 10;
+    counters.lost = 2;
+    stats.FillPing(ping, counters);
+    EXPECT_EQ(ping.good(), 10u);
+    EXPECT_EQ(ping.lost(), 2u);
+    EXPECT_EQ(ping.udp_packets(), 2u);
+    EXPECT_EQ(ping.tcp_packets(), 1u);
+    EXPECT_FLOAT_EQ(ping.udp_ping_avg(), 30);
+    EXPECT_FLOAT_EQ(ping.udp_ping_var(), 100);
+    EXPECT_FLOAT_EQ(ping.tcp_ping_avg(), 50);
+}
+
+}  // namespace
@@ -0,0 +1,219 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <random>
+#include <utility>
+#include <vector>
+#include "ControlFramer.h"
+
+using winrt::blurt::mumble::implementation::ControlFramer;
+
+namespace {
+
+struct Message {
+    std::uint16_t type;
+    std::vector<std::uint8_t> payload;
+
+    bool operator==(const Message& other) const {
+        return type == other.type && payload == other.payload;
+    }
+};
+
+void AppendWire(const Message& m, std::vector<std::uint8_t>* out) {
+    auto size = static_cast<std::uint32_t>(m.payload.size());
+    std::uint8_t header[ControlFramer::kHeaderSize] = {
+        static_cast<std::uint8_t>(m.type >> 8), static_cast<std::uint8_t>(m.type),
+        static_cast<std::uint8_t>(size >> 24),  static_cast<std::uint8_t>(size >> 16),
+        static_cast<std::uint8_t>(size >> 8),   static_cast<std::uint8_t>(size)};
+    out->insert(out->end(), header, header + sizeof(header));
+    out->insert(out->end(), m.payload.begin(), m.payload.end());
+}
+
+std::vector<Message> RandomMessages(std::mt19937& rng, std::size_t n, std::size_t max_size) {
+    std::vector<Message> messages;
+    for (std::size_t i = 0; i < n; i++) {
+        Message m;
+        m.type = static_cast<std::uint16_t>(rng() % 27);
+        // Mostly small, like voice and pings, with the odd big one
+        auto size = rng() % 8 == 0 ? rng() % (max_size + 1) : rng() % 150;
+        m.payload.resize(size);
+        for (auto& b : m.payload) b = static_cast<std::uint8_t>(rng());
+        messages.push_back(std::move(m));
+    }
+    return messages;
+}
+
+// Feed the stream to a framer in reads of the given sizes (cycling through
+// them), taking every message each read completes. Every payload slice is
+// held until the end, so this also checks that the framer never writes over
+// a slice still in use.
+std::vector<Message> Reframe(const std::vector<std::uint8_t>& stream,
+                             const std::vector<std::size_t>& read_sizes,
+                             ControlFramer& framer) {
+    std::vector<ControlFramer::Frame> frames;
+    std::size_t pos{0}, read{0};
+    while (pos < stream.size()) {
+        auto n = std::min(std::max<std::size_t>(read_sizes[read++ % read_sizes.size()], 1),
+                          stream.size() - pos);
+        auto* dest = framer.PrepareInput(n);
+        EXPECT_GE(framer.InputCapacity(), n);
+        std::memcpy(dest, stream.data() + pos, n);
+        framer.CommitInput(n);
+        pos += n;
+
+        ControlFramer::Frame frame;
+        while (true) {
+            bool has = framer.HasFrame();
+            if (!framer.NextFrame(frame)) {
+                EXPECT_FALSE(has);
+                break;
+            }
+            EXPECT_TRUE(has);
+            frames.push_back(std::move(frame));
+        }
+    }
+    std::vector<Message> out;
+    for (const auto& f : frames) out.push_back({f.type, {f.payload.begin(), f.payload.end()}});
+    return out;
+}
+
+TEST(ControlFramerTest, EmitsEveryMessageFromOneRead) {
+    std::vector<Message> messages = {
+        {3, {1, 2, 3}}, {1, {}}, {7, std::vector<std::uint8_t>(300, 9)}};
+    std::vector<std::uint8_t> stream;
+    for (const auto& m : messages) AppendWire(m, &stream);
+
+    ControlFramer framer;
+    EXPECT_EQ(Reframe(stream, {stream.size()}, framer), messages);
+    EXPECT_EQ(framer.BufferedSize(), 0u);
+}
+
+TEST(ControlFramerTest, ReassemblesMessagesSplitAtEveryByte) {
+    std::vector<Message> messages = {{9, {10, 20, 30, 40, 50}}, {0, {}}, {26, {1}}};
+    std::vector<std::uint8_t> stream;
+    for (const auto& m : messages) AppendWire(m, &stream);
+
+    for (std::size_t split = 1; split < stream.size(); split++) {
+        ControlFramer framer;
+        EXPECT_EQ(Reframe(stream, {split, stream.size()}, framer), messages) << "split " << split;
+    }
+    ControlFramer framer;
+    EXPECT_EQ(Reframe(stream, {1}, framer), messages);
+}
+
+TEST(ControlFramerTest, HoldsAPartialMessage) {
+    std::vector<std::uint8_t> stream;
+    AppendWire({5, std::vector<std::uint8_t>(100, 1)}, &stream);
+
+    ControlFramer framer;
+    auto* dest = framer.PrepareInput(50);
+    std::memcpy(dest, stream.data(), 50);
+    framer.CommitInput(50);
+    ControlFramer::Frame frame;
+    EXPECT_FALSE(framer.NextFrame(frame));
+    EXPECT_EQ(framer.BufferedSize(), 50u);
+}
+
+TEST(ControlFramerTest, RefusesMessagesOverTheLimit) {
+    std::vector<std::uint8_t> stream;
+    AppendWire({1, std::vector<std::uint8_t>(64, 0)}, &stream);
+    AppendWire({1, std::vector<std::uint8_t>(65, 0)}, &stream);
+
+    ControlFramer framer{64};
+    auto* dest = framer.PrepareInput(stream.size());
+    std::memcpy(dest, stream.data(), stream.size());
+    framer.CommitInput(stream.size());
+    ControlFramer::Frame frame;
+    ASSERT_TRUE(framer.NextFrame(frame));
+    EXPECT_EQ(frame.payload.size(), 64);
+    // Only the header is needed to know it's too long
+    EXPECT_THROW(framer.NextFrame(frame), std::exception);
+}
+
+// Random messages, cut into random reads, come out exactly as they went in
+TEST(ControlFramerTest, FuzzRandomSplits) {
+    std::mt19937 rng{1234};
+    for (int round = 0; round < 200; round++) {
+        auto messages = RandomMessages(rng, 1 + rng() % 60, 5000);
+        std::vector<std::uint8_t> stream;
+        for (const auto& m : messages) AppendWire(m, &stream);
+
+        std::vector<std::size_t> reads(1 + rng() % 8);
+        for (auto& r : reads) r = rng() % 3 == 0 ? 1 + rng() % 8 : 1 + rng() % 20000;
+        ControlFramer framer;
+        ASSERT_EQ(Reframe(stream, reads, framer), messages) << "round " << round;
+        ASSERT_EQ(framer.BufferedSize(), 0u);
+    }
+}
+
+// Messages let go of as soon as they're taken leave the framer free to
+// reuse its storage, while any still held keep theirs intact
+TEST(ControlFramerTest, ReusesStorageOnlyOnceLetGo) {
+    std::mt19937 rng{77};
+    auto messages = RandomMessages(rng, 3000, 3000);
+    std::vector<std::uint8_t> stream;
+    for (const auto& m : messages) AppendWire(m, &stream);
+
+    ControlFramer framer;
+    std::vector<std::pair<std::size_t, ControlFramer::Frame>> held;
+    std::size_t pos{0}, taken{0};
+    while (pos < stream.size()) {
+        auto n = std::min<std::size_t>(1 + rng() % 20000, stream.size() - pos);
+        std::memcpy(framer.PrepareInput(n), stream.data() + pos, n);
+        framer.CommitInput(n);
+        pos += n;
+        ControlFramer::Frame frame;
+        while (framer.NextFrame(frame)) {
+            ASSERT_EQ(frame.type, messages[taken].type);
+            // Hold on to one in fifty for a while, like a jitter buffer would
+            if (taken % 50 == 0) held.emplace_back(taken, frame);
+            taken++;
+        }
+        if (held.size() > 4) held.erase(held.begin());
+        for (const auto& [i, f] : held) {
+            ASSERT_EQ(std::vector<std::uint8_t>(f.payload.begin(), f.payload.end()),
+                      messages[i].payload);
+        }
+    }
+    EXPECT_EQ(taken, messages.size());
+}
+
+// Garbage never crashes the framer or gets it to return a frame that runs
+// past what it was given; it either frames it or refuses it
+TEST(ControlFramerTest, FuzzGarbage) {
+    std::mt19937 rng{99};
+    for (int round = 0; round < 500; round++) {
+        std::vector<std::uint8_t> stream(rng() % 4000);
+        for (auto& b : stream) b = static_cast<std::uint8_t>(rng());
+        // Keep some lengths small enough to be believable
+        for (std::size_t i = 0; i + 6 <= stream.size(); i += 1 + rng() % 64) {
+            if (rng() % 2 == 0) stream[i + 2] = stream[i + 3] = stream[i + 4] = 0;
+        }
+
+        ControlFramer framer{2048};
+        std::size_t pos{0}, framed{0};
+        try {
+            while (pos < stream.size()) {
+                auto n = std::min<std::size_t>(1 + rng() % 700, stream.size() - pos);
+                std::memcpy(framer.PrepareInput(n), stream.data() + pos, n);
+                framer.CommitInput(n);
+                pos += n;
+                ControlFramer::Frame frame;
+                while (framer.NextFrame(frame)) {
+                    ASSERT_LE(frame.payload.size(), 2048);
+                    framed += ControlFramer::kHeaderSize + frame.payload.size();
+                }
+            }
+        } catch (const std::exception&) {
+            continue;
+        }
+        EXPECT_EQ(framed + framer.BufferedSize(), stream.size());
+    }
+}
+
+}  // namespace
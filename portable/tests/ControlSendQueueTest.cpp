@@ -0,0 +1,219 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "ControlFramer.h"
+#include "ControlPacket.h"
+#include "ControlSendQueue.h"
+#include "OutgoingVoiceFrame.h"
+
+using winrt::blurt::mumble::implementation::ControlFramer;
+using winrt::blurt::mumble::implementation::ControlPacket;
+using winrt::blurt::mumble::implementation::ControlPacketType;
+using winrt::blurt::mumble::implementation::ControlSendQueue;
+using winrt::blurt::mumble::implementation::OutgoingVoiceFrame;
+
+namespace {
+
+using namespace std::chrono_literals;
+
+const ControlSendQueue::Clock::time_point kStart{std::chrono::seconds{1000}};
+
+OutgoingVoiceFrame Voice(std::uint64_t seq) {
+    OutgoingVoiceFrame frame{60};
+    frame.PayloadSize(60);
+    frame.FrameSequence(seq);
+    frame.Finish(0);
+    return frame;
+}
+
+ControlPacket Ping() { return ControlPacket{ControlPacketType::Ping, std::vector<std::uint8_t>{}}; }
+
+// A message of the given size, tagged so the order it went out in shows
+ControlPacket Text(std::size_t size, std::uint8_t tag) {
+    std::vector<std::uint8_t> payload(size, 0);
+    payload[0] = tag;
+    return ControlPacket{ControlPacketType::TextMessage, std::move(payload)};
+}
+
+std::uint8_t Tag(const ControlPacket& packet) { return *packet.Bytes().begin(); }
+
+std::size_t BatchBytes(const ControlSendQueue::Batch& batch) {
+    std::size_t bytes{0};
+    for (const auto& frame : batch.voice) bytes += frame.WireSize();
+    for (const auto& packet : batch.control)
+        bytes += ControlFramer::kHeaderSize + packet.PayloadSize();
+    return bytes;
+}
+
+TEST(ControlSendQueueTest, SendsVoiceThenPingsThenTheRest) {
+    ControlSendQueue queue;
+    queue.Push(Text(10, 1));
+    queue.Push(Ping());
+    queue.Push(Voice(0), kStart);
+    queue.Push(Text(10, 2));
+
+    ControlSendQueue::Batch batch;
+    queue.TakeBatch(kStart, batch);
+    ASSERT_EQ(batch.voice.size(), 1u);
+    ASSERT_EQ(batch.control.size(), 3u);
+    EXPECT_EQ(batch.control[0].Type(), ControlPacketType::Ping);
+    EXPECT_EQ(Tag(batch.control[1]), 1);
+    EXPECT_EQ(Tag(batch.control[2]), 2);
+
+    batch.clear();
+    queue.TakeBatch(kStart, batch);
+    EXPECT_TRUE(batch.empty());
+}
+
+TEST(ControlSendQueueTest, DropsTheOldestVoicePastTheCap) {
+    ControlSendQueue queue;
+    for (std::uint64_t seq = 0; seq < 15; seq++) queue.Push(Voice(seq), kStart);
+    EXPECT_EQ(queue.QueuedVoiceFrames(), ControlSendQueue::kMaxVoiceFrames);
+    EXPECT_EQ(queue.DroppedVoiceFrames(), 5u);
+
+    ControlSendQueue::Batch batch;
+    queue.TakeBatch(kStart, batch);
+    ASSERT_EQ(batch.voice.size(), 10u);
+    EXPECT_EQ(batch.voice.front().FrameSequence(), 5u);
+    EXPECT_EQ(batch.voice.back().FrameSequence(), 14u);
+}
+
+TEST(ControlSendQueueTest, DropsVoiceThatWaitedTooLong) {
+    ControlSendQueue queue;
+    queue.Push(Voice(0), kStart);
+    queue.Push(Voice(2), kStart + 20ms);
+    ControlSendQueue::Batch batch;
+    queue.TakeBatch(kStart + 210ms, batch);
+    ASSERT_EQ(batch.voice.size(), 1u);
+    EXPECT_EQ(batch.voice[0].FrameSequence(), 2u);
+    EXPECT_EQ(queue.DroppedVoiceFrames(), 1u);
+}
+
+TEST(ControlSendQueueTest, CoalescesUpToAWriteAtATime) {
+    ControlSendQueue queue;
+    for (std::uint8_t i = 0; i < 100; i++) queue.Push(Text(1000, i));
+    std::uint8_t next{0};
+    ControlSendQueue::Batch batch;
+    while (true) {
+        batch.clear();
+        queue.TakeBatch(kStart, batch);
+        if (batch.empty()) break;
+        EXPECT_LE(BatchBytes(batch), ControlSendQueue::kMaxBatchBytes);
+        // Full up, short of the last
+        if (next + batch.control.size() < 100) {
+            EXPECT_GT(BatchBytes(batch) + 1006, ControlSendQueue::kMaxBatchBytes);
+        }
+        for (const auto& packet : batch.control) EXPECT_EQ(Tag(packet), next++);
+    }
+    EXPECT_EQ(next, 100);
+
+    // Something bigger than a write goes out on its own
+    queue.Push(Text(100 * 1024, 0));
+    queue.Push(Ping());
+    queue.TakeBatch(kStart, batch);
+    EXPECT_EQ(batch.control.size(), 1u);
+    EXPECT_EQ(batch.control[0].Type(), ControlPacketType::Ping);
+    batch.clear();
+    queue.TakeBatch(kStart, batch);
+    EXPECT_EQ(batch.control.size(), 1u);
+    EXPECT_EQ(batch.control[0].PayloadSize(), 100 * 1024);
+}
+
+// A peer that reads the control channel at 1 MB/s, except for a second in
+// the middle when it stops reading altogether, while the encoder keeps
+// sending voice, a ping goes out every second, and 160 KB of other messages
+// turns up all at once. Writes go out as ControlSocket's pump sends them:
+// one at a time, each taking what's queued as it starts.
+struct SlowPeer {
+    static constexpr auto kRun = 5000ms;
+    static constexpr auto kStallStart = 2000ms;
+    static constexpr auto kStallEnd = 3000ms;
+    // Bytes the peer takes per millisecond when it's reading
+    static constexpr std::size_t kRate = 1000;
+
+    std::uint64_t voice_pushed{0};
+    std::uint64_t voice_sent{0};
+    std::uint32_t pings_sent{0};
+    std::uint8_t texts_sent{0};
+    std::uint64_t dropped{0};
+    std::size_t longest_batch{0};
+    std::chrono::milliseconds oldest_voice{0};
+
+    void Run(std::chrono::milliseconds packet_interval) {
+        ControlSendQueue queue;
+        ControlSendQueue::Batch batch;
+        std::chrono::milliseconds write_done{0};
+        for (std::chrono::milliseconds t{0}; t < kRun; t++) {
+            auto now = kStart + t;
+            if (t % packet_interval == 0ms) {
+                // Sequence numbers in Mumble frames count the time it was sent
+                queue.Push(Voice(t / 10ms), now);
+                voice_pushed++;
+                ASSERT_LE(queue.QueuedVoiceFrames(), ControlSendQueue::kMaxVoiceFrames);
+            }
+            if (t % 1000ms == 0ms) queue.Push(Ping());
+            if (t == 1000ms) {
+                for (std::uint8_t i = 0; i < 40; i++) queue.Push(Text(4000, i));
+            }
+            if (t < write_done) continue;
+
+            batch.clear();
+            queue.TakeBatch(now, batch);
+            if (batch.empty()) continue;
+            auto bytes = BatchBytes(batch);
+            if (batch.voice.size() + batch.control.size() > 1) {
+                ASSERT_LE(bytes, ControlSendQueue::kMaxBatchBytes);
+            }
+            longest_batch = std::max(longest_batch, batch.voice.size() + batch.control.size());
+            for (const auto& frame : batch.voice) {
+                auto sent_at = static_cast<std::int64_t>(frame.FrameSequence()) * 10ms;
+                oldest_voice = std::max(oldest_voice, t - sent_at);
+                voice_sent++;
+            }
+            bool past_pings{false};
+            for (const auto& packet : batch.control) {
+                if (packet.Type() == ControlPacketType::Ping) {
+                    EXPECT_FALSE(past_pings);
+                    pings_sent++;
+                } else {
+                    past_pings = true;
+                    EXPECT_EQ(Tag(packet), texts_sent++);
+                }
+            }
+
+            write_done = t + std::chrono::milliseconds{1 + bytes / kRate};
+            if (t < kStallEnd && write_done > kStallStart)
+                write_done += kStallEnd - std::max(t, kStallStart);
+        }
+        dropped = queue.DroppedVoiceFrames();
+    }
+};
+
+// With 20 ms packets, the cap on queued voice is what sheds the stall's
+// backlog; with 60 ms packets, ten frames is longer than voice stays fresh,
+// so it's the age limit. Either way, nothing stale goes out, and the rest
+// of the traffic gets through in order.
+TEST(ControlSendQueueTest, KeepsVoiceFreshBehindASlowPeer) {
+    for (auto interval : {20ms, 60ms}) {
+        SlowPeer peer;
+        peer.Run(interval);
+        EXPECT_LE(peer.oldest_voice, ControlSendQueue::kMaxVoiceDelay) << interval.count();
+        EXPECT_GT(peer.dropped, 0u) << interval.count();
+        // A frame or two may still be queued at the end
+        EXPECT_NEAR(static_cast<double>(peer.voice_sent + peer.dropped),
+                    static_cast<double>(peer.voice_pushed), 1)
+            << interval.count();
+        EXPECT_EQ(peer.pings_sent, 5u) << interval.count();
+        EXPECT_EQ(peer.texts_sent, 40) << interval.count();
+        // What piled up during the stall went out coalesced
+        EXPECT_GT(peer.longest_batch, 10u) << interval.count();
+    }
+}
+
+}  // namespace
@@ -0,0 +1,139 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "AudioParams.h"
+#include "EncoderWorker.h"
+#include "OpusEncoder.h"
+#include "OutgoingVoiceFrame.h"
+
+using winrt::blurt::audio::AudioSetup;
+using winrt::blurt::audio::Channels;
+using winrt::blurt::audio::SampleRate;
+using winrt::blurt::audio::implementation::EncoderWorker;
+using winrt::blurt::audio::implementation::VoiceProfile;
+using winrt::blurt::mumble::implementation::OutgoingVoiceFrame;
+// Not a using-declaration: libopus has its own OpusEncoder
+namespace impl = winrt::blurt::audio::implementation;
+
+namespace {
+
+using namespace std::chrono_literals;
+
+AudioSetup Mono48k() { return AudioSetup{SampleRate::Of48KHz(), Channels::Mono()}; }
+
+// An encoder sending 20 ms packets of everything it's given, and what it's
+// sent so far
+struct Encoded {
+    Encoded() {
+        encoder.VoiceActivation(false);
+        encoder.EncodedAudioReady([this](OutgoingVoiceFrame&& frame) {
+            std::lock_guard lock{mutex};
+            if (frame.FrameSequence() != next_seq) out_of_order = true;
+            next_seq = frame.FrameSequence() + 2;
+            samples +=
+                opus_packet_get_nb_samples(frame.PayloadDest(), frame.PayloadSize(), 48000);
+        });
+    }
+
+    std::int64_t Samples() {
+        std::lock_guard lock{mutex};
+        return samples;
+    }
+
+    // Wait for the worker to get the encoder at least this far
+    bool WaitFor(std::int64_t want) {
+        auto deadline = std::chrono::steady_clock::now() + 10s;
+        while (Samples() < want) {
+            if (std::chrono::steady_clock::now() > deadline) return false;
+            std::this_thread::sleep_for(1ms);
+        }
+        return true;
+    }
+
+    impl::OpusEncoder encoder{Mono48k(), VoiceProfile::Default()};
+    std::mutex mutex;
+    std::uint64_t next_seq{0};
+    bool out_of_order{false};
+    std::int64_t samples{0};
+};
+
+// The capture thread submitting as fast as it can, far faster than any
+// device would, into a queue short enough that some is likely dropped:
+// whatever isn't reaches the encoder once, in order
+TEST(EncoderWorkerTest, HandsAudioFromCaptureToTheEncoderUnderLoad) {
+    Encoded encoded;
+    EncoderWorker worker{encoded.encoder, Mono48k(), 20ms};
+    worker.Start();
+
+    constexpr std::int64_t kSubmits = 20000;
+    std::thread capture{[&worker] {
+        std::vector<float> pcm(480, 0.25f);
+        for (std::int64_t i = 0; i < kSubmits; i++) {
+            worker.Submit(pcm.data(), 480);
+            if (i % 64 == 0) std::this_thread::yield();
+        }
+    }};
+    capture.join();
+
+    auto kept = kSubmits * 480 - static_cast<std::int64_t>(worker.DroppedSamples());
+    // The encoder holds on to any half-filled packet
+    ASSERT_TRUE(encoded.WaitFor(kept - kept % 960));
+    worker.Stop();
+    EXPECT_EQ(encoded.Samples(), kept - kept % 960);
+    EXPECT_EQ(worker.DroppedSamples(), worker.Overflows() * 480);
+    EXPECT_EQ(worker.EncodeErrors(), 0u);
+    EXPECT_EQ(encoded.encoder.DroppedSamples(), 0u);
+    EXPECT_FALSE(encoded.out_of_order);
+}
+
+// Audio that doesn't fit is dropped and counted, never thrown or waited on;
+// what did fit is still there for the worker when it starts
+TEST(EncoderWorkerTest, CountsWhatDoesntFit) {
+    Encoded encoded;
+    EncoderWorker worker{encoded.encoder, Mono48k(), 20ms};
+    std::vector<std::int16_t> pcm(480, 1000);
+    worker.Submit(pcm.data(), 480);
+    worker.Submit(pcm.data(), 480);
+    EXPECT_EQ(worker.Overflows(), 0u);
+
+    EXPECT_NO_THROW(worker.Submit(pcm.data(), 480));
+    EXPECT_NO_THROW(worker.Submit(pcm.data(), 240));
+    EXPECT_EQ(worker.Overflows(), 2u);
+    EXPECT_EQ(worker.DroppedSamples(), 720u);
+
+    worker.Start();
+    ASSERT_TRUE(encoded.WaitFor(960));
+    worker.Stop();
+    EXPECT_EQ(encoded.Samples(), 960);
+    EXPECT_EQ(worker.Overflows(), 2u);
+}
+
+// With a converter in front, the queue holds audio as the device delivers
+// it, so it's sized in the device's samples
+TEST(EncoderWorkerTest, QueuesInTheDevicesFormat) {
+    Encoded encoded;
+    EncoderWorker worker{encoded.encoder, Mono48k(), 100ms};
+    worker.InputFormat(44100, 2);
+    // 100 ms of 44.1 kHz stereo fits, 10 ms at a time; any more doesn't
+    std::vector<float> pcm(2 * 441, 0.5f);
+    for (int i = 0; i < 10; i++) worker.Submit(pcm.data(), 2 * 441);
+    EXPECT_EQ(worker.Overflows(), 0u);
+    worker.Submit(pcm.data(), 2);
+    EXPECT_EQ(worker.Overflows(), 1u);
+
+    // Which is 100 ms once converted, or five packets
+    worker.Start();
+    ASSERT_TRUE(encoded.WaitFor(5 * 960));
+    worker.Stop();
+    EXPECT_EQ(encoded.Samples(), 5 * 960);
+    EXPECT_FALSE(encoded.out_of_order);
+}
+
+}  // namespace
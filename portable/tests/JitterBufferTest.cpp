@@ -0,0 +1,188 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "ByteChunk.h"
+#include "JitterBuffer.h"
+
+using winrt::blurt::ByteChunk;
+using winrt::blurt::ByteSlice;
+using winrt::blurt::audio::implementation::JitterBuffer;
+
+namespace {
+
+using namespace std::chrono_literals;
+
+const JitterBuffer::Clock::time_point kStart{std::chrono::seconds{1000}};
+
+ByteSlice Payload(std::uint8_t tag) {
+    return ByteSlice::Of(ByteChunk{std::vector<std::uint8_t>{0x90, tag}});
+}
+
+// A frame from a sender whose clock started with ours, arriving `late` after
+// it was sent
+JitterBuffer::PutResult PutFrame(JitterBuffer& jitter, std::uint64_t seq,
+                                 JitterBuffer::Clock::duration late = 0ms,
+                                 bool is_terminator = false) {
+    return jitter.Put(seq, 1, is_terminator, Payload(static_cast<std::uint8_t>(seq)),
+                      kStart + seq * 10ms + late);
+}
+
+struct Popped {
+    std::uint64_t seq;
+    std::uint32_t duration;
+    bool is_gap;
+
+    bool operator==(const Popped& other) const {
+        return seq == other.seq && duration == other.duration && is_gap == other.is_gap;
+    }
+};
+
+std::vector<Popped> PopAll(JitterBuffer& jitter, JitterBuffer::Clock::time_point now) {
+    std::vector<Popped> out;
+    while (auto frame = jitter.Pop(now)) {
+        if (!frame->IsGap()) {
+            EXPECT_EQ((*frame->Payload())[1], frame->Sequence() & 0xff);
+        }
+        out.push_back({frame->Sequence(), frame->Duration(), frame->IsGap()});
+    }
+    return out;
+}
+
+TEST(JitterBufferTest, HoldsTheStartOfASpurtUntilThereIsACushion) {
+    JitterBuffer jitter;
+    PutFrame(jitter, 0);
+    EXPECT_TRUE(PopAll(jitter, kStart).empty());
+    PutFrame(jitter, 1);
+    EXPECT_EQ(PopAll(jitter, kStart + 10ms),
+              (std::vector<Popped>{{0, 1, false}, {1, 1, false}}));
+}
+
+TEST(JitterBufferTest, PutsReorderedFramesBackInOrder) {
+    JitterBuffer jitter;
+    for (std::uint64_t seq : {1, 0, 3, 2}) PutFrame(jitter, seq);
+    EXPECT_EQ(PopAll(jitter, kStart + 30ms),
+              (std::vector<Popped>{{0, 1, false}, {1, 1, false}, {2, 1, false}, {3, 1, false}}));
+}
+
+TEST(JitterBufferTest, RefusesDuplicates) {
+    JitterBuffer jitter;
+    EXPECT_EQ(PutFrame(jitter, 0), JitterBuffer::PutResult::Accepted);
+    EXPECT_EQ(PutFrame(jitter, 0), JitterBuffer::PutResult::Duplicate);
+    EXPECT_EQ(jitter.DuplicateCount(), 1u);
+}
+
+// Frames that never arrive don't hold up those behind them, even if nothing
+// more arrives to prompt the buffer
+TEST(JitterBufferTest, GivesUpOnAMissingFrameInTime) {
+    JitterBuffer jitter;
+    PutFrame(jitter, 0);
+    PutFrame(jitter, 1);
+    PutFrame(jitter, 3);
+    EXPECT_EQ(PopAll(jitter, kStart + 30ms), (std::vector<Popped>{{0, 1, false}, {1, 1, false}}));
+
+    // Frame 2 might still turn up
+    EXPECT_TRUE(PopAll(jitter, kStart + 35ms).empty());
+    EXPECT_EQ(PopAll(jitter, kStart + 50ms), (std::vector<Popped>{{2, 1, true}, {3, 1, false}}));
+    EXPECT_EQ(jitter.GapCount(), 1u);
+
+    // Too late now
+    EXPECT_EQ(PutFrame(jitter, 2, 40ms), JitterBuffer::PutResult::Late);
+    EXPECT_EQ(jitter.LateCount(), 1u);
+    EXPECT_TRUE(PopAll(jitter, kStart + 60ms).empty());
+}
+
+// A spurt shorter than the cushion with its terminator lost still plays out
+// in full, just from being asked later on
+TEST(JitterBufferTest, PlaysOutALoneShortSpurtWithNoTerminator) {
+    JitterBuffer jitter;
+    PutFrame(jitter, 0);
+    EXPECT_TRUE(PopAll(jitter, kStart).empty());
+    EXPECT_TRUE(PopAll(jitter, kStart + 5ms).empty());
+    EXPECT_EQ(PopAll(jitter, kStart + 20ms), (std::vector<Popped>{{0, 1, false}}));
+    EXPECT_TRUE(PopAll(jitter, kStart + 1s).empty());
+}
+
+TEST(JitterBufferTest, TerminatorEndsTheSpurtRightAway) {
+    JitterBuffer jitter;
+    PutFrame(jitter, 0, 0ms, true);
+    EXPECT_EQ(PopAll(jitter, kStart), (std::vector<Popped>{{0, 1, false}}));
+
+    // The next spurt gets its own cushion
+    PutFrame(jitter, 50);
+    EXPECT_TRUE(PopAll(jitter, kStart + 500ms).empty());
+    EXPECT_EQ(PopAll(jitter, kStart + 520ms), (std::vector<Popped>{{50, 1, false}}));
+}
+
+// A jump too long to be loss means the sender paused; playout picks up where
+// it resumed rather than concealing the pause
+TEST(JitterBufferTest, SkipsAPauseWithoutConcealingIt) {
+    JitterBuffer jitter;
+    PutFrame(jitter, 0);
+    PutFrame(jitter, 1);
+    EXPECT_EQ(PopAll(jitter, kStart + 10ms).size(), 2u);
+    PutFrame(jitter, 500);
+    EXPECT_EQ(PopAll(jitter, kStart + 5020ms), (std::vector<Popped>{{500, 1, false}}));
+    EXPECT_EQ(jitter.GapCount(), 0u);
+}
+
+TEST(JitterBufferTest, StartsOverWhenTheSenderResetsItsCounter) {
+    JitterBuffer jitter;
+    for (std::uint64_t seq = 5000; seq < 5003; seq++) PutFrame(jitter, seq);
+    EXPECT_EQ(PopAll(jitter, kStart + 51s).size(), 3u);
+
+    jitter.Put(0, 1, false, Payload(0), kStart + 52s);
+    jitter.Put(1, 1, false, Payload(1), kStart + 52s);
+    EXPECT_EQ(PopAll(jitter, kStart + 52s), (std::vector<Popped>{{0, 1, false}, {1, 1, false}}));
+    EXPECT_EQ(jitter.LateCount(), 0u);
+}
+
+// Frames held fit in a fixed window of sequence numbers; one too far ahead
+// pushes out what it can't fit alongside, and one too far behind is late
+TEST(JitterBufferTest, KeepsHeldFramesWithinItsWindow) {
+    JitterBuffer jitter;
+    PutFrame(jitter, 0);
+    PutFrame(jitter, 1);
+    EXPECT_EQ(PutFrame(jitter, 200), JitterBuffer::PutResult::Accepted);
+    EXPECT_EQ(jitter.LateCount(), 2u);
+    EXPECT_EQ(PutFrame(jitter, 1), JitterBuffer::PutResult::Late);
+    EXPECT_EQ(PutFrame(jitter, 199), JitterBuffer::PutResult::Accepted);
+    EXPECT_EQ(PopAll(jitter, kStart + 2s),
+              (std::vector<Popped>{{199, 1, false}, {200, 1, false}}));
+}
+
+TEST(JitterBufferTest, DeepensWithJitterWithinBounds) {
+    JitterBuffer jitter{2, 10};
+    EXPECT_EQ(jitter.TargetDepth(), 2u);
+    for (std::uint64_t seq = 0; seq < 200; seq++) PutFrame(jitter, seq, (seq % 2) * 40ms);
+    EXPECT_GT(jitter.TargetDepth(), 2u);
+    EXPECT_LE(jitter.TargetDepth(), 10u);
+}
+
+TEST(JitterBufferTest, DeepensForWhatTheNetworkHintsAt) {
+    JitterBuffer jitter{2, 20};
+    PutFrame(jitter, 0);
+    EXPECT_EQ(jitter.TargetDepth(), 2u);
+
+    // Three deviations of headroom on a frame's worth of link jitter
+    jitter.NetworkHint(10ms, false);
+    PutFrame(jitter, 1);
+    EXPECT_EQ(jitter.TargetDepth(), 4u);
+
+    // A lossy speaker gets one frame more
+    jitter.NetworkHint(10ms, true);
+    PutFrame(jitter, 2);
+    EXPECT_EQ(jitter.TargetDepth(), 5u);
+
+    // The link's jitter doesn't hide the speaker's own, when that's worse
+    JitterBuffer bumpy{2, 20};
+    bumpy.NetworkHint(1ms, false);
+    for (std::uint64_t seq = 0; seq < 200; seq++) PutFrame(bumpy, seq, (seq % 2) * 40ms);
+    EXPECT_GT(bumpy.TargetDepth(), 4u);
+}
+
+}  // namespace
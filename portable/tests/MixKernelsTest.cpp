@@ -0,0 +1,71 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "MixKernels.h"
+
+using winrt::blurt::audio::implementation::SoftClip;
+
+namespace {
+
+// Levels from -2 to 2, an odd number of them so that some go through each
+// kernel's vector loop and some through its scalar tail
+std::vector<float> Sweep() {
+    std::vector<float> levels;
+    for (std::int32_t i = -200; i <= 200; i++) levels.push_back(i / 100.0f);
+    return levels;
+}
+
+std::vector<float> Clipped(std::vector<float> levels) {
+    SoftClip(levels.data(), static_cast<std::int32_t>(levels.size()));
+    return levels;
+}
+
+TEST(MixKernelsTest, SoftClipLeavesSpeechLevelsAlone) {
+    auto levels = Sweep();
+    auto clipped = Clipped(levels);
+    for (std::size_t i = 0; i < levels.size(); i++) {
+        if (std::abs(levels[i]) <= 0.8f) {
+            ASSERT_EQ(clipped[i], levels[i]) << levels[i];
+        }
+    }
+}
+
+TEST(MixKernelsTest, SoftClipStaysWithinFullScale) {
+    auto clipped = Clipped(Sweep());
+    for (float x : clipped) {
+        ASSERT_LE(x, 1.0f);
+        ASSERT_GE(x, -1.0f);
+    }
+    EXPECT_EQ(Clipped({1.4f, -1.4f, 50.0f}), (std::vector<float>{1.0f, -1.0f, 1.0f}));
+}
+
+// No steps, no kinks and no folding back: the curve rises steadily, with
+// nothing like a jump in slope at the knee
+TEST(MixKernelsTest, SoftClipBendsSmoothly) {
+    std::vector<float> levels;
+    for (std::int32_t i = 0; i <= 1500; i++) levels.push_back(i / 1000.0f);
+    auto clipped = Clipped(levels);
+    for (std::size_t i = 1; i < levels.size(); i++) {
+        ASSERT_GE(clipped[i], clipped[i - 1]) << levels[i];
+        float slope = (clipped[i] - clipped[i - 1]) * 1000;
+        ASSERT_LE(slope, 1.001f) << levels[i];
+    }
+    auto just_past = Clipped({0.801f, 0.9f});
+    EXPECT_NEAR(just_past[0], 0.801f, 1e-5f);
+    EXPECT_GT(just_past[1], 0.85f);
+    EXPECT_LT(just_past[1], 0.9f);
+}
+
+TEST(MixKernelsTest, SoftClipIsSymmetric) {
+    auto levels = Sweep();
+    auto clipped = Clipped(levels);
+    for (std::size_t i = 0; i < levels.size(); i++) {
+        ASSERT_FLOAT_EQ(clipped[i], -clipped[levels.size() - 1 - i]) << levels[i];
+    }
+}
+
+}  // namespace
@@ -0,0 +1,89 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <vector>
+#include "AudioParams.h"
+#include "ByteChunk.h"
+#include "OpusDecoder.h"
+
+// Like AudioMixerTest, these use the fake libopus unless the real one was
+// found, so a packet decodes to a level set by its second byte
+
+using winrt::blurt::ByteChunk;
+using winrt::blurt::ByteSlice;
+using winrt::blurt::audio::AudioSetup;
+using winrt::blurt::audio::Channels;
+using winrt::blurt::audio::SampleRate;
+// Not a using-declaration: libopus has its own OpusDecoder
+namespace impl = winrt::blurt::audio::implementation;
+
+namespace {
+
+constexpr std::int32_t kFramesPer10Ms = 480;
+
+AudioSetup Stereo48k() { return AudioSetup{SampleRate::Of48KHz(), Channels::Stereo()}; }
+
+ByteSlice Packet(std::vector<std::uint8_t> bytes) {
+    return ByteSlice::Of(ByteChunk{std::move(bytes)});
+}
+
+// 10 ms of CELT audio, which the fake decodes to a level of 0.5
+ByteSlice TenMs() { return Packet({0x90, 192}); }
+
+// The longest packet Opus allows: code 3, six 20 ms CELT frames, 120 ms in
+// all; the fake decodes it to 6/128 - 1
+ByteSlice OneTwentyMs() { return Packet({0xfb, 6, 0, 0, 0, 0, 0, 0}); }
+
+// Decode and throw away enough 10 ms packets to leave the decoder's free
+// space wrapping around the end of its buffer a little way ahead
+void MoveNearTheEnd(impl::OpusDecoder& decoder) {
+    // The buffer holds 480 ms; leave 30 ms before the end
+    for (int i = 0; i < 45; i++) ASSERT_EQ(decoder.DecodeToBuffer(TenMs()), kFramesPer10Ms);
+    decoder.ReleaseAudio(decoder.BufferedSamples());
+}
+
+std::vector<float> TakeAll(impl::OpusDecoder& decoder) {
+    auto n = decoder.BufferedSamples();
+    auto audio = decoder.PeekAudio(n);
+    std::vector<float> samples(audio.first.data, audio.first.data + audio.first.size);
+    samples.insert(samples.end(), audio.second.data, audio.second.data + audio.second.size);
+    decoder.ReleaseAudio(n);
+    return samples;
+}
+
+TEST(OpusDecoderTest, DecodesTheLongestPacketAcrossTheWrap) {
+    impl::OpusDecoder decoder{Stereo48k()};
+    MoveNearTheEnd(decoder);
+    ASSERT_EQ(decoder.DecodeToBuffer(OneTwentyMs()), 12 * kFramesPer10Ms);
+    auto samples = TakeAll(decoder);
+    ASSERT_EQ(samples.size(), 2u * 12 * kFramesPer10Ms);
+    for (std::size_t i = 0; i < samples.size(); i++) {
+        ASSERT_EQ(samples[i], 6 / 128.0f - 1) << "sample " << i;
+    }
+}
+
+TEST(OpusDecoderTest, RecoversTheLongestPacketAcrossTheWrap) {
+    impl::OpusDecoder decoder{Stereo48k()};
+    MoveNearTheEnd(decoder);
+    // Asking for more than a packet only gets a packet
+    EXPECT_EQ(decoder.RecoverToBuffer(OneTwentyMs(), 20 * kFramesPer10Ms), 12 * kFramesPer10Ms);
+    EXPECT_EQ(decoder.BufferedSamples(), 2 * 12 * kFramesPer10Ms);
+}
+
+TEST(OpusDecoderTest, ConcealsLongGapsAcrossTheWrap) {
+    impl::OpusDecoder decoder{Stereo48k()};
+    MoveNearTheEnd(decoder);
+    EXPECT_EQ(decoder.ConcealToBuffer(30 * kFramesPer10Ms), 30 * kFramesPer10Ms);
+    EXPECT_EQ(decoder.ConcealedSamples(), 30u * kFramesPer10Ms);
+}
+
+TEST(OpusDecoderTest, RefusesPacketsLongerThanOpusAllows) {
+    impl::OpusDecoder decoder{Stereo48k()};
+    // Seven 20 ms frames
+    EXPECT_THROW(decoder.DecodeToBuffer(Packet({0xfb, 7, 0, 0, 0, 0, 0, 0, 0})), std::exception);
+    EXPECT_EQ(decoder.BufferedSamples(), 0);
+}
+
+}  // namespace
@@ -0,0 +1,150 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "AudioParams.h"
+#include "OpusEncoder.h"
+#include "OutgoingVoiceFrame.h"
+
+// Unlike the decoding tests, these hold with the real libopus as well as the
+// fake: they only compare what the encoder makes one way against what it
+// makes another
+
+using winrt::blurt::audio::AudioSetup;
+using winrt::blurt::audio::Channels;
+using winrt::blurt::audio::SampleRate;
+using winrt::blurt::audio::implementation::VoiceProfile;
+using winrt::blurt::mumble::implementation::OutgoingVoiceFrame;
+// Not a using-declaration: libopus has its own OpusEncoder
+namespace impl = winrt::blurt::audio::implementation;
+
+namespace {
+
+AudioSetup Mono48k() { return AudioSetup{SampleRate::Of48KHz(), Channels::Mono()}; }
+
+struct Sent {
+    std::vector<std::uint8_t> payload;
+    std::uint64_t seq;
+    bool is_terminator;
+};
+
+// 1.2 s, a whole number of packets in every profile, of something
+// voice-like: a couple of tones, swelling and fading
+std::vector<float> Speech() {
+    std::vector<float> pcm(57600);
+    for (std::size_t i = 0; i < pcm.size(); i++) {
+        double t = i / 48000.0;
+        double envelope = 0.3 * (1 - std::cos(2 * 3.14159265 * 3 * t));
+        pcm[i] = static_cast<float>(envelope * (std::sin(2 * 3.14159265 * 180 * t) +
+                                                0.5 * std::sin(2 * 3.14159265 * 720 * t)));
+    }
+    return pcm;
+}
+
+// Everything an encoder with the given profile sends for that audio, fed
+// in 10 ms at a time as the capture graph would
+std::vector<Sent> Encode(VoiceProfile profile) {
+    impl::OpusEncoder encoder{Mono48k(), profile};
+    encoder.VoiceActivation(false);
+    // Encoding time mustn't change the complexity from one run to another
+    encoder.CpuBudget(1.0);
+    std::vector<Sent> sent;
+    encoder.EncodedAudioReady([&sent](OutgoingVoiceFrame&& frame) {
+        sent.push_back({std::vector<std::uint8_t>(frame.PayloadDest(),
+                                                  frame.PayloadDest() + frame.PayloadSize()),
+                        frame.FrameSequence(), frame.IsTerminator()});
+    });
+    auto pcm = Speech();
+    for (std::size_t i = 0; i < pcm.size(); i += 480) encoder.BufferRawAudio(&pcm[i], 480);
+    return sent;
+}
+
+std::int32_t DurationOf(const std::vector<std::uint8_t>& packet) {
+    return opus_packet_get_nb_samples(packet.data(), static_cast<opus_int32>(packet.size()),
+                                      48000);
+}
+
+TEST(OpusEncoderTest, CutsPacketsToEachProfile) {
+    for (auto profile : {VoiceProfile::LowDelay(), VoiceProfile::Default(),
+                         VoiceProfile::SaveBandwidth40ms(), VoiceProfile::SaveBandwidth60ms()}) {
+        auto per_packet =
+            static_cast<std::uint64_t>(profile.PacketDuration() / std::chrono::milliseconds{10});
+        auto sent = Encode(profile);
+        ASSERT_EQ(sent.size(), 120 / per_packet) << profile.PacketDuration().count() << " ms";
+        for (std::size_t i = 0; i < sent.size(); i++) {
+            EXPECT_EQ(DurationOf(sent[i].payload), 480 * static_cast<std::int32_t>(per_packet));
+            EXPECT_EQ(sent[i].seq, i * per_packet);
+            EXPECT_FALSE(sent[i].is_terminator);
+        }
+    }
+}
+
+// Packing three 20 ms frames into each packet changes nothing about the
+// frames: split back apart, they're the very packets the one-frame profile
+// sends, and joined up again, they're the packet they came from
+TEST(OpusEncoderTest, RepacketizedFramesRoundTrip) {
+    auto singles = Encode(VoiceProfile::Default());
+    auto packed = Encode(VoiceProfile::SaveBandwidth60ms());
+    ASSERT_EQ(singles.size(), 3 * packed.size());
+
+    OpusRepacketizer* rp = opus_repacketizer_create();
+    std::vector<std::uint8_t> out(4000);
+    for (std::size_t i = 0; i < packed.size(); i++) {
+        const auto& packet = packed[i].payload;
+        opus_repacketizer_init(rp);
+        ASSERT_EQ(opus_repacketizer_cat(rp, packet.data(), static_cast<opus_int32>(packet.size())),
+                  OPUS_OK);
+        ASSERT_EQ(opus_repacketizer_get_nb_frames(rp), 3);
+        for (int f = 0; f < 3; f++) {
+            auto n = opus_repacketizer_out_range(rp, f, f + 1, out.data(),
+                                                 static_cast<opus_int32>(out.size()));
+            ASSERT_GT(n, 0);
+            EXPECT_EQ(std::vector<std::uint8_t>(out.begin(), out.begin() + n),
+                      singles[3 * i + f].payload)
+                << "packet " << i << ", frame " << f;
+            EXPECT_EQ(singles[3 * i + f].seq, packed[i].seq + 2 * f);
+        }
+
+        opus_repacketizer_init(rp);
+        for (int f = 0; f < 3; f++) {
+            const auto& single = singles[3 * i + f].payload;
+            ASSERT_EQ(
+                opus_repacketizer_cat(rp, single.data(), static_cast<opus_int32>(single.size())),
+                OPUS_OK);
+        }
+        auto n = opus_repacketizer_out(rp, out.data(), static_cast<opus_int32>(out.size()));
+        EXPECT_EQ(std::vector<std::uint8_t>(out.begin(), out.begin() + n), packet);
+    }
+    opus_repacketizer_destroy(rp);
+}
+
+// A switch waits for the packet being collected to go out whole
+TEST(OpusEncoderTest, SwitchesProfileBetweenPackets) {
+    impl::OpusEncoder encoder{Mono48k(), VoiceProfile::SaveBandwidth60ms()};
+    encoder.VoiceActivation(false);
+    std::vector<Sent> sent;
+    encoder.EncodedAudioReady([&sent](OutgoingVoiceFrame&& frame) {
+        sent.push_back({std::vector<std::uint8_t>(frame.PayloadDest(),
+                                                  frame.PayloadDest() + frame.PayloadSize()),
+                        frame.FrameSequence(), frame.IsTerminator()});
+    });
+    auto pcm = Speech();
+    // 40 ms in: two of the packet's three frames are waiting
+    for (std::size_t i = 0; i < 4 * 480; i += 480) encoder.BufferRawAudio(&pcm[i], 480);
+    EXPECT_TRUE(sent.empty());
+    encoder.Profile(VoiceProfile::LowDelay());
+    for (std::size_t i = 4 * 480; i < 10 * 480; i += 480) encoder.BufferRawAudio(&pcm[i], 480);
+
+    ASSERT_EQ(sent.size(), 5u);
+    EXPECT_EQ(DurationOf(sent[0].payload), 3 * 960);
+    for (std::size_t i = 1; i < sent.size(); i++) {
+        EXPECT_EQ(DurationOf(sent[i].payload), 480);
+        EXPECT_EQ(sent[i].seq, 5 + i);
+    }
+}
+
+}  // namespace
@@ -0,0 +1,91 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include "AudioPacket.h"
+#include "ByteChunk.h"
+#include "ControlPacket.h"
+#include "OutgoingVoiceFrame.h"
+
+using winrt::blurt::ByteChunk;
+using winrt::blurt::ByteSlice;
+using winrt::blurt::mumble::implementation::AudioPacket;
+using winrt::blurt::mumble::implementation::AudioPacketType;
+using winrt::blurt::mumble::implementation::ControlPacketType;
+using winrt::blurt::mumble::implementation::OutgoingVoiceFrame;
+
+namespace {
+
+std::vector<std::uint8_t> Payload(std::int32_t size) {
+    std::vector<std::uint8_t> payload(size);
+    for (std::int32_t i = 0; i < size; i++) payload[i] = static_cast<std::uint8_t>(i * 7 + 3);
+    return payload;
+}
+
+OutgoingVoiceFrame Frame(const std::vector<std::uint8_t>& payload, std::uint64_t seq,
+                         bool is_terminator, std::uint32_t target) {
+    OutgoingVoiceFrame frame{static_cast<std::int32_t>(payload.size())};
+    if (!payload.empty()) std::memcpy(frame.PayloadDest(), payload.data(), payload.size());
+    frame.PayloadSize(static_cast<std::int32_t>(payload.size()));
+    frame.FrameSequence(seq);
+    frame.IsTerminator(is_terminator);
+    frame.Finish(target);
+    return frame;
+}
+
+// Laying out the headers in place, in front of the payload, makes the very
+// bytes the copying encoder does, for every length of varint and payload
+TEST(OutgoingVoiceFrameTest, MatchesEncodeOutgoingByteForByte) {
+    const std::uint64_t seqs[] = {0,        1,          127,
+                                  128,      0x3fff,     0x4000,
+                                  0x1fffff, 1ull << 40, std::numeric_limits<std::uint64_t>::max()};
+    for (std::int32_t size : {0, 1, 80, 127, 128, 1275, OutgoingVoiceFrame::kMaxPayloadSize}) {
+        auto payload = Payload(size);
+        for (auto seq : seqs) {
+            for (bool is_terminator : {false, true}) {
+                for (std::uint32_t target : {0u, 1u, 31u}) {
+                    auto frame = Frame(payload, seq, is_terminator, target);
+                    auto copy = ByteSlice::Of(ByteChunk{std::vector<std::uint8_t>{payload}});
+                    AudioPacket packet{AudioPacketType::Opus, target, seq, 0, is_terminator,
+                                       false, copy};
+                    auto expected = packet.EncodeOutgoing();
+                    const std::uint8_t* datagram = frame.DatagramData();
+                    ASSERT_EQ(std::vector<std::uint8_t>(datagram, datagram + frame.DatagramSize()),
+                              std::vector<std::uint8_t>(expected.begin(), expected.end()))
+                        << "payload " << size << ", seq " << seq << ", terminator "
+                        << is_terminator << ", target " << target;
+                }
+            }
+        }
+    }
+}
+
+TEST(OutgoingVoiceFrameTest, PutsTheControlHeaderInFront) {
+    auto frame = Frame(Payload(80), 1000, false, 0);
+    ASSERT_EQ(frame.WireSize(), frame.DatagramSize() + 6);
+    auto type = static_cast<std::uint16_t>(ControlPacketType::UDPTunnel);
+    auto length = static_cast<std::uint32_t>(frame.DatagramSize());
+    const std::uint8_t* p = frame.WireData();
+    EXPECT_EQ(std::vector<std::uint8_t>(p, p + 6),
+              (std::vector<std::uint8_t>{static_cast<std::uint8_t>(type >> 8),
+                                         static_cast<std::uint8_t>(type), 0, 0,
+                                         static_cast<std::uint8_t>(length >> 8),
+                                         static_cast<std::uint8_t>(length)}));
+    EXPECT_EQ(frame.DatagramData(), p + 6);
+}
+
+TEST(OutgoingVoiceFrameTest, RefusesPayloadsThatDontFit) {
+    EXPECT_THROW(OutgoingVoiceFrame{OutgoingVoiceFrame::kMaxPayloadSize + 1}, std::out_of_range);
+    EXPECT_THROW(OutgoingVoiceFrame{-1}, std::out_of_range);
+    OutgoingVoiceFrame frame{100};
+    EXPECT_THROW(frame.PayloadSize(101), std::out_of_range);
+    EXPECT_THROW(frame.PayloadSize(-1), std::out_of_range);
+    EXPECT_NO_THROW(frame.PayloadSize(100));
+}
+
+}  // namespace
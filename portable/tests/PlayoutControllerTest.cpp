@@ -0,0 +1,140 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include "PlayoutController.h"
+
+using winrt::blurt::audio::implementation::PlayoutController;
+
+namespace {
+
+constexpr std::int32_t kRate = 48000;
+
+// Everything a plan reads or consumes is buffered, and the last position it
+// interpolates at has its following frame inside read_frames
+void ExpectPlanStaysInside(const PlayoutController::Plan& plan, std::int32_t buffered) {
+    buffered -= plan.drop_frames;
+    ASSERT_GE(plan.read_frames, plan.consumed_frames);
+    ASSERT_LE(plan.read_frames, buffered);
+    if (plan.output_frames == 0 || plan.IsExact()) return;
+    ASSERT_GE(plan.start, 0);
+    ASSERT_LT(plan.start, 1);
+    double last = plan.start + (plan.output_frames - 1) * plan.step;
+    auto index = static_cast<std::int32_t>(std::floor(last));
+    ASSERT_LT(index + 1, plan.read_frames)
+        << "start " << plan.start << " step " << plan.step << " frames " << plan.output_frames;
+}
+
+// Walk the speed through everything just under and just over normal, from
+// every fractional position the controller drifts through, with the buffer
+// as close to empty as it ever gets
+void WalkSpeed(std::int32_t low, std::int32_t high, std::int32_t min_target,
+               std::int32_t max_target, bool slow) {
+    std::mt19937 rng{slow ? 7u : 8u};
+    const std::int32_t sizes[] = {1, 2, 3, 7, 64, 441, 480, 512};
+    PlayoutController controller{kRate};
+    std::int32_t buffered = (low + high) / 2;
+    int stretched{0}, wanted_way{0};
+    for (int i = 0; i < 200000; i++) {
+        auto wanted = sizes[rng() % std::size(sizes)];
+        auto target = min_target + static_cast<std::int32_t>(rng() % (max_target - min_target + 1));
+        auto plan = controller.Next(buffered, wanted, target);
+        ExpectPlanStaysInside(plan, buffered);
+        if (::testing::Test::HasFatalFailure()) return;
+        if (plan.output_frames > 0 && !plan.IsExact()) {
+            ASSERT_GE(plan.step, 0.99);
+            ASSERT_LE(plan.step, 1.01);
+            stretched++;
+            if (slow ? plan.step < 1 : plan.step > 1) wanted_way++;
+        }
+        buffered -= plan.drop_frames + plan.consumed_frames;
+        // Top up to somewhere in [low, high], sometimes leaving exactly what
+        // the next read would need
+        if (buffered < low) buffered = low + static_cast<std::int32_t>(rng() % (high - low + 1));
+    }
+    // The smoothed fill wanders, but mostly the speed goes the way asked
+    EXPECT_GT(wanted_way, stretched * 9 / 10);
+}
+
+TEST(PlayoutControllerTest, SlowPlayoutNeverReadsPastTheBuffer) {
+    // Under target, so the controller plays slow, by varying amounts
+    WalkSpeed(1, 600, 400, 900, true);
+}
+
+TEST(PlayoutControllerTest, FastPlayoutNeverReadsPastTheBuffer) {
+    // Over target but not by enough to drop, so the controller plays fast
+    WalkSpeed(1, 4000, 300, 700, false);
+}
+
+TEST(PlayoutControllerTest, ExactPlanWhenTooLittleToInterpolate) {
+    PlayoutController controller{kRate};
+    // Over target, so it wants to play fast, but only just enough is
+    // buffered for the output
+    auto plan = controller.Next(480, 480, 100);
+    EXPECT_TRUE(plan.IsExact());
+    EXPECT_EQ(plan.output_frames, 480);
+    EXPECT_EQ(plan.consumed_frames, 480);
+    EXPECT_EQ(plan.read_frames, 480);
+
+    plan = controller.Next(100, 480, 100);
+    EXPECT_EQ(plan.output_frames, 100);
+    EXPECT_EQ(plan.read_frames, 100);
+}
+
+TEST(PlayoutControllerTest, DropsExcessFarOverTarget) {
+    PlayoutController controller{kRate};
+    // 200 ms over a 50 ms target is well past the 100 ms allowed
+    auto plan = controller.Next(12000, 480, 2400);
+    EXPECT_EQ(plan.drop_frames, 9600);
+    EXPECT_LE(plan.read_frames, 2400);
+    // Dropping resets the smoothed fill, so no more is dropped right away
+    plan = controller.Next(2400 - plan.consumed_frames + 480, 480, 2400);
+    EXPECT_EQ(plan.drop_frames, 0);
+}
+
+TEST(PlayoutControllerTest, EmptyBufferStartsAfresh) {
+    PlayoutController controller{kRate};
+    for (int i = 0; i < 100; i++) controller.Next(4800, 480, 2400);
+    EXPECT_GT(controller.SpeedAdjustment(), 0);
+    EXPECT_GT(controller.Delay().count(), 0);
+
+    auto plan = controller.Next(0, 480, 2400);
+    EXPECT_EQ(plan.output_frames, 0);
+    EXPECT_EQ(plan.read_frames, 0);
+    EXPECT_EQ(controller.SpeedAdjustment(), 0);
+    EXPECT_EQ(controller.Delay().count(), 0);
+
+    // The next spurt starts from the very first frame
+    plan = controller.Next(2400, 480, 2400);
+    EXPECT_TRUE(plan.IsExact());
+}
+
+// With the sender's clock 500 ppm fast, the buffer settles a little over
+// target rather than creeping up until audio is dropped
+TEST(PlayoutControllerTest, AbsorbsClockSkew) {
+    PlayoutController controller{kRate};
+    const std::int32_t target = 2400;
+    double arriving = 0;
+    std::int32_t buffered = target;
+    std::int32_t dropped = 0;
+    // Ten minutes of 10 ms quanta
+    for (int i = 0; i < 60000; i++) {
+        auto plan = controller.Next(buffered, 480, target);
+        ExpectPlanStaysInside(plan, buffered);
+        if (HasFatalFailure()) return;
+        dropped += plan.drop_frames;
+        buffered -= plan.drop_frames + plan.consumed_frames;
+        arriving += 480 * 1.0005;
+        auto whole = static_cast<std::int32_t>(arriving);
+        buffered += whole;
+        arriving -= whole;
+    }
+    EXPECT_EQ(dropped, 0);
+    EXPECT_GT(controller.SpeedAdjustment(), 0);
+    EXPECT_LT(controller.Delay(), std::chrono::milliseconds{70});
+}
+
+}  // namespace
@@ -0,0 +1,123 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "AudioMixer.h"
+#include "AudioParams.h"
+#include "ByteChunk.h"
+#include "ReceiveLossWindow.h"
+#ifdef BLURT_HAVE_PROTOBUF
+#include "OpusEncoder.h"
+#endif
+
+using winrt::blurt::ByteChunk;
+using winrt::blurt::ByteSlice;
+using winrt::blurt::audio::AudioSetup;
+using winrt::blurt::audio::Channels;
+using winrt::blurt::audio::SampleRate;
+using winrt::blurt::audio::implementation::AudioMixer;
+using winrt::blurt::audio::implementation::JitterBuffer;
+using winrt::blurt::audio::implementation::ReceiveLossWindow;
+
+namespace {
+
+using namespace std::chrono_literals;
+
+TEST(ReceiveLossWindowTest, WaitsForAWholeWindow) {
+    ReceiveLossWindow window;
+    EXPECT_FALSE(window.OnDecoded(400, 0));
+    EXPECT_FALSE(window.OnDecoded(90, 9));
+    EXPECT_EQ(window.OnDecoded(1, 0), 2);
+    // And starts over
+    EXPECT_FALSE(window.OnDecoded(499, 0));
+    EXPECT_EQ(window.OnDecoded(1, 0), 0);
+}
+
+TEST(ReceiveLossWindowTest, RoundsUpSoAnyLossCounts) {
+    ReceiveLossWindow window;
+    EXPECT_EQ(window.OnDecoded(999, 1), 1);
+}
+
+// Loss the next packet's error correction covered for never reaches the
+// decoder's counts; the connection's count catches it
+TEST(ReceiveLossWindowTest, GoesByTheNetworkWhenThatsWorse) {
+    ReceiveLossWindow window;
+    // The first window goes back to the start of the connection
+    window.NetworkCounts(100, 50);
+    EXPECT_EQ(window.OnDecoded(500, 0), 34);
+    window.NetworkCounts(190, 60);
+    EXPECT_EQ(window.OnDecoded(500, 5), 10);
+    // Only what the network lost during the window counts
+    window.NetworkCounts(290, 60);
+    EXPECT_EQ(window.OnDecoded(500, 0), 0);
+}
+
+AudioSetup Stereo48k() { return AudioSetup{SampleRate::Of48KHz(), Channels::Stereo()}; }
+
+// 10 ms of CELT audio, which the fake decodes to a level of 0.5
+ByteSlice Packet() { return ByteSlice::Of(ByteChunk{std::vector<std::uint8_t>{0x90, 192}}); }
+
+// A speaker sending the given number of 10 ms packets, of which every
+// lose_every'th never arrives, played out as the app would: a packet
+// decoding what's due as it arrives, a tick halfway between, and the
+// output taking what's decoded. Returns each window's loss percentage.
+std::vector<std::int32_t> Receive(std::uint64_t packets, std::uint64_t lose_every,
+                                  ReceiveLossWindow& window) {
+    AudioMixer mixer{Stereo48k()};
+    JitterBuffer::Clock::time_point start{std::chrono::seconds{1000}};
+    std::vector<float> out(2 * 480);
+    std::vector<std::int32_t> percents;
+    auto note = [&](AudioMixer::DecodeCounts counts) {
+        if (auto percent = window.OnDecoded(counts.received, counts.lost))
+            percents.push_back(*percent);
+    };
+    for (std::uint64_t seq = 0; seq < packets; seq++) {
+        auto now = start + seq * 10ms;
+        if (lose_every == 0 || seq % lose_every != lose_every - 1) {
+            auto* speaker = mixer.SpeakerFor(7, now);
+            speaker->Jitter().Put(seq, 1, false, Packet(), now);
+            note(speaker->DecodeDue(now));
+        }
+        note(mixer.DecodeDue(now + 5ms));
+        while (auto n = mixer.SamplesReady(480)) mixer.MixTo(out.data(), n);
+    }
+    return percents;
+}
+
+// Gaps the jitter buffer gives up waiting on show up as loss, a window at a
+// time, and a clean stream brings it back to nothing
+TEST(ReceiveLossWindowTest, FollowsGapsInTheJitterBuffer) {
+    ReceiveLossWindow window;
+    auto lossy = Receive(2000, 10, window);
+    ASSERT_GE(lossy.size(), 3u);
+    for (auto percent : lossy) EXPECT_NEAR(percent, 10, 1);
+
+    auto clean = Receive(1000, 0, window);
+    ASSERT_GE(clean.size(), 1u);
+    EXPECT_EQ(clean.back(), 0);
+}
+
+#ifdef BLURT_HAVE_PROTOBUF
+// Through to the encoder, as AudioSystem wires it: gaps on the way in turn
+// on forward error correction on the way out, sized to the loss, and it goes
+// back off when the gaps stop
+TEST(ReceiveLossWindowTest, TurnsForwardErrorCorrectionOnAndOff) {
+    namespace impl = winrt::blurt::audio::implementation;
+    impl::OpusEncoder encoder{AudioSetup{SampleRate::Of48KHz(), Channels::Mono()},
+                              impl::VoiceProfile::Default()};
+    EXPECT_EQ(encoder.CurrentSettings().loss_percent, 0);
+
+    ReceiveLossWindow window;
+    for (auto percent : Receive(1000, 20, window)) encoder.ExpectedLossPercent(percent);
+    EXPECT_NEAR(encoder.CurrentSettings().loss_percent, 5, 1);
+
+    for (auto percent : Receive(1000, 0, window)) encoder.ExpectedLossPercent(percent);
+    EXPECT_EQ(encoder.CurrentSettings().loss_percent, 0);
+}
+#endif
+
+}  // namespace
@@ -0,0 +1,151 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+#include "AudioMixer.h"
+#include "AudioPacket.h"
+#include "AudioParams.h"
+#include "ByteChunk.h"
+#include "ControlFramer.h"
+#include "ControlPacket.h"
+#include "JitterBuffer.h"
+
+// Every allocation in the process goes through these, and is counted while
+// g_counting is set
+namespace {
+std::atomic<bool> g_counting{false};
+std::atomic<std::uint64_t> g_allocations{0};
+
+void* CountedAlloc(std::size_t size) {
+    if (g_counting.load(std::memory_order_relaxed))
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc{};
+}
+}  // namespace
+
+void* operator new(std::size_t size) { return CountedAlloc(size); }
+void* operator new[](std::size_t size) { return CountedAlloc(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return CountedAlloc(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+using winrt::blurt::ByteChunk;
+using winrt::blurt::ByteSlice;
+using winrt::blurt::audio::AudioSetup;
+using winrt::blurt::audio::Channels;
+using winrt::blurt::audio::SampleRate;
+using winrt::blurt::audio::implementation::AudioMixer;
+using winrt::blurt::audio::implementation::JitterBuffer;
+using winrt::blurt::mumble::implementation::AudioPacket;
+using winrt::blurt::mumble::implementation::AudioPacketType;
+using winrt::blurt::mumble::implementation::ControlFramer;
+using winrt::blurt::mumble::implementation::ControlPacket;
+using winrt::blurt::mumble::implementation::ControlPacketType;
+
+namespace {
+
+using namespace std::chrono_literals;
+
+constexpr std::uint32_t kSpeakers = 3;
+constexpr std::int32_t kFramesPerQuantum = 480;
+
+// A tunneled voice message as the server relays it, whole with its header:
+// 10 ms of CELT-mode Opus padded out to a typical size
+void AppendVoiceMessage(std::uint32_t session, std::uint64_t seq, std::vector<std::uint8_t>* out) {
+    std::vector<std::uint8_t> opus(60, 0);
+    opus[0] = 0x90;
+    opus[1] = 192;
+    AudioPacket packet{AudioPacketType::Opus, 0,     seq,
+                       0,                     false, false,
+                       ByteSlice::Of(ByteChunk{std::move(opus)})};
+    auto encoded = packet.EncodeOutgoing();
+    std::vector<std::uint8_t> msg{encoded.begin(), encoded.end()};
+    // The session goes after the first byte; small ones are one byte long
+    msg.insert(msg.begin() + 1, static_cast<std::uint8_t>(session));
+
+    auto size = static_cast<std::uint32_t>(msg.size());
+    std::uint8_t header[ControlFramer::kHeaderSize] = {
+        0, static_cast<std::uint8_t>(ControlPacketType::UDPTunnel),
+        static_cast<std::uint8_t>(size >> 24), static_cast<std::uint8_t>(size >> 16),
+        static_cast<std::uint8_t>(size >> 8), static_cast<std::uint8_t>(size)};
+    out->insert(out->end(), header, header + sizeof(header));
+    out->insert(out->end(), msg.begin(), msg.end());
+}
+
+// Once it's warmed up, voice tunneled over the control channel goes from
+// socket bytes through framing, parsing, the jitter buffer, decoding and
+// mixing without touching the heap, and the Opus bytes are never copied
+TEST(ReceivePathAllocTest, SteadyTunneledVoiceDoesNotAllocate) {
+    const int kWarmupTicks = 3000, kCountedTicks = 3000;
+    // Everything the "socket" will deliver, made up front
+    std::vector<std::uint8_t> stream;
+    for (int tick = 0; tick < kWarmupTicks + kCountedTicks; tick++) {
+        for (std::uint32_t session = 1; session <= kSpeakers; session++)
+            AppendVoiceMessage(session, tick, &stream);
+    }
+
+    ControlFramer framer;
+    AudioMixer mixer{AudioSetup{SampleRate::Of48KHz(), Channels::Stereo()}};
+    std::vector<float> out(2 * kFramesPerQuantum);
+    const JitterBuffer::Clock::time_point start{std::chrono::seconds{1000}};
+    std::size_t pos{0};
+    std::uint64_t decoded{0}, copied{0};
+
+    for (int tick = 0; tick < kWarmupTicks + kCountedTicks; tick++) {
+        if (tick == kWarmupTicks) g_counting = true;
+        auto now = start + tick * 10ms;
+        // Each tick's worth of messages arrives in reads that don't line up
+        // with message boundaries
+        const std::size_t tick_end = stream.size() * (tick + 1) / (kWarmupTicks + kCountedTicks);
+        while (pos < tick_end) {
+            auto n = std::min<std::size_t>(97, tick_end - pos);
+            std::memcpy(framer.PrepareInput(n), stream.data() + pos, n);
+            framer.CommitInput(n);
+            pos += n;
+
+            ControlFramer::Frame frame;
+            while (framer.NextFrame(frame)) {
+                const auto* begin = frame.payload.begin();
+                const auto* end = frame.payload.end();
+                ControlPacket packet{std::move(frame)};
+                ASSERT_EQ(packet.Type(), ControlPacketType::UDPTunnel);
+                auto audio = packet.ResolveAudioPacket();
+                const auto& payload = audio.Payload();
+                if (payload.begin() < begin || payload.end() > end) copied++;
+                auto* speaker = mixer.SpeakerFor(audio.SenderSession(), now);
+                ASSERT_NE(speaker, nullptr);
+                speaker->Jitter().Put(audio.FrameSequence(), 1, audio.IsTerminator(), payload,
+                                      now);
+            }
+        }
+        decoded += mixer.DecodeDue(now).received;
+        while (auto n = mixer.SamplesReady(kFramesPerQuantum)) mixer.MixTo(out.data(), n);
+    }
+    g_counting = false;
+
+    EXPECT_EQ(g_allocations.load(), 0u);
+    EXPECT_EQ(copied, 0u);
+    // Everything but what's still waiting in the jitter buffers played
+    EXPECT_GT(decoded, (kWarmupTicks + kCountedTicks - 10) * kSpeakers);
+}
+
+}  // namespace
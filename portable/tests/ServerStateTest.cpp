@@ -0,0 +1,183 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include "ControlFramer.h"
+#include "ControlPacket.h"
+#include "ServerState.h"
+#include "StateAnnouncer.h"
+
+using winrt::blurt::mumble::implementation::ControlFramer;
+using winrt::blurt::mumble::implementation::ControlPacket;
+using winrt::blurt::mumble::implementation::ControlPacketType;
+using winrt::blurt::mumble::implementation::ServerState;
+using winrt::blurt::mumble::implementation::StateAnnouncer;
+
+namespace {
+
+void Append(std::vector<std::uint8_t>& wire, ControlPacketType type,
+            const google::protobuf::MessageLite& msg) {
+    auto payload = msg.SerializeAsString();
+    auto t = static_cast<std::uint16_t>(type);
+    auto len = static_cast<std::uint32_t>(payload.size());
+    const std::uint8_t header[ControlFramer::kHeaderSize] = {
+        static_cast<std::uint8_t>(t >> 8),   static_cast<std::uint8_t>(t),
+        static_cast<std::uint8_t>(len >> 24), static_cast<std::uint8_t>(len >> 16),
+        static_cast<std::uint8_t>(len >> 8),  static_cast<std::uint8_t>(len)};
+    wire.insert(wire.end(), header, header + sizeof header);
+    wire.insert(wire.end(), payload.begin(), payload.end());
+}
+
+MumbleProto::UserState User(std::uint32_t session, std::uint32_t channel_id) {
+    MumbleProto::UserState user;
+    user.set_session(session);
+    user.set_name("User " + std::to_string(session));
+    user.set_channel_id(channel_id);
+    user.set_comment_hash(std::string(20, static_cast<char>(session)));
+    return user;
+}
+
+// What a busy server sends on joining: its channels, then everyone on it,
+// then ServerSync, with a ping reply in the middle for good measure
+constexpr std::uint32_t kChannels = 50;
+constexpr std::uint32_t kUsers = 500;
+
+std::vector<std::uint8_t> JoinBurst() {
+    std::vector<std::uint8_t> wire;
+    for (std::uint32_t i = 0; i < kChannels; i++) {
+        MumbleProto::ChannelState channel;
+        channel.set_channel_id(i);
+        if (i > 0) channel.set_parent(i / 8);
+        channel.set_name("Channel " + std::to_string(i));
+        Append(wire, ControlPacketType::ChannelState, channel);
+    }
+    for (std::uint32_t i = 0; i < kUsers; i++) {
+        Append(wire, ControlPacketType::UserState, User(100 + i, i % kChannels));
+        if (i == kUsers / 2) Append(wire, ControlPacketType::Ping, MumbleProto::Ping{});
+    }
+    MumbleProto::ServerSync sync;
+    sync.set_session(100);
+    Append(wire, ControlPacketType::ServerSync, sync);
+    return wire;
+}
+
+// ServerConnection's read loop, as far as state goes: the wire arrives a
+// socket read at a time, state messages are applied as ApplyToState() does,
+// and changes are taken and announced whenever StateAnnouncer says so
+struct ReadLoop {
+    ControlFramer framer;
+    ServerState state;
+    StateAnnouncer announcer;
+    std::vector<ServerState::Changes> announced;
+
+    void Read(const std::uint8_t* data, std::size_t n) {
+        std::memcpy(framer.PrepareInput(n), data, n);
+        framer.CommitInput(n);
+        ControlFramer::Frame frame;
+        while (framer.NextFrame(frame)) {
+            ControlPacket packet{std::move(frame)};
+            bool is_state = Apply(packet);
+            if (announcer.OnMessage(packet.Type(), is_state, framer.HasFrame()) &&
+                state.HasChanges())
+                announced.push_back(state.TakeChanges());
+        }
+    }
+
+    void ReadInChunks(const std::vector<std::uint8_t>& wire, std::size_t chunk) {
+        for (std::size_t at = 0; at < wire.size(); at += chunk)
+            Read(wire.data() + at, std::min(chunk, wire.size() - at));
+    }
+
+    bool Apply(const ControlPacket& packet) {
+        switch (packet.Type()) {
+            case ControlPacketType::UserState:
+                state.Apply(packet.ResolveProto<ControlPacketType::UserState>());
+                return true;
+            case ControlPacketType::UserRemove:
+                state.Apply(packet.ResolveProto<ControlPacketType::UserRemove>());
+                return true;
+            case ControlPacketType::ChannelState:
+                state.Apply(packet.ResolveProto<ControlPacketType::ChannelState>());
+                return true;
+            case ControlPacketType::ChannelRemove:
+                state.Apply(packet.ResolveProto<ControlPacketType::ChannelRemove>());
+                return true;
+            default:
+                return false;
+        }
+    }
+};
+
+// The StateChanged contract in ServerConnection.h: the whole initial sync
+// comes as one Changes, however the reads happen to split it up
+TEST(ServerStateTest, AnnouncesTheInitialSyncAsOneChange) {
+    auto wire = JoinBurst();
+    for (std::size_t chunk : {std::size_t{64 * 1024}, std::size_t{1000}, std::size_t{7}}) {
+        ReadLoop loop;
+        loop.ReadInChunks(wire, chunk);
+        ASSERT_EQ(loop.announced.size(), 1u) << "reads of " << chunk;
+        const auto& changes = loop.announced[0];
+        EXPECT_EQ(changes.users_changed.size(), kUsers) << "reads of " << chunk;
+        EXPECT_EQ(changes.channels_changed.size(), kChannels) << "reads of " << chunk;
+        EXPECT_TRUE(changes.users_removed.empty());
+        EXPECT_TRUE(changes.channels_removed.empty());
+        EXPECT_EQ(loop.state.Users().size(), kUsers);
+        EXPECT_EQ(loop.state.FindChannel(9)->parent, 1u);
+    }
+}
+
+// After that, everything that arrived together comes together, each user
+// once, and messages that aren't state don't announce anything
+TEST(ServerStateTest, AnnouncesWhatArrivesTogetherAfterTheSync) {
+    ReadLoop loop;
+    loop.ReadInChunks(JoinBurst(), 64 * 1024);
+    ASSERT_EQ(loop.announced.size(), 1u);
+
+    std::vector<std::uint8_t> wire;
+    Append(wire, ControlPacketType::UserState, User(100, 3));
+    Append(wire, ControlPacketType::UserState, User(101, 3));
+    Append(wire, ControlPacketType::UserState, User(100, 4));
+    MumbleProto::UserRemove remove;
+    remove.set_session(102);
+    Append(wire, ControlPacketType::UserRemove, remove);
+    loop.Read(wire.data(), wire.size());
+    ASSERT_EQ(loop.announced.size(), 2u);
+    auto users = loop.announced[1].users_changed;
+    std::sort(users.begin(), users.end());
+    EXPECT_EQ(users, (std::vector<std::uint32_t>{100, 101}));
+    EXPECT_EQ(loop.announced[1].users_removed, std::vector<std::uint32_t>{102});
+
+    wire.clear();
+    Append(wire, ControlPacketType::Ping, MumbleProto::Ping{});
+    loop.Read(wire.data(), wire.size());
+    EXPECT_EQ(loop.announced.size(), 2u);
+
+    // A message split across reads is announced once it's all there
+    wire.clear();
+    Append(wire, ControlPacketType::UserState, User(103, 5));
+    loop.Read(wire.data(), 10);
+    EXPECT_EQ(loop.announced.size(), 2u);
+    loop.Read(wire.data() + 10, wire.size() - 10);
+    ASSERT_EQ(loop.announced.size(), 3u);
+    EXPECT_EQ(loop.announced[2].users_changed, std::vector<std::uint32_t>{103});
+}
+
+TEST(ServerStateTest, StaysQuietUntilServerSync) {
+    StateAnnouncer announcer;
+    EXPECT_FALSE(announcer.OnMessage(ControlPacketType::UserState, true, false));
+    EXPECT_FALSE(announcer.OnMessage(ControlPacketType::Ping, false, false));
+    EXPECT_FALSE(announcer.Synced());
+    EXPECT_FALSE(announcer.OnMessage(ControlPacketType::ServerSync, false, true));
+    EXPECT_TRUE(announcer.Synced());
+    EXPECT_TRUE(announcer.OnMessage(ControlPacketType::ChannelState, true, false));
+    EXPECT_FALSE(announcer.OnMessage(ControlPacketType::ChannelState, true, true));
+    EXPECT_FALSE(announcer.OnMessage(ControlPacketType::TextMessage, false, false));
+}
+
+}  // namespace
@@ -0,0 +1,91 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "VarInt.h"
+
+using namespace winrt::blurt::mumble::implementation;
+
+namespace {
+
+std::vector<std::uint8_t> Encode(std::uint64_t n) {
+    std::uint8_t buf[kMaxVarIntSize];
+    auto len = EncodeVarInt(n, buf);
+    return {buf, buf + len};
+}
+
+std::uint64_t Negative(std::int64_t n) { return static_cast<std::uint64_t>(n); }
+
+// Encodings as Mumble's PacketDataStream writes them, at the edges of every
+// length
+TEST(VarIntTest, EncodesLikeMumble) {
+    struct Case {
+        std::uint64_t value;
+        std::vector<std::uint8_t> bytes;
+    };
+    const Case cases[] = {
+        {0, {0x00}},
+        {0x7f, {0x7f}},
+        {0x80, {0x80, 0x80}},
+        {0x3fff, {0xbf, 0xff}},
+        {0x4000, {0xc0, 0x40, 0x00}},
+        {0x1fffff, {0xdf, 0xff, 0xff}},
+        {0x200000, {0xe0, 0x20, 0x00, 0x00}},
+        {0xfffffff, {0xef, 0xff, 0xff, 0xff}},
+        {0x10000000, {0xf0, 0x10, 0x00, 0x00, 0x00}},
+        {0xffffffff, {0xf0, 0xff, 0xff, 0xff, 0xff}},
+        {0x100000000, {0xf4, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00}},
+        {0x0123456789abcdef, {0xf4, 0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef}},
+        {Negative(-1), {0xfc}},
+        {Negative(-4), {0xff}},
+        {Negative(-5), {0xf8, 0x04}},
+        {Negative(-200), {0xf8, 0x80, 0xc7}},
+    };
+    for (const auto& c : cases) {
+        EXPECT_EQ(Encode(c.value), c.bytes) << "value " << c.value;
+
+        std::uint64_t out{0};
+        EXPECT_EQ(DecodeVarInt(c.bytes.data(), c.bytes.size(), &out), c.bytes.size());
+        EXPECT_EQ(out, c.value);
+    }
+}
+
+// Decoding takes a wide load when there's room past the varint and byte
+// loads when there isn't; both must agree
+TEST(VarIntTest, RoundTripsWithAndWithoutSlack) {
+    std::mt19937_64 rng{7};
+    for (int i = 0; i < 20000; i++) {
+        std::uint64_t value = rng() >> (rng() % 64);
+        if (i % 4 == 0) value = ~value;
+        auto bytes = Encode(value);
+        ASSERT_LE(bytes.size(), kMaxVarIntSize);
+
+        std::uint64_t out{0};
+        ASSERT_EQ(DecodeVarInt(bytes.data(), bytes.size(), &out), bytes.size());
+        ASSERT_EQ(out, value);
+
+        auto padded = bytes;
+        padded.resize(bytes.size() + 8, 0xaa);
+        out = 0;
+        ASSERT_EQ(DecodeVarInt(padded.data(), padded.size(), &out), bytes.size());
+        ASSERT_EQ(out, value);
+    }
+}
+
+TEST(VarIntTest, RejectsTruncatedInput) {
+    for (std::uint64_t value : {std::uint64_t{0x80}, std::uint64_t{0x4000},
+                                std::uint64_t{0x12345678}, std::uint64_t{0x100000000},
+                                Negative(-300)}) {
+        auto bytes = Encode(value);
+        for (std::size_t len = 0; len < bytes.size(); len++) {
+            std::uint64_t out{0};
+            EXPECT_EQ(DecodeVarInt(bytes.data(), len, &out), 0u)
+                << "value " << value << " cut to " << len;
+        }
+    }
+}
+
+}  // namespace
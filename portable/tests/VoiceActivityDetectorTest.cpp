@@ -0,0 +1,158 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "VoiceActivityDetector.h"
+
+using winrt::blurt::audio::implementation::VoiceActivityDetector;
+using Decision = VoiceActivityDetector::Decision;
+
+namespace {
+
+using namespace std::chrono_literals;
+
+constexpr double kPi = 3.14159265358979323846;
+// 20 ms frames of 48 kHz mono, as the encoder's default profile uses
+constexpr std::int32_t kFrame = 960;
+constexpr std::int32_t kFramesPerSecond = 50;
+constexpr std::int32_t kHangoverFrames = 15;
+
+double Amplitude(double db) { return std::pow(10.0, db / 20); }
+
+// Fixtures, made up rather than recorded so they're the same everywhere.
+// Each is a run of samples at 48 kHz; levels are RMS, in dBFS.
+
+// A room with nobody talking: steady white noise
+std::vector<float> RoomNoise(double seconds, double level_db, std::uint32_t seed = 1) {
+    std::mt19937 rng{seed};
+    // Uniform noise's RMS is its peak over the square root of 3
+    std::uniform_real_distribution<float> dist(
+        static_cast<float>(-Amplitude(level_db) * std::sqrt(3.0)),
+        static_cast<float>(Amplitude(level_db) * std::sqrt(3.0)));
+    std::vector<float> pcm(static_cast<std::size_t>(seconds * 48000));
+    for (auto& x : pcm) x = dist(rng);
+    return pcm;
+}
+
+// Somebody talking over that noise: a voiced buzz, 140 Hz and its first few
+// harmonics, in syllables four times a second, with a 150 ms pause between
+// words every 1.1 s
+std::vector<float> Speech(double seconds, double level_db, double noise_db) {
+    auto pcm = RoomNoise(seconds, noise_db, 2);
+    // The buzz's RMS, so level_db comes out as the speech's level at its peak
+    const double buzz_rms = std::sqrt((1 + 1 / 4.0 + 1 / 9.0 + 1 / 16.0) / 2);
+    const double amplitude = Amplitude(level_db) / buzz_rms;
+    for (std::size_t i = 0; i < pcm.size(); i++) {
+        double t = i / 48000.0;
+        if (std::fmod(t, 1.1) >= 0.95) continue;
+        double syllable = 0.6 + 0.4 * std::sin(2 * kPi * 4 * t);
+        double buzz = 0;
+        for (int h = 1; h <= 4; h++) buzz += std::sin(2 * kPi * 140 * h * t) / h;
+        pcm[i] += static_cast<float>(amplitude * syllable * buzz);
+    }
+    return pcm;
+}
+
+std::vector<float> Concat(std::vector<float> a, const std::vector<float>& b) {
+    a.insert(a.end(), b.begin(), b.end());
+    return a;
+}
+
+std::vector<Decision> Classify(VoiceActivityDetector& vad, const std::vector<float>& pcm) {
+    std::vector<Decision> decisions;
+    for (std::size_t i = 0; i + kFrame <= pcm.size(); i += kFrame)
+        decisions.push_back(vad.Process(&pcm[i], kFrame));
+    return decisions;
+}
+
+std::int32_t Count(const std::vector<Decision>& decisions, Decision which, std::size_t from = 0,
+                   std::size_t to = SIZE_MAX) {
+    std::int32_t n{0};
+    for (std::size_t i = from; i < decisions.size() && i < to; i++) n += decisions[i] == which;
+    return n;
+}
+
+// Talking after a quiet stretch is one talk spurt, starting on the first
+// frame of speech, held open across the gaps between words and closed a
+// hangover after the last
+TEST(VoiceActivityDetectorTest, KeepsSpeechInOneSpurt) {
+    VoiceActivityDetector vad{20ms};
+    auto pcm = Concat(Concat(RoomNoise(2, -70), Speech(5, -25, -70)), RoomNoise(2, -70));
+    auto decisions = Classify(vad, pcm);
+
+    const std::size_t speech_start = 2 * kFramesPerSecond;
+    EXPECT_EQ(Count(decisions, Decision::Silent, 0, speech_start), speech_start);
+    EXPECT_EQ(decisions[speech_start], Decision::Start);
+    EXPECT_EQ(Count(decisions, Decision::Start), 1);
+    const std::size_t speech_end = speech_start + 5 * kFramesPerSecond;
+    for (std::size_t i = speech_start + 1; i < speech_end + kHangoverFrames - 1; i++)
+        ASSERT_EQ(decisions[i], Decision::Continue) << "frame " << i;
+    EXPECT_EQ(decisions[speech_end + kHangoverFrames - 1], Decision::End);
+    EXPECT_EQ(Count(decisions, Decision::End), 1);
+}
+
+// However loud it is, steady noise is learned as the floor rather than sent
+// for ever, within the seconds it takes the floor to rise to it
+TEST(VoiceActivityDetectorTest, LearnsSteadyNoise) {
+    for (double noise_db : {-80.0, -60.0, -50.0, -45.0}) {
+        VoiceActivityDetector vad{20ms};
+        auto decisions = Classify(vad, RoomNoise(20, noise_db));
+        EXPECT_EQ(Count(decisions, Decision::Silent, 10 * kFramesPerSecond),
+                  10 * kFramesPerSecond)
+            << noise_db << " dBFS";
+        EXPECT_LE(Count(decisions, Decision::Start), 1) << noise_db << " dBFS";
+    }
+}
+
+// Talking in a noisy room still clears the learned floor
+TEST(VoiceActivityDetectorTest, HearsSpeechOverNoise) {
+    VoiceActivityDetector vad{20ms};
+    auto decisions = Classify(vad, Concat(RoomNoise(10, -50), Speech(3, -25, -50)));
+    const std::size_t speech_start = 10 * kFramesPerSecond;
+    EXPECT_EQ(Count(decisions, Decision::Start, speech_start - kFramesPerSecond, speech_start), 0);
+    EXPECT_EQ(decisions[speech_start], Decision::Start);
+    EXPECT_EQ(Count(decisions, Decision::End, speech_start), 0);
+}
+
+// A pause shorter than the hangover doesn't end the spurt; one that lasts
+// the hangover does, on exactly its last frame
+TEST(VoiceActivityDetectorTest, EndsAfterTheHangover) {
+    VoiceActivityDetector vad{20ms};
+    std::vector<float> loud(kFrame, 0.1f), quiet(kFrame, 0.0f);
+    EXPECT_EQ(vad.Process(loud.data(), kFrame), Decision::Start);
+    for (int i = 0; i < kHangoverFrames - 1; i++)
+        EXPECT_EQ(vad.Process(quiet.data(), kFrame), Decision::Continue);
+    EXPECT_EQ(vad.Process(loud.data(), kFrame), Decision::Continue);
+    for (int i = 0; i < kHangoverFrames - 1; i++)
+        EXPECT_EQ(vad.Process(quiet.data(), kFrame), Decision::Continue);
+    EXPECT_EQ(vad.Process(quiet.data(), kFrame), Decision::End);
+    EXPECT_EQ(vad.Process(quiet.data(), kFrame), Decision::Silent);
+    EXPECT_FALSE(vad.IsActive());
+}
+
+// The hangover is a duration, whatever the frame size
+TEST(VoiceActivityDetectorTest, ScalesTheHangoverToTheFrame) {
+    VoiceActivityDetector vad{10ms};
+    std::vector<float> loud(kFrame / 2, 0.1f), quiet(kFrame / 2, 0.0f);
+    vad.Process(loud.data(), kFrame / 2);
+    std::int32_t frames{1};
+    while (vad.Process(quiet.data(), kFrame / 2) != Decision::End) frames++;
+    EXPECT_EQ(frames, 2 * kHangoverFrames);
+}
+
+// Reset drops a spurt in progress, so the next loud frame starts a new one
+TEST(VoiceActivityDetectorTest, ResetEndsTheSpurt) {
+    VoiceActivityDetector vad{20ms};
+    std::vector<float> loud(kFrame, 0.1f);
+    EXPECT_EQ(vad.Process(loud.data(), kFrame), Decision::Start);
+    vad.Reset();
+    EXPECT_FALSE(vad.IsActive());
+    EXPECT_EQ(vad.Process(loud.data(), kFrame), Decision::Start);
+}
+
+}  // namespace
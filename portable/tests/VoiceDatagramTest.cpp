@@ -0,0 +1,191 @@
+#include "pch.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "AudioPacket.h"
+#include "ByteChunk.h"
+#include "CryptState.h"
+#include "JitterBuffer.h"
+#include "OutgoingVoiceFrame.h"
+#include "VarInt.h"
+
+using winrt::blurt::ByteChunk;
+using winrt::blurt::ByteSlice;
+using winrt::blurt::audio::implementation::JitterBuffer;
+using winrt::blurt::mumble::implementation::AudioPacket;
+using winrt::blurt::mumble::implementation::CryptState;
+using winrt::blurt::mumble::implementation::EncodeVarInt;
+using winrt::blurt::mumble::implementation::kMaxVarIntSize;
+using winrt::blurt::mumble::implementation::OutgoingVoiceFrame;
+
+namespace {
+
+using namespace std::chrono_literals;
+
+const std::string kKey{"\x10\x32\x54\x76\x98\xba\xdc\xfe\x01\x23\x45\x67\x89\xab\xcd\xef", 16};
+const std::string kUpNonce(16, '\x11');
+const std::string kDownNonce(16, '\x77');
+constexpr std::uint32_t kSession = 7;
+// 20 ms packets, two Mumble frames each
+constexpr std::uint64_t kFramesPerPacket = 2;
+
+std::vector<std::uint8_t> Payload(std::uint64_t seq) {
+    std::vector<std::uint8_t> payload(60);
+    for (std::size_t i = 0; i < payload.size(); i++)
+        payload[i] = static_cast<std::uint8_t>(seq * 31 + i);
+    return payload;
+}
+
+// A voice packet from one client, through the server, to another, taking
+// each step the way the app and a Mumble server do: the sender encrypts the
+// frame the encoder wrote (ServerConnection::SendAudioAsync), the server
+// decrypts it, puts the sender's session in, and encrypts it again for the
+// listener, who decrypts it in place and parses it without a copy
+// (ServerConnection::OnDatagram)
+struct Loopback {
+    CryptState sender, server_in, server_out, listener;
+    Loopback() {
+        sender.SetKey(kKey, kUpNonce, kDownNonce);
+        server_in.SetKey(kKey, kDownNonce, kUpNonce);
+        server_out.SetKey(kKey, kDownNonce, kUpNonce);
+        listener.SetKey(kKey, kUpNonce, kDownNonce);
+    }
+
+    // Encode and send a packet, returning the datagram that reaches the
+    // listener
+    ByteChunk Send(std::uint64_t seq, bool is_terminator = false) {
+        auto payload = Payload(seq);
+        OutgoingVoiceFrame frame{static_cast<std::int32_t>(payload.size())};
+        std::memcpy(frame.PayloadDest(), payload.data(), payload.size());
+        frame.PayloadSize(static_cast<std::int32_t>(payload.size()));
+        frame.FrameSequence(seq);
+        frame.IsTerminator(is_terminator);
+        frame.Finish(0);
+
+        auto len = static_cast<std::size_t>(frame.DatagramSize());
+        auto up = ByteChunk::Allocate(CryptState::kHeaderSize + len);
+        sender.Encrypt(frame.DatagramData(), up.data(), len);
+        return Relay(up);
+    }
+
+    ByteChunk Relay(ByteChunk& up) {
+        auto len = static_cast<std::size_t>(up.size()) - CryptState::kHeaderSize;
+        std::vector<std::uint8_t> plain(len);
+        EXPECT_TRUE(server_in.Decrypt(up.data(), plain.data(), up.size()));
+
+        std::vector<std::uint8_t> relayed(1 + kMaxVarIntSize + len);
+        relayed[0] = plain[0];
+        std::size_t at = 1 + EncodeVarInt(kSession, relayed.data() + 1);
+        std::memcpy(relayed.data() + at, plain.data() + 1, len - 1);
+        relayed.resize(at + len - 1);
+
+        auto down = ByteChunk::Allocate(CryptState::kHeaderSize + relayed.size());
+        server_out.Encrypt(relayed.data(), down.data(), relayed.size());
+        return down;
+    }
+
+    // Decrypt and parse a datagram; nothing comes out if it doesn't decrypt,
+    // which is when the app would ask the server to resync
+    std::optional<AudioPacket> Receive(ByteChunk&& datagram) {
+        auto len = static_cast<std::size_t>(datagram.size());
+        auto* p = datagram.data();
+        if (!listener.Decrypt(p, p + CryptState::kHeaderSize, len)) return std::nullopt;
+        auto plain = ByteSlice::Of(std::move(datagram))
+                         .Sub(CryptState::kHeaderSize, len - CryptState::kHeaderSize);
+        return AudioPacket::FromIncomingFrame(plain);
+    }
+};
+
+void ExpectPacket(const AudioPacket& packet, std::uint64_t seq, bool is_terminator = false) {
+    EXPECT_EQ(packet.FrameSequence(), seq);
+    EXPECT_EQ(packet.SenderSession(), kSession);
+    EXPECT_EQ(packet.IsTerminator(), is_terminator);
+    const auto& payload = packet.Payload();
+    EXPECT_EQ(std::vector<std::uint8_t>(payload.data(), payload.data() + payload.size()),
+              Payload(seq))
+        << "seq " << seq;
+}
+
+TEST(VoiceDatagramTest, CarriesATalkSpurtThroughTheServer) {
+    Loopback loop;
+    constexpr std::uint64_t kPackets = 300;
+    for (std::uint64_t i = 0; i < kPackets; i++) {
+        auto seq = i * kFramesPerPacket;
+        bool is_terminator = i == kPackets - 1;
+        auto packet = loop.Receive(loop.Send(seq, is_terminator));
+        ASSERT_TRUE(packet) << "seq " << seq;
+        ExpectPacket(*packet, seq, is_terminator);
+    }
+    EXPECT_EQ(loop.listener.Stats().good, kPackets);
+    EXPECT_EQ(loop.listener.Stats().lost, 0u);
+}
+
+// Datagrams the network swaps around still decrypt, count as late rather
+// than lost once they turn up, and the jitter buffer puts the audio back
+// in order
+TEST(VoiceDatagramTest, PutsReorderedDatagramsBackInOrder) {
+    Loopback loop;
+    constexpr std::uint64_t kPackets = 40;
+    std::vector<std::pair<std::uint64_t, ByteChunk>> sent;
+    for (std::uint64_t i = 0; i < kPackets; i++) {
+        auto seq = i * kFramesPerPacket;
+        sent.emplace_back(seq, loop.Send(seq));
+    }
+    // Every fourth pair arrives the wrong way round
+    for (std::size_t i = 4; i + 1 < sent.size(); i += 4) std::swap(sent[i], sent[i + 1]);
+
+    const JitterBuffer::Clock::time_point start{std::chrono::seconds{1000}};
+    JitterBuffer jitter;
+    std::vector<std::uint64_t> played;
+    for (std::size_t i = 0; i < sent.size(); i++) {
+        // One every 20 ms, in whatever order the network delivers them
+        auto arrival = start + 20ms * i + 5ms;
+        auto packet = loop.Receive(std::move(sent[i].second));
+        ASSERT_TRUE(packet) << "arrival " << i;
+        ExpectPacket(*packet, sent[i].first);
+        jitter.Put(packet->FrameSequence(), kFramesPerPacket, false, packet->Payload(), arrival);
+        while (auto frame = jitter.Pop(arrival)) {
+            EXPECT_FALSE(frame->IsGap()) << "seq " << frame->Sequence();
+            played.push_back(frame->Sequence());
+        }
+    }
+    while (auto frame = jitter.Pop(start + 1s)) played.push_back(frame->Sequence());
+
+    ASSERT_EQ(played.size(), kPackets);
+    for (std::uint64_t i = 0; i < kPackets; i++) EXPECT_EQ(played[i], i * kFramesPerPacket);
+    EXPECT_EQ(loop.listener.Stats().late, 9u);
+    EXPECT_EQ(loop.listener.Stats().lost, 0u);
+    EXPECT_EQ(loop.listener.Stats().good, kPackets);
+}
+
+// After losing more than the listener's nonce can follow, datagrams stop
+// decrypting until it resyncs to the nonce the server says it's at, and
+// then the voice carries on where it is now
+TEST(VoiceDatagramTest, ResyncsAfterALongOutage) {
+    Loopback loop;
+    std::uint64_t seq{0};
+    for (; seq < 10 * kFramesPerPacket; seq += kFramesPerPacket)
+        ASSERT_TRUE(loop.Receive(loop.Send(seq)));
+    for (int i = 0; i < 300; i++, seq += kFramesPerPacket) loop.Send(seq);
+
+    EXPECT_FALSE(loop.Receive(loop.Send(seq)));
+    seq += kFramesPerPacket;
+    // The server answers a CryptSetup with no nonce with its own
+    ASSERT_TRUE(loop.listener.SetDecryptNonce(loop.server_out.EncryptNonce()));
+    for (int i = 0; i < 10; i++, seq += kFramesPerPacket) {
+        auto packet = loop.Receive(loop.Send(seq));
+        ASSERT_TRUE(packet) << "seq " << seq;
+        ExpectPacket(*packet, seq);
+    }
+    EXPECT_EQ(loop.listener.Stats().resync, 1u);
+    EXPECT_EQ(loop.listener.Stats().good, 20u);
+}
+
+}  // namespace